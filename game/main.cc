@@ -1,5 +1,7 @@
 #include "libs.hh"
 #include "game.hh"
+#include "benchmarks.hh"
+#include "util/texture_bake.hh"
 
 
 
@@ -17,8 +19,43 @@
 /// Collision boxes
 /// Raycast bounce gun thing
 /// 
-int main()
+
+/// Offline texture baking: game -bake <image> [output] [rgba8|bc1|bc3|bc5]
+/// Without an output path, the baked file is written next to the image, where TextureLoader will pick it up.
+static int BakeTextureCommand(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		DEBUG_LOG("TextureBake", LOG_ERROR, "Usage: %s -bake <image> [output] [rgba8|bc1|bc3|bc5]", argv[0]);
+		return 1;
+	}
+
+	const std::string input = argv[2];
+	std::string output = GetBakedTexturePath(input);
+	BakedTextureFormat format = BAKED_TEXTURE_BC3;
+
+	for (int i = 3; i < argc; i++)
+	{
+		if (!ParseBakedTextureFormat(argv[i], format))
+		{
+			output = argv[i];
+		}
+	}
+
+	return BakeTextureFile(input, output, format) ? 0 : 1;
+}
+
+int main(int argc, char** argv)
 {
+	if (argc > 1 && std::string(argv[1]) == "-bake")
+	{
+		return BakeTextureCommand(argc, argv);
+	}
+
+#ifdef _________CIRNOPRISM_RUN_BENCHMARKS
+	return RunBenchmarks();
+#endif
+
 	/// TODO: This should be stored in an .ini file
 	const int glVersionMajor = 4;
 	const int glVersionMinor = 5;
@@ -1,5 +1,15 @@
 #version 440
 
+// Variants: SHADOWED, DEPTH_ONLY (see ShaderVariants). The rest only change the vertex shader
+
+#ifdef DEPTH_ONLY
+
+void main()
+{
+}
+
+#else
+
 struct Material
 {
 	vec3 ambient;
@@ -23,8 +33,7 @@ in vec3 vs_position;
 in vec3 vs_color;
 in vec2 vs_texcoord;
 in vec3 vs_normal;
-
-in vec4 fragPosLight;
+in float vs_viewDepth;
 
 out vec4 fs_color;
 
@@ -32,7 +41,33 @@ uniform Material material;
 uniform PointLight pointLight;
 uniform vec3 camPosition;
 
-uniform sampler2D shadowMap;
+#ifdef SHADOWED
+const int MAX_SHADOW_CASCADES = 4;
+
+uniform sampler2DArrayShadow shadowMap; // One layer per cascade
+uniform mat4 cascadeMatrices[MAX_SHADOW_CASCADES];
+uniform vec4 cascadeSplits; // View-space distance where each cascade ends
+uniform vec4 cascadeTexelSizes; // World-space size of one shadow map texel, per cascade
+uniform int numCascades;
+uniform vec3 shadowLightDirection;
+#endif
+
+// Clustered lighting, see ClusteredLighting
+struct ClusterLight
+{
+	vec4 positionRadius;
+	vec4 colorIntensity;
+	vec4 attenuation; // constant, linear, quadratic
+};
+
+layout (std430, binding = 2) readonly buffer ClusterLights { ClusterLight clusterLights[]; };
+layout (std430, binding = 3) readonly buffer ClusterRanges { uvec2 clusterRanges[]; }; // Offset into clusterLightIndices, count
+layout (std430, binding = 4) readonly buffer ClusterLightIndices { uint clusterLightIndices[]; };
+
+uniform bool useClusteredLighting;
+uniform vec3 clusterGrid; // Number of clusters along x, y and z
+uniform vec2 clusterScreenScale; // Clusters per pixel
+uniform vec2 clusterDepthScaleBias; // slice = log(view depth) * x + y
 
 // Functions
 vec3 CalculateAmbient(Material material)
@@ -58,40 +93,87 @@ vec3 CalculateSpecular(Material material, vec3 vs_position, vec3 vs_normal, vec3
 	return (material.specular * specularConstant * texture(material.specularTex, vs_texcoord).rgb);
 }
 
-float CalculateShadow(vec4 fragPosLight)
+// Sums the diffuse contribution of every light binned into this fragment's cluster
+vec3 CalculateClusteredDiffuse(Material material, vec3 vs_position, vec3 vs_normal)
 {
-	vec3 projectionCoords = fragPosLight.xyz / fragPosLight.w;
+	int slice = int(floor(log(max(vs_viewDepth, 1e-4)) * clusterDepthScaleBias.x + clusterDepthScaleBias.y));
+	if (slice >= int(clusterGrid.z))
+	{
+		return vec3(0.0);
+	}
 
-	// Map to [0,1]
-	projectionCoords = projectionCoords * 0.5 + 0.5;
+	uvec3 grid = uvec3(clusterGrid);
+	uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScreenScale), grid.xy - 1u);
+	uint cluster = (uint(max(slice, 0)) * grid.y + tile.y) * grid.x + tile.x;
+	uvec2 range = clusterRanges[cluster];
+
+	vec3 normal = normalize(vs_normal);
+	vec3 result = vec3(0.0);
+	for (uint i = 0u; i < range.y; i++)
+	{
+		ClusterLight light = clusterLights[clusterLightIndices[range.x + i]];
+
+		vec3 posToLight = light.positionRadius.xyz - vs_position;
+		float distance = length(posToLight);
+		if (distance >= light.positionRadius.w)
+		{
+			continue;
+		}
 
-	// Get the closest depth value from the light's perspective in [0,1] fragPosLight
-	float closestDepth = texture(shadowMap, projectionCoords.xy).r;
-	// and get depth of current fragment from the light's perspective
-	float currentDepth = projectionCoords.z;
+		float diffuse = clamp(dot(posToLight / distance, normal), 0, 1);
+		float attenuation = light.attenuation.x / (1.0 + light.attenuation.y * distance + light.attenuation.z * (distance * distance));
 
-	// Bias calculation to reduce shadow acne
-	float bias = max(0.05 * (1.0 - dot(normalize(vs_normal), normalize(pointLight.position - vs_position))), 0.005);
+		// Fade to zero at the radius the light was binned with, so it doesn't pop at cluster boundaries
+		float falloff = clamp(1.0 - pow(distance / light.positionRadius.w, 4.0), 0.0, 1.0);
 
-	// PCF
-	float shadow = 0.0;
-	vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+		result += light.colorIntensity.rgb * (light.colorIntensity.w * diffuse * attenuation * falloff * falloff);
+	}
+
+	return material.diffuse * result;
+}
+
+#ifdef SHADOWED
+// Selects the cascade covering this fragment and returns how much of it is in shadow, from 0 to 1
+float CalculateShadow(vec3 position, vec3 normal)
+{
+	if (numCascades == 0 || vs_viewDepth > cascadeSplits[numCascades - 1])
+	{
+		return 0.0;
+	}
+
+	int cascade = 0;
+	while (cascade < numCascades - 1 && vs_viewDepth > cascadeSplits[cascade])
+	{
+		cascade++;
+	}
+
+	// Normal offset instead of a constant depth bias, to reduce shadow acne.
+	// Scaled by the cascade's texel size so every cascade gets the same bias in texels, more on surfaces facing away from the light
+	vec3 n = normalize(normal);
+	float slope = 1.0 - clamp(dot(n, -shadowLightDirection), 0.0, 1.0);
+	vec3 offsetPosition = position + n * cascadeTexelSizes[cascade] * (1.0 + 2.0 * slope);
+
+	vec4 lightSpacePosition = cascadeMatrices[cascade] * vec4(offsetPosition, 1.0);
+	vec3 projectionCoords = lightSpacePosition.xyz / lightSpacePosition.w;
+
+	// Map to [0,1]
+	projectionCoords = projectionCoords * 0.5 + 0.5;
+	float currentDepth = min(projectionCoords.z, 1.0);
+
+	// PCF, where every tap is already a bilinear 2x2 comparison
+	float lit = 0.0;
+	vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
 	for (int x = -1; x <= 1; ++x)
 	{
 		for (int y = -1; y <= 1; ++y)
 		{
-			float pcfDepth = texture(shadowMap, projectionCoords.xy + vec2(x, y) * texelSize).r; 
-            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0; 
+			lit += texture(shadowMap, vec4(projectionCoords.xy + vec2(x, y) * texelSize, float(cascade), currentDepth));
 		}
 	}
-	shadow /= 9.0;
-	if (projectionCoords.z > 1.0)
-	{
-		shadow = 0.0;
-	}
 
-	return shadow;
+	return 1.0 - lit / 9.0;
 }
+#endif
 
 // Scatters light (uniformly) similar to car headlights on a foggy day but without raymarching,
 // instead by summing total light that hits the camera using inverse square distance as magnitude in an antiderivative
@@ -156,7 +238,9 @@ float FastScatter(in vec3 lightPos, in const float clampRadius)
 void main()
 {
 	vec3 ambientFinal = CalculateAmbient(material);
-	vec3 diffuseFinal = CalculateDiffuse(material, vs_position, vs_normal, pointLight.position);
+	vec3 diffuseFinal = useClusteredLighting
+		? CalculateClusteredDiffuse(material, vs_position, vs_normal)
+		: CalculateDiffuse(material, vs_position, vs_normal, pointLight.position);
 //	vec3 specularFinal = CalculateSpecular(material, vs_position, vs_normal, pointLight.position, camPosition);
 
 	// Attenuation
@@ -167,8 +251,11 @@ void main()
 //	diffuseFinal *= attenuation;
 //	specularFinal *= attenuation;
 
-//	float shadow = CalculateShadow(fragPosLight);
+#ifdef SHADOWED
+	float shadow = CalculateShadow(vs_position, vs_normal);
+#else
 	float shadow = 0.0;
+#endif
 	
 	vec4 difTexColor = texture(material.diffuseTex, vs_texcoord);
 	if (difTexColor.a < 0.1)
@@ -185,3 +272,4 @@ void main()
 	
 }
 
+#endif
@@ -1,48 +1,114 @@
 #version 440
 
+// Variants: SKINNED, SHADOWED, INSTANCED, DEPTH_ONLY, DUAL_QUATERNION (see ShaderVariants)
+
 layout (location = 0) in vec3 vertex_position;
 layout (location = 1) in vec3 vertex_color;
 layout (location = 2) in vec2 vertex_texcoord;
 layout (location = 3) in vec3 vertex_normal;
+#ifdef SKINNED
 layout (location = 4) in ivec4 vertex_bone_ids;
 layout (location = 5) in vec4 vertex_bone_weights;
+#endif
+#ifdef INSTANCED
+layout (location = 6) in mat4 instance_model_matrix; // Locations 6-9, fed by the geometry arena
+#endif
+
+#ifdef SKINNED
+// Every animated character's skinning transforms back to back, uploaded once per frame (SKINNING_PALETTE_BINDING)
+layout (std430, binding = 5) readonly buffer BonePalette
+{
+#ifdef DUAL_QUATERNION
+	mat2x4 bonePalette[]; // Real part, then dual part, both xyzw
+#else
+	mat4 bonePalette[];
+#endif
+};
+
+uniform int paletteOffset; // Where this mesh's character starts in bonePalette
+
+#ifdef DUAL_QUATERNION
+// Blends in dual quaternion space, so twisting joints keep their volume, then hands the rest of the shader a matrix
+mat4 BlendDualQuaternions(ivec4 bones, vec4 weights)
+{
+	mat2x4 first = bonePalette[bones.x];
+	mat2x4 blended = first * weights.x;
+
+	// q and -q are the same rotation; blend every bone in the first one's half
+	for (int i = 1; i < 4; i++)
+	{
+		mat2x4 dq = bonePalette[bones[i]];
+		blended += dq * (dot(first[0], dq[0]) < 0.0 ? -weights[i] : weights[i]);
+	}
+
+	float magnitude = length(blended[0]);
+	vec4 r = blended[0] / magnitude;
+	vec4 d = blended[1] / magnitude;
+
+	vec3 t = 2.0 * (r.w * d.xyz - d.w * r.xyz + cross(r.xyz, d.xyz));
+
+	return mat4(
+		1.0 - 2.0 * (r.y * r.y + r.z * r.z), 2.0 * (r.x * r.y + r.w * r.z), 2.0 * (r.x * r.z - r.w * r.y), 0.0,
+		2.0 * (r.x * r.y - r.w * r.z), 1.0 - 2.0 * (r.x * r.x + r.z * r.z), 2.0 * (r.y * r.z + r.w * r.x), 0.0,
+		2.0 * (r.x * r.z + r.w * r.y), 2.0 * (r.y * r.z - r.w * r.x), 1.0 - 2.0 * (r.x * r.x + r.y * r.y), 0.0,
+		t, 1.0);
+}
+#endif
+#endif
 
-const int MAX_BONES = 100;
-const int MAX_WEIGHTS = 4;
+#ifndef INSTANCED
+uniform mat4 modelMatrix;
+#endif
 
+#ifdef DEPTH_ONLY
+uniform mat4 lightProjection; // Projection * view of the cascade being rendered
+#else
 out vec3 vs_position;
 out vec3 vs_color;
 out vec2 vs_texcoord;
 out vec3 vs_normal;
 
-out vec4 fragPosLight;
+out float vs_viewDepth; // Picks the shadow cascade and the light cluster
 
-uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
-
-uniform mat4 lightProjection;
-
-uniform mat4 boneTransforms[MAX_BONES];
+#endif
 
 void main()
 {
 	// All threads must reach heaven through violence
 
-	vs_position = vec4(modelMatrix * vec4(vertex_position, 1.0)).xyz;
-	vs_color = vertex_color;
-	vs_texcoord = vec2(vertex_texcoord.x, vertex_texcoord.y * -1.0);
-	vs_normal = mat3(modelMatrix) * vertex_normal;
+#ifdef INSTANCED
+	mat4 model = instance_model_matrix;
+#else
+	mat4 model = modelMatrix;
+#endif
+
+#ifdef SKINNED
+	ivec4 bones = vertex_bone_ids + paletteOffset;
+#ifdef DUAL_QUATERNION
+	mat4 finalBoneTransform = BlendDualQuaternions(bones, vertex_bone_weights);
+#else
+	mat4 finalBoneTransform = bonePalette[bones.x] * vertex_bone_weights.x;
+	finalBoneTransform += bonePalette[bones.y] * vertex_bone_weights.y;
+	finalBoneTransform += bonePalette[bones.z] * vertex_bone_weights.z;
+	finalBoneTransform += bonePalette[bones.w] * vertex_bone_weights.w;
+#endif
+	model = model * finalBoneTransform;
+#endif
 
-	fragPosLight = lightProjection * vec4(vertex_position, 1.0);
+	vec4 worldPosition = model * vec4(vertex_position, 1.0);
 
+#ifdef DEPTH_ONLY
+	gl_Position = lightProjection * worldPosition;
+#else
+	vs_position = worldPosition.xyz;
+	vs_color = vertex_color;
+	vs_texcoord = vec2(vertex_texcoord.x, vertex_texcoord.y * -1.0);
+	vs_normal = mat3(model) * vertex_normal;
 
-		mat4 finalBoneTransform = boneTransforms[vertex_bone_ids.x] * vertex_bone_weights.x;
-		finalBoneTransform += boneTransforms[vertex_bone_ids.y] * vertex_bone_weights.y;
-		finalBoneTransform += boneTransforms[vertex_bone_ids.z] * vertex_bone_weights.z;
-		finalBoneTransform += boneTransforms[vertex_bone_ids.w] * vertex_bone_weights.w;
-		vec4 posl = finalBoneTransform * vec4(vertex_position, 1.0);
+	vs_viewDepth = -(viewMatrix * worldPosition).z;
 
-	//	gl_Position = projectionMatrix * viewMatrix * modelMatrix * posl;
-		gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(vertex_position, 1.0);
+	gl_Position = projectionMatrix * viewMatrix * worldPosition;
+#endif
 }
@@ -8,5 +8,5 @@ uniform sampler2D screenTexture;
 
 void main()
 {
-	FragColor = vec4(vec3(1.0 - texture(screenTexture, texCoords).r, 1.0 - texture(screenTexture, texCoords).g, 1.0 - texture(screenTexture, texCoords).b), 1);
+	FragColor = vec4(texture(screenTexture, texCoords).rgb, 1.0);
 }
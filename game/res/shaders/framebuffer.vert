@@ -1,12 +1,10 @@
 #version 440
 
-layout (location = 0) in vec2 inPos;
-layout (location = 1) in vec2 inTexCoords;
-
+// Fullscreen triangle from gl_VertexID alone, drawn with an empty VAO: glDrawArrays(GL_TRIANGLES, 0, 3)
 out vec2 texCoords;
 
 void main()
 {
-	gl_Position = vec4(inPos.x, inPos.y, 0.0, 1.0);
-	texCoords = inTexCoords;
+	texCoords = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(texCoords * 2.0 - 1.0, 0.0, 1.0);
 }
@@ -1,6 +0,0 @@
-#version 440
-
-void main()
-{
-//	gl_FragDepth = gl_FragCoord.z;
-}
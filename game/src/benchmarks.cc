@@ -0,0 +1,2122 @@
+#include "benchmarks.hh"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <math.h>
+
+#include "common.hh"
+#include "util/benchmark.hh"
+#include "math/math_simd.hh"
+#include "renderer/transform.hh"
+#include "util/texture_bake.hh"
+#include "util/mapped_file.hh"
+#include "util/thread_pool.hh"
+#include "renderer/light_grid.hh"
+#include "util/mesh_processing.hh"
+#include "util/hash.hh"
+#include "renderer/occlusion_culler.hh"
+#include "renderer/frame_graph.hh"
+#include "renderer/skeletal_animation.hh"
+#include "renderer/animation_system.hh"
+#include "renderer/compressed_animation.hh"
+#include "renderer/blend_tree.hh"
+#include "renderer/skinning.hh"
+#include "util/md5_importer.hh"
+#include "ecs/ecs.hh"
+
+static float _MaxMatrixDifference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b)
+{
+	float maxDifference = 0.0f;
+
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		const float* lhs = &a[i][0][0];
+		const float* rhs = &b[i][0][0];
+
+		for (size_t j = 0; j < 16; j++)
+		{
+			maxDifference = std::max(maxDifference, fabsf(lhs[j] - rhs[j]));
+		}
+	}
+
+	return maxDifference;
+}
+
+/// Transform::GetModelMatrix (one glm matrix chain per entity) against the SoA batch kernels.
+/// Every entity is dirtied each iteration, which is the worst case the cache in Transform can't help with.
+static bool _BenchmarkTransformBatch(const size_t count, const size_t iterations)
+{
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> positionDist(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> angleDist(-180.0f, 180.0f);
+	std::uniform_real_distribution<float> scaleDist(0.5f, 2.0f);
+
+	std::vector<Transform> transforms(count);
+	std::vector<glm::vec3> rotations(count);
+	qt::TransformSoA batch;
+	batch.Resize(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::vec3 position(positionDist(rng), positionDist(rng), positionDist(rng));
+		const glm::vec3 origin(positionDist(rng), positionDist(rng), positionDist(rng));
+		const glm::vec3 scale(scaleDist(rng), scaleDist(rng), scaleDist(rng));
+		rotations[i] = glm::vec3(angleDist(rng), angleDist(rng), angleDist(rng));
+
+		transforms[i] = Transform(position, origin, rotations[i], scale);
+		batch.SetFromEuler(i, position, origin, rotations[i], scale);
+	}
+
+	std::vector<glm::mat4> reference(count);
+	std::vector<glm::mat4> result(count);
+
+	const double glmTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			transforms[i].SetRotation(rotations[i]);
+			reference[i] = transforms[i].GetModelMatrix();
+		}
+	});
+	LogBenchmarkResult("Transform::GetModelMatrix", count, glmTime, glmTime);
+
+	bool matched = true;
+	auto check = [&](const char* name, const double time)
+	{
+		const float difference = _MaxMatrixDifference(reference, result);
+		LogBenchmarkResult(name, count, time, glmTime);
+
+		if (difference > 1e-3f)
+		{
+			DEBUG_LOG("Benchmark", LOG_ERROR, "%s differs from the reference path by %f", name, difference);
+			matched = false;
+		}
+	};
+
+	check("qt::ComposeTransformsScalar",
+		MeasureAverageMicroseconds(iterations, [&]() { qt::ComposeTransformsScalar(batch, 0, count, result.data()); }));
+
+#ifdef QT_SIMD_SSE
+	check("qt::ComposeTransformsSSE",
+		MeasureAverageMicroseconds(iterations, [&]() { qt::ComposeTransformsSSE(batch, 0, count, result.data()); }));
+#endif
+
+#ifdef QT_SIMD_AVX2
+	check("qt::ComposeTransformsAVX2",
+		MeasureAverageMicroseconds(iterations, [&]() { qt::ComposeTransformsAVX2(batch, 0, count, result.data()); }));
+#endif
+
+	return matched;
+}
+
+/// Peak signal-to-noise ratio over the channels a format keeps. Infinite for identical images.
+static double _ComputePSNR(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, int numChannels)
+{
+	double squaredError = 0.0;
+	size_t count = 0;
+
+	for (size_t i = 0; i < a.size(); i += 4)
+	{
+		for (int c = 0; c < numChannels; c++)
+		{
+			const double difference = static_cast<double>(a[i + c]) - b[i + c];
+			squaredError += difference * difference;
+			count++;
+		}
+	}
+
+	if (squaredError == 0.0)
+	{
+		return 1e9;
+	}
+
+	return 10.0 * log10((255.0 * 255.0) / (squaredError / count));
+}
+
+/// Bakes a synthetic image in every format, writes it to disk, maps it back and decodes every level,
+/// comparing against the CPU mip chain it was built from. RGBA8 must match exactly on every level, the BC formats within a PSNR bound.
+static bool _BenchmarkTextureBake()
+{
+	const int width = 250, height = 130; // Not a multiple of 4 or a power of two, to cover partial blocks
+	std::vector<uint8_t> image(static_cast<size_t>(width) * height * 4);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			uint8_t* texel = &image[(static_cast<size_t>(y) * width + x) * 4];
+			texel[0] = static_cast<uint8_t>(x * 255 / (width - 1));
+			texel[1] = static_cast<uint8_t>(y * 255 / (height - 1));
+			texel[2] = static_cast<uint8_t>(128.0f + 127.0f * sinf(x * 0.05f) * cosf(y * 0.07f));
+			texel[3] = static_cast<uint8_t>((x + y) * 255 / (width + height - 2));
+		}
+	}
+
+	std::vector<uint8_t> reference;
+	std::vector<size_t> referenceOffsets;
+	BuildMipChainRGBA8(image.data(), width, height, reference, referenceOffsets);
+
+	static const char* formatNames[NUM_BAKED_TEXTURE_FORMATS] = { "rgba8", "bc1", "bc3", "bc5" };
+	static const int formatChannels[NUM_BAKED_TEXTURE_FORMATS] = { 4, 3, 4, 2 };
+	const char* path = "benchmark_roundtrip" BAKED_TEXTURE_EXTENSION;
+
+	bool passed = true;
+
+	for (uint32_t f = 0; f < NUM_BAKED_TEXTURE_FORMATS; f++)
+	{
+		const BakedTextureFormat format = static_cast<BakedTextureFormat>(f);
+		std::vector<uint8_t> baked;
+
+		const double bakeTime = MeasureAverageMicroseconds(1, [&]() { BakeTexture(image.data(), width, height, format, baked); });
+
+		{
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(baked.data()), baked.size());
+		}
+
+		MappedFile mapped;
+		BakedTextureView view;
+		if (!mapped.Open(path) || !ParseBakedTexture(mapped.GetData(), mapped.GetSize(), view)
+			|| view.header->numLevels != referenceOffsets.size())
+		{
+			DEBUG_LOG("Benchmark", LOG_ERROR, "%s: baked file failed to map or parse", formatNames[f]);
+			passed = false;
+			continue;
+		}
+
+		// The smallest mips pack whole color gradients into a single 4x4 block, which no BC format can hold,
+		// so the quality bound only applies to the top level. Every level must still decode to the right size.
+		double topLevelPSNR = 0.0;
+		bool exactEverywhere = true;
+		std::vector<uint8_t> decoded;
+		std::vector<uint8_t> expected;
+
+		for (uint32_t level = 0; level < view.header->numLevels; level++)
+		{
+			const int levelWidth = view.GetLevelWidth(level);
+			const int levelHeight = view.GetLevelHeight(level);
+			DecodeTextureLevel(format, view.GetLevelData(level), levelWidth, levelHeight, decoded);
+
+			const uint8_t* levelReference = reference.data() + referenceOffsets[level];
+			expected.assign(levelReference, levelReference + decoded.size());
+
+			const double psnr = _ComputePSNR(expected, decoded, formatChannels[f]);
+			if (level == 0)
+			{
+				topLevelPSNR = psnr;
+			}
+			exactEverywhere &= (psnr >= 1e9);
+		}
+
+		const bool exact = (format == BAKED_TEXTURE_RGBA8);
+		const bool ok = exact ? exactEverywhere : (topLevelPSNR >= 35.0);
+
+		char quality[32];
+		if (topLevelPSNR >= 1e9)
+		{
+			snprintf(quality, sizeof(quality), exactEverywhere ? "lossless" : "lossless at level 0");
+		}
+		else
+		{
+			snprintf(quality, sizeof(quality), "level 0 PSNR %.1f dB", topLevelPSNR);
+		}
+
+		DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Texture bake %-5s %8zu bytes, %2u levels, bake %8.0f us, %s",
+			formatNames[f], baked.size(), view.header->numLevels, bakeTime, quality);
+
+		passed &= ok;
+	}
+
+	std::remove(path);
+	return passed;
+}
+
+/// Light binning for clustered shading: scalar on one thread against SSE on one thread and SSE spread over a thread pool.
+/// All three must produce identical clusters, and every point inside a light's sphere and the frustum must find that light in its cluster.
+static bool _BenchmarkLightBinning(const size_t count, const size_t iterations, ThreadPool& pool)
+{
+	std::mt19937 rng(4242);
+	std::uniform_real_distribution<float> horizontalDist(-150.0f, 150.0f);
+	std::uniform_real_distribution<float> heightDist(-1.0f, 20.0f);
+	std::uniform_real_distribution<float> radiusDist(1.0f, 8.0f);
+
+	PointLightSoA lights;
+	lights.Resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		lights.Set(i, glm::vec3(horizontalDist(rng), heightDist(rng), horizontalDist(rng)), radiusDist(rng));
+	}
+
+	const glm::mat4 viewMatrix = glm::lookAt(glm::vec3(0.0f, 10.0f, 60.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	const float fov = glm::radians(90.0f), aspectRatio = 16.0f / 9.0f, nearPlane = 0.1f, farPlane = 300.0f;
+
+	LightGrid reference, simd, threaded;
+
+	const double scalarTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		reference.Build(viewMatrix, fov, aspectRatio, nearPlane, farPlane, lights, nullptr, false);
+	});
+	LogBenchmarkResult("LightGrid::Build scalar, 1 thread", count, scalarTime, scalarTime);
+
+	const double simdTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		simd.Build(viewMatrix, fov, aspectRatio, nearPlane, farPlane, lights, nullptr, true);
+	});
+	LogBenchmarkResult("LightGrid::Build SIMD, 1 thread", count, simdTime, scalarTime);
+
+	const double threadedTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		threaded.Build(viewMatrix, fov, aspectRatio, nearPlane, farPlane, lights, &pool, true);
+	});
+	LogBenchmarkResult("LightGrid::Build SIMD, thread pool", count, threadedTime, scalarTime);
+
+	bool passed = true;
+	auto sameAsReference = [&](const LightGrid& grid)
+	{
+		const std::vector<LightCluster>& a = reference.GetClusters();
+		const std::vector<LightCluster>& b = grid.GetClusters();
+
+		return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(LightCluster)) == 0
+			&& reference.GetLightIndices() == grid.GetLightIndices();
+	};
+
+	if (!sameAsReference(simd) || !sameAsReference(threaded))
+	{
+		DEBUG_LOG("Benchmark", LOG_ERROR, "Light binning: SIMD or threaded clusters differ from the scalar reference");
+		passed = false;
+	}
+
+	// Look points up the same way core.frag does and make sure no light is missing from its cluster
+	const glm::mat4 projectionMatrix = glm::perspective(fov, aspectRatio, nearPlane, farPlane);
+	const std::vector<LightCluster>& clusters = reference.GetClusters();
+	const std::vector<uint32_t>& indices = reference.GetLightIndices();
+	std::uniform_real_distribution<float> unitDist(-1.0f, 1.0f);
+
+	size_t numChecked = 0, numMissing = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int sample = 0; sample < 8; sample++)
+		{
+			glm::vec3 offset(unitDist(rng), unitDist(rng), unitDist(rng));
+			if (glm::length(offset) > 1.0f)
+			{
+				continue;
+			}
+
+			const glm::vec4 world(lights.x[i] + offset.x * lights.radius[i], lights.y[i] + offset.y * lights.radius[i], lights.z[i] + offset.z * lights.radius[i], 1.0f);
+			const glm::vec4 view = viewMatrix * world;
+			const glm::vec4 clip = projectionMatrix * view;
+			const float depth = -view.z;
+
+			if (depth <= nearPlane || depth >= farPlane || fabsf(clip.x) >= clip.w || fabsf(clip.y) >= clip.w)
+			{
+				continue;
+			}
+
+			const uint32_t x = std::min(static_cast<uint32_t>((clip.x / clip.w * 0.5f + 0.5f) * reference.GetNumX()), reference.GetNumX() - 1);
+			const uint32_t y = std::min(static_cast<uint32_t>((clip.y / clip.w * 0.5f + 0.5f) * reference.GetNumY()), reference.GetNumY() - 1);
+			const int slice = static_cast<int>(floorf(logf(depth) * reference.GetDepthScale() + reference.GetDepthBias()));
+			const uint32_t z = static_cast<uint32_t>(std::min(std::max(slice, 0), static_cast<int>(reference.GetNumZ()) - 1));
+
+			const LightCluster& cluster = clusters[(z * reference.GetNumY() + y) * reference.GetNumX() + x];
+			const uint32_t* begin = indices.data() + cluster.offset;
+
+			numChecked++;
+			if (std::find(begin, begin + cluster.count, static_cast<uint32_t>(i)) == begin + cluster.count)
+			{
+				numMissing++;
+			}
+		}
+	}
+
+	DEBUG_LOG("Benchmark", numMissing ? LOG_ERROR : LOG_INFO, "Light binning: %zu light indices, %zu/%zu sampled points found their light",
+		indices.size(), numChecked - numMissing, numChecked);
+
+	return passed && numMissing == 0;
+}
+
+/// Closed sphere with shared vertices, slightly bumpy so the simplifier has something to preserve.
+static void _BuildSphereMesh(uint32_t rings, uint32_t segments, std::vector<PerVertexData>& vertices, std::vector<GLuint>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
+	auto addVertex = [&](float theta, float phi)
+	{
+		PerVertexData vertex{};
+
+		const glm::vec3 direction(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+		vertex.position = direction * (1.0f + 0.05f * sinf(theta * 7.0f) * cosf(phi * 5.0f));
+		vertex.normal = direction;
+		vertices.push_back(vertex);
+	};
+
+	const float pi = 3.14159265f;
+	addVertex(0.0f, 0.0f); // North pole
+	for (uint32_t ring = 1; ring < rings; ring++)
+	{
+		for (uint32_t segment = 0; segment < segments; segment++)
+		{
+			addVertex(pi * ring / rings, 2.0f * pi * segment / segments);
+		}
+	}
+	addVertex(pi, 0.0f); // South pole
+
+	auto ringVertex = [&](uint32_t ring, uint32_t segment) { return 1 + (ring - 1) * segments + segment % segments; };
+	const GLuint south = static_cast<GLuint>(vertices.size() - 1);
+
+	for (uint32_t segment = 0; segment < segments; segment++)
+	{
+		indices.insert(indices.end(), { 0, ringVertex(1, segment + 1), ringVertex(1, segment) });
+		indices.insert(indices.end(), { south, ringVertex(rings - 1, segment), ringVertex(rings - 1, segment + 1) });
+
+		for (uint32_t ring = 1; ring + 1 < rings; ring++)
+		{
+			const GLuint a = ringVertex(ring, segment), b = ringVertex(ring, segment + 1);
+			const GLuint c = ringVertex(ring + 1, segment), d = ringVertex(ring + 1, segment + 1);
+			indices.insert(indices.end(), { a, b, d, a, d, c });
+		}
+	}
+}
+
+static double _ComputeSignedVolume(const std::vector<PerVertexData>& vertices, const std::vector<GLuint>& indices)
+{
+	double volume = 0.0;
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const glm::vec3& a = vertices[indices[i]].position;
+		const glm::vec3& b = vertices[indices[i + 1]].position;
+		const glm::vec3& c = vertices[indices[i + 2]].position;
+		volume += glm::dot(a, glm::cross(b, c)) / 6.0;
+	}
+
+	return volume;
+}
+
+/// Welds a flat copy of a sphere back together, then simplifies it to 1/2, 1/4 and 1/8 of its triangles.
+/// Each level must hit its target, stay closed and manifold, and keep the sphere's volume.
+static bool _BenchmarkMeshSimplify(const uint32_t rings, const uint32_t segments, const size_t iterations)
+{
+	std::vector<PerVertexData> vertices;
+	std::vector<GLuint> indices;
+	_BuildSphereMesh(rings, segments, vertices, indices);
+
+	std::vector<PerVertexData> flat;
+	for (GLuint index : indices)
+	{
+		flat.push_back(vertices[index]);
+	}
+
+	std::vector<PerVertexData> welded;
+	std::vector<GLuint> weldedIndices;
+	const double weldTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		WeldVertices(flat.data(), static_cast<uint32_t>(flat.size()), NULL, 0, welded, weldedIndices);
+	});
+	LogBenchmarkResult("WeldVertices", flat.size(), weldTime, weldTime);
+
+	bool passed = true;
+	if (welded.size() != vertices.size())
+	{
+		DEBUG_LOG("Benchmark", LOG_ERROR, "Mesh weld: %zu vertices after welding, expected %zu", welded.size(), vertices.size());
+		passed = false;
+	}
+
+	const double volume = _ComputeSignedVolume(welded, weldedIndices);
+	std::vector<GLuint> source = weldedIndices;
+	std::vector<GLuint> simplified;
+	double baselineTime = 0.0;
+
+	for (uint32_t level = 1; level <= 3; level++)
+	{
+		const uint32_t target = static_cast<uint32_t>(weldedIndices.size() >> level) / 3 * 3;
+		float error = 0.0f;
+
+		const double time = MeasureAverageMicroseconds(iterations, [&]()
+		{
+			error = SimplifyMesh(welded.data(), static_cast<uint32_t>(welded.size()), source.data(), static_cast<uint32_t>(source.size()), target, 1.0f, simplified);
+		});
+
+		if (level == 1)
+		{
+			baselineTime = time;
+		}
+		LogBenchmarkResult("SimplifyMesh, half the previous level", source.size() / 3, time, baselineTime);
+
+		// Closed and manifold: every half-edge has exactly one twin
+		std::vector<uint64_t> halfEdges;
+		for (size_t i = 0; i < simplified.size(); i += 3)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				halfEdges.push_back((static_cast<uint64_t>(simplified[i + j]) << 32) | simplified[i + (j + 1) % 3]);
+			}
+		}
+		std::sort(halfEdges.begin(), halfEdges.end());
+
+		size_t numOpen = 0;
+		for (size_t i = 0; i < halfEdges.size(); i++)
+		{
+			const uint64_t twin = (halfEdges[i] << 32) | (halfEdges[i] >> 32);
+			const bool duplicated = i + 1 < halfEdges.size() && halfEdges[i + 1] == halfEdges[i];
+			if (duplicated || !std::binary_search(halfEdges.begin(), halfEdges.end(), twin))
+			{
+				numOpen++;
+			}
+		}
+
+		const double volumeRatio = _ComputeSignedVolume(welded, simplified) / volume;
+		const bool ok = simplified.size() <= target && numOpen == 0 && fabs(volumeRatio - 1.0) < 0.1;
+
+		DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Mesh LOD %u: %zu -> %zu triangles (target %u), error %.4f, volume %.3f, %zu open edges",
+			level, source.size() / 3, simplified.size() / 3, target / 3, error, volumeRatio, numOpen);
+
+		passed &= ok;
+		source.swap(simplified);
+	}
+
+	return passed;
+}
+
+/// Triangles with their corners rotated so the smallest index comes first, sorted. Equal for the same triangles in any order.
+static std::vector<uint64_t> _GetCanonicalTriangles(const std::vector<PerVertexData>& vertices, const std::vector<GLuint>& indices)
+{
+	std::vector<uint64_t> triangles;
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		// Compare by position, so the check also holds across vertex renumbering
+		uint64_t corners[3];
+		for (int j = 0; j < 3; j++)
+		{
+			const glm::vec3& p = vertices[indices[i + j]].position;
+			corners[j] = HashFNV1a64(&p, sizeof(p));
+		}
+
+		const int first = (corners[0] <= corners[1] && corners[0] <= corners[2]) ? 0 : (corners[1] <= corners[2] ? 1 : 2);
+		triangles.push_back(HashFNV1a64(&corners[(first + 1) % 3], sizeof(uint64_t), HashFNV1a64(&corners[(first + 2) % 3], sizeof(uint64_t), corners[first])));
+	}
+
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+/// Shuffles a sphere's triangles, then reorders them for the vertex cache and the vertices for fetch order.
+/// The ACMR has to improve and the triangles (and their winding) have to stay the same.
+static bool _BenchmarkVertexCache(const uint32_t rings, const uint32_t segments, const size_t iterations)
+{
+	std::vector<PerVertexData> vertices;
+	std::vector<GLuint> indices;
+	_BuildSphereMesh(rings, segments, vertices, indices);
+
+	std::mt19937 rng(1337);
+	std::vector<uint32_t> order(indices.size() / 3);
+	for (uint32_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	std::shuffle(order.begin(), order.end(), rng);
+
+	std::vector<GLuint> shuffled;
+	for (uint32_t triangle : order)
+	{
+		shuffled.insert(shuffled.end(), indices.begin() + triangle * 3, indices.begin() + triangle * 3 + 3);
+	}
+
+	const std::vector<uint64_t> reference = _GetCanonicalTriangles(vertices, shuffled);
+	const float shuffledACMR = ComputeACMR(shuffled.data(), static_cast<uint32_t>(shuffled.size()), static_cast<uint32_t>(vertices.size()));
+
+	std::vector<GLuint> optimized;
+	const double time = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		optimized = shuffled;
+		OptimizeVertexCache(optimized.data(), static_cast<uint32_t>(optimized.size()), static_cast<uint32_t>(vertices.size()));
+	});
+	LogBenchmarkResult("OptimizeVertexCache", optimized.size() / 3, time, time);
+
+	const float optimizedACMR = ComputeACMR(optimized.data(), static_cast<uint32_t>(optimized.size()), static_cast<uint32_t>(vertices.size()));
+
+	std::vector<PerVertexData> fetchVertices = vertices;
+	OptimizeVertexFetch(fetchVertices, optimized.data(), static_cast<uint32_t>(optimized.size()));
+
+	// After the fetch pass, every vertex is first used right after the ones before it
+	bool inFetchOrder = true;
+	GLuint nextVertex = 0;
+	for (GLuint index : optimized)
+	{
+		if (index > nextVertex)
+		{
+			inFetchOrder = false;
+		}
+		else if (index == nextVertex)
+		{
+			nextVertex++;
+		}
+	}
+
+	const bool sameTriangles = _GetCanonicalTriangles(fetchVertices, optimized) == reference;
+	const bool ok = sameTriangles && inFetchOrder && optimizedACMR < shuffledACMR && optimizedACMR < 1.0f;
+
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Vertex cache: ACMR %.3f shuffled -> %.3f optimized, triangles %s, fetch order %s",
+		shuffledACMR, optimizedACMR, sameTriangles ? "kept" : "CHANGED", inFetchOrder ? "ok" : "WRONG");
+
+	return ok;
+}
+
+/// Appends a wall in the z = depth plane, tessellated into divisions x divisions quads so rasterization has some work to do.
+static void _AddWallOccluder(float halfWidth, float halfHeight, float depth, uint32_t divisions, std::vector<PerVertexData>& vertices)
+{
+	for (uint32_t y = 0; y < divisions; y++)
+	{
+		for (uint32_t x = 0; x < divisions; x++)
+		{
+			const float x0 = -halfWidth + 2.0f * halfWidth * x / divisions, x1 = -halfWidth + 2.0f * halfWidth * (x + 1) / divisions;
+			const float y0 = -halfHeight + 2.0f * halfHeight * y / divisions, y1 = -halfHeight + 2.0f * halfHeight * (y + 1) / divisions;
+			const glm::vec3 corners[6] = {
+				glm::vec3(x0, y0, depth), glm::vec3(x1, y0, depth), glm::vec3(x1, y1, depth),
+				glm::vec3(x0, y0, depth), glm::vec3(x1, y1, depth), glm::vec3(x0, y1, depth)
+			};
+
+			for (const glm::vec3& corner : corners)
+			{
+				PerVertexData vertex = {};
+				vertex.position = corner;
+				vertices.push_back(vertex);
+			}
+		}
+	}
+}
+
+/// Rasterizes a wall in front of the camera and tests boxes around it. Boxes fully behind the wall have to be
+/// culled, boxes in front of it, beside it, peeking over it or outside the view must not be.
+/// The SSE and scalar rasterizers have to produce the same depth buffer.
+static bool _BenchmarkOcclusionCulling(const uint32_t numBoxes, const size_t iterations)
+{
+	const glm::mat4 viewProjection = glm::perspective(glm::radians(90.0f), 2.0f, 0.1f, 1000.0f)
+		* glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	std::vector<PerVertexData> wall;
+	_AddWallOccluder(5.0f, 3.0f, -10.0f, 4, wall);
+	const uint32_t numWallVertices = static_cast<uint32_t>(wall.size());
+
+	OcclusionCuller simd(256, 128, true);
+	OcclusionCuller scalar(256, 128, false);
+
+	auto rasterize = [&](OcclusionCuller& culler)
+	{
+		culler.BeginFrame(viewProjection);
+		culler.AddOccluder(wall.data(), NULL, numWallVertices, glm::mat4(1.0f));
+		culler.EndOccluders();
+	};
+
+	const double simdTime = MeasureAverageMicroseconds(iterations, [&]() { rasterize(simd); });
+	const double scalarTime = MeasureAverageMicroseconds(iterations, [&]() { rasterize(scalar); });
+	LogBenchmarkResult("OcclusionCuller rasterize (triangles)", numWallVertices / 3, simdTime, scalarTime);
+
+	float maxDifference = 0.0f;
+	for (size_t i = 0; i < simd.GetDepth().size(); i++)
+	{
+		maxDifference = std::max(maxDifference, fabsf(simd.GetDepth()[i] - scalar.GetDepth()[i]));
+	}
+
+	struct Case
+	{
+		const char* name;
+		glm::vec3 min, max;
+		bool visible;
+	};
+	const Case cases[] = {
+		{ "behind",         glm::vec3(-0.5f, -0.5f, -20.5f), glm::vec3(0.5f, 0.5f, -19.5f), false },
+		{ "behind, offset", glm::vec3(1.5f, 0.5f, -31.0f),   glm::vec3(3.0f, 2.0f, -29.0f), false },
+		{ "in front",       glm::vec3(-0.5f, -0.5f, -5.5f),  glm::vec3(0.5f, 0.5f, -4.5f),  true },
+		{ "beside",         glm::vec3(19.0f, -0.5f, -21.0f), glm::vec3(21.0f, 0.5f, -19.0f), true },
+		{ "above",          glm::vec3(-0.5f, 2.0f, -21.0f),  glm::vec3(0.5f, 10.0f, -19.0f), true },
+		{ "through",        glm::vec3(-0.5f, -0.5f, -15.0f), glm::vec3(0.5f, 0.5f, -8.0f),  true },
+		{ "outside view",   glm::vec3(99.0f, -0.5f, -21.0f), glm::vec3(101.0f, 0.5f, -19.0f), false }
+	};
+
+	bool casesOk = true;
+	for (const Case& c : cases)
+	{
+		const qt::AABB box(c.min, c.max);
+
+		if (simd.IsVisible(box) != c.visible)
+		{
+			DEBUG_LOG("Benchmark", LOG_ERROR, "Occlusion culling: box %s is %s, expected %s", c.name,
+				c.visible ? "culled" : "visible", c.visible ? "visible" : "culled");
+			casesOk = false;
+		}
+	}
+
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> position(-30.0f, 30.0f);
+	std::vector<qt::AABB> boxes;
+	for (uint32_t i = 0; i < numBoxes; i++)
+	{
+		const glm::vec3 center(position(rng), position(rng) * 0.25f, -15.0f + position(rng) * 0.5f);
+		boxes.push_back(qt::AABB(center - glm::vec3(0.5f), center + glm::vec3(0.5f)));
+	}
+
+	uint32_t numVisible = 0;
+	const double testTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		numVisible = 0;
+		for (const auto& box : boxes)
+		{
+			numVisible += simd.IsVisible(box) ? 1 : 0;
+		}
+	});
+	LogBenchmarkResult("OcclusionCuller::IsVisible", numBoxes, testTime, testTime);
+
+	const bool ok = casesOk && maxDifference <= 1e-6f && simd.GetNumOccluderTriangles() == scalar.GetNumOccluderTriangles();
+
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Occlusion culling: %u of %u random boxes visible, SIMD/scalar depth difference %g",
+		numVisible, numBoxes, maxDifference);
+
+	return ok;
+}
+
+/// Declares a scene pass, a three pass bloom chain and a composite, out of order, plus a pass whose output nobody reads.
+/// Compiling must cull that pass, run the rest after their inputs, and fit the bloom chain into two textures.
+/// Only Compile() is used, so no GL context is needed.
+static bool _BenchmarkFrameGraph(const size_t iterations)
+{
+	FrameGraph graph;
+	std::vector<FrameGraphPass> passes;
+
+	auto build = [&]()
+	{
+		graph.Reset();
+		passes.clear();
+
+		const FrameGraphTextureDesc full = { 1280, 720, GL_RGBA16F };
+		const FrameGraphTextureDesc half = { 640, 360, GL_RGBA16F };
+
+		const FrameGraphResource backbuffer = graph.ImportBackbuffer("Backbuffer", 1280, 720);
+		const FrameGraphResource color = graph.CreateTexture("Scene color", full);
+		const FrameGraphResource depth = graph.CreateTexture("Scene depth", { 1280, 720, GL_DEPTH24_STENCIL8 });
+		const FrameGraphResource bright = graph.CreateTexture("Bright", half);
+		const FrameGraphResource blurX = graph.CreateTexture("Blur X", half);
+		const FrameGraphResource blurY = graph.CreateTexture("Blur Y", half);
+		const FrameGraphResource unused = graph.CreateTexture("Unused", full);
+
+		auto noop = [](const FrameGraph&) {};
+
+		passes.push_back(graph.AddPass("Composite", noop));
+		graph.Read(passes.back(), color);
+		graph.Read(passes.back(), blurY);
+		graph.Write(passes.back(), backbuffer);
+
+		passes.push_back(graph.AddPass("Blur Y", noop));
+		graph.Read(passes.back(), blurX);
+		graph.Write(passes.back(), blurY, true);
+
+		passes.push_back(graph.AddPass("Scene", noop));
+		graph.Write(passes.back(), color, true);
+		graph.Write(passes.back(), depth, true);
+
+		passes.push_back(graph.AddPass("Unused", noop));
+		graph.Read(passes.back(), color);
+		graph.Write(passes.back(), unused, true);
+
+		passes.push_back(graph.AddPass("Bright pass", noop));
+		graph.Read(passes.back(), color);
+		graph.Write(passes.back(), bright, true);
+
+		passes.push_back(graph.AddPass("Blur X", noop));
+		graph.Read(passes.back(), bright);
+		graph.Write(passes.back(), blurX, true);
+
+		return graph.Compile();
+	};
+
+	bool compiled = true;
+	const double time = MeasureAverageMicroseconds(iterations, [&]() { compiled &= build(); });
+	LogBenchmarkResult("FrameGraph build and compile (passes)", passes.size(), time, time);
+
+	// passes[] is in the order added: Composite, Blur Y, Scene, Unused, Bright pass, Blur X
+	const std::vector<FrameGraphPass> expectedOrder = { passes[2], passes[4], passes[5], passes[1], passes[0] };
+	const bool orderOk = graph.GetExecutionOrder() == expectedOrder && graph.IsPassCulled(passes[3]);
+
+	// Scene color, scene depth, and two half size textures for the three bloom targets
+	const uint32_t numTextures = graph.GetNumPhysicalTextures();
+	const bool ok = compiled && orderOk && numTextures == 4 && graph.GetTransientMemory() < graph.GetUnaliasedTransientMemory();
+
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Frame graph: %zu of %zu passes run %s, %u textures, %.1f MiB transient instead of %.1f MiB",
+		graph.GetExecutionOrder().size(), passes.size(), orderOk ? "in order" : "in the WRONG order", numTextures,
+		graph.GetTransientMemory() / (1024.0 * 1024.0), graph.GetUnaliasedTransientMemory() / (1024.0 * 1024.0));
+
+	return ok;
+}
+
+/// The per-frame work the Animator did before skeletons were flattened: keyframes keyed by bone name, a fresh map of
+/// matrices every frame, and a recursion that copies each child subtree. Kept as the baseline and as the reference.
+struct _NamedKeyframe
+{
+	float timestamp;
+	std::map<std::string, std::pair<glm::vec3, qt::Quaternion>> pose;
+};
+
+static void _ApplyNamedPose(std::map<std::string, glm::mat4>& pose, BoneTreeNode& bone, const glm::mat4& parentTransform, std::vector<glm::mat4>& out)
+{
+	const glm::mat4 currentTransform = parentTransform * pose[bone.GetName()];
+
+	for (BoneTreeNode child : bone.GetChildren())
+	{
+		_ApplyNamedPose(pose, child, currentTransform, out);
+	}
+
+	out[bone.GetID()] = currentTransform * bone.GetInvBindTransform();
+}
+
+static void _UpdateNamedAnimator(const std::vector<_NamedKeyframe>& keyframes, BoneTreeNode& root, float time, std::vector<glm::mat4>& out)
+{
+	std::vector<_NamedKeyframe> allFrames = keyframes;
+	_NamedKeyframe previousFrame = allFrames[0];
+	_NamedKeyframe nextFrame = allFrames[0];
+	for (uint32_t i = 1; i < allFrames.size(); i++)
+	{
+		nextFrame = allFrames[i];
+		if (nextFrame.timestamp > time)
+		{
+			break;
+		}
+		previousFrame = allFrames[i];
+	}
+
+	const float f = (time - previousFrame.timestamp) / (nextFrame.timestamp - previousFrame.timestamp);
+
+	std::map<std::string, glm::mat4> currentPose;
+	for (const auto& [name, transform] : previousFrame.pose)
+	{
+		const auto& next = nextFrame.pose[name];
+		const glm::vec3 position = transform.first * (1.0f - f) + next.first * f;
+		qt::Quaternion rotation = qt::Quaternion::NLerp(transform.second, next.second, f);
+		currentPose.insert(std::make_pair(name, glm::translate(glm::mat4(1.0f), position) * rotation.GetRotationTransformMat()));
+	}
+
+	for (auto& child : root.GetChildren())
+	{
+		_ApplyNamedPose(currentPose, child, glm::mat4(1.0f), out);
+	}
+}
+
+static BoneTreeNode _BuildBoneTree(const Skeleton& skeleton, int32_t bone)
+{
+	BoneTreeNode node = bone < 0 ? BoneTreeNode(0, "", glm::mat4(1.0f)) : BoneTreeNode(bone, skeleton.GetName(bone), glm::mat4(1.0f));
+	if (bone >= 0)
+	{
+		node.GetInvBindTransform() = skeleton.GetInverseBindMatrix(bone);
+	}
+
+	for (uint32_t i = 0; i < skeleton.GetNumBones(); i++)
+	{
+		if (skeleton.GetParent(i) == bone)
+		{
+			node.AddChild(_BuildBoneTree(skeleton, static_cast<int32_t>(i)));
+		}
+	}
+
+	return node;
+}
+
+/// Plays a random animation on a random skeleton through the Animator and through the old name-keyed path.
+/// Both have to produce the same skinning matrices every frame.
+static bool _BenchmarkAnimator(const uint32_t numBones, const uint32_t numKeyframes, const size_t iterations)
+{
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	Skeleton skeleton;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		const int32_t parent = i == 0 ? -1 : static_cast<int32_t>(rng() % i);
+		const glm::vec3 bindPosition(unit(rng), unit(rng) + 1.0f, unit(rng));
+		skeleton.AddBone("bone_" + std::to_string(i), parent, glm::translate(glm::mat4(1.0f), -bindPosition));
+	}
+
+	Animation animation;
+	std::vector<_NamedKeyframe> namedKeyframes(numKeyframes);
+	for (uint32_t k = 0; k < numKeyframes; k++)
+	{
+		Keyframe keyframe;
+		keyframe.timestamp = k / 30.0f;
+		keyframe.pose.Resize(numBones);
+		namedKeyframes[k].timestamp = keyframe.timestamp;
+
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			keyframe.pose.translations[i] = glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.2f;
+			keyframe.pose.rotations[i] = qt::Quaternion(1.0f + unit(rng) * 0.5f, unit(rng), unit(rng), unit(rng));
+			namedKeyframes[k].pose[skeleton.GetName(i)] = std::make_pair(keyframe.pose.translations[i], keyframe.pose.rotations[i]);
+		}
+
+		animation.keyframes.push_back(keyframe);
+	}
+	animation.duration = (numKeyframes - 1) / 30.0f;
+
+	BoneTreeNode root = _BuildBoneTree(skeleton, -1);
+
+	Animator animator(&skeleton);
+	animator.SetAnimation(&animation);
+
+	// Same frames through both paths
+	std::vector<glm::mat4> reference(numBones);
+	float maxDifference = 0.0f;
+	for (uint32_t frame = 0; frame < 90; frame++)
+	{
+		animator.Update(1.0f / 60.0f);
+		_UpdateNamedAnimator(namedKeyframes, root, animator.GetAnimationTime(), reference);
+		maxDifference = std::max(maxDifference, _MaxMatrixDifference(animator.GetSkinningMatrices(), reference));
+	}
+
+	const double flatTime = MeasureAverageMicroseconds(iterations, [&]() { animator.Update(1.0f / 60.0f); });
+	const double namedTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		_UpdateNamedAnimator(namedKeyframes, root, animator.GetAnimationTime(), reference);
+	});
+	LogBenchmarkResult("Animator::Update (bones)", numBones, flatTime, namedTime);
+
+	const bool ok = maxDifference < 1e-4f;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Animator: %u bones, %u keyframes, largest difference from the name-keyed path %g",
+		numBones, numKeyframes, maxDifference);
+
+	return ok;
+}
+
+/// Plays a long clip forward and seeks around it at random. Every sample has to land between the same two keyframes
+/// a scan from the start finds, with the same local pose.
+static bool _BenchmarkKeyframeLookup(const uint32_t numBones, const uint32_t numKeyframes, const size_t iterations)
+{
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	Skeleton skeleton;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		skeleton.AddBone("bone_" + std::to_string(i), static_cast<int32_t>(i) - 1, glm::mat4(1.0f));
+	}
+
+	Animation animation;
+	animation.keyframes.resize(numKeyframes);
+	for (uint32_t k = 0; k < numKeyframes; k++)
+	{
+		animation.keyframes[k].timestamp = k / 30.0f;
+		animation.keyframes[k].pose.Resize(numBones);
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			animation.keyframes[k].pose.translations[i] = glm::vec3(unit(rng), unit(rng), unit(rng));
+			animation.keyframes[k].pose.rotations[i] = qt::Quaternion(1.0f + unit(rng) * 0.5f, unit(rng), unit(rng), unit(rng));
+		}
+	}
+	animation.duration = (numKeyframes - 1) / 30.0f;
+
+	// What the Animator used to do: the last keyframe at or before the time, counting from the start
+	const auto scanKeyframes = [&](float time, uint32_t& previous, uint32_t& next)
+	{
+		previous = 0;
+		next = 0;
+		for (uint32_t i = 1; i < animation.keyframes.size(); i++)
+		{
+			next = i;
+			if (animation.keyframes[i].timestamp > time)
+			{
+				break;
+			}
+			previous = i;
+		}
+	};
+
+	float maxDifference = 0.0f;
+	const auto compareWithScan = [&](const Animator& animator)
+	{
+		uint32_t previous, next;
+		scanKeyframes(animator.GetAnimationTime(), previous, next);
+
+		const Keyframe& a = animation.keyframes[previous];
+		const Keyframe& b = animation.keyframes[next];
+		const float f = b.timestamp > a.timestamp ? glm::clamp((animator.GetAnimationTime() - a.timestamp) / (b.timestamp - a.timestamp), 0.0f, 1.0f) : 0.0f;
+
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			const glm::vec3 expected = a.pose.translations[i] * (1.0f - f) + b.pose.translations[i] * f;
+			const glm::vec3 d = animator.GetLocalPose().translations[i] - expected;
+			maxDifference = std::max(maxDifference, std::max(fabsf(d.x), std::max(fabsf(d.y), fabsf(d.z))));
+		}
+	};
+
+	Animator forward(&skeleton);
+	forward.SetAnimation(&animation);
+	for (uint32_t frame = 0; frame < 3 * numKeyframes; frame++)
+	{
+		forward.Update(1.0f / 60.0f);
+		compareWithScan(forward);
+	}
+
+	Animator seeking(&skeleton);
+	seeking.SetAnimation(&animation);
+	std::uniform_real_distribution<float> anyTime(-animation.duration, 2.0f * animation.duration);
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		seeking.SetAnimationTime(anyTime(rng));
+		compareWithScan(seeking);
+	}
+
+	const double forwardTime = MeasureAverageMicroseconds(iterations, [&]() { forward.Update(1.0f / 60.0f); });
+	const double seekTime = MeasureAverageMicroseconds(iterations, [&]() { seeking.SetAnimationTime(anyTime(rng)); });
+	uint64_t scanSum = 0;
+	const double scanTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		uint32_t previous, next;
+		scanKeyframes(anyTime(rng), previous, next);
+		scanSum += previous + next;
+	});
+	LogBenchmarkResult("Animator::Update, long clip (keyframes)", numKeyframes, forwardTime, forwardTime + scanTime);
+	LogBenchmarkResult("Animator::SetAnimationTime (keyframes)", numKeyframes, seekTime, seekTime + scanTime);
+
+	const bool ok = maxDifference < 1e-5f;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Keyframe lookup: %u keyframes, largest difference from a linear scan %g (checksum %llu)",
+		numKeyframes, maxDifference, static_cast<unsigned long long>(scanSum));
+
+	return ok;
+}
+
+/// Runs a crowd through the AnimationSystem and through one animator after another on this thread, as meshes used
+/// to while drawing. The palette has to hold exactly what each animator computes on its own.
+static bool _BenchmarkAnimationSystem(const uint32_t numCharacters, const uint32_t numBones, const size_t iterations)
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	Skeleton skeleton;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		skeleton.AddBone("bone_" + std::to_string(i), i == 0 ? -1 : static_cast<int32_t>(rng() % i), glm::mat4(1.0f));
+	}
+
+	Animation animation;
+	animation.keyframes.resize(30);
+	for (uint32_t k = 0; k < animation.keyframes.size(); k++)
+	{
+		animation.keyframes[k].timestamp = k / 30.0f;
+		animation.keyframes[k].pose.Resize(numBones);
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			animation.keyframes[k].pose.translations[i] = glm::vec3(unit(rng), unit(rng), unit(rng));
+			animation.keyframes[k].pose.rotations[i] = qt::Quaternion(1.0f + unit(rng) * 0.5f, unit(rng), unit(rng), unit(rng));
+		}
+	}
+	animation.duration = (animation.keyframes.size() - 1) / 30.0f;
+
+	// Characters start at different times and play at different speeds
+	std::vector<Animator> crowd(numCharacters, Animator(&skeleton));
+	std::vector<Animator> reference(numCharacters, Animator(&skeleton));
+	std::vector<float> speeds(numCharacters);
+
+	ThreadPool pool;
+	AnimationSystem animationSystem(pool);
+	ECSSystemList systems;
+	systems.AddSystem(animationSystem);
+
+	ECS ecs;
+	for (uint32_t i = 0; i < numCharacters; i++)
+	{
+		speeds[i] = 0.5f + (unit(rng) + 1.0f) * 0.5f;
+		const float start = (unit(rng) + 1.0f) * animation.duration * 0.5f;
+
+		crowd[i].SetAnimation(&animation);
+		crowd[i].SetAnimationTime(start);
+		reference[i].SetAnimation(&animation);
+		reference[i].SetAnimationTime(start);
+
+		AnimationComponent component;
+		component.animator = &crowd[i];
+		component.playbackSpeed = speeds[i];
+		ecs.MakeEntity(component);
+	}
+
+	const float delta = 1.0f / 60.0f;
+	const auto updateReference = [&]()
+	{
+		for (uint32_t i = 0; i < numCharacters; i++)
+		{
+			reference[i].Update(delta * speeds[i]);
+		}
+	};
+
+	float maxDifference = 0.0f;
+	for (uint32_t frame = 0; frame < 10; frame++)
+	{
+		ecs.UpdateSystems(systems, delta);
+		updateReference();
+
+		for (uint32_t i = 0; i < numCharacters; i++)
+		{
+			const std::vector<glm::mat4> palette(animationSystem.GetPalette() + i * numBones, animationSystem.GetPalette() + (i + 1) * numBones);
+			maxDifference = std::max(maxDifference, _MaxMatrixDifference(palette, reference[i].GetSkinningMatrices()));
+		}
+	}
+
+	const double systemTime = MeasureAverageMicroseconds(iterations, [&]() { ecs.UpdateSystems(systems, delta); });
+	const double serialTime = MeasureAverageMicroseconds(iterations, updateReference);
+	LogBenchmarkResult("AnimationSystem update (characters)", numCharacters, systemTime, serialTime);
+
+	const bool ok = maxDifference == 0.0f && animationSystem.GetNumAnimators() == numCharacters
+		&& animationSystem.GetNumPaletteMatrices() == numCharacters * numBones;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Animation system: %u characters of %u bones on %zu workers, largest palette difference %g",
+		numCharacters, numBones, pool.GetNumThreads(), maxDifference);
+
+	return ok;
+}
+
+/// A crowd lined up in front of and behind the camera, updated with and without animation LODs. Characters the LODs
+/// skip have to land closer to a full update by extrapolating than by holding their last pose, off-screen characters
+/// must keep theirs untouched, and bones below the reduced depth must follow their ancestor exactly.
+static bool _BenchmarkAnimationLOD(const uint32_t numCharacters, const uint32_t numBones, const size_t iterations)
+{
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	Skeleton skeleton;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		skeleton.AddBone("bone_" + std::to_string(i), i == 0 ? -1 : static_cast<int32_t>(rng() % i), glm::mat4(1.0f));
+	}
+
+	// Smooth, looping motion, which is what extrapolation is for
+	Animation animation;
+	animation.keyframes.resize(61);
+	std::vector<glm::vec3> phases(numBones);
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		phases[i] = glm::vec3(unit(rng), unit(rng), unit(rng)) * 3.14159265f;
+	}
+	for (uint32_t k = 0; k < animation.keyframes.size(); k++)
+	{
+		const float t = k / 60.0f;
+		const float angle = t * 2.0f * 3.14159265f;
+		animation.keyframes[k].timestamp = t;
+		animation.keyframes[k].pose.Resize(numBones);
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			animation.keyframes[k].pose.translations[i] = glm::vec3(0.0f, 0.2f, 0.0f) + glm::vec3(sinf(angle + phases[i].x), 0.0f, sinf(angle + phases[i].z)) * 0.02f;
+			animation.keyframes[k].pose.rotations[i] = qt::Quaternion(1.0f, sinf(angle + phases[i].x) * 0.1f, 0.0f, sinf(angle + phases[i].y) * 0.1f);
+		}
+	}
+	animation.duration = 1.0f;
+
+	// Every tenth character stands behind the camera, the rest at 2 to 200 units in front of it
+	std::vector<Animator> crowd(numCharacters, Animator(&skeleton));
+	std::vector<Animator> reference(numCharacters, Animator(&skeleton));
+	std::vector<EntityHandle> entities(numCharacters);
+
+	ThreadPool pool;
+	AnimationSystem animationSystem(pool);
+	ECSSystemList systems;
+	systems.AddSystem(animationSystem);
+
+	ECS ecs;
+	for (uint32_t i = 0; i < numCharacters; i++)
+	{
+		const float start = (unit(rng) + 1.0f) * 0.5f;
+		crowd[i].SetAnimation(&animation);
+		crowd[i].SetAnimationTime(start);
+		reference[i].SetAnimation(&animation);
+		reference[i].SetAnimationTime(start);
+
+		const float distance = 2.0f + 198.0f * i / numCharacters;
+		const glm::vec3 position(unit(rng) * distance * 0.3f, 0.0f, i % 10 == 9 ? distance : -distance);
+
+		AnimationComponent component;
+		component.animator = &crowd[i];
+		component.worldBounds = qt::AABB(position - glm::vec3(0.5f, 0.0f, 0.5f), position + glm::vec3(0.5f, 1.8f, 0.5f));
+		entities[i] = ecs.MakeEntity(component);
+	}
+
+	const glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f)
+		* glm::lookAt(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// Every bone evaluated at first, so the only difference from the reference is the skipped frames
+	AnimationLODSettings settings;
+	settings.reducedBoneDepth = ANIMATOR_ALL_BONES;
+	animationSystem.SetLODSettings(settings);
+	animationSystem.SetView(viewProjection, glm::vec3(0.0f, 1.0f, 0.0f), glm::radians(60.0f));
+
+	const float delta = 1.0f / 60.0f;
+	// Averaged over the skipped frames, since the first few have no motion to go on yet and hold their pose either way
+	double extrapolatedDifference = 0.0;
+	double heldDifference = 0.0;
+	uint32_t numSkipped = 0;
+	bool frozenHeld = true;
+
+	for (uint32_t frame = 0; frame < 40; frame++)
+	{
+		ecs.UpdateSystems(systems, delta);
+
+		for (uint32_t i = 0; i < numCharacters; i++)
+		{
+			const AnimationComponent* component = ecs.GetComponent<AnimationComponent>(entities[i]);
+			const std::vector<glm::mat4> palette(animationSystem.GetPalette() + component->paletteOffset,
+				animationSystem.GetPalette() + component->paletteOffset + numBones);
+
+			if (component->lod == ANIMATION_LOD_FROZEN)
+			{
+				frozenHeld &= palette == crowd[i].GetSkinningMatrices();
+				continue;
+			}
+
+			reference[i].Update(delta);
+
+			// Skipped this frame, so the animator still holds its last update
+			if (component->pendingTime > 0.0f)
+			{
+				extrapolatedDifference += _MaxMatrixDifference(palette, reference[i].GetSkinningMatrices());
+				heldDifference += _MaxMatrixDifference(crowd[i].GetSkinningMatrices(), reference[i].GetSkinningMatrices());
+				numSkipped++;
+			}
+		}
+	}
+
+	extrapolatedDifference /= std::max(numSkipped, 1u);
+	heldDifference /= std::max(numSkipped, 1u);
+
+	uint32_t lodCounts[NUM_ANIMATION_LODS];
+	uint32_t totalCount = 0;
+	for (uint32_t lod = 0; lod < NUM_ANIMATION_LODS; lod++)
+	{
+		lodCounts[lod] = animationSystem.GetNumAnimatorsAtLOD(static_cast<AnimationLOD>(lod));
+		totalCount += lodCounts[lod];
+	}
+
+	// Bones past the reduced depth carry their ancestor's skinning matrix
+	Animator reduced(&skeleton);
+	reduced.SetAnimation(&animation);
+	reduced.SetMaxBoneDepth(2);
+	reduced.Update(0.3f);
+	bool reducedFollows = true;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		if (skeleton.GetDepth(i) > 2)
+		{
+			reducedFollows &= reduced.GetSkinningMatrices()[i] == reduced.GetSkinningMatrices()[skeleton.GetParent(i)];
+		}
+	}
+
+	// Off screen, an animator extracting root motion still has to move its character, so its clock keeps running
+	Animator walker(&skeleton);
+	walker.SetAnimation(&animation);
+	walker.SetRootMotion(true);
+	ECS walkerECS;
+	AnimationComponent walkerComponent;
+	walkerComponent.animator = &walker;
+	walkerComponent.worldBounds = qt::AABB(glm::vec3(-0.5f, 0.0f, 9.5f), glm::vec3(0.5f, 1.8f, 10.5f));
+	const EntityHandle walkerEntity = walkerECS.MakeEntity(walkerComponent);
+	for (uint32_t frame = 0; frame < 8; frame++)
+	{
+		walkerECS.UpdateSystems(systems, delta);
+	}
+	const bool walkerRuns = walkerECS.GetComponent<AnimationComponent>(walkerEntity)->lod != ANIMATION_LOD_FROZEN
+		&& walker.GetAnimationTime() > 3.5f * delta;
+
+	animationSystem.SetLODSettings(AnimationLODSettings());
+	const double lodTime = MeasureAverageMicroseconds(iterations, [&]() { ecs.UpdateSystems(systems, delta); });
+	animationSystem.ClearView();
+	const double fullTime = MeasureAverageMicroseconds(iterations, [&]() { ecs.UpdateSystems(systems, delta); });
+	LogBenchmarkResult("AnimationSystem update with LODs (characters)", numCharacters, lodTime, fullTime);
+
+	const bool ok = frozenHeld && reducedFollows && walkerRuns && totalCount == numCharacters
+		&& lodCounts[ANIMATION_LOD_FULL] && lodCounts[ANIMATION_LOD_HALF] && lodCounts[ANIMATION_LOD_QUARTER] && lodCounts[ANIMATION_LOD_FROZEN]
+		&& numSkipped > 0 && extrapolatedDifference < heldDifference * 0.5;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR,
+		"Animation LOD: %u full, %u half, %u quarter, %u frozen, skipped frames off by %g on average extrapolated vs %g held, frozen %s, reduced bones %s, off screen walker %s",
+		lodCounts[ANIMATION_LOD_FULL], lodCounts[ANIMATION_LOD_HALF], lodCounts[ANIMATION_LOD_QUARTER], lodCounts[ANIMATION_LOD_FROZEN],
+		extrapolatedDifference, heldDifference, frozenHeld ? "held" : "MOVED", reducedFollows ? "follow" : "DON'T follow", walkerRuns ? "walks" : "STOPPED");
+
+	return ok;
+}
+
+/// A crowd walking in a few groups, each in step, through the AnimationSystem with and without the pose cache. Each
+/// group should cost about one evaluation, the walked distance handed out as root motion has to add up to the clip's
+/// over several loops, and the roots have to stay put in the pose. One more walker, out of step with every group, has
+/// nothing to share and has to play exactly as it would on its own.
+static bool _BenchmarkPoseCache(const uint32_t numCharacters, const uint32_t numGroups, const uint32_t numBones, const size_t iterations)
+{
+	std::mt19937 rng(13);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	Skeleton skeleton;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		skeleton.AddBone("bone_" + std::to_string(i), i == 0 ? -1 : static_cast<int32_t>(rng() % i), glm::mat4(1.0f));
+	}
+
+	// A one second walk cycle: the root moves forward along x at a steady pace and bobs up and down
+	const float speed = 1.5f;
+	Animation animation;
+	animation.keyframes.resize(31);
+	for (uint32_t k = 0; k < animation.keyframes.size(); k++)
+	{
+		const float t = k / 30.0f;
+		animation.keyframes[k].timestamp = t;
+		animation.keyframes[k].pose.Resize(numBones);
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			animation.keyframes[k].pose.translations[i] = glm::vec3(unit(rng), unit(rng), unit(rng));
+			animation.keyframes[k].pose.rotations[i] = qt::Quaternion(1.0f + unit(rng) * 0.5f, unit(rng), unit(rng), unit(rng));
+		}
+		animation.keyframes[k].pose.translations[0] = glm::vec3(speed * t, 0.05f * sinf(t * 4.0f * 3.14159265f), 0.0f);
+	}
+	animation.duration = 1.0f;
+
+	// Within a group, clocks are a few milliseconds apart. The loner is last, half way between two groups
+	std::vector<Animator> crowd(numCharacters + 1, Animator(&skeleton));
+	std::vector<EntityHandle> entities(numCharacters + 1);
+	Animator alone(&skeleton);
+
+	ThreadPool pool;
+	AnimationSystem animationSystem(pool);
+	ECSSystemList systems;
+	systems.AddSystem(animationSystem);
+
+	ECS ecs;
+	for (uint32_t i = 0; i <= numCharacters; i++)
+	{
+		crowd[i].SetAnimation(&animation);
+		crowd[i].SetRootMotion(true);
+		crowd[i].SetAnimationTime(i == numCharacters ? 0.5f / numGroups : static_cast<float>(i % numGroups) / numGroups + (unit(rng) + 1.0f) * 0.002f);
+
+		AnimationComponent component;
+		component.animator = &crowd[i];
+		entities[i] = ecs.MakeEntity(component);
+	}
+
+	const float delta = 1.0f / 60.0f;
+	const uint32_t numFrames = 150;
+	animationSystem.SetPoseCacheRate(60.0f);
+
+	alone.SetAnimation(&animation);
+	alone.SetRootMotion(true);
+	alone.SetAnimationTime(0.5f / numGroups);
+
+	std::vector<glm::vec3> walked(numCharacters, glm::vec3(0.0f));
+	uint32_t fewestShared = numCharacters;
+	bool loneExact = true;
+	for (uint32_t frame = 0; frame < numFrames; frame++)
+	{
+		ecs.UpdateSystems(systems, delta);
+		fewestShared = std::min(fewestShared, animationSystem.GetNumSharedPoses());
+
+		alone.Update(delta);
+		loneExact &= crowd[numCharacters].GetSkinningMatrices() == alone.GetSkinningMatrices();
+
+		for (uint32_t i = 0; i < numCharacters; i++)
+		{
+			walked[i] += ecs.GetComponent<AnimationComponent>(entities[i])->rootMotion;
+		}
+	}
+
+	// Rounding the clocks puts every character up to half a step off its own time, and a group straddling a rounding
+	// boundary splits in two
+	const float expected = speed * numFrames * delta;
+	float maxWalkError = 0.0f;
+	bool rootsPinned = true;
+	for (uint32_t i = 0; i < numCharacters; i++)
+	{
+		maxWalkError = std::max(maxWalkError, glm::length(walked[i] - glm::vec3(expected, 0.0f, 0.0f)));
+
+		const glm::mat4& root = crowd[i].GetModelMatrices()[0];
+		rootsPinned &= root[3].x == 0.0f && root[3].z == 0.0f;
+	}
+
+	const double cachedTime = MeasureAverageMicroseconds(iterations, [&]() { ecs.UpdateSystems(systems, delta); });
+	animationSystem.SetPoseCacheRate(0.0f);
+	const double uncachedTime = MeasureAverageMicroseconds(iterations, [&]() { ecs.UpdateSystems(systems, delta); });
+	LogBenchmarkResult("AnimationSystem update with pose cache (characters)", numCharacters, cachedTime, uncachedTime);
+
+	const bool ok = fewestShared + 2 * numGroups >= numCharacters && rootsPinned && loneExact && maxWalkError < speed * 0.5f / 60.0f + 1e-3f;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR,
+		"Pose cache: %u characters in %u groups, at least %u poses shared per update, root motion off %g after %g units, roots %s, loner %s",
+		numCharacters, numGroups, fewestShared, maxWalkError, expected, rootsPinned ? "pinned" : "MOVED", loneExact ? "exact" : "ROUNDED");
+
+	return ok;
+}
+
+/// Compresses a motion-capture-like clip (smooth rotations, a moving root, a still hand) and plays it back next to
+/// the original. The local pose may only be off by the compression tolerances plus quantization.
+static bool _BenchmarkAnimationCompression(const uint32_t numBones, const uint32_t numKeyframes, const size_t iterations)
+{
+	std::mt19937 rng(99);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	Skeleton skeleton;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		skeleton.AddBone("bone_" + std::to_string(i), static_cast<int32_t>(i) - 1, glm::mat4(1.0f));
+	}
+
+	// Per bone: an axis, a swing amplitude and frequency, and a fixed offset from the parent
+	std::vector<glm::vec3> axes(numBones), offsets(numBones);
+	std::vector<float> amplitudes(numBones), frequencies(numBones);
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		axes[i] = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)));
+		offsets[i] = glm::vec3(unit(rng), unit(rng) + 2.0f, unit(rng)) * 0.1f;
+		amplitudes[i] = i >= numBones * 3 / 4 ? 0.0f : 0.3f + 0.5f * fabsf(unit(rng)); // The last quarter holds still
+		frequencies[i] = 0.3f + 0.7f * fabsf(unit(rng)); // Around a walk cycle
+	}
+
+	Animation animation;
+	animation.keyframes.resize(numKeyframes);
+	for (uint32_t k = 0; k < numKeyframes; k++)
+	{
+		const float t = k / 30.0f;
+		Keyframe& keyframe = animation.keyframes[k];
+		keyframe.timestamp = t;
+		keyframe.pose.Resize(numBones);
+
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			const float angle = amplitudes[i] * sinf(6.2831853f * frequencies[i] * t + i);
+			keyframe.pose.rotations[i] = qt::Quaternion(cosf(angle * 0.5f), axes[i].x * sinf(angle * 0.5f), axes[i].y * sinf(angle * 0.5f), axes[i].z * sinf(angle * 0.5f));
+			keyframe.pose.translations[i] = offsets[i];
+		}
+
+		// The root walks forward and bobs
+		keyframe.pose.translations[0] = glm::vec3(0.0f, 1.0f + 0.05f * sinf(12.566f * t), 1.4f * t);
+	}
+	animation.duration = (numKeyframes - 1) / 30.0f;
+
+	AnimationCompressionSettings settings;
+	std::vector<uint8_t> data;
+	CompressedAnimation clip;
+	if (!CompressAnimation(animation, settings, data) || !clip.Parse(data.data(), data.size()))
+	{
+		DEBUG_LOG("Benchmark", LOG_ERROR, "Animation compression: failed to compress or parse the clip");
+		return false;
+	}
+
+	Animator original(&skeleton);
+	original.SetAnimation(&animation);
+	Animator compressed(&skeleton);
+	compressed.SetAnimation(&clip);
+
+	float maxRotationError = 0.0f, maxTranslationError = 0.0f;
+	for (uint32_t i = 0; i < 4 * numKeyframes; i++)
+	{
+		const float time = animation.duration * i / (4.0f * numKeyframes);
+		original.SetAnimationTime(time);
+		compressed.SetAnimationTime(time);
+
+		const Pose& a = original.GetLocalPose();
+		const Pose& b = compressed.GetLocalPose();
+		for (uint32_t bone = 0; bone < numBones; bone++)
+		{
+			// Angle of conjugate(a) * b from both its parts, since acos of w alone is too coarse in float
+			const qt::Quaternion difference = qt::Quaternion::Multiply(qt::Quaternion::Conjugate(a.rotations[bone]), b.rotations[bone]);
+			const float angle = 2.0f * atan2f(sqrtf(difference.x*difference.x + difference.y*difference.y + difference.z*difference.z), fabsf(difference.w));
+			maxRotationError = std::max(maxRotationError, angle);
+			maxTranslationError = std::max(maxTranslationError, glm::length(a.translations[bone] - b.translations[bone]));
+		}
+	}
+
+	// What the Animation holds: its keyframes, and the two arrays of each one's pose
+	const size_t rawSize = static_cast<size_t>(numKeyframes) * (sizeof(Keyframe) + numBones * (sizeof(glm::vec3) + sizeof(qt::Quaternion)));
+
+	const double compressedTime = MeasureAverageMicroseconds(iterations, [&]() { compressed.Update(1.0f / 60.0f); });
+	const double originalTime = MeasureAverageMicroseconds(iterations, [&]() { original.Update(1.0f / 60.0f); });
+	LogBenchmarkResult("Animator::Update, compressed (bones)", numBones, compressedTime, originalTime);
+
+	// On top of what key removal is allowed, quantization: half a step of each 15 bit smallest-three component, which
+	// the rebuilt largest one and the angle being twice the quaternion's take to under 7 steps; half a step of each
+	// 16 bit translation component over the root's range; and key times rounded to 1/65535 of the clip, which is off
+	// by however far a bone moves in half of that
+	const float keyTimeError = animation.duration / (2.0f * 65535.0f);
+	float maxAngularSpeed = 0.0f;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		maxAngularSpeed = std::max(maxAngularSpeed, amplitudes[i] * 6.2831853f * frequencies[i]);
+	}
+	const float rotationBound = settings.rotationTolerance + 7.0f * 0.70710678f / 32767.0f + maxAngularSpeed * keyTimeError;
+	const float translationBound = settings.translationTolerance + glm::length(glm::vec3(0.0f, 0.1f, 1.4f * animation.duration)) / (2.0f * 65535.0f)
+		+ glm::length(glm::vec3(0.0f, 0.05f * 12.566f, 1.4f)) * keyTimeError;
+
+	const bool ok = maxRotationError <= rotationBound && maxTranslationError <= translationBound && rawSize >= 5 * clip.GetSize();
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Animation compression: %zu bytes -> %zu (%.1fx), largest error %g rad (at most %g), %g units (at most %g)",
+		rawSize, clip.GetSize(), static_cast<double>(rawSize) / clip.GetSize(), maxRotationError, rotationBound, maxTranslationError, translationBound);
+
+	return ok;
+}
+
+static float _MaxPoseDifference(const Pose& a, const Pose& b)
+{
+	float difference = 0.0f;
+	for (uint32_t i = 0; i < a.GetNumBones(); i++)
+	{
+		const glm::vec3 t = a.translations[i] - b.translations[i];
+		const qt::Quaternion& p = a.rotations[i];
+		const qt::Quaternion& q = b.rotations[i];
+		difference = std::max(difference, std::max(fabsf(t.x), std::max(fabsf(t.y), fabsf(t.z))));
+		difference = std::max(difference, std::max(std::max(fabsf(p.x - q.x), fabsf(p.y - q.y)), std::max(fabsf(p.z - q.z), fabsf(p.w - q.w))));
+	}
+	return difference;
+}
+
+/// Times the pose blend kernels against their scalar versions, which are built on qt::Quaternion::NLerp, then
+/// evaluates a blend tree (a cross-fade under a masked additive layer) against the same blends done by hand.
+static bool _BenchmarkPoseBlending(const uint32_t numBones, const size_t iterations)
+{
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	const auto randomPose = [&](Pose& pose)
+	{
+		pose.Resize(numBones);
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			pose.translations[i] = glm::vec3(unit(rng), unit(rng), unit(rng));
+			pose.rotations[i] = qt::Quaternion(unit(rng), unit(rng), unit(rng), unit(rng));
+		}
+	};
+
+	Pose a, b, reference, result;
+	randomPose(a);
+	randomPose(b);
+	randomPose(reference);
+	randomPose(result);
+
+	std::vector<float> weights(numBones);
+	for (auto& i : weights)
+	{
+		i = (unit(rng) + 1.0f) * 0.5f;
+	}
+
+	bool matched = true;
+	const auto check = [&](const char* name, double time, double baselineTime)
+	{
+		LogBenchmarkResult(name, numBones, time, baselineTime);
+
+		const float difference = _MaxPoseDifference(reference, result);
+		if (difference > 1e-5f)
+		{
+			DEBUG_LOG("Benchmark", LOG_ERROR, "%s differs from the scalar kernel by %g", name, difference);
+			matched = false;
+		}
+	};
+
+	// Lerp: translations and rotations together, as a lerp node does them
+	const double scalarLerpTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		qt::LerpTranslationsScalar(a.translations.data(), b.translations.data(), weights.data(), 0, numBones, reference.translations.data());
+		qt::NLerpRotationsScalar(a.rotations.data(), b.rotations.data(), weights.data(), 0, numBones, reference.rotations.data());
+	});
+	LogBenchmarkResult("Pose lerp, scalar (bones)", numBones, scalarLerpTime, scalarLerpTime);
+
+#ifdef QT_SIMD_SSE
+	check("Pose lerp, SSE (bones)", MeasureAverageMicroseconds(iterations, [&]()
+	{
+		qt::LerpTranslationsSSE(a.translations.data(), b.translations.data(), weights.data(), 0, numBones, result.translations.data());
+		qt::NLerpRotationsSSE(a.rotations.data(), b.rotations.data(), weights.data(), 0, numBones, result.rotations.data());
+	}), scalarLerpTime);
+#endif
+
+#ifdef QT_SIMD_AVX2
+	check("Pose lerp, AVX2 (bones)", MeasureAverageMicroseconds(iterations, [&]()
+	{
+		qt::LerpTranslationsSSE(a.translations.data(), b.translations.data(), weights.data(), 0, numBones, result.translations.data());
+		qt::NLerpRotationsAVX2(a.rotations.data(), b.rotations.data(), weights.data(), 0, numBones, result.rotations.data());
+	}), scalarLerpTime);
+#endif
+
+	// Additive
+	const double scalarAddTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		qt::AddTranslationsScalar(a.translations.data(), b.translations.data(), weights.data(), 0, numBones, reference.translations.data());
+		qt::AddRotationsScalar(a.rotations.data(), b.rotations.data(), weights.data(), 0, numBones, reference.rotations.data());
+	});
+	LogBenchmarkResult("Pose additive, scalar (bones)", numBones, scalarAddTime, scalarAddTime);
+
+#ifdef QT_SIMD_SSE
+	check("Pose additive, SSE (bones)", MeasureAverageMicroseconds(iterations, [&]()
+	{
+		qt::AddTranslationsSSE(a.translations.data(), b.translations.data(), weights.data(), 0, numBones, result.translations.data());
+		qt::AddRotationsSSE(a.rotations.data(), b.rotations.data(), weights.data(), 0, numBones, result.rotations.data());
+	}), scalarAddTime);
+#endif
+
+	// Blend tree: walk and run cross-fading, with a waving arm added over one branch
+	Skeleton skeleton;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		skeleton.AddBone("bone_" + std::to_string(i), i == 0 ? -1 : static_cast<int32_t>(rng() % i), glm::mat4(1.0f));
+	}
+
+	Animation clips[3];
+	for (auto& clip : clips)
+	{
+		clip.keyframes.resize(20);
+		for (uint32_t k = 0; k < clip.keyframes.size(); k++)
+		{
+			clip.keyframes[k].timestamp = k / 30.0f;
+			randomPose(clip.keyframes[k].pose);
+		}
+		clip.duration = (clip.keyframes.size() - 1) / 30.0f;
+	}
+	ConvertToAdditive(clips[2], clips[2].keyframes[0].pose);
+
+	BoneMask mask;
+	BlendTree::MaskBranch(skeleton, 1, mask);
+
+	BlendTree tree(&skeleton);
+	const BlendNodeHandle walk = tree.AddClip(&clips[0]);
+	const BlendNodeHandle run = tree.AddClip(&clips[1], 1.5f);
+	const BlendNodeHandle wave = tree.AddClip(&clips[2]);
+	const BlendNodeHandle locomotion = tree.AddLerp(walk, run, 0.0f);
+	const BlendNodeHandle root = tree.AddAdditive(locomotion, wave, 0.7f, &mask);
+	tree.SetRoot(root);
+	tree.FadeWeight(locomotion, 1.0f, 0.25f);
+
+	Pose walkPose, runPose, wavePose, evaluated;
+	walkPose.Resize(numBones); runPose.Resize(numBones); wavePose.Resize(numBones); evaluated.Resize(numBones);
+
+	float maxTreeDifference = 0.0f;
+	for (uint32_t frame = 0; frame < 30; frame++)
+	{
+		tree.Update(1.0f / 60.0f);
+		tree.Evaluate(evaluated);
+
+		uint32_t cursors[3] = {};
+		SampleAnimation(clips[0], tree.GetClipTime(walk), cursors[0], walkPose);
+		SampleAnimation(clips[1], tree.GetClipTime(run), cursors[1], runPose);
+		SampleAnimation(clips[2], tree.GetClipTime(wave), cursors[2], wavePose);
+
+		const std::vector<float> fade(numBones, tree.GetWeight(locomotion));
+		std::vector<float> layer(numBones);
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			layer[i] = mask[i] * 0.7f;
+		}
+
+		qt::LerpTranslationsScalar(walkPose.translations.data(), runPose.translations.data(), fade.data(), 0, numBones, reference.translations.data());
+		qt::NLerpRotationsScalar(walkPose.rotations.data(), runPose.rotations.data(), fade.data(), 0, numBones, reference.rotations.data());
+		if (tree.GetWeight(locomotion) >= 1.0f)
+		{
+			reference.translations = runPose.translations;
+			reference.rotations = runPose.rotations;
+		}
+		qt::AddTranslationsScalar(reference.translations.data(), wavePose.translations.data(), layer.data(), 0, numBones, reference.translations.data());
+		qt::AddRotationsScalar(reference.rotations.data(), wavePose.rotations.data(), layer.data(), 0, numBones, reference.rotations.data());
+
+		maxTreeDifference = std::max(maxTreeDifference, _MaxPoseDifference(reference, evaluated));
+	}
+
+	// Mid-fade, so every node is evaluated: 3 clips and 2 blends
+	tree.SetWeight(locomotion, 0.5f);
+	const double treeTime = MeasureAverageMicroseconds(iterations, [&]() { tree.Evaluate(evaluated); });
+	DEBUG_LOG("Benchmark", LOG_INFO, "BlendTree::Evaluate: %.2f us for %u bones, 3 clips and 2 blend nodes (%.1f ns per bone per node)",
+		treeTime, numBones, treeTime * 1000.0 / (numBones * 5.0));
+
+	const bool ok = matched && maxTreeDifference < 1e-5f;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR, "Pose blending: blend tree differs from blending by hand by %g", maxTreeDifference);
+
+	return ok;
+}
+
+/// Skins a crowd sharing one mesh, each character with its own palette, with the scalar kernel, the SSE kernel, and
+/// the SSE kernel spread over the thread pool. Character 0 is also checked against summing every influence's
+/// transformed position by hand.
+static bool _BenchmarkSkinning(const uint32_t numCharacters, const uint32_t numVertices, const uint32_t numBones, const size_t iterations)
+{
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	std::vector<PerVertexData> vertices(numVertices);
+	for (auto& v : vertices)
+	{
+		v.position = glm::vec3(unit(rng), unit(rng) + 1.0f, unit(rng)) * 0.5f;
+		v.normal = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+
+		// One to four influences, like an exported character
+		const uint32_t numInfluences = 1 + rng() % 4;
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			v.bone_ids[j] = j < numInfluences ? static_cast<int>(rng() % numBones) : 0;
+			v.bone_weights[j] = j < numInfluences ? 0.1f + (unit(rng) + 1.0f) : 0.0f;
+		}
+	}
+
+	SkinningSource source;
+	source.Build(vertices.data(), numVertices);
+
+	std::vector<glm::mat4> palettes(static_cast<size_t>(numCharacters) * numBones);
+	for (auto& m : palettes)
+	{
+		qt::Quaternion rotation(1.0f + unit(rng) * 0.5f, unit(rng), unit(rng), unit(rng));
+		m = rotation.GetRotationTransformMat();
+		m[3] = glm::vec4(unit(rng), unit(rng), unit(rng), 1.0f);
+	}
+
+	const size_t numOutput = static_cast<size_t>(numCharacters) * numVertices;
+	std::vector<SkinnedPositionNormal> reference(numOutput), simd(numOutput), threaded(numOutput);
+
+	const auto queue = [&](CpuSkinner& skinner, std::vector<SkinnedPositionNormal>& out)
+	{
+		skinner.Clear();
+		for (uint32_t i = 0; i < numCharacters; i++)
+		{
+			skinner.Add(source, &palettes[static_cast<size_t>(i) * numBones], &out[static_cast<size_t>(i) * numVertices]);
+		}
+	};
+
+	ThreadPool pool;
+	CpuSkinner skinner;
+	const size_t totalVertices = numOutput;
+
+	queue(skinner, reference);
+	const double scalarTime = MeasureAverageMicroseconds(iterations, [&]() { skinner.Run(nullptr, false); });
+	LogBenchmarkResult("Skinning scalar, 1 thread", totalVertices, scalarTime, scalarTime);
+
+	queue(skinner, simd);
+	const double simdTime = MeasureAverageMicroseconds(iterations, [&]() { skinner.Run(nullptr, true); });
+	LogBenchmarkResult("Skinning SIMD, 1 thread", totalVertices, simdTime, scalarTime);
+
+	queue(skinner, threaded);
+	const double threadedTime = MeasureAverageMicroseconds(iterations, [&]() { skinner.Run(&pool, true); });
+	LogBenchmarkResult("Skinning SIMD, thread pool", totalVertices, threadedTime, scalarTime);
+
+	const auto unpackNormal = [](uint32_t packed, int component)
+	{
+		int value = (packed >> (component * 10)) & 0x3ff;
+		return value & 0x200 ? value - 0x400 : value;
+	};
+
+	float maxPositionDifference = 0.0f;
+	int maxNormalDifference = 0;
+	for (const auto* result : { &simd, &threaded })
+	{
+		for (size_t i = 0; i < numOutput; i++)
+		{
+			const SkinnedPositionNormal& a = reference[i];
+			const SkinnedPositionNormal& b = (*result)[i];
+
+			for (int j = 0; j < 3; j++)
+			{
+				maxPositionDifference = std::max(maxPositionDifference, fabsf(a.position[j] - b.position[j]));
+				maxNormalDifference = std::max(maxNormalDifference, abs(unpackNormal(a.normal, j) - unpackNormal(b.normal, j)));
+			}
+		}
+	}
+
+	float maxReferenceDifference = 0.0f;
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		glm::vec3 position(0.0f);
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			position += glm::vec3(palettes[source.boneIds[i * 4 + j]] * glm::vec4(source.positions[i], 1.0f)) * source.boneWeights[i * 4 + j];
+		}
+
+		maxReferenceDifference = std::max(maxReferenceDifference, glm::length(position - reference[i].position));
+	}
+
+	// Rounding to the nearest even and to the nearest away from zero can disagree by one step of the normal's 10 bits
+	const bool ok = maxPositionDifference < 1e-5f && maxNormalDifference <= 1 && maxReferenceDifference < 1e-5f;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR,
+		"CPU skinning: %u characters of %u vertices on %zu workers, SIMD off by %g (position) and %d (normal steps), scalar off the per-influence sum by %g",
+		numCharacters, numVertices, pool.GetNumThreads(), maxPositionDifference, maxNormalDifference, maxReferenceDifference);
+
+	return ok;
+}
+
+/// What core.vert's DUAL_QUATERNION variant does to a position: blend in the first bone's half, normalize, transform.
+static glm::vec3 _DualQuaternionSkinPoint(const qt::DualQuaternion* palette, const uint8_t* bones, const float* weights, const glm::vec3& point)
+{
+	const qt::Quaternion& first = palette[bones[0]].real;
+	glm::vec4 real(0.0f), dual(0.0f);
+
+	for (int i = 0; i < 4; i++)
+	{
+		const qt::DualQuaternion& dq = palette[bones[i]];
+		const float sameHalf = first.x * dq.real.x + first.y * dq.real.y + first.z * dq.real.z + first.w * dq.real.w;
+		const float weight = sameHalf < 0.0f ? -weights[i] : weights[i];
+
+		real += glm::vec4(dq.real.x, dq.real.y, dq.real.z, dq.real.w) * weight;
+		dual += glm::vec4(dq.dual.x, dq.dual.y, dq.dual.z, dq.dual.w) * weight;
+	}
+
+	const float magnitude = glm::length(real);
+	real /= magnitude;
+	dual /= magnitude;
+
+	const glm::vec3 r(real), d(dual);
+	const glm::vec3 translation = 2.0f * (real.w * d - dual.w * r + glm::cross(r, d));
+	const glm::vec3 rotated = point + 2.0f * glm::cross(r, glm::cross(r, point) + real.w * point);
+
+	return rotated + translation;
+}
+
+/// Converts a palette of rigid matrices with the scalar and SSE kernels, checks that the dual quaternions move points
+/// like the matrices do (including half turns, where the conversion changes case), and compares an elbow bent 50/50
+/// between two bones under both blends: matrices collapse it towards the axis, dual quaternions keep its radius.
+static bool _BenchmarkDualQuaternionPalette(const uint32_t numBones, const size_t iterations)
+{
+	std::mt19937 rng(13);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	std::vector<glm::mat4> palette(numBones);
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		qt::Quaternion rotation(unit(rng), unit(rng), unit(rng), unit(rng));
+		if (i % 16 == 1)
+		{
+			rotation = qt::Quaternion(0.0f, 1.0f, 0.0f, 0.0f); // Half turns, with w = 0
+		}
+		else if (i % 16 == 2)
+		{
+			rotation = qt::Quaternion(0.0f, 0.6f, 0.0f, -0.8f);
+		}
+
+		palette[i] = rotation.GetRotationTransformMat();
+		palette[i][3] = glm::vec4(unit(rng) * 2.0f, unit(rng) * 2.0f, unit(rng) * 2.0f, 1.0f);
+	}
+
+	std::vector<qt::DualQuaternion> reference(numBones), simd(numBones);
+
+	const double scalarTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		qt::RigidMatricesToDualQuaternionsScalar(palette.data(), 0, numBones, reference.data());
+	});
+	LogBenchmarkResult("Matrix to dual quat, scalar", numBones, scalarTime, scalarTime);
+
+	const double simdTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		qt::RigidMatricesToDualQuaternions(palette.data(), numBones, simd.data());
+	});
+	LogBenchmarkResult("Matrix to dual quat, SIMD", numBones, simdTime, scalarTime);
+
+	bool passed = memcmp(reference.data(), simd.data(), numBones * sizeof(qt::DualQuaternion)) == 0;
+	if (!passed)
+	{
+		DEBUG_LOG("Benchmark", LOG_ERROR, "Dual quaternion palette: SIMD conversion differs from the scalar kernel");
+	}
+
+	// One bone at a time, the dual quaternion has to land every point where the matrix does
+	float maxPointDifference = 0.0f;
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		const uint8_t bones[4] = { 0, 0, 0, 0 };
+		const float weights[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+		const glm::vec3 point(unit(rng), unit(rng), unit(rng));
+
+		const glm::vec3 expected = glm::vec3(palette[i] * glm::vec4(point, 1.0f));
+		maxPointDifference = std::max(maxPointDifference, glm::length(_DualQuaternionSkinPoint(&reference[i], bones, weights, point) - expected));
+	}
+
+	// Candy wrapper: a forearm twisted 160 degrees about its own axis against an untwisted upper arm
+	qt::Quaternion twist(cosf(glm::radians(80.0f)), sinf(glm::radians(80.0f)), 0.0f, 0.0f);
+	const glm::mat4 arm[2] = { glm::mat4(1.0f), twist.GetRotationTransformMat() };
+	qt::DualQuaternion armDQ[2];
+	qt::RigidMatricesToDualQuaternionsScalar(arm, 0, 2, armDQ);
+
+	const uint8_t elbowBones[4] = { 0, 1, 0, 0 };
+	const float elbowWeights[4] = { 0.5f, 0.5f, 0.0f, 0.0f };
+	const glm::vec3 skinPoint(0.0f, 1.0f, 0.0f); // Unit distance from the twist axis
+
+	const glm::mat4 linear = arm[0] * 0.5f + arm[1] * 0.5f;
+	const glm::vec3 linearPoint = glm::vec3(linear * glm::vec4(skinPoint, 1.0f));
+	const glm::vec3 dualPoint = _DualQuaternionSkinPoint(armDQ, elbowBones, elbowWeights, skinPoint);
+	const float linearRadius = sqrtf(linearPoint.y * linearPoint.y + linearPoint.z * linearPoint.z);
+	const float dualRadius = sqrtf(dualPoint.y * dualPoint.y + dualPoint.z * dualPoint.z);
+
+	const bool ok = passed && maxPointDifference < 1e-4f && fabsf(dualRadius - 1.0f) < 1e-4f;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR,
+		"Dual quaternion palette: %zu instead of %zu bytes per bone, points off the matrices by %g, twisted elbow keeps %.0f%% of its radius (matrices: %.0f%%)",
+		sizeof(qt::DualQuaternion), sizeof(glm::mat4), maxPointDifference, dualRadius * 100.0f, linearRadius * 100.0f);
+
+	return ok;
+}
+
+/// md5 stores unit quaternions as x y z with w <= 0; returns the orientation the importer will rebuild from those three.
+static qt::Quaternion _ToMD5Orientation(qt::Quaternion q, glm::vec3& xyz)
+{
+	if (q.w > 0.0f)
+	{
+		q = qt::Quaternion(-q.w, -q.x, -q.y, -q.z, false);
+	}
+	xyz = glm::vec3(q.x, q.y, q.z);
+	return qt::Quaternion(xyz.x, xyz.y, xyz.z);
+}
+
+/// Model space joints of one md5anim frame, composed the way md5 defines it.
+static void _ComposeMD5Joints(const std::vector<int32_t>& parents, const std::vector<glm::vec3>& localPositions,
+	const std::vector<qt::Quaternion>& localOrientations, std::vector<glm::vec3>& positions, std::vector<qt::Quaternion>& orientations)
+{
+	for (size_t i = 0; i < parents.size(); i++)
+	{
+		if (parents[i] < 0)
+		{
+			positions[i] = localPositions[i];
+			orientations[i] = localOrientations[i];
+			continue;
+		}
+
+		positions[i] = positions[parents[i]] + qt::Quaternion::RotatePoint(localPositions[i], orientations[parents[i]]);
+		orientations[i] = qt::Quaternion::Multiply(orientations[parents[i]], localOrientations[i]);
+		orientations[i].Normalize();
+	}
+}
+
+static bool _BenchmarkMD5Import(const uint32_t numJoints, const uint32_t numVertices, const uint32_t numFrames, const size_t iterations)
+{
+	std::mt19937 rng(48);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<uint32_t> anyJoint(0, numJoints - 1);
+	char line[256];
+
+	// A binary tree of joints, each with a random rotation and offset from its parent
+	std::vector<int32_t> parents(numJoints);
+	std::vector<glm::vec3> basePositions(numJoints), baseOrientationsXYZ(numJoints);
+	std::vector<qt::Quaternion> baseOrientations(numJoints);
+	for (uint32_t i = 0; i < numJoints; i++)
+	{
+		parents[i] = static_cast<int32_t>(i) - 1 < 0 ? -1 : static_cast<int32_t>((i - 1) / 2);
+		basePositions[i] = glm::vec3(unit(rng), unit(rng), unit(rng));
+		baseOrientations[i] = _ToMD5Orientation(qt::Quaternion(unit(rng), unit(rng), unit(rng), unit(rng)), baseOrientationsXYZ[i]);
+	}
+
+	std::vector<glm::vec3> bindPositions(numJoints);
+	std::vector<qt::Quaternion> bindOrientations(numJoints);
+	_ComposeMD5Joints(parents, basePositions, baseOrientations, bindPositions, bindOrientations);
+
+	std::string meshText = "MD5Version 10\ncommandline \"\"\n\nnumJoints " + std::to_string(numJoints) + "\nnumMeshes 1\n\njoints {\n";
+	for (uint32_t i = 0; i < numJoints; i++)
+	{
+		glm::vec3 xyz;
+		bindOrientations[i] = _ToMD5Orientation(bindOrientations[i], xyz);
+		snprintf(line, sizeof(line), "\t\"joint_%u\"\t%d ( %.9g %.9g %.9g ) ( %.9g %.9g %.9g )\t\t// joint_%d\n",
+			i, parents[i], bindPositions[i].x, bindPositions[i].y, bindPositions[i].z, xyz.x, xyz.y, xyz.z, parents[i]);
+		meshText += line;
+	}
+
+	// Every vertex hangs off two joints, with weight positions that agree on where it sits in the bind pose, as
+	// exporters write them; every three vertices make a triangle
+	std::vector<uint32_t> weightJoints(numVertices * 2);
+	std::vector<glm::vec3> weightPositions(numVertices * 2);
+	meshText += "}\n\nmesh {\n\tshader \"test\"\n\n\tnumverts " + std::to_string(numVertices) + "\n";
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		snprintf(line, sizeof(line), "\tvert %u ( %.9g %.9g ) %u 2\n", i, unit(rng) * 0.5f + 0.5f, unit(rng) * 0.5f + 0.5f, i * 2);
+		meshText += line;
+	}
+	meshText += "\n\tnumtris " + std::to_string(numVertices / 3) + "\n";
+	for (uint32_t i = 0; i < numVertices / 3; i++)
+	{
+		snprintf(line, sizeof(line), "\ttri %u %u %u %u\n", i, i * 3, i * 3 + 1, i * 3 + 2);
+		meshText += line;
+	}
+	meshText += "\n\tnumweights " + std::to_string(numVertices * 2) + "\n";
+	glm::vec3 bindPoint;
+	for (uint32_t i = 0; i < numVertices * 2; i++)
+	{
+		if (i % 2 == 0)
+		{
+			bindPoint = glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f;
+		}
+
+		weightJoints[i] = anyJoint(rng);
+		weightPositions[i] = qt::Quaternion::RotatePoint(bindPoint - bindPositions[weightJoints[i]], qt::Quaternion::Conjugate(bindOrientations[weightJoints[i]]));
+		snprintf(line, sizeof(line), "\tweight %u %u %.9g ( %.9g %.9g %.9g )\n",
+			i, weightJoints[i], i % 2 ? 0.25f : 0.75f, weightPositions[i].x, weightPositions[i].y, weightPositions[i].z);
+		meshText += line;
+	}
+	meshText += "}\n";
+
+	// Every joint animates all six components, frame 0 being the baseframe
+	std::vector<std::vector<glm::vec3>> framePositions(numFrames, basePositions), frameOrientationsXYZ(numFrames, baseOrientationsXYZ);
+	std::vector<std::vector<qt::Quaternion>> frameOrientations(numFrames, baseOrientations);
+	std::string animText = "MD5Version 10\ncommandline \"\"\n\nnumFrames " + std::to_string(numFrames) + "\nnumJoints " + std::to_string(numJoints)
+		+ "\nframeRate 30\nnumAnimatedComponents " + std::to_string(numJoints * 6) + "\n\nhierarchy {\n";
+	for (uint32_t i = 0; i < numJoints; i++)
+	{
+		snprintf(line, sizeof(line), "\t\"joint_%u\"\t%d 63 %u\n", i, parents[i], i * 6);
+		animText += line;
+	}
+	animText += "}\n\nbounds {\n";
+	for (uint32_t f = 0; f < numFrames; f++)
+	{
+		animText += "\t( -1 -1 -1 ) ( 1 1 1 )\n";
+	}
+	animText += "}\n\nbaseframe {\n";
+	for (uint32_t i = 0; i < numJoints; i++)
+	{
+		snprintf(line, sizeof(line), "\t( %.9g %.9g %.9g ) ( %.9g %.9g %.9g )\n", basePositions[i].x, basePositions[i].y, basePositions[i].z,
+			baseOrientationsXYZ[i].x, baseOrientationsXYZ[i].y, baseOrientationsXYZ[i].z);
+		animText += line;
+	}
+	animText += "}\n";
+	for (uint32_t f = 0; f < numFrames; f++)
+	{
+		animText += "\nframe " + std::to_string(f) + " {\n";
+		for (uint32_t i = 0; i < numJoints; i++)
+		{
+			if (f > 0)
+			{
+				framePositions[f][i] += glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.1f;
+				const qt::Quaternion swing(1.0f, unit(rng) * 0.2f, unit(rng) * 0.2f, unit(rng) * 0.2f);
+				frameOrientations[f][i] = _ToMD5Orientation(qt::Quaternion::Multiply(baseOrientations[i], swing), frameOrientationsXYZ[f][i]);
+			}
+
+			const glm::vec3& p = framePositions[f][i];
+			const glm::vec3& q = frameOrientationsXYZ[f][i];
+			snprintf(line, sizeof(line), "\t%.9g %.9g %.9g %.9g %.9g %.9g\n", p.x, p.y, p.z, q.x, q.y, q.z);
+			animText += line;
+		}
+		animText += "}\n";
+	}
+
+	const char* meshPath = "benchmark_roundtrip.md5mesh";
+	const char* animPath = "benchmark_roundtrip.md5anim";
+	{
+		std::ofstream meshFile(meshPath, std::ios::binary | std::ios::trunc);
+		meshFile << meshText;
+		std::ofstream animFile(animPath, std::ios::binary | std::ios::trunc);
+		animFile << animText;
+	}
+
+	std::vector<PerVertexData> vertices, cachedVertices;
+	Skeleton skeleton, cachedSkeleton;
+	Animation animation, cachedAnimation;
+	bool loaded = true;
+
+	const double meshImportTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		loaded &= ImportMD5Mesh(meshPath, vertices, DUPLICATE_VERTICES_TO_MATCH_INDEX_BUFFER_SIZE, &skeleton);
+	});
+	LogBenchmarkResult("md5mesh text import", numVertices, meshImportTime, meshImportTime);
+
+	loaded &= LoadMD5Mesh(meshPath, cachedVertices, DUPLICATE_VERTICES_TO_MATCH_INDEX_BUFFER_SIZE, &cachedSkeleton); // Writes the cache
+	const double meshCacheTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		loaded &= LoadMD5Mesh(meshPath, cachedVertices, DUPLICATE_VERTICES_TO_MATCH_INDEX_BUFFER_SIZE, &cachedSkeleton);
+	});
+	LogBenchmarkResult("md5mesh cache load", numVertices, meshCacheTime, meshImportTime);
+
+	const double animImportTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		loaded &= ImportMD5Anim(animPath, animation, &skeleton);
+	});
+	LogBenchmarkResult("md5anim text import", numFrames, animImportTime, animImportTime);
+
+	loaded &= LoadMD5Anim(animPath, cachedAnimation, &skeleton);
+	const double animCacheTime = MeasureAverageMicroseconds(iterations, [&]()
+	{
+		loaded &= LoadMD5Anim(animPath, cachedAnimation, &skeleton);
+	});
+	LogBenchmarkResult("md5anim cache load", numFrames, animCacheTime, animImportTime);
+
+	const std::string meshCachePath = GetMD5CachePath(GetMD5CacheKey(meshPath, MD5_CACHE_MESH, DUPLICATE_VERTICES_TO_MATCH_INDEX_BUFFER_SIZE), MD5_CACHE_MESH);
+	const std::string animCachePath = GetMD5CachePath(GetMD5CacheKey(animPath, MD5_CACHE_ANIM), MD5_CACHE_ANIM);
+	MappedFile meshCache, animCache;
+	const bool cached = meshCache.Open(meshCachePath) && animCache.Open(animCachePath);
+	const size_t meshCacheSize = meshCache.GetSize(), animCacheSize = animCache.GetSize();
+	meshCache.Close();
+	animCache.Close();
+
+	std::remove(meshPath);
+	std::remove(animPath);
+	std::remove(meshCachePath.c_str());
+	std::remove(animCachePath.c_str());
+
+	// The cache has to give back exactly what the text parse did
+	bool sameSkeleton = cachedSkeleton.GetNumBones() == skeleton.GetNumBones() && skeleton.GetNumBones() == numJoints;
+	for (uint32_t i = 0; sameSkeleton && i < numJoints; i++)
+	{
+		sameSkeleton = cachedSkeleton.GetName(i) == skeleton.GetName(i) && cachedSkeleton.GetParent(i) == skeleton.GetParent(i)
+			&& memcmp(&cachedSkeleton.GetInverseBindMatrix(i), &skeleton.GetInverseBindMatrix(i), sizeof(glm::mat4)) == 0;
+	}
+
+	bool sameAnimation = cachedAnimation.keyframes.size() == animation.keyframes.size() && cachedAnimation.duration == animation.duration;
+	for (size_t f = 0; sameAnimation && f < animation.keyframes.size(); f++)
+	{
+		sameAnimation = cachedAnimation.keyframes[f].timestamp == animation.keyframes[f].timestamp
+			&& _MaxPoseDifference(cachedAnimation.keyframes[f].pose, animation.keyframes[f].pose) == 0.0f;
+	}
+
+	const bool sameVertices = cachedVertices.size() == vertices.size() && vertices.size() == numVertices / 3 * 3
+		&& memcmp(cachedVertices.data(), vertices.data(), vertices.size() * sizeof(PerVertexData)) == 0;
+
+	// Skinned with the parsed clip, a frame halfway through has to put every vertex where md5 says it goes
+	Animator animator(&skeleton);
+	animator.SetAnimation(&animation);
+	animator.SetAnimationTime(animation.keyframes[numFrames / 2].timestamp);
+	const std::vector<glm::mat4>& palette = animator.GetSkinningMatrices();
+
+	std::vector<glm::vec3> jointPositions(numJoints);
+	std::vector<qt::Quaternion> jointOrientations(numJoints);
+	_ComposeMD5Joints(parents, framePositions[numFrames / 2], frameOrientations[numFrames / 2], jointPositions, jointOrientations);
+
+	float maxVertexDifference = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		glm::mat4 blended(0.0f);
+		for (int j = 0; j < 4; j++)
+		{
+			blended += palette[vertices[i].bone_ids[j]] * vertices[i].bone_weights[j];
+		}
+		const glm::vec3 skinned = glm::vec3(blended * glm::vec4(vertices[i].position, 1.0f));
+
+		glm::vec3 expected(0.0f);
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			const uint32_t weight = static_cast<uint32_t>(i) * 2 + j;
+			const uint32_t joint = weightJoints[weight];
+			expected += (jointPositions[joint] + qt::Quaternion::RotatePoint(weightPositions[weight], jointOrientations[joint])) * (j ? 0.25f : 0.75f);
+		}
+
+		maxVertexDifference = std::max(maxVertexDifference, glm::length(skinned - expected));
+	}
+
+	const bool matches = loaded && cached && sameSkeleton && sameAnimation && sameVertices;
+	const bool ok = matches && maxVertexDifference < 1e-3f;
+	DEBUG_LOG("Benchmark", ok ? LOG_INFO : LOG_ERROR,
+		"md5 import: %zu + %zu bytes of text, %zu + %zu bytes cached, cache %s, animated vertices off md5 by %g",
+		meshText.size(), animText.size(), meshCacheSize, animCacheSize, matches ? "matches the import" : "DIFFERS from the import", maxVertexDifference);
+
+	return ok;
+}
+
+int RunBenchmarks()
+{
+	bool passed = true;
+
+	passed &= _BenchmarkTransformBatch(1000, 1000);
+	passed &= _BenchmarkTransformBatch(10003, 100); // Odd count to cover the scalar tail
+	passed &= _BenchmarkTextureBake();
+
+	ThreadPool pool;
+	passed &= _BenchmarkLightBinning(1000, 200, pool);
+	passed &= _BenchmarkLightBinning(10000, 50, pool);
+
+	passed &= _BenchmarkMeshSimplify(64, 128, 5);
+	passed &= _BenchmarkVertexCache(64, 128, 20);
+
+	passed &= _BenchmarkOcclusionCulling(10000, 50);
+	passed &= _BenchmarkFrameGraph(1000);
+
+	passed &= _BenchmarkAnimator(64, 30, 200);
+	passed &= _BenchmarkKeyframeLookup(16, 20000, 2000);
+	passed &= _BenchmarkAnimationSystem(1000, 64, 20);
+	passed &= _BenchmarkAnimationLOD(1000, 64, 20);
+	passed &= _BenchmarkPoseCache(1000, 8, 64, 20);
+	passed &= _BenchmarkAnimationCompression(64, 121, 2000);
+	passed &= _BenchmarkPoseBlending(64, 20000);
+	passed &= _BenchmarkSkinning(100, 4000, 64, 20);
+	passed &= _BenchmarkDualQuaternionPalette(1003, 2000); // Odd count to cover the scalar tail
+	passed &= _BenchmarkMD5Import(64, 30000, 120, 5);
+
+	return passed ? 0 : 1;
+}
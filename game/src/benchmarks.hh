@@ -0,0 +1,6 @@
+#pragma once
+
+/// Headless micro-benchmarks and round-trip checks for the engine's hot paths. Needs no window or GL context.
+/// Enabled by defining _________CIRNOPRISM_RUN_BENCHMARKS in common.hh; main() then runs these instead of the game.
+/// Returns 0 if every benchmark's results matched its reference path.
+int RunBenchmarks();
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #define _________CIRNOPRISM_DEVELOPMENT_DEBUG
+//#define _________CIRNOPRISM_RUN_BENCHMARKS // Run the headless benchmarks in benchmarks.cc instead of the game
 
 #define LOG_INFO "INFO"
 #define LOG_FATAL "FATAL"
@@ -216,6 +216,7 @@ void ECS::UpdateSystems(ECSSystemList& systems, float delta)
 	for (uint32_t i = 0; i < systems.size(); i++)
 	{
 		const std::vector<uint32_t>& componentTypes = systems[i]->GetComponentTypes();
+		systems[i]->BeginUpdate(delta);
 
 		if (componentTypes.size() == 1)
 		{
@@ -232,6 +233,8 @@ void ECS::UpdateSystems(ECSSystemList& systems, float delta)
 		{
 			_UpdateSystemWithMultipleComponents(i, systems, delta, componentTypes, componentParam, componentArrays);
 		}
+
+		systems[i]->EndUpdate(delta);
 	}
 }
 
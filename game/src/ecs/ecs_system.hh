@@ -26,6 +26,20 @@ public:
 	{
 	}
 
+	virtual ~BaseECSSystem()
+	{
+	}
+
+	/// Called once per update before any component, and once after all of them. Systems that batch their work
+	/// (see AnimationSystem) collect components in UpdateComponents() and process them in EndUpdate().
+	virtual void BeginUpdate(float /*delta*/)
+	{
+	}
+
+	virtual void EndUpdate(float /*delta*/)
+	{
+	}
+
 	// Update components by default is empty. Override to implement functionality into system.
 	virtual void UpdateComponents(float delta, BaseECSComponent** components)
 	{
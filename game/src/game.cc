@@ -1,5 +1,8 @@
 #include "game.hh"
 
+#include <algorithm>
+#include <tuple>
+
 #define DR_WAV_IMPLEMENTATION
 #include "sound/dr_wav.h"
 
@@ -77,6 +80,12 @@ void Game::_InitGLFlags()
 //	glfwSwapInterval(0);
 }
 
+void Game::_InitStreamingBuffers()
+{
+	_frameData = new RingBuffer(4 * 1024 * 1024); // 4 MiB per frame in flight
+	_staticGeometry = new GeometryArena(VERTEX_LAYOUT_STATIC, 256 * 1024, 1024 * 1024);
+}
+
 void Game::_InitMatrices()
 {
 	_viewMatrix = glm::mat4(1.0f);
@@ -93,19 +102,13 @@ void Game::_InitMatrices()
 
 void Game::_InitShaders()
 {
-	_shaders.push_back(new Shader(
+	// Variants get compiled the first time they're used
+	_coreShaders = new ShaderVariants(
 		_GL_VERSION_MAJOR,
 		_GL_VERSION_MINOR,
 		"res/shaders/core.vert",
 		"res/shaders/core.frag"
-	));
-
-	_shaders.push_back(new Shader(
-		_GL_VERSION_MAJOR,
-		_GL_VERSION_MINOR,
-		"res/shaders/shadow.vert",
-		"res/shaders/shadow.frag"
-	));
+	);
 
 	_shaders.push_back(
 		new Shader(
@@ -115,6 +118,15 @@ void Game::_InitShaders()
 			"res/shaders/misc/normals.frag",
 			"res/shaders/misc/normals.geom"
 	));
+
+	_shaders.push_back(
+		new Shader(
+			_GL_VERSION_MAJOR,
+			_GL_VERSION_MINOR,
+			"res/shaders/framebuffer.vert",
+			"res/shaders/framebuffer.frag"
+	));
+	_shaders[POST_PROCESS]->Set1i(0, "screenTexture");
 }
 
 /// NOTE: Initialize shaders first.
@@ -129,14 +141,28 @@ void Game::_InitFramebuffers()
 		glm::vec3(0.0f, 4.0f, 4.0f)
 	));*/
 	
+	_shadowMap = new CascadedShadowMap(); // 4 cascades of 1024x1024, the same texel count as a single 2048x2048 map
 
-	
+	// Scene render targets are transient, owned by the frame graph and sized to the window every frame
+	_frameGraph = new FrameGraph();
+	glCreateVertexArrays(1, &_fullscreenVAO);
 }
 
+void Game::_InitThreadPool()
+{
+	_threadPool = new ThreadPool();
+}
+
+/// Textures start out as a placeholder and are filled in by _textureLoader over the next few frames.
 void Game::_InitTextures()
 {
-	_textures.push_back(new Texture("res/textures/models/mouse.jpg", GL_TEXTURE_2D));
-	_textures.push_back(new Texture("res/textures/models/matoshi_emissive.png", GL_TEXTURE_2D));
+	_textureLoader = new TextureLoader(*_threadPool);
+
+	_textures.push_back(new Texture(GL_TEXTURE_2D));
+	_textureLoader->Load(_textures.back(), "res/textures/models/mouse.jpg");
+
+	_textures.push_back(new Texture(GL_TEXTURE_2D));
+	_textureLoader->Load(_textures.back(), "res/textures/models/matoshi_emissive.png");
 }
 
 void Game::_InitMaterials()
@@ -290,6 +316,9 @@ void Game::_InitModels()
 		meshes2
 	));
 
+	// The ground plane hides whatever is below it
+	_models[1]->SetOccluder(true);
+
 	for (auto*& i : meshes)
 	{
 		delete i;
@@ -298,34 +327,64 @@ void Game::_InitModels()
 	{
 		delete i;
 	}
+
+	for (auto* m : _models)
+	{
+		m->UploadToArena(*_staticGeometry);
+		_modelDrawOrder.push_back(m);
+	}
+
+	// Group models by material and textures, so each group is one multi-draw
+	std::sort(_modelDrawOrder.begin(), _modelDrawOrder.end(), [](const Model* a, const Model* b)
+	{
+		return std::make_tuple(a->GetMaterial(), a->GetDiffuseTexture(), a->GetSpecularTexture())
+			< std::make_tuple(b->GetMaterial(), b->GetDiffuseTexture(), b->GetSpecularTexture());
+	});
 }
 
 void Game::_InitPointLights()
 {
 	_pointLights.push_back(new PointLight(glm::vec3(0.0f, 4.0f, 4.0), glm::vec3(1.0f, 1.0f, 1.0f)));
+
+	// A grid of small colored lights over the floor, only affordable through clustered lighting
+	for (int z = 0; z < 12; z++)
+	{
+		for (int x = 0; x < 12; x++)
+		{
+			const glm::vec3 position(-22.0f + 4.0f * x, -0.5f, -22.0f + 4.0f * z);
+			const glm::vec3 color(0.5f + 0.5f * sinf(0.7f * x), 0.5f + 0.5f * sinf(0.9f * z + 2.0f), 0.5f + 0.5f * sinf(0.5f * (x + z) + 4.0f));
+			_pointLights.push_back(new PointLight(position, color, 1.0f, 1.0f, 0.7f, 1.8f));
+		}
+	}
 }
 
 void Game::_InitLights()
 {
 	_InitPointLights();
 
-	
+	_clusteredLighting = new ClusteredLighting();
 }
 
-void Game::_InitUniforms()
+void Game::_InitOcclusionCulling()
 {
-	_shaders[SHADER_CORE_PROGRAM]->Use();
-	
-	// Send matrices to shader files
-	// *Model matrix is handled by an individual Mesh class
-	_shaders[SHADER_CORE_PROGRAM]->SetMat4fv(_viewMatrix, "viewMatrix");
-	_shaders[SHADER_CORE_PROGRAM]->SetMat4fv(_projectionMatrix, "projectionMatrix");
+	_occlusionCuller = new OcclusionCuller(256, 128);
+}
 
-	for (auto* pl : _pointLights)
+void Game::_InitUniforms()
+{
+	for (Shader* shader : { _coreShaders->Get(SHADER_FEATURE_SHADOWED), _coreShaders->Get(SHADER_FEATURE_SHADOWED | SHADER_FEATURE_INSTANCED) })
 	{
-		pl->SendToShader(*(_shaders[SHADER_CORE_PROGRAM]));
+		// Send matrices to shader files
+		// *Model matrix is handled by an individual Mesh class
+		shader->SetMat4fv(_viewMatrix, "viewMatrix");
+		shader->SetMat4fv(_projectionMatrix, "projectionMatrix");
+
+		// Only the first light goes through the single pointLight uniform, the rest are clustered
+		if (!_pointLights.empty())
+		{
+			_pointLights[0]->SendToShader(*shader);
+		}
 	}
-	
 }
 
 void Game::_InitECS()
@@ -346,7 +405,43 @@ void Game::_InitECS()
 	
 //	_entity = _ecs.MakeEntity(transformComponent, movementControl);
 
+	// One per animated mesh. Models own their meshes, so the animators stay put for as long as the entities live.
+	// The first animated mesh of a model also carries its transform, for root motion to move the whole model by
+	for (auto* model : _models)
+	{
+		const std::vector<Mesh*>& meshes = model->GetMeshes();
+		bool movesModel = true;
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			if (meshes[i]->GetSkeleton().GetNumBones() > 0)
+			{
+				AnimationComponent animation;
+				animation.animator = &meshes[i]->GetAnimator();
+
+				EntityHandle entity;
+				if (movesModel)
+				{
+					TransformComponent transform;
+					transform.transform = model->GetTransform();
+					entity = _ecs.MakeEntity(transform, animation);
+					movesModel = false;
+				}
+				else
+				{
+					entity = _ecs.MakeEntity(animation);
+				}
+				_animatedMeshes.push_back({ meshes[i], model, i, entity });
+			}
+		}
+	}
+
 	// Systems
+
+	_animationSystem = new AnimationSystem(*_threadPool);
+	_ecsMainSystems.AddSystem(*_animationSystem);
+	_rootMotionSystem = new RootMotionSystem();
+	_ecsMainSystems.AddSystem(*_rootMotionSystem);
+	_cpuSkinner = new CpuSkinner();
 	
 //	MovementControlSystem movementControlSystem;
 //	_ecsMainSystems.AddSystem(movementControlSystem);
@@ -397,7 +492,6 @@ void Game::_UpdateCameraUniforms()
 }*/
 
 /// Updates VP matrices as rendered from Camera and sends their data to a shader.
-/// Call Shader::Use() first.
 void Game::_UpdateUniforms(Shader* shader)
 {
 	// Update view matrix
@@ -407,9 +501,10 @@ void Game::_UpdateUniforms(Shader* shader)
 
 	// TODO: THIS IS REALTIME LIGHTING LOCATION UPDATING.
 	// In the future, only send this information if a light pos has been updated
-	for (auto* pl : _pointLights)
+	// Only the first light goes through the single pointLight uniform, the rest are clustered
+	if (!_pointLights.empty())
 	{
-		pl->SendToShader(*shader);
+		_pointLights[0]->SendToShader(*shader);
 	}
 
 	// Update framebuffer...
@@ -427,6 +522,265 @@ void Game::_UpdateUniforms(Shader* shader)
 	shader->SetMat4fv(_projectionMatrix, "projectionMatrix");
 }
 
+/// Mesh LODs are picked for the main camera, in every pass.
+LODSelector Game::_GetLODSelector()
+{
+	LODSelector selector;
+	selector.cameraPosition = _camera.GetPosition();
+	selector.pixelsPerUnit = _framebufferHeight / (2.0f * tanf(glm::radians(_fov) * 0.5f));
+	selector.maxErrorPixels = r_meshlods ? r_loderror : 0.0f;
+
+	return selector;
+}
+
+/// Rasterizes the occluder models for the main camera. Call _UpdateUniforms() first.
+void Game::_UpdateOcclusionCulling()
+{
+	if (!r_occlusionculling)
+	{
+		return;
+	}
+
+	_occlusionCuller->BeginFrame(_projectionMatrix * _viewMatrix);
+
+	for (auto* m : _models)
+	{
+		if (m->IsOccluder())
+		{
+			m->AddOccluders(*_occlusionCuller);
+		}
+	}
+
+	_occlusionCuller->EndOccluders();
+}
+
+/// Draws every model through the static geometry arena: one glMultiDrawElementsIndirect per material/texture set.
+/// Uses the core shader variants with the given features, plus INSTANCED for the arena.
+/// Meshes hidden behind the occluders are skipped; call _UpdateOcclusionCulling() first.
+void Game::_DrawModelsIndirect(uint32_t features)
+{
+	Shader* instanced = _coreShaders->Get(features | SHADER_FEATURE_INSTANCED);
+	const LODSelector lodSelector = _GetLODSelector();
+	const Model* previous = nullptr;
+
+	for (auto* m : _modelDrawOrder)
+	{
+		const bool sameState = previous
+			&& previous->GetMaterial() == m->GetMaterial()
+			&& previous->GetDiffuseTexture() == m->GetDiffuseTexture()
+			&& previous->GetSpecularTexture() == m->GetSpecularTexture();
+
+		if (!sameState)
+		{
+			_staticGeometry->Flush(instanced, *_frameData);
+			m->Bind(*_coreShaders, features);
+		}
+
+		m->SubmitVisible(*_coreShaders, features, *_staticGeometry, lodSelector, [this](const qt::AABB& bounds)
+		{
+			return !r_occlusionculling || _occlusionCuller->IsVisible(bounds);
+		});
+		previous = m;
+	}
+
+	_staticGeometry->Flush(instanced, *_frameData);
+}
+
+/// Bins the point lights into clusters for this frame's camera and streams them to the GPU.
+/// Call _UpdateUniforms() first.
+void Game::_UpdateClusteredLighting()
+{
+	if (!r_clusteredlighting)
+	{
+		return;
+	}
+
+	const float aspectRatio = static_cast<float>(_framebufferWidth) / std::max(_framebufferHeight, 1);
+	_clusteredLighting->Update(_pointLights, _viewMatrix, glm::radians(_fov), aspectRatio, _nearPlane, _lightingDistance, *_threadPool);
+	_clusteredLighting->Upload(*_frameData);
+}
+
+/// Hands the animation system every animated mesh's bounds and the camera, so distant characters update less often
+/// and off-screen ones not at all. Uses the last frame's matrices, which the camera can't have moved far from.
+void Game::_UpdateAnimationLODs()
+{
+	if (!r_animationlods)
+	{
+		_animationSystem->ClearView();
+		return;
+	}
+
+	for (auto& i : _animatedMeshes)
+	{
+		_ecs.GetComponent<AnimationComponent>(i.entity)->worldBounds = i.model->GetMeshWorldBounds(i.meshIndex);
+	}
+
+	_animationSystem->SetView(_projectionMatrix * _viewMatrix, _camera.GetPosition(), glm::radians(_fov));
+}
+
+/// Hands every entity carrying a TransformComponent its model's current transform, so root motion starts from
+/// wherever anything else moved or scaled the model to since the last update. Call before the ECS update.
+void Game::_PrepareRootMotion()
+{
+	for (auto& i : _animatedMeshes)
+	{
+		TransformComponent* transform = _ecs.GetComponent<TransformComponent>(i.entity);
+		if (transform)
+		{
+			transform->transform = i.model->GetTransform();
+		}
+	}
+}
+
+/// Moves every model by the root motion its entity's TransformComponent picked up this update. Call after the
+/// ECS update.
+void Game::_ApplyRootMotion()
+{
+	for (auto& i : _animatedMeshes)
+	{
+		const TransformComponent* transform = _ecs.GetComponent<TransformComponent>(i.entity);
+		if (transform && transform->transform.GetPosition() != i.model->GetTransform().GetPosition())
+		{
+			i.model->SetPosition(transform->transform.GetPosition());
+		}
+	}
+}
+
+/// Streams this frame's skinning: every animator's matrices in one storage buffer for the SKINNED shader variants,
+/// or with r_cpuskinning, every animated mesh skinned in one batch on the thread pool, straight into the ring buffer.
+/// Call after the animation system has run, once the frame's ring buffer region is ready.
+void Game::_UpdateSkinning()
+{
+	if (_animatedMeshes.empty())
+	{
+		return;
+	}
+
+	const uint32_t numPaletteMatrices = _animationSystem->GetNumPaletteMatrices();
+	const glm::mat4* palette = _animationSystem->GetPalette();
+
+	if (numPaletteMatrices == 0)
+	{
+		for (auto& i : _animatedMeshes)
+		{
+			i.mesh->ClearSkinning();
+		}
+		return;
+	}
+
+	if (r_cpuskinning)
+	{
+		_cpuSkinner->Clear();
+
+		for (auto& i : _animatedMeshes)
+		{
+			Mesh* mesh = i.mesh;
+			const RingBufferAllocation allocation = _frameData->Allocate(mesh->GetNumVertices() * sizeof(SkinnedPositionNormal));
+			if (!allocation.IsValid())
+			{
+				DEBUG_LOG("Game", LOG_WARN, "Out of frame data space for %u skinned vertices", mesh->GetNumVertices());
+				mesh->ClearSkinning();
+				continue;
+			}
+
+			const uint32_t paletteOffset = _ecs.GetComponent<AnimationComponent>(i.entity)->paletteOffset;
+			_cpuSkinner->Add(mesh->GetSkinningSource(), palette + paletteOffset, static_cast<SkinnedPositionNormal*>(allocation.data));
+			mesh->SetSkinnedVertices(allocation.buffer, allocation.offset);
+		}
+
+		_cpuSkinner->Run(_threadPool);
+		return;
+	}
+
+	// Dual quaternions are half the size of the matrices they're converted from
+	const size_t boneSize = r_dualquatskinning ? sizeof(qt::DualQuaternion) : sizeof(glm::mat4);
+	const RingBufferAllocation allocation = _frameData->Allocate(numPaletteMatrices * boneSize, RingBuffer::GetStorageAlignment());
+	if (!allocation.IsValid())
+	{
+		DEBUG_LOG("Game", LOG_WARN, "Out of frame data space for %u bones", numPaletteMatrices);
+		for (auto& i : _animatedMeshes)
+		{
+			i.mesh->ClearSkinning();
+		}
+		return;
+	}
+
+	if (r_dualquatskinning)
+	{
+		qt::RigidMatricesToDualQuaternions(palette, numPaletteMatrices, static_cast<qt::DualQuaternion*>(allocation.data));
+	}
+	else
+	{
+		memcpy(allocation.data, palette, numPaletteMatrices * sizeof(glm::mat4));
+	}
+	_frameData->BindRange(GL_SHADER_STORAGE_BUFFER, SKINNING_PALETTE_BINDING, allocation);
+
+	for (auto& i : _animatedMeshes)
+	{
+		i.mesh->SetPaletteOffset(_ecs.GetComponent<AnimationComponent>(i.entity)->paletteOffset, r_dualquatskinning);
+	}
+}
+
+/// The features of the variant GPU skinned meshes draw with this frame, on top of the pass's own.
+uint32_t Game::_GetSkinningFeatures() const
+{
+	return SHADER_FEATURE_SKINNED | (r_dualquatskinning ? SHADER_FEATURE_DUAL_QUATERNION : 0);
+}
+
+/// Call _UpdateClusteredLighting() first.
+void Game::_SendClusteredLighting(Shader* shader)
+{
+	if (!r_clusteredlighting)
+	{
+		shader->Set1i(0, "useClusteredLighting");
+		return;
+	}
+
+	_clusteredLighting->SendToShader(*shader, _framebufferWidth, _framebufferHeight);
+}
+
+/// Fits the shadow cascades to the camera, then renders every caster that can reach each cascade into its layer.
+void Game::_RenderShadowMaps()
+{
+	const float aspectRatio = static_cast<float>(_framebufferWidth) / std::max(_framebufferHeight, 1);
+	_shadowMap->Update(_camera.GetViewMatrix(), glm::radians(_fov), aspectRatio, _nearPlane, _shadowDistance, _sunDirection);
+
+	const uint32_t features = SHADER_FEATURE_DEPTH_ONLY;
+	Shader* shader = _coreShaders->Get(features);
+	Shader* instanced = _coreShaders->Get(features | SHADER_FEATURE_INSTANCED);
+	Shader* skinned = _coreShaders->Get(features | _GetSkinningFeatures());
+	const LODSelector lodSelector = _GetLODSelector();
+
+	// Casters in front of a cascade's near plane get flattened onto it instead of clipped
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+
+	for (uint32_t i = 0; i < _shadowMap->GetNumCascades(); i++)
+	{
+		_shadowMap->BeginCascade(i);
+		shader->SetMat4fv(_shadowMap->GetLightMatrix(i), "lightProjection");
+		instanced->SetMat4fv(_shadowMap->GetLightMatrix(i), "lightProjection");
+		skinned->SetMat4fv(_shadowMap->GetLightMatrix(i), "lightProjection");
+
+		for (auto* m : _models)
+		{
+			m->SubmitVisible(*_coreShaders, features, *_staticGeometry, lodSelector, [this, i](const qt::AABB& bounds)
+			{
+				return _shadowMap->IsCasterVisible(i, bounds);
+			});
+		}
+
+		_staticGeometry->Flush(instanced, *_frameData);
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_DEPTH_CLAMP);
+
+	_shadowMap->End();
+	shader->UnUse();
+}
+
 void Game::_UpdateDeltaTime()
 {
 	_currentTime = static_cast<float>(glfwGetTime());
@@ -518,6 +872,41 @@ void Game::_UpdateInputKeyboard()
 		r_vertnormals ^= 1;
 	}
 
+	if (glfwGetKey(_window, GLFW_KEY_F8) == GLFW_PRESS)
+	{
+		r_clusteredlighting ^= 1;
+	}
+
+	if (glfwGetKey(_window, GLFW_KEY_F7) == GLFW_PRESS)
+	{
+		r_meshlods ^= 1;
+	}
+
+	if (glfwGetKey(_window, GLFW_KEY_F6) == GLFW_PRESS)
+	{
+		r_occlusionculling ^= 1;
+	}
+
+	if (glfwGetKey(_window, GLFW_KEY_F5) == GLFW_PRESS)
+	{
+		r_cpuskinning ^= 1;
+	}
+
+	if (glfwGetKey(_window, GLFW_KEY_F4) == GLFW_PRESS)
+	{
+		r_dualquatskinning ^= 1;
+	}
+
+	if (glfwGetKey(_window, GLFW_KEY_F10) == GLFW_PRESS)
+	{
+		r_animationlods ^= 1;
+	}
+
+	if (glfwGetKey(_window, GLFW_KEY_F11) == GLFW_PRESS)
+	{
+		r_posecache ^= 1;
+	}
+
 }
 
 void Game::_UpdateInput(GLFWwindow* window)
@@ -671,6 +1060,16 @@ Game::Game(
 	_camera(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f))
 {
 	_window = nullptr;
+	_threadPool = nullptr;
+	_textureLoader = nullptr;
+	_frameData = nullptr;
+	_staticGeometry = nullptr;
+	_occlusionCuller = nullptr;
+	_frameGraph = nullptr;
+	_animationSystem = nullptr;
+	_rootMotionSystem = nullptr;
+	_cpuSkinner = nullptr;
+	_fullscreenVAO = 0;
 	_framebufferWidth = _WINDOW_WIDTH;
 	_framebufferHeight = _WINDOW_HEIGHT;
 
@@ -682,6 +1081,10 @@ Game::Game(
 	_nearPlane = 0.1f;
 	_farPlane = 10000000.0f;
 
+	_sunDirection = glm::normalize(glm::vec3(0.0f, -1.0f, -1.0f));
+	_shadowDistance = 100.0f;
+	_lightingDistance = 300.0f;
+
 	_deltaTime = 0.0f;
 	_currentTime = 0.0f;
 	_previousTime = 0.0f;
@@ -701,6 +1104,8 @@ Game::Game(
 	_InitWindow(title, true);
 	_InitGLEW();
 	_InitGLFlags();
+	_InitThreadPool();
+	_InitStreamingBuffers();
 	_InitMatrices();
 	_InitShaders(); // Framebuffers must be after shaders.
 	_InitFramebuffers();
@@ -709,6 +1114,7 @@ Game::Game(
 	_InitMaterials();
 	_InitModels();
 	_InitLights(); // Init lights first, THEN send to uniforms!
+	_InitOcclusionCulling();
 	_InitUniforms(); // This activates shaders and sends values to core, should be called near the end
 
 	_InitECS();
@@ -720,9 +1126,25 @@ Game::Game(
 
 Game::~Game()
 {
+	delete _textureLoader; // Waits for its decode jobs, so the pool must still be running
+	delete _animationSystem;
+	delete _rootMotionSystem;
+	delete _cpuSkinner;
+	delete _threadPool;
+
+	delete _clusteredLighting;
+	delete _occlusionCuller;
+	delete _shadowMap;
+	delete _frameGraph;
+	glDeleteVertexArrays(1, &_fullscreenVAO);
+	delete _staticGeometry;
+	delete _frameData; // Unmaps the buffer, so the context must still be alive
+
 	glfwDestroyWindow(_window);
 	glfwTerminate();
 
+	delete _coreShaders;
+
 	for (size_t i = 0; i < _shaders.size(); i++)
 		delete _shaders[i];
 
@@ -770,7 +1192,15 @@ void Game::Update()
 
 	glfwPollEvents();
 
+	_textureLoader->Update(); // Upload textures that finished decoding, within a per-frame budget
+
 	_UpdateDeltaTime();
+	_UpdateAnimationLODs();
+	_animationSystem->SetPoseCacheRate(r_posecache ? _POSE_CACHE_RATE : 0.0f);
+	_PrepareRootMotion();
+	_ecs.UpdateSystems(_ecsMainSystems, _deltaTime);
+	_ApplyRootMotion();
+
 	// Update input
 	if (currentTime - _lastTime >= (1.0f / 30.0f))
 	{	
@@ -782,186 +1212,141 @@ void Game::Update()
 
 void Game::_TestFunction()
 {
-	glGenFramebuffers(1, &_shadowMapFBO);
-
-	glGenTextures(1, &_shadowMapID);
-	glBindTexture(GL_TEXTURE_2D, _shadowMapID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, _shadowMapWidth, _shadowMapHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	float clampColor[] = { 1.0, 1.0, 1.0, 1.0 };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, clampColor);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, _shadowMapFBO);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _shadowMapID, 0);
-		glDrawBuffer(GL_NONE);
-		glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	// Light matrices orthographic projection
-	glm::mat4 orthogonalProjection = glm::ortho(-35.0f, 35.0f, -35.0f, 35.0f, 0.1f, 75.0f);
-	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f, 8.0f, 8.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	_lightProjection = orthogonalProjection * lightView;
-
-	// Init uniforms (move later)
-	_shaders[1]->SetMat4fv(_lightProjection, "lightProjection");
-
-/**	POST PROCESSING, USE LATER
-
-	float rectangleVertices[] =
-	{
-		// Coords		// TexCoords
-		1.0f, -1.0f, 1.0f, 0.0f,
-		-1.0f, -1.0f, 0.0f, 0.0f,
-		-1.0f, 1.0f, 0.0f, 1.0f,
-
-		1.0f, 1.0f, 1.0f, 1.0f,
-		1.0f, -1.0f, 1.0f, 0.0f,
-		-1.0f, 1.0f, 0.0f, 1.0f
-	};
-
-	glGenVertexArrays(1, &rectVAO);
-	glGenBuffers(1, &rectVBO);
-	glBindVertexArray(rectVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, rectVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(rectangleVertices), &rectangleVertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-
-
-	// frame buffer object
-	glGenFramebuffers(1, &FBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-
-	// frame buffer texture
-	glGenTextures(1, &framebufferTexture);
-	glBindTexture(GL_TEXTURE_2D, framebufferTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _WINDOW_WIDTH, _WINDOW_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebufferTexture, 0);
-
-	// render buffer object
-	glGenRenderbuffers(1, &RBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, RBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, _WINDOW_WIDTH, _WINDOW_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO);
-
-	auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-	if (fboStatus != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "Framebuffer error: " << fboStatus << "\n";
-	// 36054: Not all framebuffer attachment points are framebuffer-attachment-complete.
-	//			At least one attachment point with renderbuffer or texture attached has its attached object
-	// 			-	No longer in existence
-	// 			-	Has an attached image with width or height = 0
-	// 			-	Color attachment point has a non-color-renderable image attached
-	// 			-	Depth attachment point has a non-depth-renderable image attached
-	// 			-	Stencil attachment point has a non-stencil-renderable image attached
-	// 36057: Not all attached images have same width & height
-	// 36055: No images are attached to framebuffer
-	// 36061: Combination of internal formats of attached images violates an implementation-dependent set of restrictions
-
-
-
-	_shaders.push_back(new Shader(_GL_VERSION_MAJOR, _GL_VERSION_MINOR, "shaders/framebuffer.vert", "shaders/framebuffer.frag"));
-
-	_shaders[1]->Use();
-	_shaders[1]->Set1i(1, "screenTexture");**/
 }
 
 void Game::Render()
 {
-//	glEnable(GL_DEPTH_TEST);
-//	glViewport(0, 0, _shadowMapWidth, _shadowMapHeight);
-//	glBindFramebuffer(GL_FRAMEBUFFER, _shadowMapFBO);
-//		glClear(GL_DEPTH_BUFFER_BIT);
-//		for (auto& x : _models)
-//			x->Draw(_shaders[1]); // Draw into shadow shader!
-//	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-
+	_frameData->BeginFrame();
+	_UpdateSkinning(); // Before any pass, since both the shadow and the scene passes draw the animated meshes
 
+	_BuildFrameGraph();
+	if (_frameGraph->Compile())
+	{
+		_frameGraph->Execute();
+	}
 
-	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	// End draw, start cleanup
+	_frameData->EndFrame();
+	glfwSwapBuffers(_window);
+	glFlush();
 
-	// Reset viewport
-	glViewport(0, 0, _framebufferWidth, _framebufferHeight); /// Should be removed later
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			glEnable(GL_DEPTH_TEST);
+	glBindVertexArray(0);
+	glUseProgram(0);
+	glActiveTexture(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_TEXTURE_2D, 0);
+}
 
-	_shaders[SHADER_CORE_PROGRAM]->Use();
+/// Declares this frame's passes. The scene is drawn into transient textures and copied to the screen by the post-process pass.
+void Game::_BuildFrameGraph()
+{
+	const uint32_t width = std::max(_framebufferWidth, 1);
+	const uint32_t height = std::max(_framebufferHeight, 1);
 
+	_frameGraph->Reset();
 
-	_UpdateUniforms(_shaders[SHADER_CORE_PROGRAM]); // Update matrices related to drawing from the camera -- this is done before drawing models for obvious reasons
+	const FrameGraphResource backbuffer = _frameGraph->ImportBackbuffer("Backbuffer", width, height);
+	const FrameGraphResource shadowMap = _frameGraph->ImportTexture("Shadow map", _shadowMap->GetDepthArrayID(),
+		{ _shadowMap->GetResolution(), _shadowMap->GetResolution(), GL_DEPTH_COMPONENT32F });
+	const FrameGraphResource sceneColor = _frameGraph->CreateTexture("Scene color", { width, height, GL_RGBA8 });
+	const FrameGraphResource sceneDepth = _frameGraph->CreateTexture("Scene depth", { width, height, GL_DEPTH24_STENCIL8 });
 
+	const FrameGraphPass shadowPass = _frameGraph->AddPass("Shadow maps", [this](const FrameGraph&)
+	{
+		_RenderShadowMaps();
+	});
+	_frameGraph->Write(shadowPass, shadowMap);
 
-	_materials[MAT1]->SendToShader(*(_shaders[SHADER_CORE_PROGRAM]));
+	const FrameGraphPass scenePass = _frameGraph->AddPass("Scene", [this](const FrameGraph&)
+	{
+		_RenderScene();
+	});
+	_frameGraph->Read(scenePass, shadowMap);
+	_frameGraph->Write(scenePass, sceneColor, true);
+	_frameGraph->Write(scenePass, sceneDepth, true);
+	_frameGraph->SetClearColor(scenePass, glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
 
+	if (r_vertnormals)
+	{
+		const FrameGraphPass normalsPass = _frameGraph->AddPass("Debug normals", [this](const FrameGraph&)
+		{
+			_RenderDebugNormals();
+		});
+		_frameGraph->Read(normalsPass, sceneColor);
+		_frameGraph->Read(normalsPass, sceneDepth);
+		_frameGraph->Write(normalsPass, sceneColor);
+		_frameGraph->Write(normalsPass, sceneDepth);
+	}
 
+	const FrameGraphPass postPass = _frameGraph->AddPass("Post process", [this, sceneColor](const FrameGraph& graph)
+	{
+		_RenderPostProcess(graph.GetTexture(sceneColor));
+	});
+	_frameGraph->Read(postPass, sceneColor);
+	_frameGraph->Write(postPass, backbuffer);
+}
 
+/// Draws every model with the core shaders. The frame graph has bound and cleared the target.
+void Game::_RenderScene()
+{
+	glEnable(GL_DEPTH_TEST);
 
-	
+	// The core pass draws arena meshes with the INSTANCED variant, GPU skinned meshes with the SKINNED one and the rest with the
+	// plain one, so all of them get the frame uniforms
+	const uint32_t coreFeatures = SHADER_FEATURE_SHADOWED;
+	Shader* coreShaders[] = {
+		_coreShaders->Get(coreFeatures),
+		_coreShaders->Get(coreFeatures | SHADER_FEATURE_INSTANCED),
+		_coreShaders->Get(coreFeatures | _GetSkinningFeatures())
+	};
 
-	_shaders[SHADER_CORE_PROGRAM]->SetMat4fv(_lightProjection, "lightProjection");
-	glActiveTexture(GL_TEXTURE0 + 2);
-	glBindTexture(GL_TEXTURE_2D, _shadowMapID);
-//d	std::cout << "shadowMapID: " << shadowMapID << "\n";
-	_shaders[SHADER_CORE_PROGRAM]->Set1i(2, "shadowMap");
+	for (Shader* shader : coreShaders)
+	{
+		_UpdateUniforms(shader); // Update matrices related to drawing from the camera -- this is done before drawing models for obvious reasons
+	}
 
+	_UpdateClusteredLighting(); // Needs this frame's view matrix from _UpdateUniforms()
+	_UpdateOcclusionCulling();
 
+	for (Shader* shader : coreShaders)
+	{
+		_SendClusteredLighting(shader);
+		_materials[MAT1]->SendToShader(*shader);
+		_shadowMap->SendToShader(*shader, 2);
+	}
 
 	_textures[TEX_ROCK32]->Bind(0);
 	_textures[TEX_ROCK32_SPEC]->Bind(1);
 
-//	glCullFace(GL_FRONT);
-	for (auto& m : _models)
-		m->Draw(_shaders[SHADER_CORE_PROGRAM]); // Draw into core shader!
-//	glCullFace(GL_BACK);
-//	for (auto& m : _models)
-//		m->Draw(_shaders[SHADER_CORE_PROGRAM]); // Draw into core shader!
-
-
-	
+	_DrawModelsIndirect(coreFeatures); // Draw into core shader!
 
-	_shaders[SHADER_CORE_PROGRAM]->UnUse();
-
-//			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-//			_shaders[1]->Use();
-//			glBindVertexArray(rectVAO);
-//			glDisable(GL_DEPTH_TEST); // Make sure the post-processing rectangle doesn't fill the depth test
-//			glBindTexture(GL_TEXTURE_2D, framebufferTexture);
-//				glDisable(GL_CULL_FACE);
-//			glDrawArrays(GL_TRIANGLES, 0, 6);
-//				glEnable(GL_CULL_FACE);
-
-	if (r_vertnormals)
-	{
-		_shaders[DEBUG_NORMALS]->Use();
-		_UpdateUniforms(_shaders[DEBUG_NORMALS]);
-		for (auto& m : _models)
-			m->Draw(_shaders[DEBUG_NORMALS]);
+	coreShaders[0]->UnUse();
+}
 
-		_shaders[DEBUG_NORMALS]->UnUse();
-	}
+void Game::_RenderDebugNormals()
+{
+	_shaders[DEBUG_NORMALS]->Use();
+	_UpdateUniforms(_shaders[DEBUG_NORMALS]);
+	for (auto& m : _models)
+		m->Draw(_shaders[DEBUG_NORMALS]);
 
+	_shaders[DEBUG_NORMALS]->UnUse();
+}
 
+/// Copies the scene to the screen with a single fullscreen triangle.
+void Game::_RenderPostProcess(GLuint sceneColor)
+{
+	glDisable(GL_DEPTH_TEST); // Make sure the post-processing triangle doesn't fill the depth test
+	glDisable(GL_CULL_FACE);
 
-	// End draw, start cleanup
-	glfwSwapBuffers(_window);
-	glFlush();
+	_shaders[POST_PROCESS]->Use();
+	glBindTextureUnit(0, sceneColor);
+	glBindVertexArray(_fullscreenVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
 
-	glBindVertexArray(0);
-	glUseProgram(0);
-	glActiveTexture(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindFramebuffer(GL_TEXTURE_2D, 0);
+	glEnable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+	_shaders[POST_PROCESS]->UnUse();
 }
 
 
@@ -15,7 +15,7 @@
 
 #define _DEBUG 1
 
-enum ShaderEnum { SHADER_CORE_PROGRAM = 0, SHADOW, DEBUG_NORMALS };
+enum ShaderEnum { DEBUG_NORMALS = 0, POST_PROCESS };
 enum TextureEnum { TEX_ROCK32 = 0, TEX_ROCK32_SPEC };
 enum MaterialEnum { MAT1 = 0 };
 
@@ -56,6 +56,31 @@ public:
 	}
 };
 
+/// Moves entities by their clip's root motion. Transform applies its position after its rotation, so the model-space
+/// step only needs scaling to come out in the direction the entity faces. Run after the AnimationSystem.
+class RootMotionSystem : public BaseECSSystem
+{
+private:
+
+public:
+	RootMotionSystem() : BaseECSSystem()
+	{
+		AddComponentType(TransformComponent::ID);
+		AddComponentType(AnimationComponent::ID);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		TransformComponent* transform = (TransformComponent*)components[0];
+		AnimationComponent* animation = (AnimationComponent*)components[1];
+
+		if (animation->rootMotion != glm::vec3(0.0f))
+		{
+			transform->transform.SetPosition(transform->transform.GetPosition() + animation->rootMotion * transform->transform.GetScale());
+		}
+	}
+};
+
 enum SOUND_EVENT
 {
 	ZERO,
@@ -148,12 +173,15 @@ private:
 
 	// Cvars
 	bool r_vertnormals = false;
-
-	// TODO: Framebuffer testing, remove later!
-//	unsigned int FBO, framebufferTexture, RBO, rectVAO, rectVBO;
-	unsigned int _shadowMapFBO, _shadowMapID;
-	unsigned int _shadowMapWidth = 1024, _shadowMapHeight = 1024;
-	glm::mat4 _lightProjection;
+	bool r_clusteredlighting = true;
+	bool r_meshlods = true;
+	float r_loderror = 1.0f; /// Largest simplification error a mesh LOD may show, in pixels
+	bool r_occlusionculling = true;
+	bool r_cpuskinning = false; /// Skin animated meshes on the thread pool instead of in the vertex shader
+	bool r_dualquatskinning = false; /// Upload palettes as dual quaternions and blend them as such in the vertex shader
+	bool r_animationlods = true; /// Update small characters less often and freeze off-screen ones
+	bool r_posecache = true; /// Animators playing the same clip in step share one evaluation
+	const float _POSE_CACHE_RATE = 60.0f; /// Samples per second animators sharing a pose are rounded to when r_posecache is on
 
 	// Matrices
 	glm::mat4 _viewMatrix;
@@ -169,16 +197,46 @@ private:
 	// Game elements
 	Camera _camera;
 
-	std::vector<Shader*> _shaders;
+	ShaderVariants* _coreShaders; /// core.vert/core.frag, also used for the shadow pass as the DEPTH_ONLY variant
+	std::vector<Shader*> _shaders; /// Standalone programs, indexed by ShaderEnum
 	std::vector<Texture*> _textures;
 	std::vector<Material*> _materials;
 	std::vector<Model*> _models;
 	std::vector<PointLight*> _pointLights;
 	
 	std::vector<Framebuffer*> _framebuffers;
+	FrameGraph* _frameGraph; /// Rebuilt every frame by _BuildFrameGraph(), keeps its render targets between frames
+	GLuint _fullscreenVAO; /// Empty, fullscreen passes make their triangle from gl_VertexID
+
+	CascadedShadowMap* _shadowMap;
+	glm::vec3 _sunDirection; /// Direction the shadow-casting light shines in
+	float _shadowDistance; /// Shadows are only rendered this far in front of the camera
+
+	ClusteredLighting* _clusteredLighting; /// Bins _pointLights into view-space clusters every frame
+	float _lightingDistance; /// Point lights are only shaded this far in front of the camera
+
+	OcclusionCuller* _occlusionCuller; /// Software depth buffer of the occluder models, tested against before drawing
+
+	ThreadPool* _threadPool; /// Shared by every system that farms work out to other cores
+	TextureLoader* _textureLoader;
+
+	RingBuffer* _frameData; /// Per-frame streaming data (instance matrices, bone palettes, ...), rewritten every frame
+	GeometryArena* _staticGeometry; /// Shared vertex/index buffers for every static mesh, drawn with indirect multi-draws
+	std::vector<Model*> _modelDrawOrder; /// _models sorted so models sharing a material and textures are adjacent
 
 	ECS _ecs;
 	ECSSystemList _ecsMainSystems;
+	AnimationSystem* _animationSystem; /// Advances every skinned mesh's animator each frame, on the thread pool
+	RootMotionSystem* _rootMotionSystem; /// Moves entities with a TransformComponent by their clip's root motion
+	CpuSkinner* _cpuSkinner; /// Skins every animated mesh in one batch when r_cpuskinning is on
+	struct _AnimatedMesh
+	{
+		Mesh* mesh;
+		Model* model; /// Owns mesh, as its meshIndex-th
+		size_t meshIndex;
+		EntityHandle entity; /// Holds the mesh's AnimationComponent, and for the model's first animated mesh its TransformComponent
+	};
+	std::vector<_AnimatedMesh> _animatedMeshes;
 	ECSSystemList _ecsRenderingPipeline;
 
 	InputControl _ic_x;
@@ -192,6 +250,8 @@ private:
 	/// DO NOT CALL InitGlew() BEFORE glfwMakeContextCurrent(...)
 	void _InitGLEW();
 	void _InitGLFlags();
+	void _InitStreamingBuffers();
+	void _InitThreadPool();
 	void _InitMatrices();
 	void _InitShaders();
 	void _InitFramebuffers();
@@ -200,12 +260,28 @@ private:
 	void _InitModels();
 	void _InitPointLights();
 	void _InitLights();
+	void _InitOcclusionCulling();
 	void _InitUniforms();
 	
 	void _InitECS();
 
 
 	void _UpdateUniforms(Shader* shader);
+	LODSelector _GetLODSelector();
+	void _UpdateOcclusionCulling();
+	void _DrawModelsIndirect(uint32_t features);
+	void _RenderShadowMaps();
+	void _UpdateClusteredLighting();
+	void _SendClusteredLighting(Shader* shader);
+	void _UpdateAnimationLODs();
+	void _PrepareRootMotion();
+	void _ApplyRootMotion();
+	void _UpdateSkinning();
+	uint32_t _GetSkinningFeatures() const;
+	void _BuildFrameGraph();
+	void _RenderScene();
+	void _RenderDebugNormals();
+	void _RenderPostProcess(GLuint sceneColor);
 //	void _UpdateCameraUniforms();
 
 	void _UpdateDeltaTime();
@@ -30,12 +30,22 @@
 #include "renderer/primitives.hh"
 #include "renderer/mesh.hh"
 #include "renderer/shader.hh"
+#include "renderer/shader_variants.hh"
 #include "renderer/texture.hh"
+#include "renderer/texture_loader.hh"
 #include "renderer/material.hh"
 #include "renderer/model.hh"
 #include "renderer/light.hh"
+#include "renderer/clustered_lighting.hh"
+#include "renderer/occlusion_culler.hh"
+#include "renderer/frame_graph.hh"
+#include "renderer/animation_system.hh"
+#include "renderer/skinning.hh"
 #include "renderer/framebuffer.hh"
+#include "renderer/cascaded_shadow_map.hh"
 #include "renderer/camera.hh"
+#include "renderer/ring_buffer.hh"
+#include "renderer/geometry_arena.hh"
 
 
 /// Cirnoprism numerical 16-bit flags
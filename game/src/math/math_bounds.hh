@@ -0,0 +1,91 @@
+#pragma once
+
+#include <math.h>
+#include <float.h>
+
+#include <glm.hpp>
+
+namespace qt
+{
+	/// Axis-aligned bounding box. A default-constructed box is empty (min > max) until a point is added.
+	struct AABB
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+
+		AABB() : min(FLT_MAX), max(-FLT_MAX) {}
+		AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+		inline void Expand(const glm::vec3& point)
+		{
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+
+		inline bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+		inline glm::vec3 GetCenter() const { return (min + max) * 0.5f; }
+		inline glm::vec3 GetExtents() const { return (max - min) * 0.5f; }
+
+		/// Bounds of this box after an affine transform. Transforms the center and sums the absolute
+		/// contribution of each axis to the extents (Arvo), instead of transforming all eight corners.
+		AABB Transformed(const glm::mat4& m) const
+		{
+			const glm::vec3 center = GetCenter();
+			const glm::vec3 extents = GetExtents();
+
+			glm::vec3 newCenter(m[3].x, m[3].y, m[3].z);
+			glm::vec3 newExtents(0.0f);
+			for (int column = 0; column < 3; column++)
+			{
+				for (int row = 0; row < 3; row++)
+				{
+					newCenter[row] += m[column][row] * center[column];
+					newExtents[row] += fabsf(m[column][row]) * extents[column];
+				}
+			}
+
+			return AABB(newCenter - newExtents, newCenter + newExtents);
+		}
+	};
+
+	/// The clip volume of a view-projection matrix as six planes facing inwards (Gribb & Hartmann), for culling
+	/// bounding volumes in world space.
+	struct Frustum
+	{
+		glm::vec4 planes[6]; // Normal in xyz, unit length; a point p is inside a plane if dot(normal, p) + w >= 0
+
+		Frustum() {}
+
+		explicit Frustum(const glm::mat4& viewProjection)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (int side = 0; side < 2; side++)
+				{
+					// Row 3 plus or minus row axis, with GL's -w <= z <= w
+					glm::vec4& plane = planes[axis * 2 + side];
+					for (int column = 0; column < 4; column++)
+					{
+						const float sign = side ? -1.0f : 1.0f;
+						plane[column] = viewProjection[column][3] + sign * viewProjection[column][axis];
+					}
+
+					plane /= sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+				}
+			}
+		}
+
+		/// False only if the sphere is entirely behind one of the planes, so spheres just outside a corner still pass.
+		inline bool IntersectsSphere(const glm::vec3& center, float radius) const
+		{
+			for (int i = 0; i < 6; i++)
+			{
+				if (planes[i].x * center.x + planes[i].y * center.y + planes[i].z * center.z + planes[i].w < -radius)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+}
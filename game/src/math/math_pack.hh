@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string.h>
+#include <math.h>
+
+#include "common.hh"
+
+namespace qt
+{
+	/// Converts a float to an IEEE 754 half float, rounding to nearest. Overflows become infinity.
+	static inline uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const uint32_t sign = (bits >> 16) & 0x8000;
+		const uint32_t floatExponent = (bits >> 23) & 0xff;
+		const int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+		uint32_t mantissa = bits & 0x007fffff;
+
+		if (floatExponent == 0xff)
+		{
+			return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x0200 : 0)); // Infinity or NaN
+		}
+		if (exponent >= 0x1f)
+		{
+			return static_cast<uint16_t>(sign | 0x7c00);
+		}
+		if (exponent <= 0)
+		{
+			// Subnormal half, or too small to represent at all
+			if (exponent < -10)
+			{
+				return static_cast<uint16_t>(sign);
+			}
+
+			mantissa |= 0x00800000;
+			const uint32_t shift = static_cast<uint32_t>(14 - exponent);
+			uint32_t half = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1)
+			{
+				half++;
+			}
+
+			return static_cast<uint16_t>(sign | half);
+		}
+
+		uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+		if (mantissa & 0x00001000)
+		{
+			half++; // A carry into the exponent is still the correctly rounded result
+		}
+
+		return static_cast<uint16_t>(half);
+	}
+
+	/// Converts an IEEE 754 half float back to a float. Exact.
+	static inline float HalfToFloat(uint16_t half)
+	{
+		const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1f;
+		uint32_t mantissa = half & 0x03ff;
+		uint32_t bits;
+
+		if (exponent == 0)
+		{
+			if (mantissa == 0)
+			{
+				bits = sign;
+			}
+			else
+			{
+				// Subnormal, renormalize
+				exponent = 127 - 15 + 1;
+				while (!(mantissa & 0x0400))
+				{
+					mantissa <<= 1;
+					exponent--;
+				}
+				bits = sign | (exponent << 23) | ((mantissa & 0x03ff) << 13);
+			}
+		}
+		else if (exponent == 0x1f)
+		{
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else
+		{
+			bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	/// Maps [0, 1] to [0, 255].
+	static inline uint8_t PackUnorm8(float value)
+	{
+		value = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+		return static_cast<uint8_t>(value * 255.0f + 0.5f);
+	}
+
+	/// Maps [-1, 1] to a signed integer with the given number of bits.
+	static inline int32_t PackSnorm(float value, uint32_t bits)
+	{
+		const float scale = static_cast<float>((1 << (bits - 1)) - 1);
+		value = (value < -1.0f) ? -1.0f : ((value > 1.0f) ? 1.0f : value);
+		return static_cast<int32_t>(roundf(value * scale));
+	}
+
+	/// Packs a signed normalized vector into the GL_INT_2_10_10_10_REV layout: x in the lowest 10 bits, then y, z, and w in the top 2.
+	static inline uint32_t PackSnorm1010102(float x, float y, float z, float w = 0.0f)
+	{
+		return (static_cast<uint32_t>(PackSnorm(x, 10)) & 0x3ff)
+			| ((static_cast<uint32_t>(PackSnorm(y, 10)) & 0x3ff) << 10)
+			| ((static_cast<uint32_t>(PackSnorm(z, 10)) & 0x3ff) << 20)
+			| ((static_cast<uint32_t>(PackSnorm(w, 2)) & 0x3) << 30);
+	}
+}
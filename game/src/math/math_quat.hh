@@ -241,4 +241,13 @@ namespace qt
 			return result;
 		}
 	};
-}
\ No newline at end of file
+
+	/// Rigid transform as a rotation (real) and half the translation times the rotation (dual). Blends without the
+	/// volume loss of blended matrices, and takes half the space of a mat4; laid out x, y, z, w per part, as the
+	/// shaders read it.
+	struct DualQuaternion
+	{
+		Quaternion real;
+		Quaternion dual;
+	};
+}
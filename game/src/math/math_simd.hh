@@ -0,0 +1,659 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include <glm.hpp>
+
+#include "math/math_quat.hh"
+
+// Instruction set selection happens at compile time.
+// MSVC only defines __AVX2__ with /arch:AVX2, and SSE2 is always available on x64.
+#if defined(__AVX2__)
+	#define QT_SIMD_AVX2 1
+	#define QT_SIMD_SSE 1
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define QT_SIMD_SSE 1
+	#include <emmintrin.h>
+#endif
+
+namespace qt
+{
+	/// Structure-of-arrays storage for a batch of translation/rotation/scale transforms.
+	/// Rotations are unit quaternions. Every stream has the same length.
+	struct TransformSoA
+	{
+		std::vector<float> px, py, pz;
+		std::vector<float> qx, qy, qz, qw;
+		std::vector<float> sx, sy, sz;
+
+		void Resize(size_t count)
+		{
+			px.resize(count); py.resize(count); pz.resize(count);
+			qx.resize(count); qy.resize(count); qz.resize(count); qw.resize(count);
+			sx.resize(count, 1.0f); sy.resize(count, 1.0f); sz.resize(count, 1.0f);
+		}
+
+		inline size_t size() const { return px.size(); }
+
+		void Set(size_t i, const glm::vec3& position, const Quaternion& rotation, const glm::vec3& scale)
+		{
+			px[i] = position.x; py[i] = position.y; pz[i] = position.z;
+			qx[i] = rotation.x; qy[i] = rotation.y; qz[i] = rotation.z; qw[i] = rotation.w;
+			sx[i] = scale.x; sy[i] = scale.y; sz[i] = scale.z;
+		}
+
+		/// Same convention as Transform: rotate by XYZ euler angles (degrees) around origin, then translate by position - origin.
+		/// T(o) * R * T(p - o) * S is stored as the equivalent T(o + R(p - o)) * R * S.
+		void SetFromEuler(size_t i, const glm::vec3& position, const glm::vec3& origin, const glm::vec3& rotationDegrees, const glm::vec3& scale)
+		{
+			const glm::vec3 half = rotationDegrees * (0.5f * 0.0174532925f);
+			const Quaternion rx(cosf(half.x), sinf(half.x), 0.0f, 0.0f, false);
+			const Quaternion ry(cosf(half.y), 0.0f, sinf(half.y), 0.0f, false);
+			const Quaternion rz(cosf(half.z), 0.0f, 0.0f, sinf(half.z), false);
+			const Quaternion rotation = Quaternion::Multiply(Quaternion::Multiply(rx, ry), rz);
+
+			Set(i, origin + Quaternion::RotatePoint(position - origin, rotation), rotation, scale);
+		}
+	};
+
+	/// Scalar reference kernel. Writes glm-style column-major T * R * S matrices for transforms [begin, end).
+	static inline void ComposeTransformsScalar(const TransformSoA& in, size_t begin, size_t end, glm::mat4* out)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const float x = in.qx[i], y = in.qy[i], z = in.qz[i], w = in.qw[i];
+			const float x2 = x + x, y2 = y + y, z2 = z + z;
+			const float xx = x * x2, yy = y * y2, zz = z * z2;
+			const float xy = x * y2, xz = x * z2, yz = y * z2;
+			const float wx = w * x2, wy = w * y2, wz = w * z2;
+
+			float* m = &out[i][0][0];
+			m[0] = (1.0f - (yy + zz)) * in.sx[i];
+			m[1] = (xy + wz) * in.sx[i];
+			m[2] = (xz - wy) * in.sx[i];
+			m[3] = 0.0f;
+
+			m[4] = (xy - wz) * in.sy[i];
+			m[5] = (1.0f - (xx + zz)) * in.sy[i];
+			m[6] = (yz + wx) * in.sy[i];
+			m[7] = 0.0f;
+
+			m[8] = (xz + wy) * in.sz[i];
+			m[9] = (yz - wx) * in.sz[i];
+			m[10] = (1.0f - (xx + yy)) * in.sz[i];
+			m[11] = 0.0f;
+
+			m[12] = in.px[i];
+			m[13] = in.py[i];
+			m[14] = in.pz[i];
+			m[15] = 1.0f;
+		}
+	}
+
+#ifdef QT_SIMD_SSE
+	/// Transposes four lanes of (a, b, c, d) into four column vectors and writes column `column` of out[0..3].
+	static inline void _StoreColumnsSSE(__m128 a, __m128 b, __m128 c, __m128 d, glm::mat4* out, size_t column)
+	{
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+		_mm_storeu_ps(&out[0][0][0] + 4 * column, a);
+		_mm_storeu_ps(&out[1][0][0] + 4 * column, b);
+		_mm_storeu_ps(&out[2][0][0] + 4 * column, c);
+		_mm_storeu_ps(&out[3][0][0] + 4 * column, d);
+	}
+
+	/// Four transforms per iteration. Tail elements fall back to the scalar kernel.
+	static inline void ComposeTransformsSSE(const TransformSoA& in, size_t begin, size_t end, glm::mat4* out)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 zero = _mm_setzero_ps();
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const __m128 x = _mm_loadu_ps(&in.qx[i]);
+			const __m128 y = _mm_loadu_ps(&in.qy[i]);
+			const __m128 z = _mm_loadu_ps(&in.qz[i]);
+			const __m128 w = _mm_loadu_ps(&in.qw[i]);
+
+			const __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+			const __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+			const __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+			const __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+			const __m128 sx = _mm_loadu_ps(&in.sx[i]);
+			const __m128 sy = _mm_loadu_ps(&in.sy[i]);
+			const __m128 sz = _mm_loadu_ps(&in.sz[i]);
+
+			_StoreColumnsSSE(
+				_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+				_mm_mul_ps(_mm_add_ps(xy, wz), sx),
+				_mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+				zero, out + i, 0);
+
+			_StoreColumnsSSE(
+				_mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+				_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+				_mm_mul_ps(_mm_add_ps(yz, wx), sy),
+				zero, out + i, 1);
+
+			_StoreColumnsSSE(
+				_mm_mul_ps(_mm_add_ps(xz, wy), sz),
+				_mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+				_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+				zero, out + i, 2);
+
+			_StoreColumnsSSE(
+				_mm_loadu_ps(&in.px[i]),
+				_mm_loadu_ps(&in.py[i]),
+				_mm_loadu_ps(&in.pz[i]),
+				one, out + i, 3);
+		}
+
+		ComposeTransformsScalar(in, i, end, out);
+	}
+#endif
+
+#ifdef QT_SIMD_AVX2
+	/// Splits eight lanes into two groups of four and writes column `column` of out[0..7].
+	static inline void _StoreColumnsAVX(__m256 a, __m256 b, __m256 c, __m256 d, glm::mat4* out, size_t column)
+	{
+		_StoreColumnsSSE(_mm256_castps256_ps128(a), _mm256_castps256_ps128(b), _mm256_castps256_ps128(c), _mm256_castps256_ps128(d), out, column);
+		_StoreColumnsSSE(_mm256_extractf128_ps(a, 1), _mm256_extractf128_ps(b, 1), _mm256_extractf128_ps(c, 1), _mm256_extractf128_ps(d, 1), out + 4, column);
+	}
+
+	/// Eight transforms per iteration. Tail elements fall back to the SSE kernel.
+	static inline void ComposeTransformsAVX2(const TransformSoA& in, size_t begin, size_t end, glm::mat4* out)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 zero = _mm256_setzero_ps();
+
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			const __m256 x = _mm256_loadu_ps(&in.qx[i]);
+			const __m256 y = _mm256_loadu_ps(&in.qy[i]);
+			const __m256 z = _mm256_loadu_ps(&in.qz[i]);
+			const __m256 w = _mm256_loadu_ps(&in.qw[i]);
+
+			const __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+			const __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+			const __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+			const __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+			const __m256 sx = _mm256_loadu_ps(&in.sx[i]);
+			const __m256 sy = _mm256_loadu_ps(&in.sy[i]);
+			const __m256 sz = _mm256_loadu_ps(&in.sz[i]);
+
+			_StoreColumnsAVX(
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+				_mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+				_mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+				zero, out + i, 0);
+
+			_StoreColumnsAVX(
+				_mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+				_mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+				zero, out + i, 1);
+
+			_StoreColumnsAVX(
+				_mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+				_mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+				zero, out + i, 2);
+
+			_StoreColumnsAVX(
+				_mm256_loadu_ps(&in.px[i]),
+				_mm256_loadu_ps(&in.py[i]),
+				_mm256_loadu_ps(&in.pz[i]),
+				one, out + i, 3);
+		}
+
+		ComposeTransformsSSE(in, i, end, out);
+	}
+#endif
+
+	/// Builds one T * R * S model matrix per transform in the batch, using the widest kernel available.
+	/// out must have room for in.size() matrices.
+	static inline void ComposeTransforms(const TransformSoA& in, glm::mat4* out)
+	{
+#if defined(QT_SIMD_AVX2)
+		ComposeTransformsAVX2(in, 0, in.size(), out);
+#elif defined(QT_SIMD_SSE)
+		ComposeTransformsSSE(in, 0, in.size(), out);
+#else
+		ComposeTransformsScalar(in, 0, in.size(), out);
+#endif
+	}
+
+	// Pose blending. Poses are arrays of glm::vec3 translations and Quaternion rotations, one per bone, with one weight
+	// per bone so the same kernels serve masked layers. Every kernel works element by element, so out may alias an input.
+
+	/// out[i] = a[i] + (b[i] - a[i]) * weights[i]
+	static inline void LerpTranslationsScalar(const glm::vec3* a, const glm::vec3* b, const float* weights, size_t begin, size_t end, glm::vec3* out)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			out[i] = a[i] + (b[i] - a[i]) * weights[i];
+		}
+	}
+
+	/// out[i] = base[i] + additive[i] * weights[i]
+	static inline void AddTranslationsScalar(const glm::vec3* base, const glm::vec3* additive, const float* weights, size_t begin, size_t end, glm::vec3* out)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			out[i] = base[i] + additive[i] * weights[i];
+		}
+	}
+
+	/// out[i] = Quaternion::NLerp(a[i], b[i], weights[i])
+	static inline void NLerpRotationsScalar(const Quaternion* a, const Quaternion* b, const float* weights, size_t begin, size_t end, Quaternion* out)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			out[i] = Quaternion::NLerp(a[i], b[i], weights[i]);
+		}
+	}
+
+	/// out[i] = base[i] * Quaternion::NLerp(identity, additive[i], weights[i])
+	static inline void AddRotationsScalar(const Quaternion* base, const Quaternion* additive, const float* weights, size_t begin, size_t end, Quaternion* out)
+	{
+		const Quaternion identity(1.0f, 0.0f, 0.0f, 0.0f, false);
+
+		for (size_t i = begin; i < end; i++)
+		{
+			out[i] = Quaternion::Multiply(base[i], Quaternion::NLerp(identity, additive[i], weights[i]));
+		}
+	}
+
+#ifdef QT_SIMD_SSE
+	static_assert(sizeof(Quaternion) == 4 * sizeof(float) && sizeof(glm::vec3) == 3 * sizeof(float), "Blend kernels need tightly packed poses");
+
+	/// Spreads four bone weights over the 12 floats of four glm::vec3s.
+	static inline void _ExpandVec3WeightsSSE(__m128 w, __m128& w0, __m128& w1, __m128& w2)
+	{
+		w0 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 0, 0, 0));
+		w1 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 1, 1));
+		w2 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 3, 2));
+	}
+
+	/// Four bones per iteration. Tail elements fall back to the scalar kernel.
+	static inline void LerpTranslationsSSE(const glm::vec3* a, const glm::vec3* b, const float* weights, size_t begin, size_t end, glm::vec3* out)
+	{
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 w[3];
+			_ExpandVec3WeightsSSE(_mm_loadu_ps(weights + i), w[0], w[1], w[2]);
+
+			const float* pa = &a[i].x;
+			const float* pb = &b[i].x;
+			float* po = &out[i].x;
+			for (size_t j = 0; j < 3; j++)
+			{
+				const __m128 va = _mm_loadu_ps(pa + 4 * j);
+				const __m128 vb = _mm_loadu_ps(pb + 4 * j);
+				_mm_storeu_ps(po + 4 * j, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), w[j])));
+			}
+		}
+
+		LerpTranslationsScalar(a, b, weights, i, end, out);
+	}
+
+	static inline void AddTranslationsSSE(const glm::vec3* base, const glm::vec3* additive, const float* weights, size_t begin, size_t end, glm::vec3* out)
+	{
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 w[3];
+			_ExpandVec3WeightsSSE(_mm_loadu_ps(weights + i), w[0], w[1], w[2]);
+
+			const float* pa = &base[i].x;
+			const float* pb = &additive[i].x;
+			float* po = &out[i].x;
+			for (size_t j = 0; j < 3; j++)
+			{
+				_mm_storeu_ps(po + 4 * j, _mm_add_ps(_mm_loadu_ps(pa + 4 * j), _mm_mul_ps(_mm_loadu_ps(pb + 4 * j), w[j])));
+			}
+		}
+
+		AddTranslationsScalar(base, additive, weights, i, end, out);
+	}
+
+	/// Loads four quaternions and transposes them into x, y, z and w lanes.
+	static inline void _LoadRotationsSSE(const Quaternion* q, __m128& x, __m128& y, __m128& z, __m128& w)
+	{
+		x = _mm_loadu_ps(&q[0].x);
+		y = _mm_loadu_ps(&q[1].x);
+		z = _mm_loadu_ps(&q[2].x);
+		w = _mm_loadu_ps(&q[3].x);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+	}
+
+	/// Normalizes four quaternions held as lanes and writes them back as four quaternions.
+	static inline void _NormalizeStoreRotationsSSE(__m128 x, __m128 y, __m128 z, __m128 w, Quaternion* out)
+	{
+		const __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+		const __m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+
+		x = _mm_mul_ps(x, inverseLength);
+		y = _mm_mul_ps(y, inverseLength);
+		z = _mm_mul_ps(z, inverseLength);
+		w = _mm_mul_ps(w, inverseLength);
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(&out[0].x, x);
+		_mm_storeu_ps(&out[1].x, y);
+		_mm_storeu_ps(&out[2].x, z);
+		_mm_storeu_ps(&out[3].x, w);
+	}
+
+	/// Four bones per iteration, transposed to one lane per bone. Tail elements fall back to the scalar kernel.
+	static inline void NLerpRotationsSSE(const Quaternion* a, const Quaternion* b, const float* weights, size_t begin, size_t end, Quaternion* out)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 ax, ay, az, aw, bx, by, bz, bw;
+			_LoadRotationsSSE(a + i, ax, ay, az, aw);
+			_LoadRotationsSSE(b + i, bx, by, bz, bw);
+
+			// Blend towards -b where the two are more than half a turn apart, like Quaternion::NLerp
+			const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+			const __m128 f = _mm_loadu_ps(weights + i);
+			const __m128 fa = _mm_sub_ps(one, f);
+			const __m128 fb = _mm_xor_ps(f, _mm_and_ps(dot, signMask));
+
+			_NormalizeStoreRotationsSSE(
+				_mm_add_ps(_mm_mul_ps(fa, ax), _mm_mul_ps(fb, bx)),
+				_mm_add_ps(_mm_mul_ps(fa, ay), _mm_mul_ps(fb, by)),
+				_mm_add_ps(_mm_mul_ps(fa, az), _mm_mul_ps(fb, bz)),
+				_mm_add_ps(_mm_mul_ps(fa, aw), _mm_mul_ps(fb, bw)),
+				out + i);
+		}
+
+		NLerpRotationsScalar(a, b, weights, i, end, out);
+	}
+
+	static inline void AddRotationsSSE(const Quaternion* base, const Quaternion* additive, const float* weights, size_t begin, size_t end, Quaternion* out)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 bx, by, bz, bw, ax, ay, az, aw;
+			_LoadRotationsSSE(base + i, bx, by, bz, bw);
+			_LoadRotationsSSE(additive + i, ax, ay, az, aw);
+
+			// NLerp from identity: the dot product with identity is just w
+			const __m128 f = _mm_loadu_ps(weights + i);
+			const __m128 fa = _mm_sub_ps(one, f);
+			const __m128 fb = _mm_xor_ps(f, _mm_and_ps(aw, signMask));
+
+			__m128 dx = _mm_mul_ps(fb, ax);
+			__m128 dy = _mm_mul_ps(fb, ay);
+			__m128 dz = _mm_mul_ps(fb, az);
+			__m128 dw = _mm_add_ps(fa, _mm_mul_ps(fb, aw));
+
+			const __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_add_ps(_mm_mul_ps(dz, dz), _mm_mul_ps(dw, dw)));
+			const __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+			dx = _mm_mul_ps(dx, inverseLength);
+			dy = _mm_mul_ps(dy, inverseLength);
+			dz = _mm_mul_ps(dz, inverseLength);
+			dw = _mm_mul_ps(dw, inverseLength);
+
+			// base * delta, as in Quaternion::Multiply
+			__m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bw, dx), _mm_mul_ps(bx, dw)), _mm_sub_ps(_mm_mul_ps(by, dz), _mm_mul_ps(bz, dy)));
+			__m128 y = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(bw, dy), _mm_mul_ps(bx, dz)), _mm_add_ps(_mm_mul_ps(by, dw), _mm_mul_ps(bz, dx)));
+			__m128 z = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(bw, dz), _mm_mul_ps(bx, dy)), _mm_mul_ps(by, dx)), _mm_mul_ps(bz, dw));
+			__m128 w = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(bw, dw), _mm_mul_ps(bx, dx)), _mm_add_ps(_mm_mul_ps(by, dy), _mm_mul_ps(bz, dz)));
+
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			_mm_storeu_ps(&out[i].x, x);
+			_mm_storeu_ps(&out[i + 1].x, y);
+			_mm_storeu_ps(&out[i + 2].x, z);
+			_mm_storeu_ps(&out[i + 3].x, w);
+		}
+
+		AddRotationsScalar(base, additive, weights, i, end, out);
+	}
+#endif
+
+#ifdef QT_SIMD_AVX2
+	/// _MM_TRANSPOSE4_PS within each 128-bit half.
+	static inline void _Transpose4AVX(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+	{
+		const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		const __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+		const __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+		const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+
+		r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+		r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+		r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	/// Eight quaternions into x, y, z and w lanes, bones 0-3 in the low half and 4-7 in the high half.
+	static inline void _LoadRotationsAVX(const Quaternion* q, __m256& x, __m256& y, __m256& z, __m256& w)
+	{
+		x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&q[0].x)), _mm_loadu_ps(&q[4].x), 1);
+		y = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&q[1].x)), _mm_loadu_ps(&q[5].x), 1);
+		z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&q[2].x)), _mm_loadu_ps(&q[6].x), 1);
+		w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&q[3].x)), _mm_loadu_ps(&q[7].x), 1);
+		_Transpose4AVX(x, y, z, w);
+	}
+
+	/// Eight bones per iteration. Tail elements fall back to the SSE kernel.
+	static inline void NLerpRotationsAVX2(const Quaternion* a, const Quaternion* b, const float* weights, size_t begin, size_t end, Quaternion* out)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 ax, ay, az, aw, bx, by, bz, bw;
+			_LoadRotationsAVX(a + i, ax, ay, az, aw);
+			_LoadRotationsAVX(b + i, bx, by, bz, bw);
+
+			const __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_add_ps(_mm256_mul_ps(az, bz), _mm256_mul_ps(aw, bw)));
+			const __m256 f = _mm256_loadu_ps(weights + i);
+			const __m256 fa = _mm256_sub_ps(one, f);
+			const __m256 fb = _mm256_xor_ps(f, _mm256_and_ps(dot, signMask));
+
+			__m256 x = _mm256_add_ps(_mm256_mul_ps(fa, ax), _mm256_mul_ps(fb, bx));
+			__m256 y = _mm256_add_ps(_mm256_mul_ps(fa, ay), _mm256_mul_ps(fb, by));
+			__m256 z = _mm256_add_ps(_mm256_mul_ps(fa, az), _mm256_mul_ps(fb, bz));
+			__m256 w = _mm256_add_ps(_mm256_mul_ps(fa, aw), _mm256_mul_ps(fb, bw));
+
+			const __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_add_ps(_mm256_mul_ps(z, z), _mm256_mul_ps(w, w)));
+			const __m256 inverseLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSquared));
+			x = _mm256_mul_ps(x, inverseLength);
+			y = _mm256_mul_ps(y, inverseLength);
+			z = _mm256_mul_ps(z, inverseLength);
+			w = _mm256_mul_ps(w, inverseLength);
+
+			_Transpose4AVX(x, y, z, w);
+			_mm_storeu_ps(&out[i].x, _mm256_castps256_ps128(x));
+			_mm_storeu_ps(&out[i + 1].x, _mm256_castps256_ps128(y));
+			_mm_storeu_ps(&out[i + 2].x, _mm256_castps256_ps128(z));
+			_mm_storeu_ps(&out[i + 3].x, _mm256_castps256_ps128(w));
+			_mm_storeu_ps(&out[i + 4].x, _mm256_extractf128_ps(x, 1));
+			_mm_storeu_ps(&out[i + 5].x, _mm256_extractf128_ps(y, 1));
+			_mm_storeu_ps(&out[i + 6].x, _mm256_extractf128_ps(z, 1));
+			_mm_storeu_ps(&out[i + 7].x, _mm256_extractf128_ps(w, 1));
+		}
+
+		NLerpRotationsSSE(a, b, weights, i, end, out);
+	}
+#endif
+
+	/// Pose blend kernels using the widest instruction set available. Translations are only three floats per bone and
+	/// bound by memory, so they stop at SSE; so do additive rotations, which are rare next to plain blends.
+	static inline void LerpTranslations(const glm::vec3* a, const glm::vec3* b, const float* weights, size_t count, glm::vec3* out)
+	{
+#if defined(QT_SIMD_SSE)
+		LerpTranslationsSSE(a, b, weights, 0, count, out);
+#else
+		LerpTranslationsScalar(a, b, weights, 0, count, out);
+#endif
+	}
+
+	static inline void AddTranslations(const glm::vec3* base, const glm::vec3* additive, const float* weights, size_t count, glm::vec3* out)
+	{
+#if defined(QT_SIMD_SSE)
+		AddTranslationsSSE(base, additive, weights, 0, count, out);
+#else
+		AddTranslationsScalar(base, additive, weights, 0, count, out);
+#endif
+	}
+
+	static inline void NLerpRotations(const Quaternion* a, const Quaternion* b, const float* weights, size_t count, Quaternion* out)
+	{
+#if defined(QT_SIMD_AVX2)
+		NLerpRotationsAVX2(a, b, weights, 0, count, out);
+#elif defined(QT_SIMD_SSE)
+		NLerpRotationsSSE(a, b, weights, 0, count, out);
+#else
+		NLerpRotationsScalar(a, b, weights, 0, count, out);
+#endif
+	}
+
+	static inline void AddRotations(const Quaternion* base, const Quaternion* additive, const float* weights, size_t count, Quaternion* out)
+	{
+#if defined(QT_SIMD_SSE)
+		AddRotationsSSE(base, additive, weights, 0, count, out);
+#else
+		AddRotationsScalar(base, additive, weights, 0, count, out);
+#endif
+	}
+
+	/// out[i] = matrices[i] as a dual quaternion that moves points the way matrices[i] * point does, with the real part
+	/// in the w >= 0 half. Only for rigid matrices (rotation and translation), such as skinning matrices; scale is lost.
+	/// The rotation comes from the largest of the four diagonal combinations, so it stays accurate near 180 degrees.
+	static inline void RigidMatricesToDualQuaternionsScalar(const glm::mat4* matrices, size_t begin, size_t end, DualQuaternion* out)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const glm::mat4& m = matrices[i]; // m[column][row]
+
+			const float rw = 1.0f + m[0][0] + m[1][1] + m[2][2];
+			const float rx = 1.0f + m[0][0] - m[1][1] - m[2][2];
+			const float ry = 1.0f - m[0][0] + m[1][1] - m[2][2];
+			const float rz = 1.0f - m[0][0] - m[1][1] + m[2][2];
+			const float largest = std::max(std::max(rw, rx), std::max(ry, rz));
+
+			const float d21 = m[1][2] - m[2][1], d02 = m[2][0] - m[0][2], d10 = m[0][1] - m[1][0];
+			const float s01 = m[1][0] + m[0][1], s02 = m[2][0] + m[0][2], s12 = m[2][1] + m[1][2];
+
+			float w, x, y, z;
+			if (rw >= largest) { w = rw; x = d21; y = d02; z = d10; }
+			else if (rx >= largest) { w = d21; x = rx; y = s01; z = s02; }
+			else if (ry >= largest) { w = d02; x = s01; y = ry; z = s12; }
+			else { w = d10; x = s02; y = s12; z = rz; }
+
+			const float scale = (signbit(w) ? -0.5f : 0.5f) / sqrtf(largest);
+			w *= scale; x *= scale; y *= scale; z *= scale;
+
+			const float tx = m[3][0], ty = m[3][1], tz = m[3][2];
+			out[i].real = Quaternion(w, x, y, z, false);
+			out[i].dual = Quaternion(
+				-0.5f * (tx * x + ty * y + tz * z),
+				0.5f * (tx * w + ty * z - tz * y),
+				0.5f * (ty * w + tz * x - tx * z),
+				0.5f * (tz * w + tx * y - ty * x), false);
+		}
+	}
+
+#ifdef QT_SIMD_SSE
+	/// Four matrices per iteration, transposed to one lane per matrix, with the four cases picked by masks instead of
+	/// branches. Tail elements fall back to the scalar kernel.
+	static inline void RigidMatricesToDualQuaternionsSSE(const glm::mat4* matrices, size_t begin, size_t end, DualQuaternion* out)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 signBit = _mm_set1_ps(-0.0f);
+
+		const auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			// mRC holds element [R][C] of all four matrices
+			__m128 m00 = _mm_loadu_ps(&matrices[i][0][0]), m01 = _mm_loadu_ps(&matrices[i + 1][0][0]);
+			__m128 m02 = _mm_loadu_ps(&matrices[i + 2][0][0]), m03 = _mm_loadu_ps(&matrices[i + 3][0][0]);
+			_MM_TRANSPOSE4_PS(m00, m01, m02, m03);
+			__m128 m10 = _mm_loadu_ps(&matrices[i][1][0]), m11 = _mm_loadu_ps(&matrices[i + 1][1][0]);
+			__m128 m12 = _mm_loadu_ps(&matrices[i + 2][1][0]), m13 = _mm_loadu_ps(&matrices[i + 3][1][0]);
+			_MM_TRANSPOSE4_PS(m10, m11, m12, m13);
+			__m128 m20 = _mm_loadu_ps(&matrices[i][2][0]), m21 = _mm_loadu_ps(&matrices[i + 1][2][0]);
+			__m128 m22 = _mm_loadu_ps(&matrices[i + 2][2][0]), m23 = _mm_loadu_ps(&matrices[i + 3][2][0]);
+			_MM_TRANSPOSE4_PS(m20, m21, m22, m23);
+			__m128 tx = _mm_loadu_ps(&matrices[i][3][0]), ty = _mm_loadu_ps(&matrices[i + 1][3][0]);
+			__m128 tz = _mm_loadu_ps(&matrices[i + 2][3][0]), tw = _mm_loadu_ps(&matrices[i + 3][3][0]);
+			_MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+
+			const __m128 rw = _mm_add_ps(_mm_add_ps(_mm_add_ps(one, m00), m11), m22);
+			const __m128 rx = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(one, m00), m11), m22);
+			const __m128 ry = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(one, m00), m11), m22);
+			const __m128 rz = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(one, m00), m11), m22);
+			const __m128 largest = _mm_max_ps(_mm_max_ps(rw, rx), _mm_max_ps(ry, rz));
+
+			const __m128 d21 = _mm_sub_ps(m12, m21), d02 = _mm_sub_ps(m20, m02), d10 = _mm_sub_ps(m01, m10);
+			const __m128 s01 = _mm_add_ps(m10, m01), s02 = _mm_add_ps(m20, m02), s12 = _mm_add_ps(m21, m12);
+
+			// First case whose diagonal combination is the largest, same as the scalar kernel's if chain
+			const __m128 isW = _mm_cmpge_ps(rw, largest);
+			const __m128 isX = _mm_andnot_ps(isW, _mm_cmpge_ps(rx, largest));
+			const __m128 isY = _mm_andnot_ps(_mm_or_ps(isW, isX), _mm_cmpge_ps(ry, largest));
+
+			__m128 w = select(isW, rw, select(isX, d21, select(isY, d02, d10)));
+			__m128 x = select(isW, d21, select(isX, rx, select(isY, s01, s02)));
+			__m128 y = select(isW, d02, select(isX, s01, select(isY, ry, s12)));
+			__m128 z = select(isW, d10, select(isX, s02, select(isY, s12, rz)));
+
+			const __m128 scale = _mm_div_ps(_mm_or_ps(half, _mm_and_ps(w, signBit)), _mm_sqrt_ps(largest));
+			w = _mm_mul_ps(w, scale); x = _mm_mul_ps(x, scale); y = _mm_mul_ps(y, scale); z = _mm_mul_ps(z, scale);
+
+			__m128 dw = _mm_mul_ps(_mm_set1_ps(-0.5f), _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, x), _mm_mul_ps(ty, y)), _mm_mul_ps(tz, z)));
+			__m128 dx = _mm_mul_ps(half, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(tx, w), _mm_mul_ps(ty, z)), _mm_mul_ps(tz, y)));
+			__m128 dy = _mm_mul_ps(half, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(ty, w), _mm_mul_ps(tz, x)), _mm_mul_ps(tx, z)));
+			__m128 dz = _mm_mul_ps(half, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(tz, w), _mm_mul_ps(tx, y)), _mm_mul_ps(ty, x)));
+
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			_MM_TRANSPOSE4_PS(dx, dy, dz, dw);
+
+			_mm_storeu_ps(&out[i].real.x, x);
+			_mm_storeu_ps(&out[i].dual.x, dx);
+			_mm_storeu_ps(&out[i + 1].real.x, y);
+			_mm_storeu_ps(&out[i + 1].dual.x, dy);
+			_mm_storeu_ps(&out[i + 2].real.x, z);
+			_mm_storeu_ps(&out[i + 2].dual.x, dz);
+			_mm_storeu_ps(&out[i + 3].real.x, w);
+			_mm_storeu_ps(&out[i + 3].dual.x, dw);
+		}
+
+		RigidMatricesToDualQuaternionsScalar(matrices, i, end, out);
+	}
+#endif
+
+	/// A palette's worth of bones is a few hundred matrices at most, so SSE is as wide as this goes.
+	static inline void RigidMatricesToDualQuaternions(const glm::mat4* matrices, size_t count, DualQuaternion* out)
+	{
+#if defined(QT_SIMD_SSE)
+		RigidMatricesToDualQuaternionsSSE(matrices, 0, count, out);
+#else
+		RigidMatricesToDualQuaternionsScalar(matrices, 0, count, out);
+#endif
+	}
+}
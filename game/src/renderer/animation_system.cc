@@ -0,0 +1,256 @@
+#include "animation_system.hh"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <tuple>
+
+AnimationSystem::AnimationSystem(ThreadPool& threadPool)
+	: BaseECSSystem(), _threadPool(threadPool), _numPaletteMatrices(0),
+	_hasView(false), _cameraPosition(0.0f), _inverseTanHalfFov(1.0f), _frameIndex(0),
+	_poseCacheRate(0.0f), _numSharedPoses(0)
+{
+	AddComponentType(AnimationComponent::ID);
+	memset(_lodCounts, 0, sizeof(_lodCounts));
+}
+
+AnimationSystem::~AnimationSystem()
+{
+}
+
+void AnimationSystem::SetView(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float fovY)
+{
+	_hasView = true;
+	_frustum = qt::Frustum(viewProjection);
+	_cameraPosition = cameraPosition;
+	_inverseTanHalfFov = 1.0f / tanf(fovY * 0.5f);
+}
+
+void AnimationSystem::ClearView()
+{
+	_hasView = false;
+}
+
+AnimationLOD AnimationSystem::_SelectLOD(const AnimationComponent& component) const
+{
+	if (!_hasView || component.worldBounds.IsEmpty())
+	{
+		return ANIMATION_LOD_FULL;
+	}
+
+	const glm::vec3 center = component.worldBounds.GetCenter();
+	const float radius = glm::length(component.worldBounds.GetExtents());
+
+	// Root motion moves the character, which can't wait until it's seen again, so those only drop to the lowest rate
+	if (_lodSettings.freezeOffscreen && !_frustum.IntersectsSphere(center, radius))
+	{
+		return component.animator->IsExtractingRootMotion() ? ANIMATION_LOD_QUARTER : ANIMATION_LOD_FROZEN;
+	}
+
+	// Projected sphere height over viewport height. The camera inside the sphere means it fills the screen
+	const float distance = glm::length(center - _cameraPosition);
+	if (distance <= radius)
+	{
+		return ANIMATION_LOD_FULL;
+	}
+
+	const float screenSize = radius * _inverseTanHalfFov / distance;
+	if (screenSize < _lodSettings.quarterRateScreenSize)
+	{
+		return ANIMATION_LOD_QUARTER;
+	}
+	if (screenSize < _lodSettings.halfRateScreenSize)
+	{
+		return ANIMATION_LOD_HALF;
+	}
+	return ANIMATION_LOD_FULL;
+}
+
+void AnimationSystem::BeginUpdate(float /*delta*/)
+{
+	_queued.clear();
+	_numPaletteMatrices = 0;
+	memset(_lodCounts, 0, sizeof(_lodCounts));
+}
+
+void AnimationSystem::UpdateComponents(float /*delta*/, BaseECSComponent** components)
+{
+	AnimationComponent* component = (AnimationComponent*)components[0];
+	if (!component->animator || !component->animator->GetSkeleton())
+	{
+		return;
+	}
+
+	component->lod = _SelectLOD(*component);
+	_lodCounts[component->lod]++;
+
+	component->paletteOffset = _numPaletteMatrices;
+	_numPaletteMatrices += component->animator->GetSkeleton()->GetNumBones();
+	_queued.push_back(component);
+}
+
+void AnimationSystem::_PlanJobs(float delta)
+{
+	_jobs.resize(_queued.size());
+	_poseKeys.clear();
+	_numSharedPoses = 0;
+
+	const uint32_t frameIndex = _frameIndex++;
+	const float cacheRate = _poseCacheRate;
+
+	for (size_t i = 0; i < _queued.size(); i++)
+	{
+		AnimationComponent* component = _queued[i];
+		Animator* animator = component->animator;
+		_Job& job = _jobs[i];
+
+		component->pendingTime += delta * component->playbackSpeed;
+		component->rootMotion = glm::vec3(0.0f);
+
+		// The clock stops with the pose. Catching up on however long it was off screen would jump the clip, and the
+		// root with it, all at once
+		if (component->lod == ANIMATION_LOD_FROZEN)
+		{
+			component->pendingTime = 0.0f;
+			job.work = _WORK_FROZEN;
+			continue;
+		}
+
+		// Offsetting by the character's index spreads the updates evenly over the frames
+		const uint32_t rate = component->lod == ANIMATION_LOD_QUARTER ? 4 : (component->lod == ANIMATION_LOD_HALF ? 2 : 1);
+		if ((frameIndex + static_cast<uint32_t>(i)) % rate != 0)
+		{
+			job.work = _WORK_EXTRAPOLATE;
+			continue;
+		}
+
+		animator->SetMaxBoneDepth(component->lod == ANIMATION_LOD_QUARTER ? _lodSettings.reducedBoneDepth : ANIMATOR_ALL_BONES);
+
+		// Moving the clock is cheap, and only afterwards is it known who plays what when
+		if (cacheRate > 0.0f && animator->Advance(component->pendingTime))
+		{
+			const uint32_t frame = static_cast<uint32_t>(animator->GetAnimationTime() * cacheRate + 0.5f);
+			job.work = _WORK_EVALUATE;
+			job.sampleTime = frame / cacheRate;
+			_poseKeys.push_back({ animator->GetClip(), animator->GetSkeleton(), frame, animator->GetMaxBoneDepth(),
+				animator->IsExtractingRootMotion(), static_cast<uint32_t>(i) });
+		}
+		else
+		{
+			job.work = _WORK_UPDATE;
+		}
+	}
+
+	if (_poseKeys.empty())
+	{
+		return;
+	}
+
+	const auto sameKey = [](const _PoseKey& a, const _PoseKey& b)
+	{
+		return std::tie(a.clip, a.skeleton, a.frame, a.maxBoneDepth, a.rootMotion) == std::tie(b.clip, b.skeleton, b.frame, b.maxBoneDepth, b.rootMotion);
+	};
+
+	std::sort(_poseKeys.begin(), _poseKeys.end(), [](const _PoseKey& a, const _PoseKey& b)
+	{
+		return std::tie(a.clip, a.skeleton, a.frame, a.maxBoneDepth, a.rootMotion, a.index)
+			< std::tie(b.clip, b.skeleton, b.frame, b.maxBoneDepth, b.rootMotion, b.index);
+	});
+
+	// The first of every run of equal keys evaluates, the rest copy it. An animator alone in its run has no one to
+	// share with, so it samples its own clock rather than the rounded one
+	size_t first = 0;
+	for (size_t i = 1; i <= _poseKeys.size(); i++)
+	{
+		if (i < _poseKeys.size() && sameKey(_poseKeys[i], _poseKeys[first]))
+		{
+			continue;
+		}
+
+		const uint32_t source = _poseKeys[first].index;
+		if (i - first == 1)
+		{
+			_jobs[source].sampleTime = _queued[source]->animator->GetAnimationTime();
+		}
+
+		for (size_t j = first + 1; j < i; j++)
+		{
+			_jobs[_poseKeys[j].index].work = _WORK_COPY;
+			_jobs[_poseKeys[j].index].source = source;
+			_numSharedPoses++;
+		}
+
+		first = i;
+	}
+}
+
+void AnimationSystem::EndUpdate(float delta)
+{
+	if (_palette.size() < _numPaletteMatrices)
+	{
+		_palette.resize(_numPaletteMatrices);
+	}
+
+	_PlanJobs(delta);
+
+	// Every animator writes its own range of the palette, so the batches never touch the same memory
+	_threadPool.ParallelFor(_queued.size(), _MIN_BATCH_SIZE, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (_jobs[i].work != _WORK_COPY)
+			{
+				_RunJob(i);
+			}
+		}
+	});
+
+	// Copies wait until every pose they copy has been evaluated
+	if (_numSharedPoses > 0)
+	{
+		_threadPool.ParallelFor(_queued.size(), _MIN_BATCH_SIZE, [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				if (_jobs[i].work == _WORK_COPY)
+				{
+					_RunJob(i);
+				}
+			}
+		});
+	}
+}
+
+void AnimationSystem::_RunJob(size_t index)
+{
+	AnimationComponent* component = _queued[index];
+	Animator* animator = component->animator;
+	const _Job& job = _jobs[index];
+
+	switch (job.work)
+	{
+	case _WORK_FROZEN:
+		break;
+	case _WORK_EXTRAPOLATE:
+		animator->Extrapolate(component->pendingTime, &_palette[component->paletteOffset]);
+		return;
+	case _WORK_UPDATE:
+		animator->Update(component->pendingTime);
+		break;
+	case _WORK_EVALUATE:
+		animator->EvaluateAt(job.sampleTime);
+		break;
+	case _WORK_COPY:
+		animator->CopyPose(*_queued[job.source]->animator);
+		break;
+	}
+
+	if (job.work != _WORK_FROZEN)
+	{
+		component->rootMotion = animator->GetRootMotion();
+		component->pendingTime = 0.0f;
+	}
+
+	const std::vector<glm::mat4>& skinningMatrices = animator->GetSkinningMatrices();
+	memcpy(&_palette[component->paletteOffset], skinningMatrices.data(), skinningMatrices.size() * sizeof(glm::mat4));
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+
+#include <glm.hpp>
+
+#include "common.hh"
+#include "ecs/ecs_component.hh"
+#include "ecs/ecs_system.hh"
+#include "util/thread_pool.hh"
+#include "math/math_bounds.hh"
+#include "renderer/skeletal_animation.hh"
+
+enum AnimationLOD : uint32_t
+{
+	ANIMATION_LOD_FULL = 0,	// Every frame, every bone
+	ANIMATION_LOD_HALF,		// Every second frame, extrapolated in between
+	ANIMATION_LOD_QUARTER,	// Every fourth frame, extrapolated in between, only down to AnimationLODSettings::reducedBoneDepth
+	ANIMATION_LOD_FROZEN,	// Off screen: holds its last pose, and its clock, until it's seen again. Quarter rate instead with root motion
+	NUM_ANIMATION_LODS
+};
+
+/// Screen sizes are the height of a character's bounding sphere as a fraction of the viewport's.
+struct AnimationLODSettings
+{
+	float halfRateScreenSize = 0.2f; // Smaller characters update at half rate
+	float quarterRateScreenSize = 0.08f; // Smaller characters update at quarter rate, with fewer bones
+	uint32_t reducedBoneDepth = 4; // Deepest bone evaluated at quarter rate; roots are depth 0
+	bool freezeOffscreen = true;
+};
+
+struct AnimationComponent : public ECSComponent<AnimationComponent>
+{
+	Animator* animator = nullptr; // Owned elsewhere, usually by a Mesh
+	float playbackSpeed = 1.0f;
+	uint32_t paletteOffset = 0; // First of this animator's matrices in AnimationSystem::GetPalette(), set every update
+
+	qt::AABB worldBounds; // Kept up to date by the owner for LOD selection; empty bounds always get ANIMATION_LOD_FULL
+	AnimationLOD lod = ANIMATION_LOD_FULL; // Picked every update
+	float pendingTime = 0.0f; // Playback time skipped frames haven't handed to the animator yet
+
+	/// The animator's root motion (see Animator::SetRootMotion()) in the last update, zero on frames it skipped.
+	glm::vec3 rootMotion = glm::vec3(0.0f);
+};
+
+/// Advances every animator with the frame's delta time, spread across the thread pool, and gathers their skinning
+/// matrices into one contiguous palette ready to upload.
+///
+/// The ECS hands components over one at a time, so UpdateComponents() only queues them and assigns palette ranges;
+/// the animators run all at once in EndUpdate(). Components must not be added or removed during UpdateSystems().
+///
+/// Once SetView() has been called, every character also gets an AnimationLOD from its screen size: small ones update
+/// every second or fourth frame and extrapolate their palette in between, the smallest also skip their deepest bones,
+/// and characters outside the view frustum keep the pose they had. Reduced rates are staggered over the crowd, so each
+/// frame updates an even share of it instead of all of it every few frames.
+///
+/// With the pose cache on, animators playing the same clip at nearly the same time (crowds walking in step, idle
+/// loops started together) share one evaluation per update: their clocks are rounded to the cache's rate, the first
+/// of each group samples the clip and takes it to model space, and the rest copy its matrices.
+class AnimationSystem : public BaseECSSystem
+{
+private:
+	static constexpr size_t _MIN_BATCH_SIZE = 4; // Characters per job; one character is a few microseconds of work
+
+	enum _Work : uint32_t
+	{
+		_WORK_FROZEN = 0,
+		_WORK_EXTRAPOLATE,
+		_WORK_UPDATE,
+		_WORK_EVALUATE, // Samples the pose others copy
+		_WORK_COPY,
+	};
+
+	/// Who does what this update, one per queued animator. Decided on the calling thread before anything runs.
+	struct _Job
+	{
+		_Work work;
+		uint32_t source; // _WORK_COPY: queue index of the animator evaluating the pose
+		float sampleTime; // _WORK_EVALUATE: the clock, rounded to the cache's rate if others copy the pose
+	};
+
+	/// Everything a shared pose depends on, and the animator asking for it.
+	struct _PoseKey
+	{
+		const void* clip;
+		const Skeleton* skeleton;
+		uint32_t frame; // Clock in steps of the cache's rate
+		uint32_t maxBoneDepth;
+		bool rootMotion;
+		uint32_t index; // Into the queue, and the tie breaker that makes the first animator of a group evaluate
+	};
+
+	ThreadPool& _threadPool;
+
+	std::vector<AnimationComponent*> _queued;
+	std::vector<glm::mat4> _palette; // Only grows, so a steady crowd never reallocates
+	uint32_t _numPaletteMatrices;
+
+	AnimationLODSettings _lodSettings;
+	bool _hasView;
+	qt::Frustum _frustum;
+	glm::vec3 _cameraPosition;
+	float _inverseTanHalfFov;
+	uint32_t _frameIndex; // Staggers the characters that skip frames
+	uint32_t _lodCounts[NUM_ANIMATION_LODS];
+
+	float _poseCacheRate; // 0 when off
+	std::vector<_Job> _jobs;
+	std::vector<_PoseKey> _poseKeys; // Sorted so that equal keys sit together
+	uint32_t _numSharedPoses;
+
+	AnimationLOD _SelectLOD(const AnimationComponent& component) const;
+	void _PlanJobs(float delta);
+	void _RunJob(size_t index);
+public:
+	AnimationSystem(ThreadPool& threadPool);
+	virtual ~AnimationSystem();
+
+	virtual void BeginUpdate(float delta);
+	virtual void UpdateComponents(float delta, BaseECSComponent** components);
+	virtual void EndUpdate(float delta);
+
+	/// Camera the LODs are picked for, from the next update on. fovY in radians.
+	void SetView(const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float fovY);
+
+	/// Back to every character at ANIMATION_LOD_FULL.
+	void ClearView();
+
+	inline void SetLODSettings(const AnimationLODSettings& settings) { _lodSettings = settings; }
+	inline const AnimationLODSettings& GetLODSettings() const { return _lodSettings; }
+
+	/// Every queued animator's skinning matrices, at its component's paletteOffset. Valid until the next update.
+	inline const glm::mat4* GetPalette() const { return _palette.data(); }
+	inline uint32_t GetNumPaletteMatrices() const { return _numPaletteMatrices; }
+	inline size_t GetNumAnimators() const { return _queued.size(); }
+
+	/// Characters at lod in the last update.
+	inline uint32_t GetNumAnimatorsAtLOD(AnimationLOD lod) const { return _lodCounts[lod]; }
+
+	/// Clock resolution of the pose cache in samples per second, from the next update on. Animators sharing a pose
+	/// are sampled at most half a step away from their own clock; the rest at their own clock. 0 turns the cache off,
+	/// which it is by default.
+	inline void SetPoseCacheRate(float samplesPerSecond) { _poseCacheRate = samplesPerSecond; }
+	inline float GetPoseCacheRate() const { return _poseCacheRate; }
+
+	/// Animators that copied another's pose instead of evaluating their own in the last update.
+	inline uint32_t GetNumSharedPoses() const { return _numSharedPoses; }
+};
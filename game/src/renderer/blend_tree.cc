@@ -0,0 +1,279 @@
+#include "blend_tree.hh"
+
+#include <math.h>
+#include <algorithm>
+
+BlendTree::BlendTree(const Skeleton* skeleton)
+	: _skeleton(skeleton), _root(NULL_BLEND_NODE_HANDLE)
+{
+}
+
+BlendTree::~BlendTree()
+{
+}
+
+BlendNodeHandle BlendTree::_AddNode(const _Node& node)
+{
+	_nodes.push_back(node);
+	return static_cast<BlendNodeHandle>(_nodes.size() - 1);
+}
+
+BlendNodeHandle BlendTree::AddClip(const Animation* animation, float speed)
+{
+	if (!animation || animation->keyframes.empty() || animation->keyframes[0].pose.GetNumBones() != _skeleton->GetNumBones())
+	{
+		DEBUG_LOG("BlendTree", LOG_ERROR, "Clip is empty or doesn't match the skeleton's %u bones", _skeleton->GetNumBones());
+		return NULL_BLEND_NODE_HANDLE;
+	}
+
+	_Node node = {};
+	node.type = _CLIP;
+	node.animation = animation;
+	node.speed = speed;
+	node.inputs[0] = node.inputs[1] = NULL_BLEND_NODE_HANDLE;
+	return _AddNode(node);
+}
+
+BlendNodeHandle BlendTree::AddClip(const CompressedAnimation* animation, float speed)
+{
+	if (!animation || !animation->IsValid() || animation->GetNumBones() != _skeleton->GetNumBones())
+	{
+		DEBUG_LOG("BlendTree", LOG_ERROR, "Compressed clip is invalid or doesn't match the skeleton's %u bones", _skeleton->GetNumBones());
+		return NULL_BLEND_NODE_HANDLE;
+	}
+
+	_Node node = {};
+	node.type = _COMPRESSED_CLIP;
+	node.compressedAnimation = animation;
+	node.trackCursors.assign(2 * animation->GetNumBones(), 0);
+	node.speed = speed;
+	node.inputs[0] = node.inputs[1] = NULL_BLEND_NODE_HANDLE;
+	return _AddNode(node);
+}
+
+BlendNodeHandle BlendTree::AddLerp(BlendNodeHandle from, BlendNodeHandle to, float weight, const BoneMask* mask)
+{
+	if (from >= _nodes.size() || to >= _nodes.size())
+	{
+		DEBUG_LOG("BlendTree", LOG_ERROR, "Lerp inputs have to be added before the lerp");
+		return NULL_BLEND_NODE_HANDLE;
+	}
+
+	_Node node = {};
+	node.type = _LERP;
+	node.inputs[0] = from;
+	node.inputs[1] = to;
+	node.weight = node.targetWeight = weight;
+	node.mask = mask;
+	return _AddNode(node);
+}
+
+BlendNodeHandle BlendTree::AddAdditive(BlendNodeHandle base, BlendNodeHandle additive, float weight, const BoneMask* mask)
+{
+	if (base >= _nodes.size() || additive >= _nodes.size())
+	{
+		DEBUG_LOG("BlendTree", LOG_ERROR, "Additive inputs have to be added before the additive node");
+		return NULL_BLEND_NODE_HANDLE;
+	}
+
+	_Node node = {};
+	node.type = _ADDITIVE;
+	node.inputs[0] = base;
+	node.inputs[1] = additive;
+	node.weight = node.targetWeight = weight;
+	node.mask = mask;
+	return _AddNode(node);
+}
+
+uint32_t BlendTree::_GetDepth(BlendNodeHandle node) const
+{
+	const _Node& n = _nodes[node];
+	if (n.type == _CLIP || n.type == _COMPRESSED_CLIP)
+	{
+		return 0;
+	}
+
+	return 1 + std::max(_GetDepth(n.inputs[0]), _GetDepth(n.inputs[1]));
+}
+
+void BlendTree::SetRoot(BlendNodeHandle node)
+{
+	if (node >= _nodes.size())
+	{
+		DEBUG_LOG("BlendTree", LOG_ERROR, "Root %u isn't a node of this tree", node);
+		return;
+	}
+
+	_root = node;
+
+	// The first input of a blend is evaluated straight into the blend's output, the second needs a pose of its own
+	_scratchPoses.resize(_GetDepth(node));
+	for (auto& i : _scratchPoses)
+	{
+		i.Resize(_skeleton->GetNumBones());
+	}
+	_boneWeights.resize(_skeleton->GetNumBones());
+}
+
+void BlendTree::SetWeight(BlendNodeHandle node, float weight)
+{
+	_nodes[node].weight = _nodes[node].targetWeight = glm::clamp(weight, 0.0f, 1.0f);
+	_nodes[node].fadeRate = 0.0f;
+}
+
+void BlendTree::FadeWeight(BlendNodeHandle node, float target, float duration)
+{
+	_Node& n = _nodes[node];
+	n.targetWeight = glm::clamp(target, 0.0f, 1.0f);
+
+	if (duration <= 0.0f)
+	{
+		n.weight = n.targetWeight;
+		n.fadeRate = 0.0f;
+		return;
+	}
+
+	n.fadeRate = fabsf(n.targetWeight - n.weight) / duration;
+}
+
+void BlendTree::SetClipTime(BlendNodeHandle node, float time)
+{
+	_Node& n = _nodes[node];
+	const float duration = n.type == _CLIP ? n.animation->duration : n.compressedAnimation->GetDuration();
+
+	n.time = duration > 0.0f ? fmodf(time, duration) : 0.0f;
+	if (n.time < 0.0f)
+	{
+		n.time += duration;
+	}
+}
+
+void BlendTree::Update(float deltaTime)
+{
+	for (auto& n : _nodes)
+	{
+		switch (n.type)
+		{
+		case _CLIP:
+		case _COMPRESSED_CLIP:
+		{
+			const float duration = n.type == _CLIP ? n.animation->duration : n.compressedAnimation->GetDuration();
+			n.time += deltaTime * n.speed;
+			if (n.time > duration || n.time < 0.0f)
+			{
+				n.time = duration > 0.0f ? fmodf(n.time, duration) : 0.0f;
+				n.time += n.time < 0.0f ? duration : 0.0f;
+				n.cursor = 0;
+				std::fill(n.trackCursors.begin(), n.trackCursors.end(), 0);
+			}
+			break;
+		}
+		case _LERP:
+		case _ADDITIVE:
+			if (n.weight < n.targetWeight)
+			{
+				n.weight = std::min(n.weight + n.fadeRate * deltaTime, n.targetWeight);
+			}
+			else if (n.weight > n.targetWeight)
+			{
+				n.weight = std::max(n.weight - n.fadeRate * deltaTime, n.targetWeight);
+			}
+			break;
+		}
+	}
+}
+
+void BlendTree::_FillBoneWeights(const _Node& node)
+{
+	const uint32_t numBones = _skeleton->GetNumBones();
+
+	if (node.mask)
+	{
+		const uint32_t numMasked = std::min(numBones, static_cast<uint32_t>(node.mask->size()));
+		for (uint32_t i = 0; i < numMasked; i++)
+		{
+			_boneWeights[i] = (*node.mask)[i] * node.weight;
+		}
+		std::fill(_boneWeights.begin() + numMasked, _boneWeights.end(), 0.0f);
+	}
+	else
+	{
+		std::fill(_boneWeights.begin(), _boneWeights.end(), node.weight);
+	}
+}
+
+void BlendTree::_Evaluate(BlendNodeHandle node, Pose& out, uint32_t depth)
+{
+	_Node& n = _nodes[node];
+
+	switch (n.type)
+	{
+	case _CLIP:
+		SampleAnimation(*n.animation, n.time, n.cursor, out);
+		return;
+	case _COMPRESSED_CLIP:
+		n.compressedAnimation->Sample(n.time, n.trackCursors, out);
+		return;
+	default:
+		break;
+	}
+
+	// Skip inputs that can't show at this weight
+	if (n.weight <= 0.0f)
+	{
+		_Evaluate(n.inputs[0], out, depth);
+		return;
+	}
+	if (n.type == _LERP && n.weight >= 1.0f && !n.mask)
+	{
+		_Evaluate(n.inputs[1], out, depth);
+		return;
+	}
+
+	Pose& other = _scratchPoses[depth];
+	_Evaluate(n.inputs[0], out, depth + 1);
+	_Evaluate(n.inputs[1], other, depth + 1);
+
+	// Inputs are done with _boneWeights by now
+	_FillBoneWeights(n);
+
+	const uint32_t numBones = _skeleton->GetNumBones();
+	if (n.type == _LERP)
+	{
+		qt::LerpTranslations(out.translations.data(), other.translations.data(), _boneWeights.data(), numBones, out.translations.data());
+		qt::NLerpRotations(out.rotations.data(), other.rotations.data(), _boneWeights.data(), numBones, out.rotations.data());
+	}
+	else
+	{
+		qt::AddTranslations(out.translations.data(), other.translations.data(), _boneWeights.data(), numBones, out.translations.data());
+		qt::AddRotations(out.rotations.data(), other.rotations.data(), _boneWeights.data(), numBones, out.rotations.data());
+	}
+}
+
+void BlendTree::Evaluate(Pose& pose)
+{
+	if (_root == NULL_BLEND_NODE_HANDLE)
+	{
+		return;
+	}
+
+	_Evaluate(_root, pose, 0);
+}
+
+void BlendTree::MaskBranch(const Skeleton& skeleton, uint32_t bone, BoneMask& mask)
+{
+	const uint32_t numBones = skeleton.GetNumBones();
+	mask.resize(numBones, 0.0f);
+
+	// Parents come first, so one pass reaches every descendant
+	std::vector<bool> inBranch(numBones, false);
+	for (uint32_t i = bone; i < numBones; i++)
+	{
+		const int32_t parent = skeleton.GetParent(i);
+		inBranch[i] = i == bone || (parent >= 0 && inBranch[parent]);
+		if (inBranch[i])
+		{
+			mask[i] = 1.0f;
+		}
+	}
+}
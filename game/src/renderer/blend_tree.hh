@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hh"
+#include "math/math_simd.hh"
+#include "renderer/skeletal_animation.hh"
+#include "renderer/compressed_animation.hh"
+
+typedef uint32_t BlendNodeHandle;
+#define NULL_BLEND_NODE_HANDLE 0xffffffff
+
+/// One weight per bone, 0 to 1, that scales a blend node's weight, e.g. 1 over the upper body and 0 elsewhere.
+typedef std::vector<float> BoneMask;
+
+/// One character's animation graph: clips at the leaves, blends above them, evaluated from the root into a Pose.
+///
+/// Lerp nodes blend two inputs (a cross-fade is a lerp whose weight fades from 0 to 1). Additive nodes put a clip
+/// made with ConvertToAdditive() on top of a base pose. Either can take a BoneMask to only affect part of the
+/// skeleton. Every clip keeps its own time, advanced by Update(); inputs a node doesn't need at its current weight
+/// aren't sampled. Blends run over whole poses with the SIMD kernels in math_simd.hh.
+///
+/// Nodes are added children first. Evaluation uses pose buffers sized when the root is set, so it never allocates.
+class BlendTree
+{
+private:
+	enum _NodeType
+	{
+		_CLIP,
+		_COMPRESSED_CLIP,
+		_LERP,
+		_ADDITIVE,
+	};
+
+	struct _Node
+	{
+		_NodeType type;
+
+		// Clips
+		const Animation* animation;
+		const CompressedAnimation* compressedAnimation;
+		float time;
+		float speed;
+		uint32_t cursor; // Keyframe cursor for SampleAnimation()
+		std::vector<uint32_t> trackCursors; // Per track cursors for CompressedAnimation::Sample()
+
+		// Blends
+		BlendNodeHandle inputs[2]; // Lerp: from, to. Additive: base, additive
+		float weight;
+		float targetWeight;
+		float fadeRate; // Weight per second towards targetWeight
+		const BoneMask* mask; // nullptr for the whole skeleton
+	};
+
+	const Skeleton* _skeleton;
+	std::vector<_Node> _nodes;
+	BlendNodeHandle _root;
+
+	std::vector<Pose> _scratchPoses; // One per level below the root
+	std::vector<float> _boneWeights;
+
+	BlendNodeHandle _AddNode(const _Node& node);
+	uint32_t _GetDepth(BlendNodeHandle node) const;
+	void _Evaluate(BlendNodeHandle node, Pose& out, uint32_t depth);
+	void _FillBoneWeights(const _Node& node);
+public:
+	BlendTree(const Skeleton* skeleton);
+	~BlendTree();
+
+	/// Rejected (and logged) if the clip doesn't have one transform per bone of the skeleton.
+	BlendNodeHandle AddClip(const Animation* animation, float speed = 1.0f);
+	BlendNodeHandle AddClip(const CompressedAnimation* animation, float speed = 1.0f);
+
+	/// weight 0 is all from, 1 is all to.
+	BlendNodeHandle AddLerp(BlendNodeHandle from, BlendNodeHandle to, float weight, const BoneMask* mask = nullptr);
+
+	/// weight scales the additive clip; 0 leaves the base pose as it is.
+	BlendNodeHandle AddAdditive(BlendNodeHandle base, BlendNodeHandle additive, float weight, const BoneMask* mask = nullptr);
+
+	/// The node Evaluate() returns. Sizes the evaluation buffers.
+	void SetRoot(BlendNodeHandle node);
+
+	/// Sets a blend node's weight right away, stopping any fade.
+	void SetWeight(BlendNodeHandle node, float weight);
+
+	/// Moves a blend node's weight to target, linearly over duration seconds of Update().
+	void FadeWeight(BlendNodeHandle node, float target, float duration);
+
+	/// Jumps a clip to time, wrapped into its length.
+	void SetClipTime(BlendNodeHandle node, float time);
+
+	/// Advances every clip by deltaTime times its speed, looping, and moves fading weights along.
+	void Update(float deltaTime);
+
+	/// Samples and blends everything the root needs into pose, which must have one transform per bone.
+	void Evaluate(Pose& pose);
+
+	/// Weight 1 on bone and everything below it, leaving the rest of mask as it is. Sizes mask to the skeleton.
+	static void MaskBranch(const Skeleton& skeleton, uint32_t bone, BoneMask& mask);
+
+	inline const Skeleton* GetSkeleton() const { return _skeleton; }
+	inline float GetWeight(BlendNodeHandle node) const { return _nodes[node].weight; }
+	inline float GetClipTime(BlendNodeHandle node) const { return _nodes[node].time; }
+	inline size_t GetNumNodes() const { return _nodes.size(); }
+};
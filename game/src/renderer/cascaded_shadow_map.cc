@@ -0,0 +1,149 @@
+#include "cascaded_shadow_map.hh"
+
+CascadedShadowMap::CascadedShadowMap(uint32_t numCascades, uint32_t resolution, float splitLambda)
+	: _framebuffer(0), _depthArray(0), _resolution(resolution), _numCascades(numCascades), _splitLambda(splitLambda),
+	_splitDepths(0.0f), _texelSizes(0.0f), _lightDirection(0.0f, -1.0f, 0.0f)
+{
+	if (_numCascades == 0 || _numCascades > MAX_SHADOW_CASCADES)
+	{
+		DEBUG_LOG("CascadedShadowMap", LOG_WARN, "%u cascades requested, clamping to [1, %d]", _numCascades, MAX_SHADOW_CASCADES);
+		_numCascades = (_numCascades == 0) ? 1 : MAX_SHADOW_CASCADES;
+	}
+
+	_lightMatrices.resize(_numCascades, glm::mat4(1.0f));
+
+	// Linear filtering with a compare mode makes every lookup a 2x2 PCF in hardware
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &_depthArray);
+	glTextureStorage3D(_depthArray, 1, GL_DEPTH_COMPONENT32F, _resolution, _resolution, _numCascades);
+	glTextureParameteri(_depthArray, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(_depthArray, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(_depthArray, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTextureParameteri(_depthArray, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTextureParameteri(_depthArray, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTextureParameteri(_depthArray, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	const float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f }; // Outside the map counts as lit
+	glTextureParameterfv(_depthArray, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+	// No color attachment, one depth layer is attached at a time in BeginCascade()
+	glCreateFramebuffers(1, &_framebuffer);
+	glNamedFramebufferDrawBuffer(_framebuffer, GL_NONE);
+	glNamedFramebufferReadBuffer(_framebuffer, GL_NONE);
+	glNamedFramebufferTextureLayer(_framebuffer, GL_DEPTH_ATTACHMENT, _depthArray, 0, 0);
+
+	const GLenum status = glCheckNamedFramebufferStatus(_framebuffer, GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		DEBUG_LOG("CascadedShadowMap", LOG_ERROR, "Shadow framebuffer is incomplete (status 0x%x)", status);
+	}
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+	glDeleteFramebuffers(1, &_framebuffer);
+	glDeleteTextures(1, &_depthArray);
+}
+
+void CascadedShadowMap::Update(const glm::mat4& viewMatrix, float fovRadians, float aspectRatio, float nearPlane, float shadowDistance, const glm::vec3& lightDirection)
+{
+	_lightDirection = glm::normalize(lightDirection);
+
+	// Camera basis straight out of the (rigid) view matrix, which saves a full 4x4 inverse
+	const glm::vec3 right(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+	const glm::vec3 up(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+	const glm::vec3 back(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2]);
+	const glm::vec3 eye = -(right * viewMatrix[3][0] + up * viewMatrix[3][1] + back * viewMatrix[3][2]);
+
+	const float tanHalfFov = tanf(fovRadians * 0.5f);
+	const glm::vec3 lightUp = (fabsf(_lightDirection.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+	float sliceNear = nearPlane;
+	for (uint32_t i = 0; i < _numCascades; i++)
+	{
+		// Blend of logarithmic and uniform splits
+		const float t = static_cast<float>(i + 1) / _numCascades;
+		const float logSplit = nearPlane * powf(shadowDistance / nearPlane, t);
+		const float uniformSplit = nearPlane + (shadowDistance - nearPlane) * t;
+		const float sliceFar = _splitLambda * logSplit + (1.0f - _splitLambda) * uniformSplit;
+
+		// Corners of this slice of the view frustum
+		glm::vec3 corners[8];
+		const float distances[2] = { sliceNear, sliceFar };
+		for (int d = 0; d < 2; d++)
+		{
+			const glm::vec3 center = eye - back * distances[d];
+			const glm::vec3 halfHeight = up * (distances[d] * tanHalfFov);
+			const glm::vec3 halfWidth = right * (distances[d] * tanHalfFov * aspectRatio);
+
+			corners[d * 4 + 0] = center - halfWidth - halfHeight;
+			corners[d * 4 + 1] = center + halfWidth - halfHeight;
+			corners[d * 4 + 2] = center + halfWidth + halfHeight;
+			corners[d * 4 + 3] = center - halfWidth + halfHeight;
+		}
+
+		// The bounding sphere doesn't change size as the camera rotates, unlike a box fitted to the corners
+		glm::vec3 sphereCenter(0.0f);
+		for (int c = 0; c < 8; c++)
+		{
+			sphereCenter += corners[c];
+		}
+		sphereCenter /= 8.0f;
+
+		float radius = 0.0f;
+		for (int c = 0; c < 8; c++)
+		{
+			radius = fmaxf(radius, glm::length(corners[c] - sphereCenter));
+		}
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		const glm::mat4 lightView = glm::lookAt(sphereCenter - _lightDirection * (radius + _CASTER_MARGIN), sphereCenter, lightUp);
+		glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + _CASTER_MARGIN);
+
+		// Snap the world origin to a texel, so the whole projection only ever moves in whole-texel steps
+		const float halfResolution = 0.5f * _resolution;
+		const glm::vec4 origin = (lightProjection * lightView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		lightProjection[3][0] += (roundf(origin.x * halfResolution) - origin.x * halfResolution) / halfResolution;
+		lightProjection[3][1] += (roundf(origin.y * halfResolution) - origin.y * halfResolution) / halfResolution;
+
+		_lightMatrices[i] = lightProjection * lightView;
+		_splitDepths[i] = sliceFar;
+		_texelSizes[i] = 2.0f * radius / _resolution;
+
+		sliceNear = sliceFar;
+	}
+}
+
+void CascadedShadowMap::BeginCascade(uint32_t cascade)
+{
+	glNamedFramebufferTextureLayer(_framebuffer, GL_DEPTH_ATTACHMENT, _depthArray, 0, cascade);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glViewport(0, 0, _resolution, _resolution);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void CascadedShadowMap::End()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+bool CascadedShadowMap::IsCasterVisible(uint32_t cascade, const qt::AABB& worldBounds) const
+{
+	// The projection is orthographic, so the light-space box is exact enough and needs no perspective divide
+	const qt::AABB lightBounds = worldBounds.Transformed(_lightMatrices[cascade]);
+
+	return lightBounds.max.x >= -1.0f && lightBounds.min.x <= 1.0f
+		&& lightBounds.max.y >= -1.0f && lightBounds.min.y <= 1.0f
+		&& lightBounds.min.z <= 1.0f;
+}
+
+void CascadedShadowMap::SendToShader(Shader& shader, GLint textureUnit)
+{
+	glBindTextureUnit(textureUnit, _depthArray);
+
+	shader.Set1i(textureUnit, "shadowMap");
+	shader.Set1i(static_cast<int>(_numCascades), "numCascades");
+	shader.SetArrMat4fv(_lightMatrices, "cascadeMatrices");
+	shader.SetVec4f(_splitDepths, "cascadeSplits");
+	shader.SetVec4f(_texelSizes, "cascadeTexelSizes");
+	shader.SetVec3f(_lightDirection, "shadowLightDirection");
+}
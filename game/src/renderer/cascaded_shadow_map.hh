@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include <glew.h>
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include "common.hh"
+#include "renderer/shader.hh"
+#include "math/math_bounds.hh"
+
+/// Split distances and texel sizes are sent to shaders packed in a vec4, so this is a hard limit.
+#define MAX_SHADOW_CASCADES 4
+
+/// Directional light shadows rendered into one layer of a depth texture array per cascade.
+/// The camera frustum, cut off at a shadow distance, is split into slices that get further apart with depth,
+/// so nearby shadows get most of the texels. Each slice is fitted with an orthographic projection around its
+/// bounding sphere, which keeps the projection size constant while the camera turns, and the projection is
+/// snapped to whole texels so shadow edges don't shimmer while the camera moves.
+class CascadedShadowMap
+{
+private:
+	GLuint _framebuffer;
+	GLuint _depthArray;
+
+	uint32_t _resolution;
+	uint32_t _numCascades;
+	float _splitLambda; // 0 = uniform splits, 1 = logarithmic splits
+
+	const float _CASTER_MARGIN = 25.0f; // How far behind a cascade's bounding sphere the light still picks up casters
+
+	std::vector<glm::mat4> _lightMatrices; // Projection * view of each cascade
+	glm::vec4 _splitDepths; // View-space distance where each cascade ends
+	glm::vec4 _texelSizes; // World-space size of one texel in each cascade
+
+	glm::vec3 _lightDirection;
+public:
+	CascadedShadowMap(uint32_t numCascades = MAX_SHADOW_CASCADES, uint32_t resolution = 1024, float splitLambda = 0.75f);
+	~CascadedShadowMap();
+
+	/// Refits every cascade to the camera frustum between nearPlane and shadowDistance.
+	/// lightDirection points from the light towards the scene.
+	void Update(const glm::mat4& viewMatrix, float fovRadians, float aspectRatio, float nearPlane, float shadowDistance, const glm::vec3& lightDirection);
+
+	/// Binds the cascade's layer as the depth target, sets the viewport and clears it.
+	void BeginCascade(uint32_t cascade);
+
+	/// Rebinds the default framebuffer. The caller is responsible for restoring its viewport.
+	void End();
+
+	/// Whether anything inside worldBounds can cast a shadow into the cascade.
+	/// Casters between the light and the cascade are kept, since depth clamping flattens them onto its near plane.
+	bool IsCasterVisible(uint32_t cascade, const qt::AABB& worldBounds) const;
+
+	/// Binds the depth array to textureUnit and sends the cascade uniforms.
+	void SendToShader(Shader& shader, GLint textureUnit);
+
+	inline uint32_t GetNumCascades() const { return _numCascades; }
+	inline uint32_t GetResolution() const { return _resolution; }
+	inline const glm::mat4& GetLightMatrix(uint32_t cascade) const { return _lightMatrices[cascade]; }
+	inline float GetSplitDepth(uint32_t cascade) const { return _splitDepths[cascade]; }
+	inline GLuint GetDepthArrayID() const { return _depthArray; }
+};
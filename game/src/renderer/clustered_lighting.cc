@@ -0,0 +1,88 @@
+#include "clustered_lighting.hh"
+
+#include <string.h>
+#include <algorithm>
+
+#include "renderer/light.hh"
+
+ClusteredLighting::ClusteredLighting(uint32_t numX, uint32_t numY, uint32_t numZ)
+	: _grid(numX, numY, numZ), _isUploaded(false)
+{
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+}
+
+void ClusteredLighting::Update(const std::vector<PointLight*>& lights, const glm::mat4& viewMatrix, float fovRadians, float aspectRatio,
+	float nearPlane, float farPlane, ThreadPool& pool)
+{
+	_isUploaded = false;
+
+	_bounds.Resize(lights.size());
+	_lights.resize(lights.size());
+
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		const float radius = lights[i]->GetRadius();
+		_bounds.Set(i, lights[i]->GetPosition(), radius);
+
+		_lights[i].positionRadius = glm::vec4(lights[i]->GetPosition(), radius);
+		_lights[i].colorIntensity = glm::vec4(lights[i]->GetColor(), lights[i]->GetIntensity());
+		_lights[i].attenuation = glm::vec4(lights[i]->GetAttenuation(), 0.0f);
+	}
+
+	_grid.Build(viewMatrix, fovRadians, aspectRatio, nearPlane, farPlane, _bounds, &pool);
+}
+
+bool ClusteredLighting::Upload(RingBuffer& frameData)
+{
+	const std::vector<LightCluster>& clusters = _grid.GetClusters();
+	const std::vector<uint32_t>& indices = _grid.GetLightIndices();
+
+	// Zero-sized ranges can't be bound, so every buffer gets at least one element
+	const GLsizeiptr lightsSize = std::max<size_t>(_lights.size(), 1) * sizeof(ClusteredPointLight);
+	const GLsizeiptr clustersSize = clusters.size() * sizeof(LightCluster);
+	const GLsizeiptr indicesSize = std::max<size_t>(indices.size(), 1) * sizeof(uint32_t);
+
+	const GLsizeiptr alignment = RingBuffer::GetStorageAlignment();
+	const RingBufferAllocation lightsAllocation = frameData.Allocate(lightsSize, alignment);
+	const RingBufferAllocation clustersAllocation = frameData.Allocate(clustersSize, alignment);
+	const RingBufferAllocation indicesAllocation = frameData.Allocate(indicesSize, alignment);
+
+	if (!lightsAllocation.IsValid() || !clustersAllocation.IsValid() || !indicesAllocation.IsValid())
+	{
+		DEBUG_LOG("ClusteredLighting", LOG_WARN, "Out of frame data space for %zu lights and %zu light indices", _lights.size(), indices.size());
+		_isUploaded = false;
+		return false;
+	}
+
+	memcpy(lightsAllocation.data, _lights.data(), _lights.size() * sizeof(ClusteredPointLight));
+	memcpy(clustersAllocation.data, clusters.data(), clustersSize);
+	memcpy(indicesAllocation.data, indices.data(), indices.size() * sizeof(uint32_t));
+
+	frameData.BindRange(GL_SHADER_STORAGE_BUFFER, CLUSTERED_LIGHTS_BINDING, lightsAllocation);
+	frameData.BindRange(GL_SHADER_STORAGE_BUFFER, CLUSTERED_RANGES_BINDING, clustersAllocation);
+	frameData.BindRange(GL_SHADER_STORAGE_BUFFER, CLUSTERED_INDICES_BINDING, indicesAllocation);
+
+	_isUploaded = true;
+	return true;
+}
+
+void ClusteredLighting::SendToShader(Shader& shader, int viewportWidth, int viewportHeight)
+{
+	if (!_isUploaded)
+	{
+		shader.Set1i(0, "useClusteredLighting");
+		return;
+	}
+
+	const glm::vec2 clustersPerPixel(
+		static_cast<float>(_grid.GetNumX()) / std::max(viewportWidth, 1),
+		static_cast<float>(_grid.GetNumY()) / std::max(viewportHeight, 1));
+
+	shader.Set1i(1, "useClusteredLighting");
+	shader.SetVec3f(glm::vec3(_grid.GetNumX(), _grid.GetNumY(), _grid.GetNumZ()), "clusterGrid");
+	shader.SetVec2f(clustersPerPixel, "clusterScreenScale");
+	shader.SetVec2f(glm::vec2(_grid.GetDepthScale(), _grid.GetDepthBias()), "clusterDepthScaleBias");
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include <glew.h>
+
+#include <glm.hpp>
+
+#include "common.hh"
+#include "renderer/shader.hh"
+#include "renderer/ring_buffer.hh"
+#include "renderer/light_grid.hh"
+#include "util/thread_pool.hh"
+
+class PointLight;
+
+/// Shader storage binding points used by the clustered lighting buffers in core.frag.
+#define CLUSTERED_LIGHTS_BINDING 2
+#define CLUSTERED_RANGES_BINDING 3
+#define CLUSTERED_INDICES_BINDING 4
+
+/// std430 layout of one light in the light buffer.
+struct ClusteredPointLight
+{
+	glm::vec4 positionRadius; // World-space position, w = radius the light was binned with
+	glm::vec4 colorIntensity;
+	glm::vec4 attenuation; // constant, linear, quadratic, unused
+};
+
+/// Clustered forward shading for point lights. Every frame the lights are binned into a LightGrid on the thread pool,
+/// then the lights, each cluster's (offset, count) and the light index lists are streamed through the RingBuffer into
+/// three shader storage buffers. The fragment shader finds its cluster from gl_FragCoord and its view depth, and only
+/// loops over the lights listed there.
+class ClusteredLighting
+{
+private:
+	LightGrid _grid;
+	PointLightSoA _bounds;
+	std::vector<ClusteredPointLight> _lights;
+	bool _isUploaded; // Whether this frame's buffers made it into the ring buffer
+public:
+	ClusteredLighting(uint32_t numX = 16, uint32_t numY = 9, uint32_t numZ = 24);
+	~ClusteredLighting();
+
+	/// Bins lights for the camera. farPlane is where clustered lighting stops, which can be well short of the camera's far plane.
+	void Update(const std::vector<PointLight*>& lights, const glm::mat4& viewMatrix, float fovRadians, float aspectRatio,
+		float nearPlane, float farPlane, ThreadPool& pool);
+
+	/// Streams this frame's buffers and binds them. Returns false if the ring buffer is out of space.
+	bool Upload(RingBuffer& frameData);
+
+	/// Sends the grid uniforms. Can be called for several shaders after one Upload(); if that failed,
+	/// clustered lighting is disabled in the shader instead.
+	void SendToShader(Shader& shader, int viewportWidth, int viewportHeight);
+
+	inline const LightGrid& GetGrid() const { return _grid; }
+	inline size_t GetNumLights() const { return _lights.size(); }
+};
@@ -0,0 +1,439 @@
+#include "compressed_animation.hh"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+static const float _SMALLEST_THREE_RANGE = 0.70710678f; // No component but the largest of a unit quaternion can be bigger
+static const float _MAX_KEY_TIME = 65535.0f;
+
+static void _EncodeRotation(const qt::Quaternion& q, uint16_t out[3])
+{
+	const float components[4] = { q.x, q.y, q.z, q.w };
+
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; i++)
+	{
+		if (fabsf(components[i]) > fabsf(components[largest]))
+		{
+			largest = i;
+		}
+	}
+
+	// q and -q are the same rotation, so the dropped component can always be made positive
+	const float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint64_t packed = static_cast<uint64_t>(largest) << 46;
+	uint32_t shift = 30;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i == largest)
+		{
+			continue;
+		}
+
+		const float value = glm::clamp(components[i] * sign, -_SMALLEST_THREE_RANGE, _SMALLEST_THREE_RANGE);
+		const uint64_t quantized = static_cast<uint64_t>(lroundf((value + _SMALLEST_THREE_RANGE) / (2.0f * _SMALLEST_THREE_RANGE) * 32767.0f));
+		packed |= quantized << shift;
+		shift -= 15;
+	}
+
+	out[0] = static_cast<uint16_t>(packed >> 32);
+	out[1] = static_cast<uint16_t>(packed >> 16);
+	out[2] = static_cast<uint16_t>(packed);
+}
+
+static inline void _DecodeRotation(const uint16_t in[3], float out[4])
+{
+	const uint64_t packed = (static_cast<uint64_t>(in[0]) << 32) | (static_cast<uint64_t>(in[1]) << 16) | in[2];
+	const uint32_t largest = static_cast<uint32_t>(packed >> 46) & 3;
+
+	float sumOfSquares = 0.0f;
+	uint32_t shift = 30;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i == largest)
+		{
+			continue;
+		}
+
+		const float quantized = static_cast<float>((packed >> shift) & 0x7fff);
+		out[i] = quantized / 32767.0f * (2.0f * _SMALLEST_THREE_RANGE) - _SMALLEST_THREE_RANGE;
+		sumOfSquares += out[i] * out[i];
+		shift -= 15;
+	}
+
+	out[largest] = sqrtf(std::max(0.0f, 1.0f - sumOfSquares));
+}
+
+static inline qt::Quaternion _NLerp(const qt::Quaternion& a, const qt::Quaternion& b, float f)
+{
+	const float dot = a.w*b.w + a.x*b.x + a.y*b.y + a.z*b.z;
+	const float fb = dot < 0.0f ? -f : f;
+	const float fa = 1.0f - f;
+
+	return qt::Quaternion(fa*a.w + fb*b.w, fa*a.x + fb*b.x, fa*a.y + fb*b.y, fa*a.z + fb*b.z);
+}
+
+/// Angle of the rotation from a to b. Taken from both parts of conjugate(a) * b rather than acos of its w, which
+/// rounds everything under about 7e-4 radians to 0 in float.
+static inline float _RotationError(const qt::Quaternion& a, const qt::Quaternion& b)
+{
+	const float w = a.w*b.w + a.x*b.x + a.y*b.y + a.z*b.z;
+	const float x = a.w*b.x - b.w*a.x - (a.y*b.z - a.z*b.y);
+	const float y = a.w*b.y - b.w*a.y - (a.z*b.x - a.x*b.z);
+	const float z = a.w*b.z - b.w*a.z - (a.x*b.y - a.y*b.x);
+	return 2.0f * atan2f(sqrtf(x*x + y*y + z*z), fabsf(w));
+}
+
+static inline float _TranslationError(const glm::vec3& a, const glm::vec3& b)
+{
+	return glm::length(a - b);
+}
+
+/// Fills kept with the indices of the keys to keep, so that interpolating between consecutive kept keys reproduces
+/// every dropped key within tolerance. Greedy: each segment is stretched until one of the keys it covers misses.
+template <typename Value, typename Lerp, typename Error>
+static void _ReduceKeys(const std::vector<float>& times, const std::vector<Value>& values, float tolerance,
+	const Lerp& lerp, const Error& error, std::vector<uint32_t>& kept)
+{
+	const uint32_t numKeys = static_cast<uint32_t>(values.size());
+	kept.clear();
+	kept.push_back(0);
+
+	bool isConstant = true;
+	for (uint32_t i = 1; i < numKeys && isConstant; i++)
+	{
+		isConstant = error(values[i], values[0]) <= tolerance;
+	}
+
+	if (isConstant)
+	{
+		return;
+	}
+
+	uint32_t anchor = 0;
+	for (uint32_t end = 2; end < numKeys; end++)
+	{
+		const float span = times[end] - times[anchor];
+
+		for (uint32_t i = anchor + 1; i < end; i++)
+		{
+			const float f = span > 0.0f ? (times[i] - times[anchor]) / span : 0.0f;
+			if (error(lerp(values[anchor], values[end], f), values[i]) > tolerance)
+			{
+				anchor = end - 1;
+				kept.push_back(anchor);
+				break;
+			}
+		}
+	}
+
+	kept.push_back(numKeys - 1);
+}
+
+bool CompressAnimation(const Animation& animation, const AnimationCompressionSettings& settings, std::vector<uint8_t>& out)
+{
+	if (animation.keyframes.empty())
+	{
+		DEBUG_LOG("AnimationCompression", LOG_ERROR, "Animation has no keyframes");
+		return false;
+	}
+
+	const uint32_t numBones = animation.keyframes[0].pose.GetNumBones();
+	const uint32_t numFrames = static_cast<uint32_t>(animation.keyframes.size());
+	for (const auto& i : animation.keyframes)
+	{
+		if (i.pose.GetNumBones() != numBones || i.pose.rotations.size() != numBones)
+		{
+			DEBUG_LOG("AnimationCompression", LOG_ERROR, "Keyframe at %.3fs has %u bones, the first has %u", i.timestamp, i.pose.GetNumBones(), numBones);
+			return false;
+		}
+	}
+
+	std::vector<float> times(numFrames);
+	std::vector<uint16_t> keyTimes(numFrames);
+	for (uint32_t i = 0; i < numFrames; i++)
+	{
+		times[i] = animation.keyframes[i].timestamp;
+		const float fraction = animation.duration > 0.0f ? glm::clamp(times[i] / animation.duration, 0.0f, 1.0f) : 0.0f;
+		keyTimes[i] = static_cast<uint16_t>(lroundf(fraction * _MAX_KEY_TIME));
+	}
+
+	std::vector<CompressedTrack> rotationTracks(numBones), translationTracks(numBones);
+	std::vector<CompressedTranslationRange> translationRanges(numBones);
+	std::vector<CompressedKey> rotationKeys, translationKeys;
+
+	std::vector<qt::Quaternion> rotations(numFrames);
+	std::vector<glm::vec3> translations(numFrames);
+	std::vector<uint32_t> kept;
+
+	for (uint32_t bone = 0; bone < numBones; bone++)
+	{
+		// Rotations, each in the same hemisphere as the one before so neighbours interpolate the short way round
+		for (uint32_t i = 0; i < numFrames; i++)
+		{
+			qt::Quaternion q = animation.keyframes[i].pose.rotations[bone];
+			if (i > 0 && q.w*rotations[i - 1].w + q.x*rotations[i - 1].x + q.y*rotations[i - 1].y + q.z*rotations[i - 1].z < 0.0f)
+			{
+				q = qt::Quaternion(-q.w, -q.x, -q.y, -q.z, false);
+			}
+			rotations[i] = q;
+		}
+
+		_ReduceKeys(times, rotations, settings.rotationTolerance, _NLerp, _RotationError, kept);
+
+		rotationTracks[bone].firstKey = static_cast<uint32_t>(rotationKeys.size());
+		rotationTracks[bone].numKeys = static_cast<uint32_t>(kept.size());
+		for (uint32_t i : kept)
+		{
+			CompressedKey key;
+			key.time = keyTimes[i];
+			_EncodeRotation(rotations[i], key.value);
+			rotationKeys.push_back(key);
+		}
+
+		// Translations, quantized over the range of the keys that are left
+		for (uint32_t i = 0; i < numFrames; i++)
+		{
+			translations[i] = animation.keyframes[i].pose.translations[bone];
+		}
+
+		_ReduceKeys(times, translations, settings.translationTolerance,
+			[](const glm::vec3& a, const glm::vec3& b, float f) { return a * (1.0f - f) + b * f; }, _TranslationError, kept);
+
+		glm::vec3 minimum = translations[kept[0]], maximum = translations[kept[0]];
+		for (uint32_t i : kept)
+		{
+			minimum = glm::min(minimum, translations[i]);
+			maximum = glm::max(maximum, translations[i]);
+		}
+
+		CompressedTranslationRange& range = translationRanges[bone];
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			range.min[c] = minimum[c];
+			range.extent[c] = maximum[c] - minimum[c];
+		}
+
+		translationTracks[bone].firstKey = static_cast<uint32_t>(translationKeys.size());
+		translationTracks[bone].numKeys = static_cast<uint32_t>(kept.size());
+		for (uint32_t i : kept)
+		{
+			CompressedKey key;
+			key.time = keyTimes[i];
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				const float fraction = range.extent[c] > 0.0f ? (translations[i][c] - range.min[c]) / range.extent[c] : 0.0f;
+				key.value[c] = static_cast<uint16_t>(lroundf(glm::clamp(fraction, 0.0f, 1.0f) * 65535.0f));
+			}
+			translationKeys.push_back(key);
+		}
+	}
+
+	CompressedAnimationHeader header;
+	header.magic = COMPRESSED_ANIMATION_MAGIC;
+	header.version = COMPRESSED_ANIMATION_VERSION;
+	header.numBones = numBones;
+	header.duration = animation.duration;
+	header.numRotationKeys = static_cast<uint32_t>(rotationKeys.size());
+	header.numTranslationKeys = static_cast<uint32_t>(translationKeys.size());
+
+	out.clear();
+	const auto append = [&out](const void* data, size_t size)
+	{
+		const size_t offset = out.size();
+		out.resize(offset + size);
+		if (size > 0)
+		{
+			memcpy(&out[offset], data, size);
+		}
+	};
+
+	append(&header, sizeof(header));
+	append(rotationTracks.data(), rotationTracks.size() * sizeof(CompressedTrack));
+	append(translationTracks.data(), translationTracks.size() * sizeof(CompressedTrack));
+	append(translationRanges.data(), translationRanges.size() * sizeof(CompressedTranslationRange));
+	append(rotationKeys.data(), rotationKeys.size() * sizeof(CompressedKey));
+	append(translationKeys.data(), translationKeys.size() * sizeof(CompressedKey));
+
+	return true;
+}
+
+CompressedAnimation::CompressedAnimation()
+	: _header(nullptr), _rotationTracks(nullptr), _translationTracks(nullptr), _translationRanges(nullptr),
+	_rotationKeys(nullptr), _translationKeys(nullptr), _size(0)
+{
+}
+
+CompressedAnimation::~CompressedAnimation()
+{
+}
+
+bool CompressedAnimation::Parse(const uint8_t* data, size_t size)
+{
+	_header = nullptr;
+	_size = 0;
+
+	if (data == nullptr || size < sizeof(CompressedAnimationHeader))
+	{
+		return false;
+	}
+
+	const CompressedAnimationHeader* header = reinterpret_cast<const CompressedAnimationHeader*>(data);
+	if (header->magic != COMPRESSED_ANIMATION_MAGIC || header->version != COMPRESSED_ANIMATION_VERSION)
+	{
+		return false;
+	}
+
+	const size_t numBones = header->numBones;
+	const size_t expectedSize = sizeof(CompressedAnimationHeader)
+		+ numBones * (2 * sizeof(CompressedTrack) + sizeof(CompressedTranslationRange))
+		+ (static_cast<size_t>(header->numRotationKeys) + header->numTranslationKeys) * sizeof(CompressedKey);
+	if (size < expectedSize)
+	{
+		return false;
+	}
+
+	const uint8_t* cursor = data + sizeof(CompressedAnimationHeader);
+	const CompressedTrack* rotationTracks = reinterpret_cast<const CompressedTrack*>(cursor);
+	cursor += numBones * sizeof(CompressedTrack);
+	const CompressedTrack* translationTracks = reinterpret_cast<const CompressedTrack*>(cursor);
+	cursor += numBones * sizeof(CompressedTrack);
+	const CompressedTranslationRange* translationRanges = reinterpret_cast<const CompressedTranslationRange*>(cursor);
+	cursor += numBones * sizeof(CompressedTranslationRange);
+	const CompressedKey* rotationKeys = reinterpret_cast<const CompressedKey*>(cursor);
+	cursor += header->numRotationKeys * sizeof(CompressedKey);
+	const CompressedKey* translationKeys = reinterpret_cast<const CompressedKey*>(cursor);
+
+	for (size_t i = 0; i < numBones; i++)
+	{
+		if (rotationTracks[i].numKeys == 0 || static_cast<size_t>(rotationTracks[i].firstKey) + rotationTracks[i].numKeys > header->numRotationKeys
+			|| translationTracks[i].numKeys == 0 || static_cast<size_t>(translationTracks[i].firstKey) + translationTracks[i].numKeys > header->numTranslationKeys)
+		{
+			return false;
+		}
+	}
+
+	_header = header;
+	_rotationTracks = rotationTracks;
+	_translationTracks = translationTracks;
+	_translationRanges = translationRanges;
+	_rotationKeys = rotationKeys;
+	_translationKeys = translationKeys;
+	_size = expectedSize;
+
+	return true;
+}
+
+static const uint32_t _MAX_CURSOR_STEPS = 4; // Keys to walk forward before binary searching instead
+
+/// Index of the key a track interpolates from at time, and how far it is towards the next one. Starts from cursor,
+/// the key found last time, and leaves the new one there.
+static inline uint32_t _FindKey(const CompressedKey* keys, uint32_t numKeys, float time, uint32_t& cursor, float& f)
+{
+	uint32_t index = std::min(cursor, numKeys - 2);
+	bool found = false;
+
+	// Playing forward, the time is still between the same two keys or at most a few keys further
+	if (static_cast<float>(keys[index].time) <= time)
+	{
+		for (uint32_t step = 0; step < _MAX_CURSOR_STEPS; step++)
+		{
+			if (index + 2 >= numKeys || static_cast<float>(keys[index + 1].time) > time)
+			{
+				found = true;
+				break;
+			}
+			index++;
+		}
+	}
+
+	// Seeked backwards or far ahead
+	if (!found)
+	{
+		const CompressedKey* after = std::upper_bound(keys, keys + numKeys, time,
+			[](float t, const CompressedKey& key) { return t < static_cast<float>(key.time); });
+		index = std::min(static_cast<uint32_t>(std::max<ptrdiff_t>(after - keys - 1, 0)), numKeys - 2);
+	}
+
+	cursor = index;
+	const float span = static_cast<float>(keys[index + 1].time) - static_cast<float>(keys[index].time);
+	f = span > 0.0f ? glm::clamp((time - keys[index].time) / span, 0.0f, 1.0f) : 0.0f;
+
+	return index;
+}
+
+void CompressedAnimation::Sample(float time, std::vector<uint32_t>& cursors, Pose& pose) const
+{
+	if (cursors.size() != 2 * _header->numBones)
+	{
+		cursors.assign(2 * _header->numBones, 0);
+	}
+
+	const float duration = _header->duration;
+	const float keyTime = duration > 0.0f ? glm::clamp(time / duration, 0.0f, 1.0f) * _MAX_KEY_TIME : 0.0f;
+
+	for (uint32_t bone = 0; bone < _header->numBones; bone++)
+	{
+		// Rotation
+		const CompressedTrack& rotationTrack = _rotationTracks[bone];
+		const CompressedKey* rotationKeys = _rotationKeys + rotationTrack.firstKey;
+		qt::Quaternion& rotation = pose.rotations[bone];
+
+		if (rotationTrack.numKeys == 1)
+		{
+			float q[4];
+			_DecodeRotation(rotationKeys[0].value, q);
+			rotation.x = q[0]; rotation.y = q[1]; rotation.z = q[2]; rotation.w = q[3];
+		}
+		else
+		{
+			float f;
+			const uint32_t key = _FindKey(rotationKeys, rotationTrack.numKeys, keyTime, cursors[2 * bone], f);
+
+			float a[4], b[4];
+			_DecodeRotation(rotationKeys[key].value, a);
+			_DecodeRotation(rotationKeys[key + 1].value, b);
+
+			const float dot = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+			const float fb = dot < 0.0f ? -f : f;
+			const float fa = 1.0f - f;
+
+			float q[4];
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				q[c] = fa * a[c] + fb * b[c];
+			}
+
+			const float inverseLength = 1.0f / sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+			rotation.x = q[0] * inverseLength; rotation.y = q[1] * inverseLength; rotation.z = q[2] * inverseLength; rotation.w = q[3] * inverseLength;
+		}
+
+		// Translation
+		const CompressedTrack& translationTrack = _translationTracks[bone];
+		const CompressedKey* translationKeys = _translationKeys + translationTrack.firstKey;
+		const CompressedTranslationRange& range = _translationRanges[bone];
+		glm::vec3& translation = pose.translations[bone];
+
+		if (translationTrack.numKeys == 1)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				translation[c] = range.min[c] + translationKeys[0].value[c] * (range.extent[c] / 65535.0f);
+			}
+		}
+		else
+		{
+			float f;
+			const uint32_t key = _FindKey(translationKeys, translationTrack.numKeys, keyTime, cursors[2 * bone + 1], f);
+
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				const float a = static_cast<float>(translationKeys[key].value[c]);
+				const float b = static_cast<float>(translationKeys[key + 1].value[c]);
+				translation[c] = range.min[c] + (a + (b - a) * f) * (range.extent[c] / 65535.0f);
+			}
+		}
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <glm.hpp>
+
+#include "common.hh"
+#include "math/math_quat.hh"
+#include "renderer/skeletal_animation.hh"
+
+#define COMPRESSED_ANIMATION_MAGIC 0x4e415043 // "CPAN"
+#define COMPRESSED_ANIMATION_VERSION 1
+#define COMPRESSED_ANIMATION_EXTENSION ".cpanim"
+
+struct AnimationCompressionSettings
+{
+	float translationTolerance = 0.001f; // Largest position error a removed key may leave, in model units
+	float rotationTolerance = 0.001f; // Largest rotation error a removed key may leave, in radians
+};
+
+/// Sits at the start of a compressed clip. Then come, each array numBones long: rotation tracks, translation tracks,
+/// translation ranges; then every rotation key, then every translation key.
+struct CompressedAnimationHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numBones;
+	float duration;
+	uint32_t numRotationKeys;
+	uint32_t numTranslationKeys;
+};
+
+/// One bone's keys, contiguous within their key array. A single key holds the bone still.
+struct CompressedTrack
+{
+	uint32_t firstKey;
+	uint32_t numKeys;
+};
+
+/// A translation component is min + value / 65535 * extent.
+struct CompressedTranslationRange
+{
+	float min[3];
+	float extent[3];
+};
+
+/// 8 bytes, so a cache line holds 8 keys. time is a fraction of the clip's duration, 0 to 65535.
+/// Rotations are smallest-three: the top 2 bits of the 48 name the dropped (largest) component, which is positive;
+/// the other three are 15 bits each over [-1/sqrt(2), 1/sqrt(2)]. Translations are 16 bits per component.
+struct CompressedKey
+{
+	uint16_t time;
+	uint16_t value[3];
+};
+
+/// Strips keys that linear interpolation reproduces within the tolerances, bone by bone and separately for rotations
+/// and translations, then quantizes what is left. out receives the whole clip, ready to write to disk.
+/// Returns false (and logs) for clips without keyframes or with keyframes of different sizes.
+bool CompressAnimation(const Animation& animation, const AnimationCompressionSettings& settings, std::vector<uint8_t>& out);
+
+/// A compressed clip, sampled straight from its packed keys. Points into memory owned by someone else, usually
+/// a MappedFile or the output of CompressAnimation(), which must outlive it.
+class CompressedAnimation
+{
+private:
+	const CompressedAnimationHeader* _header;
+	const CompressedTrack* _rotationTracks;
+	const CompressedTrack* _translationTracks;
+	const CompressedTranslationRange* _translationRanges;
+	const CompressedKey* _rotationKeys;
+	const CompressedKey* _translationKeys;
+	size_t _size;
+public:
+	CompressedAnimation();
+	~CompressedAnimation();
+
+	/// Returns false if data isn't a complete clip of this version.
+	bool Parse(const uint8_t* data, size_t size);
+
+	/// Interpolates every bone's two surrounding keys at time (clamped to the clip) into pose, which must already
+	/// have GetNumBones() bones. Each track is searched on its own, so nothing else is decompressed.
+	/// cursors holds the key each track was at, a rotation and a translation per bone, and is set to 0s if it isn't
+	/// that long. Playing forward, a track walks on from its cursor; only a seek or a jump back binary searches.
+	void Sample(float time, std::vector<uint32_t>& cursors, Pose& pose) const;
+
+	inline bool IsValid() const { return _header != nullptr; }
+	inline uint32_t GetNumBones() const { return _header->numBones; }
+	inline float GetDuration() const { return _header->duration; }
+	inline size_t GetSize() const { return _size; }
+};
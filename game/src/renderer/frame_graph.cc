@@ -0,0 +1,618 @@
+#include "frame_graph.hh"
+
+#include <algorithm>
+
+/// Used for memory statistics only.
+static size_t _GetBytesPerPixel(GLenum format)
+{
+	switch (format)
+	{
+	case GL_R8:
+		return 1;
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_RGBA16F:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default: // GL_RGBA8, GL_R11F_G11F_B10F, GL_RG16F, GL_R32F, GL_DEPTH24_STENCIL8, GL_DEPTH_COMPONENT32F, ...
+		return 4;
+	}
+}
+
+static bool _IsDepthFormat(GLenum format)
+{
+	return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F
+		|| format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+static bool _HasStencil(GLenum format)
+{
+	return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+FrameGraph::FrameGraph()
+	: _isCompiled(false)
+{
+}
+
+FrameGraph::~FrameGraph()
+{
+	for (auto& i : _physicalTextures)
+	{
+		if (i.id != 0)
+		{
+			glDeleteTextures(1, &i.id);
+		}
+	}
+
+	if (!_retiredTextures.empty())
+	{
+		glDeleteTextures(static_cast<GLsizei>(_retiredTextures.size()), _retiredTextures.data());
+	}
+
+	if (!_framebuffers.empty())
+	{
+		glDeleteFramebuffers(static_cast<GLsizei>(_framebuffers.size()), _framebuffers.data());
+	}
+}
+
+void FrameGraph::Reset()
+{
+	_resources.clear();
+	_passes.clear();
+	_executionOrder.clear();
+	_isCompiled = false;
+}
+
+FrameGraphResource FrameGraph::CreateTexture(const char* name, const FrameGraphTextureDesc& desc)
+{
+	_Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	resource.isImported = false;
+	resource.isBackbuffer = false;
+	resource.importedTexture = 0;
+	resource.firstUse = resource.lastUse = 0;
+	resource.physical = NULL_FRAME_GRAPH_RESOURCE;
+
+	_resources.push_back(resource);
+	return static_cast<FrameGraphResource>(_resources.size() - 1);
+}
+
+FrameGraphResource FrameGraph::ImportTexture(const char* name, GLuint texture, const FrameGraphTextureDesc& desc)
+{
+	const FrameGraphResource handle = CreateTexture(name, desc);
+	_resources[handle].isImported = true;
+	_resources[handle].importedTexture = texture;
+
+	return handle;
+}
+
+FrameGraphResource FrameGraph::ImportBackbuffer(const char* name, uint32_t width, uint32_t height)
+{
+	const FrameGraphResource handle = ImportTexture(name, 0, { width, height, GL_RGBA8 });
+	_resources[handle].isBackbuffer = true;
+
+	return handle;
+}
+
+FrameGraphPass FrameGraph::AddPass(const char* name, std::function<void(const FrameGraph&)> execute)
+{
+	_Pass pass;
+	pass.name = name;
+	pass.execute = std::move(execute);
+	pass.clearColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	pass.hasSideEffects = false;
+	pass.isCulled = false;
+
+	_passes.push_back(std::move(pass));
+	return static_cast<FrameGraphPass>(_passes.size() - 1);
+}
+
+void FrameGraph::Read(FrameGraphPass pass, FrameGraphResource resource)
+{
+	_passes[pass].reads.push_back(resource);
+	_resources[resource].readers.push_back(pass);
+}
+
+void FrameGraph::Write(FrameGraphPass pass, FrameGraphResource resource, bool clear)
+{
+	_passes[pass].writes.push_back(resource);
+	_resources[resource].writers.push_back(pass);
+
+	if (clear)
+	{
+		_passes[pass].clears.push_back(resource);
+	}
+
+	if (_resources[resource].isImported)
+	{
+		_passes[pass].hasSideEffects = true;
+	}
+}
+
+void FrameGraph::SetClearColor(FrameGraphPass pass, const glm::vec4& color)
+{
+	_passes[pass].clearColor = color;
+}
+
+void FrameGraph::SetSideEffects(FrameGraphPass pass)
+{
+	_passes[pass].hasSideEffects = true;
+}
+
+bool FrameGraph::_SortPasses()
+{
+	// Edges: each writer of a resource to the next one, and the last writer to every pass that only reads it
+	std::vector<std::vector<FrameGraphPass>> successors(_passes.size());
+	std::vector<uint32_t> numPredecessors(_passes.size(), 0);
+
+	auto addEdge = [&](FrameGraphPass from, FrameGraphPass to)
+	{
+		if (from != to)
+		{
+			successors[from].push_back(to);
+			numPredecessors[to]++;
+		}
+	};
+
+	for (const auto& r : _resources)
+	{
+		for (size_t i = 1; i < r.writers.size(); i++)
+		{
+			addEdge(r.writers[i - 1], r.writers[i]);
+		}
+
+		if (r.writers.empty())
+		{
+			continue;
+		}
+
+		for (FrameGraphPass reader : r.readers)
+		{
+			if (std::find(r.writers.begin(), r.writers.end(), reader) == r.writers.end())
+			{
+				addEdge(r.writers.back(), reader);
+			}
+		}
+	}
+
+	// Kahn's algorithm, always taking the earliest added pass that is ready, so independent passes keep their order
+	std::vector<uint8_t> isSorted(_passes.size(), 0);
+	_executionOrder.clear();
+
+	while (_executionOrder.size() < _passes.size())
+	{
+		FrameGraphPass next = NULL_FRAME_GRAPH_RESOURCE;
+		for (FrameGraphPass p = 0; p < _passes.size(); p++)
+		{
+			if (!isSorted[p] && numPredecessors[p] == 0)
+			{
+				next = p;
+				break;
+			}
+		}
+
+		if (next == NULL_FRAME_GRAPH_RESOURCE)
+		{
+			for (FrameGraphPass p = 0; p < _passes.size(); p++)
+			{
+				if (!isSorted[p])
+				{
+					DEBUG_LOG("FrameGraph", LOG_ERROR, "Pass \"%s\" is part of a dependency cycle", _passes[p].name);
+				}
+			}
+
+			_executionOrder.clear();
+			return false;
+		}
+
+		isSorted[next] = 1;
+		_executionOrder.push_back(next);
+
+		for (FrameGraphPass s : successors[next])
+		{
+			numPredecessors[s]--;
+		}
+	}
+
+	return true;
+}
+
+void FrameGraph::_CullPasses()
+{
+	for (auto& p : _passes)
+	{
+		p.isCulled = !p.hasSideEffects;
+	}
+
+	// Walk backwards from the passes that must run: whoever last wrote what a live pass reads is live too
+	for (auto it = _executionOrder.rbegin(); it != _executionOrder.rend(); ++it)
+	{
+		const FrameGraphPass p = *it;
+		if (_passes[p].isCulled)
+		{
+			continue;
+		}
+
+		for (FrameGraphResource r : _passes[p].reads)
+		{
+			const auto& writers = _resources[r].writers;
+			const auto self = std::find(writers.begin(), writers.end(), p);
+
+			if (self != writers.end())
+			{
+				if (self != writers.begin())
+				{
+					_passes[*(self - 1)].isCulled = false;
+				}
+			}
+			else if (!writers.empty())
+			{
+				_passes[writers.back()].isCulled = false;
+			}
+			else if (!_resources[r].isImported)
+			{
+				DEBUG_LOG("FrameGraph", LOG_WARN, "Pass \"%s\" reads \"%s\", which nothing writes", _passes[p].name, _resources[r].name);
+			}
+		}
+	}
+
+	_executionOrder.erase(std::remove_if(_executionOrder.begin(), _executionOrder.end(), [this](FrameGraphPass p)
+	{
+		return _passes[p].isCulled;
+	}), _executionOrder.end());
+}
+
+void FrameGraph::_AssignPhysicalTextures()
+{
+	std::vector<std::vector<FrameGraphResource>> firstUses(_executionOrder.size()), lastUses(_executionOrder.size());
+	std::vector<uint8_t> isUsed(_resources.size(), 0);
+
+	for (uint32_t position = 0; position < _executionOrder.size(); position++)
+	{
+		const _Pass& pass = _passes[_executionOrder[position]];
+
+		for (const auto* list : { &pass.reads, &pass.writes })
+		{
+			for (FrameGraphResource r : *list)
+			{
+				if (!isUsed[r])
+				{
+					isUsed[r] = 1;
+					_resources[r].firstUse = position;
+				}
+
+				_resources[r].lastUse = position;
+			}
+		}
+	}
+
+	for (FrameGraphResource r = 0; r < _resources.size(); r++)
+	{
+		_resources[r].physical = NULL_FRAME_GRAPH_RESOURCE;
+
+		if (isUsed[r] && !_resources[r].isImported)
+		{
+			firstUses[_resources[r].firstUse].push_back(r);
+			lastUses[_resources[r].lastUse].push_back(r);
+		}
+	}
+
+	for (auto& i : _physicalTextures)
+	{
+		i.isUsed = false;
+	}
+
+	// Textures are handed out when a resource is first used and become free for the same size and format after its last use
+	std::vector<uint8_t> isLive(_physicalTextures.size(), 0);
+
+	for (uint32_t position = 0; position < _executionOrder.size(); position++)
+	{
+		for (FrameGraphResource r : firstUses[position])
+		{
+			const FrameGraphTextureDesc& desc = _resources[r].desc;
+			uint32_t chosen = NULL_FRAME_GRAPH_RESOURCE;
+
+			// Prefer a texture that already has the right size and format, then one the graph doesn't need this frame
+			for (uint32_t i = 0; i < _physicalTextures.size() && chosen == NULL_FRAME_GRAPH_RESOURCE; i++)
+			{
+				if (!isLive[i] && _physicalTextures[i].desc == desc)
+				{
+					chosen = i;
+				}
+			}
+			for (uint32_t i = 0; i < _physicalTextures.size() && chosen == NULL_FRAME_GRAPH_RESOURCE; i++)
+			{
+				if (!_physicalTextures[i].isUsed)
+				{
+					chosen = i;
+				}
+			}
+
+			if (chosen == NULL_FRAME_GRAPH_RESOURCE)
+			{
+				_physicalTextures.push_back({ desc, 0, false });
+				isLive.push_back(0);
+				chosen = static_cast<uint32_t>(_physicalTextures.size() - 1);
+			}
+
+			_PhysicalTexture& texture = _physicalTextures[chosen];
+			if (!(texture.desc == desc))
+			{
+				// Recreated by Execute() with the new size and format
+				texture.desc = desc;
+				if (texture.id != 0)
+				{
+					_retiredTextures.push_back(texture.id);
+					texture.id = 0;
+				}
+			}
+
+			texture.isUsed = true;
+			isLive[chosen] = 1;
+			_resources[r].physical = chosen;
+		}
+
+		for (FrameGraphResource r : lastUses[position])
+		{
+			isLive[_resources[r].physical] = 0;
+		}
+	}
+}
+
+bool FrameGraph::Compile()
+{
+	_isCompiled = false;
+
+	if (!_SortPasses())
+	{
+		return false;
+	}
+
+	_CullPasses();
+	_AssignPhysicalTextures();
+
+	_isCompiled = true;
+	return true;
+}
+
+void FrameGraph::_CreatePhysicalTextures()
+{
+	if (!_retiredTextures.empty())
+	{
+		glDeleteTextures(static_cast<GLsizei>(_retiredTextures.size()), _retiredTextures.data());
+		_retiredTextures.clear();
+	}
+
+	for (auto& i : _physicalTextures)
+	{
+		if (!i.isUsed)
+		{
+			// Not needed by this graph, give the memory back
+			if (i.id != 0)
+			{
+				glDeleteTextures(1, &i.id);
+				i.id = 0;
+			}
+			continue;
+		}
+
+		if (i.id != 0)
+		{
+			continue;
+		}
+
+		const GLint filter = _IsDepthFormat(i.desc.format) ? GL_NEAREST : GL_LINEAR;
+
+		glCreateTextures(GL_TEXTURE_2D, 1, &i.id);
+		glTextureStorage2D(i.id, 1, i.desc.format, i.desc.width, i.desc.height);
+		glTextureParameteri(i.id, GL_TEXTURE_MIN_FILTER, filter);
+		glTextureParameteri(i.id, GL_TEXTURE_MAG_FILTER, filter);
+		glTextureParameteri(i.id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(i.id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+}
+
+void FrameGraph::_BindTargets(uint32_t position, const _Pass& pass)
+{
+	std::vector<FrameGraphResource> colors;
+	FrameGraphResource depth = NULL_FRAME_GRAPH_RESOURCE;
+	FrameGraphResource backbuffer = NULL_FRAME_GRAPH_RESOURCE;
+
+	for (FrameGraphResource r : pass.writes)
+	{
+		if (_resources[r].isBackbuffer)
+		{
+			backbuffer = r;
+		}
+		else if (!_resources[r].isImported)
+		{
+			if (_IsDepthFormat(_resources[r].desc.format))
+			{
+				depth = r;
+			}
+			else
+			{
+				colors.push_back(r);
+			}
+		}
+	}
+
+	GLuint framebuffer = 0;
+	FrameGraphTextureDesc size;
+
+	if (backbuffer != NULL_FRAME_GRAPH_RESOURCE)
+	{
+		if (!colors.empty() || depth != NULL_FRAME_GRAPH_RESOURCE)
+		{
+			DEBUG_LOG("FrameGraph", LOG_ERROR, "Pass \"%s\" writes the backbuffer and transient textures at once, only the backbuffer is bound", pass.name);
+		}
+
+		size = _resources[backbuffer].desc;
+	}
+	else if (!colors.empty() || depth != NULL_FRAME_GRAPH_RESOURCE)
+	{
+		framebuffer = _framebuffers[position];
+		size = _resources[colors.empty() ? depth : colors[0]].desc;
+
+		GLenum drawBuffers[8];
+		const uint32_t numColors = std::min<uint32_t>(static_cast<uint32_t>(colors.size()), 8);
+
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0 + i, i < numColors ? GetTexture(colors[i]) : 0, 0);
+			drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+		}
+
+		// Clear both slots, since the previous frame may have used the other one
+		glNamedFramebufferTexture(framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, 0, 0);
+		glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, 0, 0);
+		if (depth != NULL_FRAME_GRAPH_RESOURCE)
+		{
+			const GLenum attachment = _HasStencil(_resources[depth].desc.format) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+			glNamedFramebufferTexture(framebuffer, attachment, GetTexture(depth), 0);
+		}
+
+		if (numColors > 0)
+		{
+			glNamedFramebufferDrawBuffers(framebuffer, numColors, drawBuffers);
+		}
+		else
+		{
+			glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+		}
+
+		const GLenum status = glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			DEBUG_LOG("FrameGraph", LOG_ERROR, "Framebuffer for pass \"%s\" is incomplete: 0x%x", pass.name, status);
+		}
+	}
+	else
+	{
+		// Only imported textures, the pass binds its own targets
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, size.width, size.height);
+
+	if (pass.clears.empty())
+	{
+		return;
+	}
+
+	// Clears obey the write masks
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+
+	for (FrameGraphResource r : pass.clears)
+	{
+		if (_resources[r].isBackbuffer)
+		{
+			glClearNamedFramebufferfv(0, GL_COLOR, 0, &pass.clearColor[0]);
+		}
+		else if (r == depth)
+		{
+			if (_HasStencil(_resources[r].desc.format))
+			{
+				glClearNamedFramebufferfi(framebuffer, GL_DEPTH_STENCIL, 0, 1.0f, 0);
+			}
+			else
+			{
+				const float one = 1.0f;
+				glClearNamedFramebufferfv(framebuffer, GL_DEPTH, 0, &one);
+			}
+		}
+		else
+		{
+			const auto color = std::find(colors.begin(), colors.end(), r);
+			if (color != colors.end())
+			{
+				glClearNamedFramebufferfv(framebuffer, GL_COLOR, static_cast<GLint>(color - colors.begin()), &pass.clearColor[0]);
+			}
+		}
+	}
+}
+
+void FrameGraph::Execute()
+{
+	if (!_isCompiled)
+	{
+		DEBUG_LOG("FrameGraph", LOG_ERROR, "Execute() called without a successful Compile()");
+		return;
+	}
+
+	_CreatePhysicalTextures();
+
+	if (_framebuffers.size() < _executionOrder.size())
+	{
+		const size_t first = _framebuffers.size();
+		_framebuffers.resize(_executionOrder.size());
+		glCreateFramebuffers(static_cast<GLsizei>(_framebuffers.size() - first), &_framebuffers[first]);
+	}
+
+	for (uint32_t position = 0; position < _executionOrder.size(); position++)
+	{
+		const _Pass& pass = _passes[_executionOrder[position]];
+
+		_BindTargets(position, pass);
+		pass.execute(*this);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint FrameGraph::GetTexture(FrameGraphResource resource) const
+{
+	const _Resource& r = _resources[resource];
+
+	if (r.isImported)
+	{
+		return r.importedTexture;
+	}
+
+	return r.physical != NULL_FRAME_GRAPH_RESOURCE ? _physicalTextures[r.physical].id : 0;
+}
+
+uint32_t FrameGraph::GetNumPhysicalTextures() const
+{
+	uint32_t count = 0;
+	for (const auto& i : _physicalTextures)
+	{
+		count += i.isUsed ? 1 : 0;
+	}
+
+	return count;
+}
+
+size_t FrameGraph::GetTransientMemory() const
+{
+	size_t bytes = 0;
+	for (const auto& i : _physicalTextures)
+	{
+		if (i.isUsed)
+		{
+			bytes += static_cast<size_t>(i.desc.width) * i.desc.height * _GetBytesPerPixel(i.desc.format);
+		}
+	}
+
+	return bytes;
+}
+
+size_t FrameGraph::GetUnaliasedTransientMemory() const
+{
+	size_t bytes = 0;
+	for (const auto& r : _resources)
+	{
+		if (r.physical != NULL_FRAME_GRAPH_RESOURCE)
+		{
+			bytes += static_cast<size_t>(r.desc.width) * r.desc.height * _GetBytesPerPixel(r.desc.format);
+		}
+	}
+
+	return bytes;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include <glew.h>
+
+#include <glm.hpp>
+
+#include "common.hh"
+
+typedef uint32_t FrameGraphResource;
+typedef uint32_t FrameGraphPass;
+#define NULL_FRAME_GRAPH_RESOURCE 0xffffffff
+
+struct FrameGraphTextureDesc
+{
+	uint32_t width;
+	uint32_t height;
+	GLenum format; // Sized internal format: GL_RGBA8, GL_RGBA16F, GL_DEPTH24_STENCIL8, ...
+
+	inline bool operator==(const FrameGraphTextureDesc& other) const
+	{
+		return width == other.width && height == other.height && format == other.format;
+	}
+};
+
+/// Declarative list of render passes for one frame.
+///
+/// Every frame, passes are added with the textures they read and write, then Compile() works out which passes
+/// actually contribute to the screen (or to an imported texture), puts them in dependency order, and gives each
+/// transient texture a physical GL texture. Transient textures whose lifetimes don't overlap share memory, so a
+/// chain of post-processing passes only ever needs two textures of each size and format.
+///
+/// Ordering rules: writers of a resource run in the order they were added, and pure readers run after the last one.
+/// A pass that draws on top of existing contents must Read() the resource as well as Write() it.
+///
+/// The graph binds a framebuffer with every transient texture (or the backbuffer) a pass writes, sets the
+/// viewport and does the requested clears before calling the pass. Imported textures are only used for ordering
+/// and culling; passes writing those bind their own targets (see CascadedShadowMap).
+/// Transient contents are undefined when a pass first writes them: clear them or overwrite every pixel.
+class FrameGraph
+{
+private:
+	struct _Resource
+	{
+		const char* name;
+		FrameGraphTextureDesc desc;
+		bool isImported;
+		bool isBackbuffer;
+		GLuint importedTexture;
+
+		std::vector<FrameGraphPass> writers; // In the order they were added
+		std::vector<FrameGraphPass> readers;
+		uint32_t firstUse, lastUse; // Positions in _executionOrder
+		uint32_t physical; // Into _physicalTextures, transient only
+	};
+
+	struct _Pass
+	{
+		const char* name;
+		std::function<void(const FrameGraph&)> execute;
+		std::vector<FrameGraphResource> reads;
+		std::vector<FrameGraphResource> writes;
+		std::vector<FrameGraphResource> clears;
+		glm::vec4 clearColor;
+		bool hasSideEffects;
+		bool isCulled;
+	};
+
+	struct _PhysicalTexture
+	{
+		FrameGraphTextureDesc desc;
+		GLuint id; // 0 until Execute() creates it
+		bool isUsed; // By the graph compiled last
+	};
+
+	std::vector<_Resource> _resources;
+	std::vector<_Pass> _passes;
+	std::vector<FrameGraphPass> _executionOrder;
+	bool _isCompiled;
+
+	// Persist across frames
+	std::vector<_PhysicalTexture> _physicalTextures;
+	std::vector<GLuint> _retiredTextures; // Resized by Compile(), deleted by the next Execute()
+	std::vector<GLuint> _framebuffers; // One per position in _executionOrder, reattached every frame
+
+	bool _SortPasses();
+	void _CullPasses();
+	void _AssignPhysicalTextures();
+
+	void _CreatePhysicalTextures();
+	void _BindTargets(uint32_t position, const _Pass& pass);
+public:
+	FrameGraph();
+	~FrameGraph();
+
+	/// Drops every pass and resource. Physical textures and framebuffers are kept for the next frame.
+	void Reset();
+
+	/// A texture that only lives within this frame.
+	FrameGraphResource CreateTexture(const char* name, const FrameGraphTextureDesc& desc);
+
+	/// A texture owned by someone else. Passes writing it are never culled.
+	FrameGraphResource ImportTexture(const char* name, GLuint texture, const FrameGraphTextureDesc& desc);
+
+	/// The default framebuffer. Passes writing it are never culled.
+	FrameGraphResource ImportBackbuffer(const char* name, uint32_t width, uint32_t height);
+
+	FrameGraphPass AddPass(const char* name, std::function<void(const FrameGraph&)> execute);
+
+	void Read(FrameGraphPass pass, FrameGraphResource resource);
+	/// If clear is set, the graph clears the texture before the pass runs: color to the pass' clear color, depth to 1, stencil to 0.
+	void Write(FrameGraphPass pass, FrameGraphResource resource, bool clear = false);
+	void SetClearColor(FrameGraphPass pass, const glm::vec4& color);
+	/// Keeps a pass that writes nothing anyone reads, e.g. one that only reads back results.
+	void SetSideEffects(FrameGraphPass pass);
+
+	/// Culls, orders and allocates. Doesn't touch GL, so it can run without a context.
+	/// Returns false (and logs) on a dependency cycle.
+	bool Compile();
+
+	/// Creates any missing textures, then runs the passes that survived Compile().
+	void Execute();
+
+	/// The GL texture behind a resource. Only valid while Execute() is running the passes.
+	GLuint GetTexture(FrameGraphResource resource) const;
+
+	inline bool IsPassCulled(FrameGraphPass pass) const { return _passes[pass].isCulled; }
+	inline const std::vector<FrameGraphPass>& GetExecutionOrder() const { return _executionOrder; }
+	/// Distinct textures the compiled graph needs, against one per transient resource without aliasing.
+	uint32_t GetNumPhysicalTextures() const;
+	size_t GetTransientMemory() const;
+	size_t GetUnaliasedTransientMemory() const;
+};
@@ -0,0 +1,105 @@
+#include "geometry_arena.hh"
+
+GeometryArena::GeometryArena(VertexLayout layout, uint32_t vertexCapacity, uint32_t indexCapacity)
+	: _layout(layout), _stride(GetVertexStride(layout)),
+	_vertexCapacity(vertexCapacity), _indexCapacity(indexCapacity), _numVertices(0), _numIndices(0)
+{
+	glCreateBuffers(1, &_vertexBuffer);
+	glNamedBufferStorage(_vertexBuffer, static_cast<GLsizeiptr>(_vertexCapacity) * _stride, NULL, GL_DYNAMIC_STORAGE_BIT);
+
+	glCreateBuffers(1, &_elementBuffer);
+	glNamedBufferStorage(_elementBuffer, _indexCapacity * sizeof(GLuint), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+	glCreateVertexArrays(1, &_vertexArrayObject);
+	glVertexArrayElementBuffer(_vertexArrayObject, _elementBuffer);
+
+	// Binding 0: packed per-vertex data, same attribute locations as Mesh
+	glVertexArrayVertexBuffer(_vertexArrayObject, 0, _vertexBuffer, 0, _stride);
+	SetVertexArrayFormat(_vertexArrayObject, 0, _layout);
+
+	// Binding 1: one model matrix per draw. The buffer itself is attached in Flush(), since it moves around the ring buffer every frame
+	for (GLuint i = 0; i < 4; i++)
+	{
+		const GLuint location = GEOMETRY_ARENA_INSTANCE_MATRIX_LOCATION + i;
+		glVertexArrayAttribFormat(_vertexArrayObject, location, 4, GL_FLOAT, GL_FALSE, i * sizeof(glm::vec4));
+		glVertexArrayAttribBinding(_vertexArrayObject, location, 1);
+		glEnableVertexArrayAttrib(_vertexArrayObject, location);
+	}
+	glVertexArrayBindingDivisor(_vertexArrayObject, 1, 1);
+}
+
+GeometryArena::~GeometryArena()
+{
+	glDeleteVertexArrays(1, &_vertexArrayObject);
+	glDeleteBuffers(1, &_vertexBuffer);
+	glDeleteBuffers(1, &_elementBuffer);
+}
+
+bool GeometryArena::Allocate(const PerVertexData* vertices, uint32_t numVertices, const GLuint* indices, uint32_t numIndices, GeometryRange& range)
+{
+	if (indices == NULL)
+	{
+		_scratchIndices.resize(numVertices);
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			_scratchIndices[i] = i;
+		}
+
+		indices = _scratchIndices.data();
+		numIndices = numVertices;
+	}
+
+	if (_numVertices + numVertices > _vertexCapacity || _numIndices + numIndices > _indexCapacity)
+	{
+		DEBUG_LOG("GeometryArena", LOG_ERROR, "Out of space for a mesh with %u vertices and %u indices (%u/%u vertices, %u/%u indices used)",
+			numVertices, numIndices, _numVertices, _vertexCapacity, _numIndices, _indexCapacity);
+		return false;
+	}
+
+	PackVertices(_layout, vertices, numVertices, _scratchVertices);
+
+	glNamedBufferSubData(_vertexBuffer, static_cast<GLintptr>(_numVertices) * _stride, _scratchVertices.size(), _scratchVertices.data());
+	glNamedBufferSubData(_elementBuffer, _numIndices * sizeof(GLuint), numIndices * sizeof(GLuint), indices);
+
+	range.baseVertex = _numVertices;
+	range.firstIndex = _numIndices;
+	range.numIndices = numIndices;
+
+	_numVertices += numVertices;
+	_numIndices += numIndices;
+
+	return true;
+}
+
+void GeometryArena::Flush(Shader* shader, RingBuffer& frameData)
+{
+	if (_commands.empty())
+	{
+		return;
+	}
+
+	const GLsizeiptr matricesSize = _modelMatrices.size() * sizeof(glm::mat4);
+	const GLsizeiptr commandsSize = _commands.size() * sizeof(DrawElementsIndirectCommand);
+
+	RingBufferAllocation matrices = frameData.Allocate(matricesSize, sizeof(glm::vec4));
+	RingBufferAllocation commands = frameData.Allocate(commandsSize, sizeof(GLuint));
+
+	if (matrices.IsValid() && commands.IsValid())
+	{
+		memcpy(matrices.data, _modelMatrices.data(), matricesSize);
+		memcpy(commands.data, _commands.data(), commandsSize);
+
+		glVertexArrayVertexBuffer(_vertexArrayObject, 1, matrices.buffer, matrices.offset, sizeof(glm::mat4));
+
+		shader->Use();
+
+		glBindVertexArray(_vertexArrayObject);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)commands.offset, static_cast<GLsizei>(_commands.size()), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+
+	_commands.clear();
+	_modelMatrices.clear();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+
+#include <glew.h>
+
+#include <glm.hpp>
+
+#include "common.hh"
+#include "renderer/vertex.hh"
+#include "renderer/shader.hh"
+#include "renderer/ring_buffer.hh"
+
+/// Attribute locations 6-9 hold the per-draw model matrix, one column each.
+#define GEOMETRY_ARENA_INSTANCE_MATRIX_LOCATION 6
+
+/// Where a mesh lives inside the arena's shared buffers.
+struct GeometryRange
+{
+	uint32_t baseVertex = 0;
+	uint32_t firstIndex = 0;
+	uint32_t numIndices = 0;
+};
+
+/// Layout fixed by the GL spec for glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/// One VAO, one vertex buffer and one index buffer shared by every static mesh with the same packed VertexLayout.
+/// Meshes are suballocated once at load time. Each frame, visible meshes are Submit()ted with their world matrix
+/// and Flush() draws all of them with a single glMultiDrawElementsIndirect call. The command buffer and the
+/// model matrices (read through an instanced attribute, indexed by baseInstance) are streamed through the RingBuffer.
+class GeometryArena
+{
+private:
+	GLuint _vertexArrayObject;
+	GLuint _vertexBuffer;
+	GLuint _elementBuffer;
+
+	VertexLayout _layout;
+	GLsizei _stride;
+
+	uint32_t _vertexCapacity;
+	uint32_t _indexCapacity;
+	uint32_t _numVertices;
+	uint32_t _numIndices;
+
+	// Built on the CPU between Flush() calls
+	std::vector<DrawElementsIndirectCommand> _commands;
+	std::vector<glm::mat4> _modelMatrices;
+
+	std::vector<uint8_t> _scratchVertices; // Packed copy of the mesh being uploaded
+	std::vector<GLuint> _scratchIndices; // For meshes that come without an index buffer
+public:
+	GeometryArena(VertexLayout layout, uint32_t vertexCapacity, uint32_t indexCapacity);
+	~GeometryArena();
+
+	/// Packs a mesh into the arena's layout and copies it into the shared buffers. If indices is NULL, every vertex is used once, in order.
+	/// Returns false (and leaves range untouched) if the arena is full.
+	bool Allocate(const PerVertexData* vertices, uint32_t numVertices, const GLuint* indices, uint32_t numIndices, GeometryRange& range);
+
+	/// Queues one draw of range for the next Flush().
+	inline void Submit(const GeometryRange& range, const glm::mat4& modelMatrix)
+	{
+		DrawElementsIndirectCommand command;
+		command.count = range.numIndices;
+		command.instanceCount = 1;
+		command.firstIndex = range.firstIndex;
+		command.baseVertex = static_cast<GLint>(range.baseVertex);
+		command.baseInstance = static_cast<GLuint>(_commands.size());
+
+		_commands.push_back(command);
+		_modelMatrices.push_back(modelMatrix);
+	}
+
+	/// Draws everything submitted since the last Flush() with the currently bound textures, using the given shader.
+	/// The shader must be an INSTANCED variant, it reads the model matrices from the per-instance attribute.
+	void Flush(Shader* shader, RingBuffer& frameData);
+
+	inline VertexLayout GetVertexLayout() const { return _layout; }
+	inline size_t GetNumPendingDraws() const { return _commands.size(); }
+	inline uint32_t GetNumVertices() const { return _numVertices; }
+	inline uint32_t GetNumIndices() const { return _numIndices; }
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <float.h>
+
 #include "libs.hh"
 
 class Light
@@ -56,4 +58,27 @@ public:
 	{
 		_position = val;
 	}
+
+	/// Distance at which the attenuated intensity drops below threshold. Used as the light's bounding sphere for culling.
+	float GetRadius(float threshold = 0.02f) const
+	{
+		// Solve quadratic * d^2 + linear * d + 1 = constant * intensity / threshold
+		const float c = 1.0f - (_constant * _intensity) / threshold;
+		if (c >= 0.0f)
+		{
+			return 0.0f;
+		}
+
+		if (_quadratic <= 0.0f)
+		{
+			return (_linear > 0.0f) ? (-c / _linear) : FLT_MAX;
+		}
+
+		return (-_linear + sqrtf(_linear * _linear - 4.0f * _quadratic * c)) / (2.0f * _quadratic);
+	}
+
+	inline const glm::vec3& GetPosition() const { return _position; }
+	inline const glm::vec3& GetColor() const { return _color; }
+	inline float GetIntensity() const { return _intensity; }
+	inline glm::vec3 GetAttenuation() const { return glm::vec3(_constant, _linear, _quadratic); }
 };
\ No newline at end of file
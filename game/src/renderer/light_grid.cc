@@ -0,0 +1,311 @@
+#include "light_grid.hh"
+
+#include <string.h>
+#include <algorithm>
+
+LightGrid::LightGrid(uint32_t numX, uint32_t numY, uint32_t numZ)
+	: _numX(numX), _numY(numY), _numZ(numZ), _nearPlane(0.1f), _farPlane(100.0f), _depthScale(0.0f), _depthBias(0.0f)
+{
+	if (_numX == 0 || _numX > 255 || _numY == 0 || _numY > 255 || _numZ == 0 || _numZ > 255)
+	{
+		DEBUG_LOG("LightGrid", LOG_WARN, "%ux%ux%u clusters requested, clamping each axis to [1, 255]", _numX, _numY, _numZ);
+		_numX = std::min(std::max(_numX, 1u), 255u);
+		_numY = std::min(std::max(_numY, 1u), 255u);
+		_numZ = std::min(std::max(_numZ, 1u), 255u);
+	}
+
+	_clusters.resize(_numX * _numY * _numZ);
+	_sliceIndices.resize(_numZ);
+	_sliceLights.resize(_numZ);
+}
+
+LightGrid::~LightGrid()
+{
+}
+
+void LightGrid::_FinishRange(LightCellRange& range, float depth, float radius, int rightOfColumns, int leftOfColumns, int aboveRows, int belowRows) const
+{
+	// Entirely right of boundaries 0..k-1 means the first column it can touch is k-1, and so on
+	const int x0 = rightOfColumns - 1;
+	const int x1 = static_cast<int>(_numX) - leftOfColumns;
+	const int y0 = aboveRows - 1;
+	const int y1 = static_cast<int>(_numY) - belowRows;
+
+	const float nearest = depth - radius;
+	const float farthest = depth + radius;
+
+	range.visible = 0;
+	if (x0 >= static_cast<int>(_numX) || x1 < 0 || y0 >= static_cast<int>(_numY) || y1 < 0
+		|| farthest < _nearPlane || nearest > _farPlane)
+	{
+		return;
+	}
+
+	const int z0 = (nearest <= _nearPlane) ? 0 : _GetSlice(nearest);
+	const int z1 = (farthest >= _farPlane) ? static_cast<int>(_numZ) - 1 : _GetSlice(farthest);
+
+	range.x0 = static_cast<uint8_t>(std::max(x0, 0));
+	range.x1 = static_cast<uint8_t>(std::min(x1, static_cast<int>(_numX) - 1));
+	range.y0 = static_cast<uint8_t>(std::max(y0, 0));
+	range.y1 = static_cast<uint8_t>(std::min(y1, static_cast<int>(_numY) - 1));
+	range.z0 = static_cast<uint8_t>(std::min(std::max(z0, 0), static_cast<int>(_numZ) - 1));
+	range.z1 = static_cast<uint8_t>(std::min(std::max(z1, 0), static_cast<int>(_numZ) - 1));
+	range.visible = 1;
+}
+
+void LightGrid::_ComputeRangesScalar(const glm::mat4& viewMatrix, const PointLightSoA& lights, size_t begin, size_t end)
+{
+	const glm::mat4& m = viewMatrix;
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const float x = lights.x[i], y = lights.y[i], z = lights.z[i];
+		const float radius = lights.radius[i];
+
+		const float viewX = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+		const float viewY = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+		const float depth = -(m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2]);
+
+		int rightOf = 0, leftOf = 0;
+		for (uint32_t k = 0; k <= _numX; k++)
+		{
+			const float distance = (viewX - _columnSlopes[k] * depth) * _columnNormalizers[k];
+			rightOf += (distance > radius);
+			leftOf += (distance < -radius);
+		}
+
+		int above = 0, below = 0;
+		for (uint32_t k = 0; k <= _numY; k++)
+		{
+			const float distance = (viewY - _rowSlopes[k] * depth) * _rowNormalizers[k];
+			above += (distance > radius);
+			below += (distance < -radius);
+		}
+
+		_FinishRange(_ranges[i], depth, radius, rightOf, leftOf, above, below);
+	}
+}
+
+#ifdef QT_SIMD_SSE
+/// Same arithmetic as the scalar kernel, in the same order, so both produce identical ranges.
+void LightGrid::_ComputeRangesSSE(const glm::mat4& viewMatrix, const PointLightSoA& lights, size_t begin, size_t end)
+{
+	const glm::mat4& m = viewMatrix;
+
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&lights.x[i]);
+		const __m128 y = _mm_loadu_ps(&lights.y[i]);
+		const __m128 z = _mm_loadu_ps(&lights.z[i]);
+		const __m128 radius = _mm_loadu_ps(&lights.radius[i]);
+		const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+		auto transformRow = [&](int row)
+		{
+			__m128 result = _mm_mul_ps(_mm_set1_ps(m[0][row]), x);
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(m[1][row]), y));
+			result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(m[2][row]), z));
+			return _mm_add_ps(result, _mm_set1_ps(m[3][row]));
+		};
+
+		const __m128 viewX = transformRow(0);
+		const __m128 viewY = transformRow(1);
+		const __m128 depth = _mm_sub_ps(_mm_setzero_ps(), transformRow(2));
+
+		// Compare masks are all ones (-1) where true, so subtracting them counts
+		__m128i rightOf = _mm_setzero_si128(), leftOf = _mm_setzero_si128();
+		for (uint32_t k = 0; k <= _numX; k++)
+		{
+			const __m128 distance = _mm_mul_ps(_mm_sub_ps(viewX, _mm_mul_ps(_mm_set1_ps(_columnSlopes[k]), depth)), _mm_set1_ps(_columnNormalizers[k]));
+			rightOf = _mm_sub_epi32(rightOf, _mm_castps_si128(_mm_cmpgt_ps(distance, radius)));
+			leftOf = _mm_sub_epi32(leftOf, _mm_castps_si128(_mm_cmplt_ps(distance, negativeRadius)));
+		}
+
+		__m128i above = _mm_setzero_si128(), below = _mm_setzero_si128();
+		for (uint32_t k = 0; k <= _numY; k++)
+		{
+			const __m128 distance = _mm_mul_ps(_mm_sub_ps(viewY, _mm_mul_ps(_mm_set1_ps(_rowSlopes[k]), depth)), _mm_set1_ps(_rowNormalizers[k]));
+			above = _mm_sub_epi32(above, _mm_castps_si128(_mm_cmpgt_ps(distance, radius)));
+			below = _mm_sub_epi32(below, _mm_castps_si128(_mm_cmplt_ps(distance, negativeRadius)));
+		}
+
+		alignas(16) float depths[4];
+		alignas(16) int32_t counts[4][4];
+		_mm_store_ps(depths, depth);
+		_mm_store_si128(reinterpret_cast<__m128i*>(counts[0]), rightOf);
+		_mm_store_si128(reinterpret_cast<__m128i*>(counts[1]), leftOf);
+		_mm_store_si128(reinterpret_cast<__m128i*>(counts[2]), above);
+		_mm_store_si128(reinterpret_cast<__m128i*>(counts[3]), below);
+
+		// The log for the depth slices stays scalar
+		for (size_t lane = 0; lane < 4; lane++)
+		{
+			_FinishRange(_ranges[i + lane], depths[lane], lights.radius[i + lane], counts[0][lane], counts[1][lane], counts[2][lane], counts[3][lane]);
+		}
+	}
+
+	_ComputeRangesScalar(viewMatrix, lights, i, end);
+}
+#endif
+
+void LightGrid::_BinSlice(uint32_t slice)
+{
+	const uint32_t tilesPerSlice = _numX * _numY;
+	LightCluster* clusters = &_clusters[slice * tilesPerSlice];
+	const std::vector<uint32_t>& lights = _sliceLights[slice];
+	std::vector<uint32_t>& indices = _sliceIndices[slice];
+
+	for (uint32_t i = 0; i < tilesPerSlice; i++)
+	{
+		clusters[i].offset = 0;
+		clusters[i].count = 0;
+	}
+
+	// Count, then turn the counts into offsets (local to this slice), then fill
+	for (const uint32_t light : lights)
+	{
+		const LightCellRange& range = _ranges[light];
+		for (uint32_t y = range.y0; y <= range.y1; y++)
+		{
+			for (uint32_t x = range.x0; x <= range.x1; x++)
+			{
+				clusters[y * _numX + x].count++;
+			}
+		}
+	}
+
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < tilesPerSlice; i++)
+	{
+		clusters[i].offset = total;
+		total += clusters[i].count;
+		clusters[i].count = 0;
+	}
+
+	indices.resize(total);
+
+	for (const uint32_t light : lights)
+	{
+		const LightCellRange& range = _ranges[light];
+		for (uint32_t y = range.y0; y <= range.y1; y++)
+		{
+			for (uint32_t x = range.x0; x <= range.x1; x++)
+			{
+				LightCluster& cluster = clusters[y * _numX + x];
+				indices[cluster.offset + cluster.count++] = light;
+			}
+		}
+	}
+}
+
+void LightGrid::Build(const glm::mat4& viewMatrix, float fovRadians, float aspectRatio, float nearPlane, float farPlane,
+	const PointLightSoA& lights, ThreadPool* pool, bool useSimd)
+{
+	_nearPlane = nearPlane;
+	_farPlane = farPlane;
+
+	const float logDepthRange = logf(_farPlane / _nearPlane);
+	_depthScale = _numZ / logDepthRange;
+	_depthBias = -(_numZ * logf(_nearPlane)) / logDepthRange;
+
+	const float tanHalfFovY = tanf(fovRadians * 0.5f);
+	const float tanHalfFovX = tanHalfFovY * aspectRatio;
+
+	_columnSlopes.resize(_numX + 1);
+	_columnNormalizers.resize(_numX + 1);
+	for (uint32_t k = 0; k <= _numX; k++)
+	{
+		_columnSlopes[k] = tanHalfFovX * (2.0f * k / _numX - 1.0f);
+		_columnNormalizers[k] = 1.0f / sqrtf(1.0f + _columnSlopes[k] * _columnSlopes[k]);
+	}
+
+	_rowSlopes.resize(_numY + 1);
+	_rowNormalizers.resize(_numY + 1);
+	for (uint32_t k = 0; k <= _numY; k++)
+	{
+		_rowSlopes[k] = tanHalfFovY * (2.0f * k / _numY - 1.0f);
+		_rowNormalizers[k] = 1.0f / sqrtf(1.0f + _rowSlopes[k] * _rowSlopes[k]);
+	}
+
+	const size_t numLights = lights.size();
+	_ranges.resize(numLights);
+
+	auto computeRanges = [&](size_t begin, size_t end)
+	{
+#ifdef QT_SIMD_SSE
+		if (useSimd)
+		{
+			_ComputeRangesSSE(viewMatrix, lights, begin, end);
+			return;
+		}
+#endif
+		_ComputeRangesScalar(viewMatrix, lights, begin, end);
+	};
+
+	auto binSlices = [&](size_t begin, size_t end)
+	{
+		for (size_t slice = begin; slice < end; slice++)
+		{
+			_BinSlice(static_cast<uint32_t>(slice));
+		}
+	};
+
+	if (pool)
+	{
+		pool->ParallelFor(numLights, 256, computeRanges);
+	}
+	else
+	{
+		computeRanges(0, numLights);
+	}
+
+	// Cheap compared to the passes around it, and keeps every slice's list in increasing light order
+	for (uint32_t slice = 0; slice < _numZ; slice++)
+	{
+		_sliceLights[slice].clear();
+	}
+
+	for (size_t i = 0; i < numLights; i++)
+	{
+		const LightCellRange& range = _ranges[i];
+		if (range.visible)
+		{
+			for (uint32_t slice = range.z0; slice <= range.z1; slice++)
+			{
+				_sliceLights[slice].push_back(static_cast<uint32_t>(i));
+			}
+		}
+	}
+
+	if (pool)
+	{
+		pool->ParallelFor(_numZ, 1, binSlices);
+	}
+	else
+	{
+		binSlices(0, _numZ);
+	}
+
+	// Join the per-slice lists, turning slice-local offsets into offsets into _lightIndices
+	const uint32_t tilesPerSlice = _numX * _numY;
+	uint32_t sliceStart = 0;
+	for (uint32_t slice = 0; slice < _numZ; slice++)
+	{
+		for (uint32_t i = 0; i < tilesPerSlice; i++)
+		{
+			_clusters[slice * tilesPerSlice + i].offset += sliceStart;
+		}
+
+		sliceStart += static_cast<uint32_t>(_sliceIndices[slice].size());
+	}
+
+	_lightIndices.resize(sliceStart);
+	for (uint32_t slice = 0; slice < _numZ; slice++)
+	{
+		if (!_sliceIndices[slice].empty())
+		{
+			memcpy(&_lightIndices[_clusters[slice * tilesPerSlice].offset], _sliceIndices[slice].data(), _sliceIndices[slice].size() * sizeof(uint32_t));
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <math.h>
+
+#include <glm.hpp>
+
+#include "common.hh"
+#include "math/math_simd.hh"
+#include "util/thread_pool.hh"
+
+/// Point light positions (world space) and radii, stored as separate streams so four lights fit one SSE register.
+struct PointLightSoA
+{
+	std::vector<float> x, y, z;
+	std::vector<float> radius;
+
+	void Resize(size_t count)
+	{
+		x.resize(count); y.resize(count); z.resize(count);
+		radius.resize(count);
+	}
+
+	inline size_t size() const { return x.size(); }
+
+	inline void Set(size_t i, const glm::vec3& position, float r)
+	{
+		x[i] = position.x; y[i] = position.y; z[i] = position.z;
+		radius[i] = r;
+	}
+};
+
+/// First and last cluster a light touches along each axis of the grid.
+struct LightCellRange
+{
+	uint8_t x0, x1;
+	uint8_t y0, y1;
+	uint8_t z0, z1;
+	uint8_t visible;
+	uint8_t padding;
+};
+
+/// Where a cluster's lights start in the index list, and how many there are. Matches a uvec2 in std430.
+struct LightCluster
+{
+	uint32_t offset;
+	uint32_t count;
+};
+
+/// Bins point lights into a grid of froxels (frustum-aligned voxels) covering the camera frustum, for clustered shading.
+/// The grid has numX * numY tiles across the screen and numZ slices in depth, spaced exponentially so clusters
+/// stay roughly cube-shaped. Cluster (x, y, z) is stored at index (z * numY + y) * numX + x.
+///
+/// Build() runs in two passes, both spread over the thread pool:
+/// - per light: move it into view space and find the range of tiles and slices its sphere overlaps (SSE, four lights at a time)
+/// - per depth slice: sort the lights that reach the slice into compact per-cluster lists
+/// Lights in a cluster are listed in increasing index order, so the output does not depend on the thread count.
+class LightGrid
+{
+private:
+	uint32_t _numX, _numY, _numZ;
+
+	float _nearPlane, _farPlane;
+	float _depthScale, _depthBias; // slice = floor(log(depth) * _depthScale + _depthBias)
+
+	// Tile boundary planes pass through the eye; boundary k sits at x = slope * depth. Normalizers turn plane tests into distances
+	std::vector<float> _columnSlopes, _columnNormalizers;
+	std::vector<float> _rowSlopes, _rowNormalizers;
+
+	std::vector<LightCellRange> _ranges; // One per light
+	std::vector<std::vector<uint32_t>> _sliceLights; // Lights whose depth range covers each slice, so binning a slice doesn't scan every light
+	std::vector<LightCluster> _clusters;
+	std::vector<std::vector<uint32_t>> _sliceIndices; // Light lists of each depth slice, before they're joined into _lightIndices
+	std::vector<uint32_t> _lightIndices;
+
+	inline int _GetSlice(float depth) const
+	{
+		return static_cast<int>(floorf(logf(depth) * _depthScale + _depthBias));
+	}
+
+	/// Turns boundary plane counts into a tile range, and adds the depth range.
+	void _FinishRange(LightCellRange& range, float depth, float radius, int rightOfColumns, int leftOfColumns, int aboveRows, int belowRows) const;
+
+	void _ComputeRangesScalar(const glm::mat4& viewMatrix, const PointLightSoA& lights, size_t begin, size_t end);
+#ifdef QT_SIMD_SSE
+	void _ComputeRangesSSE(const glm::mat4& viewMatrix, const PointLightSoA& lights, size_t begin, size_t end);
+#endif
+
+	void _BinSlice(uint32_t slice);
+public:
+	/// The grid is limited to 255 clusters per axis.
+	LightGrid(uint32_t numX = 16, uint32_t numY = 9, uint32_t numZ = 24);
+	~LightGrid();
+
+	/// Rebuilds every cluster's light list for a symmetric perspective camera. fovRadians is the vertical field of view.
+	/// farPlane can be (much) closer than the camera's; fragments past it get no clustered lights.
+	/// pool = nullptr runs everything on the calling thread, useSimd = false forces the scalar kernel.
+	void Build(const glm::mat4& viewMatrix, float fovRadians, float aspectRatio, float nearPlane, float farPlane,
+		const PointLightSoA& lights, ThreadPool* pool = nullptr, bool useSimd = true);
+
+	inline uint32_t GetNumX() const { return _numX; }
+	inline uint32_t GetNumY() const { return _numY; }
+	inline uint32_t GetNumZ() const { return _numZ; }
+	inline float GetDepthScale() const { return _depthScale; }
+	inline float GetDepthBias() const { return _depthBias; }
+
+	inline const std::vector<LightCluster>& GetClusters() const { return _clusters; }
+	inline const std::vector<uint32_t>& GetLightIndices() const { return _lightIndices; }
+	inline const std::vector<LightCellRange>& GetRanges() const { return _ranges; }
+};
@@ -1,22 +1,6 @@
 #include "mesh.hh"
 
-/// Use this to get an array of all current animated transformation matrices by bone ID.
-std::vector<glm::mat4> Mesh::_GetBoneTransforms()
-{
-	std::vector<glm::mat4> boneMatrices;
-	boneMatrices.resize(_numBones);
-	_AddBonesToArray(_boneHierarchy, boneMatrices);
-	return boneMatrices;
-}
-
-void Mesh::_AddBonesToArray(BoneTreeNode& bone, std::vector<glm::mat4>& boneMatrices)
-{
-	boneMatrices[bone.GetID()] = bone.GetAnimTransform();
-	for (auto& childBone : bone.GetChildren())
-	{
-		_AddBonesToArray(childBone, boneMatrices);
-	}
-}
+#include <algorithm>
 
 //Mesh::Mesh(
 //	Vertex* vertices, const uint32_t& numVertices,
@@ -63,10 +47,9 @@ Mesh::Mesh(
 	_numVertices = primitive->GetNumberOfVertices();
 	_numIndices = primitive->GetNumberOfIndices();
 	
-	_position = position;
-	_origin = origin;
-	_rotation = rotation;
-	_scale = scale;
+	_transform = Transform(position, origin, rotation, scale);
+	_inArena = false;
+	_layout = VERTEX_LAYOUT_STATIC;
 
 	_vertices = new PerVertexData[_numVertices];
 	for (uint32_t i = 0; i < _numVertices; i++)
@@ -80,8 +63,8 @@ Mesh::Mesh(
 		_indices[i] = primitive->GetIndices()[i];
 	}
 	
+	_GenerateLODs();
 	_InitMeshBuffers();
-	_UpdateModelMatrix();
 }
 
 Mesh::Mesh(
@@ -92,32 +75,50 @@ Mesh::Mesh(
 	glm::vec3 rotation,
 	glm::vec3 scale)
 	:
-	_position(position),
-	_origin(origin),
-	_rotation(rotation),
-	_scale(scale)
+	_transform(position, origin, rotation, scale),
+	_inArena(false)
 {
 	std::vector<PerVertexData> vertices;
 	if (type & 1)
 	{
-		ImportMD5Mesh(path, vertices, 0x0001);
+		LoadMD5Mesh(path, vertices, DUPLICATE_VERTICES_TO_MATCH_INDEX_BUFFER_SIZE, &_skeleton);
+		_animator.SetSkeleton(&_skeleton);
+		_layout = VERTEX_LAYOUT_SKINNED;
 	}
 	else
 	{
 		ImportOBJ(path, vertices);
+		_layout = VERTEX_LAYOUT_STATIC;
 	}
 	
 
-	_numVertices = vertices.size();
-	_numIndices = 0;
+	// The importers emit flat triangle lists. Weld them into an indexed mesh, order the triangles for the
+	// post-transform cache, then lay the vertices out in the order they are first fetched
+	std::vector<PerVertexData> weldedVertices;
+	std::vector<GLuint> indices;
+	WeldVertices(vertices.data(), static_cast<uint32_t>(vertices.size()), NULL, 0, weldedVertices, indices);
+
+	const float weldedACMR = ComputeACMR(indices.data(), indices.size(), weldedVertices.size());
+	OptimizeVertexCache(indices.data(), indices.size(), weldedVertices.size());
+	OptimizeVertexFetch(weldedVertices, indices.data(), indices.size());
+
+	DEBUG_LOG("Mesh", LOG_INFO, "%s: %zu -> %zu vertices, ACMR 3.000 unindexed, %.3f welded, %.3f optimized",
+		path.c_str(), vertices.size(), weldedVertices.size(), weldedACMR, ComputeACMR(indices.data(), indices.size(), weldedVertices.size()));
+
+	_numVertices = weldedVertices.size();
+	_numIndices = indices.size();
 
 	_vertices = new PerVertexData[_numVertices];
 	for (uint32_t i = 0; i < _numVertices; i++)
 	{
-		_vertices[i] = (vertices.data())[i];
+		_vertices[i] = weldedVertices[i];
 	}
 
-	_indices = NULL;
+	_indices = new GLuint[_numIndices];
+	for (uint32_t i = 0; i < _numIndices; i++)
+	{
+		_indices[i] = indices[i];
+	}
 
 	
 //	_boneHierarchy = BoneTreeNode(1, "A", glm::mat4(1.0f));
@@ -128,16 +129,15 @@ Mesh::Mesh(
 	
 
 
+	_GenerateLODs();
 	_InitMeshBuffers();
-	_UpdateModelMatrix();
 }
 
 Mesh::Mesh(const Mesh& other)
 {
-	_position = other._position;
-	_origin = other._origin;
-	_rotation = other._rotation;
-	_scale = other._scale;
+	_transform = other._transform;
+	_inArena = other._inArena;
+	_layout = other._layout;
 
 	_numVertices = other._numVertices;
 	_numIndices = other._numIndices;
@@ -154,10 +154,20 @@ Mesh::Mesh(const Mesh& other)
 		_indices[i] = other._indices[i];
 	}
 
-	_boneHierarchy = other._boneHierarchy;
+	// Same geometry, so the LODs and the arena copy can be shared
+	_numLODs = other._numLODs;
+	_lodIndices = other._lodIndices;
+	for (uint32_t i = 0; i < MESH_MAX_LODS; i++)
+	{
+		_lods[i] = other._lods[i];
+		_arenaRanges[i] = other._arenaRanges[i];
+	}
+
+	// The animator points at the skeleton it plays on, which is our own copy now
+	_skeleton = other._skeleton;
+	_animator.SetSkeleton(&_skeleton);
 
 	_InitMeshBuffers();
-	_UpdateModelMatrix();
 }
 
 
@@ -169,7 +179,8 @@ Mesh::Mesh(const Mesh& other)
 
 Mesh::~Mesh()
 {
-	glDeleteVertexArrays(1, &_vertexArrayBuffer);
+	glDeleteVertexArrays(1, &_vertexArrayObject);
+	glDeleteVertexArrays(1, &_skinnedVertexArrayObject); // Ignores 0
 	glDeleteBuffers(1, &_vertexArrayBuffer);
 	if (_numIndices > 0)
 	{
@@ -180,66 +191,224 @@ Mesh::~Mesh()
 	delete[] _indices;
 }
 
+/// Builds up to MESH_MAX_LODS - 1 simplified index lists, each about half the triangles of the one before.
+/// Stops early once a level can't get meaningfully smaller without going past the error limit.
+void Mesh::_GenerateLODs()
+{
+	_lods[0].firstIndex = 0;
+	_lods[0].numIndices = _numIndices;
+	_lods[0].error = 0.0f;
+	_numLODs = 1;
+	_lodIndices.clear();
+
+	if (_numIndices < _MIN_LOD_INDICES)
+	{
+		return;
+	}
+
+	qt::AABB bounds;
+	for (uint32_t i = 0; i < _numVertices; i++)
+	{
+		bounds.Expand(_vertices[i].position);
+	}
+	const float maxError = _MAX_LOD_ERROR * 2.0f * glm::length(bounds.GetExtents());
+
+	// Each level simplifies the previous one, which is cheaper and keeps the levels nested
+	std::vector<GLuint> source(_indices, _indices + _numIndices);
+	std::vector<GLuint> simplified;
+
+	for (uint32_t lod = 1; lod < MESH_MAX_LODS; lod++)
+	{
+		const uint32_t target = (_numIndices >> lod) / 3 * 3;
+		const float error = SimplifyMesh(_vertices, _numVertices, source.data(), static_cast<uint32_t>(source.size()), target, maxError, simplified);
+
+		if (simplified.empty() || simplified.size() * 5 > source.size() * 4)
+		{
+			break;
+		}
+
+		// Collapses leave triangles where their neighbours were, which is no longer a cache-friendly order
+		OptimizeVertexCache(simplified.data(), static_cast<uint32_t>(simplified.size()), _numVertices);
+
+		_lods[lod].firstIndex = _numIndices + static_cast<uint32_t>(_lodIndices.size());
+		_lods[lod].numIndices = static_cast<uint32_t>(simplified.size());
+		_lods[lod].error = _lods[lod - 1].error + error; // Each level's error is measured against the level before it
+		_numLODs++;
+
+		_lodIndices.insert(_lodIndices.end(), simplified.begin(), simplified.end());
+		source.swap(simplified);
+	}
+
+	DEBUG_LOG("Mesh", LOG_INFO, "Built %u LODs, smallest has %u of %u triangles",
+		_numLODs, _lods[_numLODs - 1].numIndices / 3, _numIndices / 3);
+}
+
 void Mesh::_InitMeshBuffers()
 {
-	// Create and bind VAO
+	_bounds = qt::AABB();
+	for (uint32_t i = 0; i < _numVertices; i++)
+	{
+		_bounds.Expand(_vertices[i].position);
+	}
+
+	// Only the quantized layout is uploaded, _vertices keeps full precision for CPU-side work
+	std::vector<uint8_t> packedVertices;
+	PackVertices(_layout, _vertices, _numVertices, packedVertices);
+
+	// Create the VAO and a VBO holding the packed vertices
 	glCreateVertexArrays(1, &_vertexArrayObject);
-	glBindVertexArray(_vertexArrayObject);
 
-	// Create, bind, and send data of a VBO
-	glGenBuffers(1, &_vertexArrayBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, _vertexArrayBuffer);
-	glBufferData(GL_ARRAY_BUFFER, _numVertices * sizeof(_vertices[0]), _vertices, GL_STATIC_DRAW);
+	glCreateBuffers(1, &_vertexArrayBuffer);
+	glNamedBufferData(_vertexArrayBuffer, packedVertices.size(), packedVertices.data(), GL_STATIC_DRAW);
+	glVertexArrayVertexBuffer(_vertexArrayObject, 0, _vertexArrayBuffer, 0, GetVertexStride(_layout));
 
-	// Create, bind, and send data of an EBO (if indices exist)
+	// Create and send data of an EBO (if indices exist), with every LOD after the full mesh
 	if (_numIndices > 0)
 	{
-		glGenBuffers(1, &_elementArrayBuffer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elementArrayBuffer);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _numIndices * sizeof(_indices[0]), _indices, GL_STATIC_DRAW);
+		glCreateBuffers(1, &_elementArrayBuffer);
+		glNamedBufferData(_elementArrayBuffer, (_numIndices + _lodIndices.size()) * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+		glNamedBufferSubData(_elementArrayBuffer, 0, _numIndices * sizeof(GLuint), _indices);
+		if (!_lodIndices.empty())
+		{
+			glNamedBufferSubData(_elementArrayBuffer, _numIndices * sizeof(GLuint), _lodIndices.size() * sizeof(GLuint), _lodIndices.data());
+		}
+		glVertexArrayElementBuffer(_vertexArrayObject, _elementArrayBuffer);
 	}
 
-	// Set Vertex attribute pointers, then enable them at their specified location
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PerVertexData), (GLvoid*)offsetof(PerVertexData, position));
-	glEnableVertexAttribArray(0);
+	// Set vertex attribute formats, then enable them at their specified location
+	SetVertexArrayFormat(_vertexArrayObject, 0, _layout);
 
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PerVertexData), (GLvoid*)offsetof(PerVertexData, color));
-	glEnableVertexAttribArray(1);
+	// Starts out in the bind pose
+	_skinnedVertexArrayObject = 0;
+	_isGpuSkinned = false;
+	_isDualQuaternionSkinned = false;
+	_isCpuSkinned = false;
+	_paletteOffset = 0;
 
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PerVertexData), (GLvoid*)offsetof(PerVertexData, texcoord));
-	glEnableVertexAttribArray(2);
+	if (_layout == VERTEX_LAYOUT_SKINNED)
+	{
+		_skinningSource.Build(_vertices, _numVertices);
 
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(PerVertexData), (GLvoid*)offsetof(PerVertexData, normal));
-	glEnableVertexAttribArray(3);
+		// Texcoords and colors still come from the packed vertices. Drawn with variants without SKINNED, so the bone attributes stay off
+		glCreateVertexArrays(1, &_skinnedVertexArrayObject);
+		glVertexArrayVertexBuffer(_skinnedVertexArrayObject, 0, _vertexArrayBuffer, 0, GetVertexStride(_layout));
+		if (_numIndices > 0)
+		{
+			glVertexArrayElementBuffer(_skinnedVertexArrayObject, _elementArrayBuffer);
+		}
+		SetVertexArrayFormat(_skinnedVertexArrayObject, 0, VERTEX_LAYOUT_STATIC);
 
-	// Unbind
-	glBindVertexArray(0);
+		glVertexArrayAttribFormat(_skinnedVertexArrayObject, 0, 3, GL_FLOAT, GL_FALSE, offsetof(SkinnedPositionNormal, position));
+		glVertexArrayAttribFormat(_skinnedVertexArrayObject, 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(SkinnedPositionNormal, normal));
+		glVertexArrayAttribBinding(_skinnedVertexArrayObject, 0, 1);
+		glVertexArrayAttribBinding(_skinnedVertexArrayObject, 3, 1);
+	}
 
 	// TODO: Error check
 }
 
-void Mesh::_UpdateModelMatrix()
+void Mesh::SetPaletteOffset(uint32_t paletteOffset, bool dualQuaternions)
+{
+	_isGpuSkinned = _layout == VERTEX_LAYOUT_SKINNED;
+	_isDualQuaternionSkinned = dualQuaternions;
+	_isCpuSkinned = false;
+	_paletteOffset = paletteOffset;
+}
+
+void Mesh::SetSkinnedVertices(GLuint buffer, GLintptr offset)
+{
+	if (!_skinnedVertexArrayObject)
+	{
+		return;
+	}
+
+	glVertexArrayVertexBuffer(_skinnedVertexArrayObject, 1, buffer, offset, sizeof(SkinnedPositionNormal));
+	_isCpuSkinned = true;
+	_isGpuSkinned = false;
+}
+
+void Mesh::ClearSkinning()
+{
+	_isGpuSkinned = false;
+	_isCpuSkinned = false;
+}
+
+bool Mesh::UploadToArena(GeometryArena& arena)
 {
-	// When rotating any mesh in world space, it must be moved to the origin point, rotated, then MOVED BACK.
-	// This is to assure the object rotates around its own relative origin, instead of always rotating around WORLD origin.
-	// So every mesh, if rotated, will at one point be at the center of the world. Reality is a lie :^)
-	_modelMatrix = glm::mat4(1.0f);
-	_modelMatrix = glm::translate(_modelMatrix, _origin);
-	_modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-	_modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-	_modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-	_modelMatrix = glm::translate(_modelMatrix, _position - _origin);
-	_modelMatrix = glm::scale(_modelMatrix, _scale);
+	if (_inArena || arena.GetVertexLayout() != _layout)
+	{
+		return _inArena;
+	}
+
+	if (_skeleton.GetNumBones() > 0)
+	{
+		return false;
+	}
+
+	if (_numIndices == 0)
+	{
+		_inArena = arena.Allocate(_vertices, _numVertices, NULL, 0, _arenaRanges[0]);
+		return _inArena;
+	}
+
+	// One allocation for every LOD, so they share the vertices
+	std::vector<GLuint> indices(_indices, _indices + _numIndices);
+	indices.insert(indices.end(), _lodIndices.begin(), _lodIndices.end());
+
+	GeometryRange range;
+	_inArena = arena.Allocate(_vertices, _numVertices, indices.data(), static_cast<uint32_t>(indices.size()), range);
+
+	if (_inArena)
+	{
+		for (uint32_t i = 0; i < _numLODs; i++)
+		{
+			_arenaRanges[i].baseVertex = range.baseVertex;
+			_arenaRanges[i].firstIndex = range.firstIndex + _lods[i].firstIndex;
+			_arenaRanges[i].numIndices = _lods[i].numIndices;
+		}
+	}
+
+	return _inArena;
 }
 
-void Mesh::_UpdateUniforms(Shader* shader)
+uint32_t Mesh::SelectLOD(const glm::mat4& worldMatrix, const LODSelector& selector) const
 {
-	shader->SetMat4fv(_modelMatrix, "modelMatrix");
+	if (_numLODs == 1 || selector.maxErrorPixels <= 0.0f)
+	{
+		return 0;
+	}
+
+	// Distance to the nearest point of the bounding sphere, so meshes the camera is inside of stay at full detail
+	const qt::AABB bounds = _bounds.Transformed(worldMatrix);
+	const float distance = glm::length(bounds.GetCenter() - selector.cameraPosition) - glm::length(bounds.GetExtents());
+	if (distance <= 0.0f)
+	{
+		return 0;
+	}
+
+	const float scale = std::max(glm::length(glm::vec3(worldMatrix[0])),
+		std::max(glm::length(glm::vec3(worldMatrix[1])), glm::length(glm::vec3(worldMatrix[2]))));
+	const float pixelsPerErrorUnit = scale * selector.pixelsPerUnit / distance;
+
+	for (uint32_t lod = _numLODs - 1; lod > 0; lod--)
+	{
+		if (_lods[lod].error * pixelsPerErrorUnit <= selector.maxErrorPixels)
+		{
+			return lod;
+		}
+	}
+
+	return 0;
 }
 
-void Mesh::_UpdateAnimations()
+void Mesh::_UpdateUniforms(Shader* shader, const glm::mat4& modelMatrix)
 {
-	_animator.Update();
+	shader->SetMat4fv(modelMatrix, "modelMatrix");
+
+	if (_isGpuSkinned)
+	{
+		shader->Set1i(static_cast<int>(_paletteOffset), "paletteOffset");
+	}
 }
 
 /*
@@ -353,15 +522,20 @@ const aiNodeAnim* Mesh::_FindNodeAnim(const aiAnimation* pAnimation, const std::
 /// Shader: which shader to throw this mesh's modelMatrix into when rendering.
 void Mesh::Draw(Shader* shader)
 {
-	_UpdateModelMatrix();
-	_UpdateUniforms(shader);
-	_UpdateAnimations();
+	Draw(shader, _transform.GetModelMatrix());
+}
+
+/// Same as above, but with a model matrix supplied by the caller (e.g. a world matrix from a TransformHierarchy), at any LOD.
+void Mesh::Draw(Shader* shader, const glm::mat4& modelMatrix, uint32_t lod)
+{
+	_UpdateUniforms(shader, modelMatrix);
 	
-	glBindVertexArray(_vertexArrayObject);
+	glBindVertexArray(_isCpuSkinned ? _skinnedVertexArrayObject : _vertexArrayObject);
 
 	if (_numIndices > 0)
 	{
-		glDrawElements(GL_TRIANGLES, _numIndices, GL_UNSIGNED_INT, 0);
+		const size_t offset = static_cast<size_t>(_lods[lod].firstIndex) * sizeof(GLuint);
+		glDrawElements(GL_TRIANGLES, _lods[lod].numIndices, GL_UNSIGNED_INT, reinterpret_cast<const void*>(offset));
 	}
 	else
 	{
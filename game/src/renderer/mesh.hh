@@ -10,6 +10,10 @@
 #include "renderer/texture.hh"
 #include "renderer/material.hh"
 #include "renderer/primitives.hh"
+#include "renderer/transform.hh"
+#include "renderer/geometry_arena.hh"
+#include "renderer/shader_variants.hh"
+#include "renderer/skinning.hh"
 #include "common.hh"
 
 #include <glm.hpp>
@@ -18,18 +22,43 @@
 
 #include "math/math_linalg.hh"
 #include "math/math_quat.hh"
+#include "math/math_bounds.hh"
 
 #include "util/md5_importer.hh"
 #include "util/obj_importer.hh"
+#include "util/mesh_processing.hh"
 
 #include "renderer/skeletal_animation.hh"
 
+/// Levels of detail per mesh, including the full mesh as level 0.
+#define MESH_MAX_LODS 4
+
+/// One level of detail. Indices live back to back after the full mesh's, in the same buffers, over the same vertices.
+struct MeshLOD
+{
+	uint32_t firstIndex; // Into _indices followed by _lodIndices
+	uint32_t numIndices;
+	float error; // Distance the simplified surface may be off by, in the mesh's local units
+};
+
+/// Camera state for Mesh::SelectLOD().
+struct LODSelector
+{
+	glm::vec3 cameraPosition;
+	float pixelsPerUnit; // Viewport height / (2 * tan(fov / 2)): how many pixels one unit covers at distance one
+	float maxErrorPixels; // 0 always picks the full mesh
+};
+
 class Mesh
 {
 private:
+	static constexpr uint32_t _MIN_LOD_INDICES = 3 * 256; // Smaller meshes only get level 0
+	static constexpr float _MAX_LOD_ERROR = 0.05f; // Of the bounding box diagonal
+
 	// OpenGL
-	PerVertexData* _vertices; // Vertex array
+	PerVertexData* _vertices; // Vertex array, full precision. The GPU copy is packed into _layout
 	uint32_t _numVertices;
+	VertexLayout _layout;
 	GLuint* _indices; // Index array
 	uint32_t _numIndices;
 
@@ -37,27 +66,32 @@ private:
 	GLuint _vertexArrayBuffer;
 	GLuint _elementArrayBuffer;
 
-	glm::vec3 _position;
-	glm::vec3 _origin;
-	glm::vec3 _rotation;
-	glm::vec3 _scale;
+	Transform _transform; // Caches the model matrix, so it is only rebuilt after the mesh has been moved
+	qt::AABB _bounds; // Local space, before _transform
+
+	MeshLOD _lods[MESH_MAX_LODS];
+	uint32_t _numLODs;
+	std::vector<GLuint> _lodIndices; // Every level past 0, back to back
 
-	glm::mat4 _modelMatrix;
+	GeometryRange _arenaRanges[MESH_MAX_LODS]; // Only valid if _inArena
+	bool _inArena;
 
 
+	void _GenerateLODs();
 	void _InitMeshBuffers();
-	void _UpdateModelMatrix();
-	void _UpdateUniforms(Shader* shader);
-	void _UpdateAnimations();
+	void _UpdateUniforms(Shader* shader, const glm::mat4& modelMatrix);
 
 	
-	BoneTreeNode _boneHierarchy; // Tree of all translation/rotation bone transforms
-	uint32_t _numBones;
+	Skeleton _skeleton; // Bones in parent-before-child order, empty for static meshes
+	Animator _animator; // Plays on _skeleton, advanced by the AnimationSystem rather than by drawing
 
-	Animator _animator;
-	
-	std::vector<glm::mat4> _GetBoneTransforms();
-	void _AddBonesToArray(BoneTreeNode& bone, std::vector<glm::mat4>& boneMatrices);
+	// Skinning, set up again every frame by whoever uploaded the palette or skinned the vertices
+	SkinningSource _skinningSource; // Bind pose read by the CPU backend, skinned layouts only
+	GLuint _skinnedVertexArrayObject; // Like _vertexArrayObject, but positions and normals come from buffer binding 1
+	bool _isGpuSkinned; // Draw with the SKINNED variant, reading the palette from _paletteOffset
+	bool _isDualQuaternionSkinned; // The palette holds dual quaternions (DUAL_QUATERNION variant)
+	bool _isCpuSkinned; // Draw from _skinnedVertexArrayObject
+	uint32_t _paletteOffset;
 
 public:
 //	Mesh(
@@ -90,16 +124,63 @@ public:
 
 	virtual ~Mesh();
 
+	/// Only binds and draws; the animator is never advanced here, so the shadow cascades and the scene pass can all draw
+	/// a skinned mesh in the same frame and see the same pose.
 	void Draw(Shader* shader);
-
-	inline void SetPosition(const glm::vec3 val) { _position = val; }
-	inline void SetOrigin(const glm::vec3 val){ _origin = val; }
-	inline void SetRotation(const glm::vec3 val){ _rotation = val; }
-	inline void SetScale(const glm::vec3 val){ _scale = val; }
-
-	inline void Translate(const glm::vec3 val){ _position += val; }
-	inline void Rotate(const glm::vec3 val){ _rotation += val; }
-	inline void Scale(const glm::vec3 val){ _scale += val; }
+	void Draw(Shader* shader, const glm::mat4& modelMatrix, uint32_t lod = 0);
+
+	/// Picks the coarsest level whose simplification error projects to at most selector.maxErrorPixels on screen.
+	uint32_t SelectLOD(const glm::mat4& worldMatrix, const LODSelector& selector) const;
+
+	/// Copies the mesh into the shared static geometry buffers so it can be drawn through GeometryArena::Submit().
+	/// The mesh keeps its own VAO for shaders that still draw it one at a time. Skinned meshes are never uploaded:
+	/// arena draws share one static vertex format and skip everything a skinned draw binds per mesh.
+	bool UploadToArena(GeometryArena& arena);
+
+	inline bool IsInArena() const { return _inArena; }
+	inline VertexLayout GetVertexLayout() const { return _layout; }
+	inline const GeometryRange& GetArenaRange(uint32_t lod = 0) const { return _arenaRanges[lod]; }
+	inline uint32_t GetNumLODs() const { return _numLODs; }
+	inline const MeshLOD& GetLOD(uint32_t lod) const { return _lods[lod]; }
+
+	inline const PerVertexData* GetVertices() const { return _vertices; }
+	inline uint32_t GetNumVertices() const { return _numVertices; }
+	/// NULL for meshes drawn straight from the vertex array.
+	inline const GLuint* GetIndices() const { return _numIndices > 0 ? _indices : NULL; }
+	inline uint32_t GetNumIndices() const { return _numIndices; }
+
+	/// Skins the following draws in the vertex shader, with the palette bound at SKINNING_PALETTE_BINDING.
+	/// paletteOffset is where this mesh's skinning matrices start in it, or its dual quaternions if dualQuaternions is set.
+	void SetPaletteOffset(uint32_t paletteOffset, bool dualQuaternions = false);
+
+	/// Draws the following draws from vertices skinned on the CPU: GetNumVertices() SkinnedPositionNormals at
+	/// offset in buffer, e.g. a RingBuffer allocation filled by a CpuSkinner.
+	void SetSkinnedVertices(GLuint buffer, GLintptr offset);
+
+	/// Back to drawing the bind pose.
+	void ClearSkinning();
+
+	/// The features a shader variant needs to draw this mesh as it is currently set up.
+	inline uint32_t GetShaderFeatures() const
+	{
+		return _isGpuSkinned ? (SHADER_FEATURE_SKINNED | (_isDualQuaternionSkinned ? SHADER_FEATURE_DUAL_QUATERNION : 0)) : 0;
+	}
+
+	inline const Skeleton& GetSkeleton() const { return _skeleton; }
+	inline Animator& GetAnimator() { return _animator; }
+	inline const SkinningSource& GetSkinningSource() const { return _skinningSource; }
+
+	inline const Transform& GetTransform() const { return _transform; }
+	inline const qt::AABB& GetBounds() const { return _bounds; }
+
+	inline void SetPosition(const glm::vec3 val) { _transform.SetPosition(val); }
+	inline void SetOrigin(const glm::vec3 val){ _transform.SetOrigin(val); }
+	inline void SetRotation(const glm::vec3 val){ _transform.SetRotation(val); }
+	inline void SetScale(const glm::vec3 val){ _transform.SetScale(val); }
+
+	inline void Translate(const glm::vec3 val){ _transform.Translate(val); }
+	inline void Rotate(const glm::vec3 val){ _transform.Rotate(val); }
+	inline void Scale(const glm::vec3 val){ _transform.Scale(val); }
 
 
 };
\ No newline at end of file
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "renderer/mesh.hh"
+#include "renderer/transform_hierarchy.hh"
 
 #include "renderer/shader.hh"
+#include "renderer/shader_variants.hh"
 #include "renderer/texture.hh"
 #include "renderer/material.hh"
+#include "renderer/occlusion_culler.hh"
 
 class Model
 {
@@ -15,6 +18,12 @@ private:
 	std::vector<Mesh*> _meshes;
 
 	glm::vec3 _position;
+
+	// Node 0 is the model itself, node i+1 belongs to _meshes[i]
+	TransformHierarchy _transforms;
+	TransformHandle _root;
+
+	bool _isOccluder; // Rasterized into the occlusion buffer, see AddOccluders()
 public:
 	Model(
 		glm::vec3 position,
@@ -28,16 +37,20 @@ public:
 		_material = material;
 		_overrideTextureDiffuse = orTexDiff;
 		_overrideTextureSpecular = orTexSpec;
+		_isOccluder = false;
 
 		for (auto* i : meshes)
 		{
 			_meshes.push_back(new Mesh(*i));
 		}
 
+		// Meshes are parented to the model, which rotates around its own position
+		_root = _transforms.Add(Transform(_position, _position));
 		for (auto& i : _meshes)
 		{
-			i->Translate(_position);
-			i->SetOrigin(_position);
+			Transform local = i->GetTransform();
+			local.SetOrigin(glm::vec3(0.0f));
+			_transforms.Add(local, _root);
 		}
 	}
 
@@ -49,25 +62,121 @@ public:
 
 	void Translate(const glm::vec3 val)
 	{
-		for (auto& i : _meshes)
+		Transform& root = _transforms.Edit(_root);
+		root.Translate(val);
+		root.SetOrigin(root.GetPosition());
+	}
+
+	/// Moves the model to position, which it keeps rotating around.
+	void SetPosition(const glm::vec3& position)
+	{
+		Transform& root = _transforms.Edit(_root);
+		root.SetPosition(position);
+		root.SetOrigin(position);
+	}
+
+	void Rotate(const glm::vec3 val)
+	{
+		_transforms.Edit(_root).Rotate(val);
+	}
+
+	void Scale(const glm::vec3 val)
+	{
+		_transforms.Edit(_root).Scale(val);
+	}
+
+	inline const std::vector<Mesh*>& GetMeshes() const { return _meshes; }
+	inline const Transform& GetTransform() const { return _transforms.Get(_root); }
+	inline const Material* GetMaterial() const { return _material; }
+	inline const Texture* GetDiffuseTexture() const { return _overrideTextureDiffuse; }
+	inline const Texture* GetSpecularTexture() const { return _overrideTextureSpecular; }
+
+	/// Occluders should be few, large and closed or flat, like walls, terrain and buildings.
+	inline void SetOccluder(bool val) { _isOccluder = val; }
+	inline bool IsOccluder() const { return _isOccluder; }
+
+	/// World-space bounds of mesh (an index into GetMeshes()) in its bind pose.
+	qt::AABB GetMeshWorldBounds(size_t mesh)
+	{
+		_transforms.Update();
+		return _meshes[mesh]->GetBounds().Transformed(_transforms.GetWorldMatrix(static_cast<TransformHandle>(mesh + 1)));
+	}
+
+	/// Rasterizes every mesh, at full detail, into the culler's depth buffer.
+	void AddOccluders(OcclusionCuller& culler)
+	{
+		_transforms.Update();
+
+		for (size_t i = 0; i < _meshes.size(); i++)
 		{
-			i->Translate(val);
+			const Mesh* mesh = _meshes[i];
+			const uint32_t numIndices = mesh->GetIndices() ? mesh->GetNumIndices() : mesh->GetNumVertices();
+
+			culler.AddOccluder(mesh->GetVertices(), mesh->GetIndices(), numIndices, _transforms.GetWorldMatrix(static_cast<TransformHandle>(i + 1)));
 		}
 	}
 
-	void Rotate(const glm::vec3 val)
+	/// Copies every mesh into the arena. Meshes that don't fit keep drawing through their own VAO.
+	void UploadToArena(GeometryArena& arena)
 	{
-		for (auto& i : _meshes)
+		for (auto* i : _meshes)
 		{
-			i->Rotate(val);
+			i->UploadToArena(arena);
 		}
 	}
 
-	void Scale(const glm::vec3 val)
+	/// Sends the material to every variant a pass draws this model with, and binds the textures shared by every mesh of this model.
+	void Bind(ShaderVariants& shaders, uint32_t features)
 	{
-		for (auto& i : _meshes)
+		_material->SendToShader(*shaders.Get(features));
+		_material->SendToShader(*shaders.Get(features | SHADER_FEATURE_INSTANCED));
+		for (auto* i : _meshes)
 		{
-			i->Scale(val);
+			if (i->GetShaderFeatures())
+			{
+				_material->SendToShader(*shaders.Get(features | i->GetShaderFeatures()));
+				break;
+			}
+		}
+		_overrideTextureDiffuse->Bind(0);
+		_overrideTextureSpecular->Bind(1);
+	}
+
+	/// Queues meshes that live in the arena for its next Flush(), and draws the rest right away with the non-instanced variant
+	/// (plus SKINNED for meshes skinned on the GPU this frame).
+	/// Each mesh goes in at the level of detail lodSelector picks for it. Bind() a model with the same material and textures first.
+	void Submit(ShaderVariants& shaders, uint32_t features, GeometryArena& arena, const LODSelector& lodSelector)
+	{
+		SubmitVisible(shaders, features, arena, lodSelector, [](const qt::AABB&) { return true; });
+	}
+
+	/// Same as Submit(), but skips meshes whose world-space bounds fail isVisible(const qt::AABB&).
+	template <typename VisibilityTest>
+	void SubmitVisible(ShaderVariants& shaders, uint32_t features, GeometryArena& arena, const LODSelector& lodSelector, const VisibilityTest& isVisible)
+	{
+		_transforms.Update();
+
+		for (size_t i = 0; i < _meshes.size(); i++)
+		{
+			const glm::mat4& worldMatrix = _transforms.GetWorldMatrix(static_cast<TransformHandle>(i + 1));
+
+			if (!isVisible(_meshes[i]->GetBounds().Transformed(worldMatrix)))
+			{
+				continue;
+			}
+
+			const uint32_t lod = _meshes[i]->SelectLOD(worldMatrix, lodSelector);
+
+			if (_meshes[i]->IsInArena())
+			{
+				arena.Submit(_meshes[i]->GetArenaRange(lod), worldMatrix);
+			}
+			else
+			{
+				Shader* shader = shaders.Get(features | _meshes[i]->GetShaderFeatures());
+				shader->Use();
+				_meshes[i]->Draw(shader, worldMatrix, lod);
+			}
 		}
 	}
 
@@ -78,14 +187,17 @@ public:
 		// Use the program -- should be AFTER calling Set functions from the shader class, since they Use and UnUse the program!!
 		shader->Use();
 
+		// No-op unless the model was moved since the last draw
+		_transforms.Update();
+
 		// Draw
-		for (auto& i : _meshes)
+		for (size_t i = 0; i < _meshes.size(); i++)
 		{
 			// Activate a texture
 			_overrideTextureDiffuse->Bind(0);
 			_overrideTextureSpecular->Bind(1);
 
-			i->Draw(shader);
+			_meshes[i]->Draw(shader, _transforms.GetWorldMatrix(static_cast<TransformHandle>(i + 1)));
 		}
 	}
 };
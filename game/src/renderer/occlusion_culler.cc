@@ -0,0 +1,318 @@
+#include "occlusion_culler.hh"
+
+#include <math.h>
+#include <algorithm>
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height, bool useSimd)
+	: _width(std::max<uint32_t>((width + 3) & ~3u, 4)), _height(std::max<uint32_t>(height, 1)), _useSimd(useSimd),
+	_viewProjection(1.0f), _isHierarchyBuilt(false), _numOccluderTriangles(0)
+{
+	if (_width != width)
+	{
+		DEBUG_LOG("OcclusionCuller", LOG_WARN, "Width %u is not a multiple of 4, using %u", width, _width);
+	}
+
+	_depth.resize(static_cast<size_t>(_width) * _height, 1.0f);
+
+	// The pyramid is allocated once, it's rebuilt every frame
+	_levelSizes.push_back(glm::uvec2(_width, _height));
+	while (_levelSizes.back().x > 1 || _levelSizes.back().y > 1)
+	{
+		const glm::uvec2 size((_levelSizes.back().x + 1) / 2, (_levelSizes.back().y + 1) / 2);
+		_levelSizes.push_back(size);
+		_hierarchy.push_back(std::vector<float>(static_cast<size_t>(size.x) * size.y, 1.0f));
+	}
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection)
+{
+	_viewProjection = viewProjection;
+	_numOccluderTriangles = 0;
+	std::fill(_depth.begin(), _depth.end(), 1.0f);
+	_isHierarchyBuilt = false;
+}
+
+void OcclusionCuller::AddOccluder(const PerVertexData* vertices, const GLuint* indices, uint32_t numIndices, const glm::mat4& worldMatrix)
+{
+	const glm::mat4 matrix = _viewProjection * worldMatrix;
+
+	for (uint32_t i = 0; i + 2 < numIndices; i += 3)
+	{
+		glm::vec4 clip[3];
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			const uint32_t vertex = indices ? indices[i + j] : i + j;
+			clip[j] = matrix * glm::vec4(vertices[vertex].position, 1.0f);
+		}
+
+		_AddTriangle(clip[0], clip[1], clip[2]);
+	}
+}
+
+void OcclusionCuller::_AddTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+	// Sutherland-Hodgman against the near plane (z = -w). The other planes are handled by clamping to the buffer
+	const glm::vec4 input[3] = { a, b, c };
+	glm::vec4 clipped[4];
+	int numClipped = 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec4& current = input[i];
+		const glm::vec4& next = input[(i + 1) % 3];
+		const float currentDistance = current.z + current.w;
+		const float nextDistance = next.z + next.w;
+
+		if (currentDistance >= 0.0f)
+		{
+			clipped[numClipped++] = current;
+		}
+
+		if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+		{
+			const float t = currentDistance / (currentDistance - nextDistance);
+			clipped[numClipped++] = current + (next - current) * t;
+		}
+	}
+
+	if (numClipped < 3)
+	{
+		return;
+	}
+
+	glm::vec3 window[4];
+	for (int i = 0; i < numClipped; i++)
+	{
+		const float inverseW = 1.0f / clipped[i].w;
+		window[i] = glm::vec3(
+			(clipped[i].x * inverseW * 0.5f + 0.5f) * _width,
+			(clipped[i].y * inverseW * 0.5f + 0.5f) * _height,
+			clipped[i].z * inverseW * 0.5f + 0.5f);
+	}
+
+	_RasterizeTriangle(window[0], window[1], window[2]);
+	if (numClipped == 4)
+	{
+		_RasterizeTriangle(window[0], window[2], window[3]);
+	}
+}
+
+void OcclusionCuller::_RasterizeTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	glm::vec3 v[3] = { a, b, c };
+
+	float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (!(fabsf(area) > 1e-8f)) // Also rejects NaN
+	{
+		return;
+	}
+
+	// Occluders are drawn from both sides, so flip clockwise triangles around instead of culling them
+	if (area < 0.0f)
+	{
+		std::swap(v[1], v[2]);
+		area = -area;
+	}
+
+	const float minX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+	const float maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+	const float minY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+	const float maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+
+	// Pixels whose centers can be inside. SIMD rows start on a multiple of 4, which the edge tests take care of
+	const int x0 = std::max(0, static_cast<int>(floorf(minX))) & ~3;
+	const int x1 = std::min(static_cast<int>(_width) - 1, static_cast<int>(ceilf(maxX)));
+	const int y0 = std::max(0, static_cast<int>(floorf(minY)));
+	const int y1 = std::min(static_cast<int>(_height) - 1, static_cast<int>(ceilf(maxY)));
+
+	if (x0 > x1 || y0 > y1)
+	{
+		return;
+	}
+
+	_numOccluderTriangles++;
+
+	// Edge i runs from v[i + 1] to v[i + 2] and is positive on the inside: e(x, y) = A x + B y + C
+	float edgeA[3], edgeB[3], edgeC[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3& from = v[(i + 1) % 3];
+		const glm::vec3& to = v[(i + 2) % 3];
+
+		edgeA[i] = -(to.y - from.y);
+		edgeB[i] = to.x - from.x;
+		edgeC[i] = -(edgeA[i] * from.x + edgeB[i] * from.y);
+	}
+
+	// Window-space depth is affine across the triangle
+	const float depthDx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+	const float depthDy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+	const float depthC = v[0].z - depthDx * v[0].x - depthDy * v[0].y;
+
+	for (int y = y0; y <= y1; y++)
+	{
+		const float py = y + 0.5f;
+		float* row = &_depth[static_cast<size_t>(y) * _width];
+
+		const float rowE0 = edgeB[0] * py + edgeC[0];
+		const float rowE1 = edgeB[1] * py + edgeC[1];
+		const float rowE2 = edgeB[2] * py + edgeC[2];
+		const float rowDepth = depthDy * py + depthC;
+
+#ifdef QT_SIMD_SSE
+		if (_useSimd)
+		{
+			const __m128 a0 = _mm_set1_ps(edgeA[0]), a1 = _mm_set1_ps(edgeA[1]), a2 = _mm_set1_ps(edgeA[2]);
+			const __m128 r0 = _mm_set1_ps(rowE0), r1 = _mm_set1_ps(rowE1), r2 = _mm_set1_ps(rowE2);
+			const __m128 dx = _mm_set1_ps(depthDx), rd = _mm_set1_ps(rowDepth);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+
+			for (int x = x0; x <= x1; x += 4)
+			{
+				const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+
+				const __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+				const __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+				const __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+				const __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+
+				if (_mm_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+
+				const __m128 depth = _mm_add_ps(_mm_mul_ps(dx, px), rd);
+				const __m128 previous = _mm_loadu_ps(row + x);
+				const __m128 nearest = _mm_min_ps(previous, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+			}
+
+			continue;
+		}
+#endif
+
+		for (int x = x0; x <= x1; x++)
+		{
+			const float px = x + 0.5f;
+
+			if (edgeA[0] * px + rowE0 >= 0.0f && edgeA[1] * px + rowE1 >= 0.0f && edgeA[2] * px + rowE2 >= 0.0f)
+			{
+				row[x] = std::min(row[x], depthDx * px + rowDepth);
+			}
+		}
+	}
+}
+
+void OcclusionCuller::EndOccluders()
+{
+	// Each texel keeps the farthest of the (up to) 2x2 texels below it
+	for (uint32_t level = 1; level < _levelSizes.size(); level++)
+	{
+		const glm::uvec2 size = _levelSizes[level - 1];
+		const glm::uvec2 nextSize = _levelSizes[level];
+
+		const float* source = _GetLevel(level - 1);
+		float* destination = _hierarchy[level - 1].data();
+
+		for (uint32_t y = 0; y < nextSize.y; y++)
+		{
+			const float* row0 = source + static_cast<size_t>(y * 2) * size.x;
+			const float* row1 = source + static_cast<size_t>(std::min(y * 2 + 1, size.y - 1)) * size.x;
+			float* out = destination + static_cast<size_t>(y) * nextSize.x;
+			uint32_t x = 0;
+
+#ifdef QT_SIMD_SSE
+			if (_useSimd)
+			{
+				// 8 source columns to 4 texels: vertical max, then max of each horizontal pair
+				for (; x + 4 <= size.x / 2; x += 4)
+				{
+					const __m128 a = _mm_max_ps(_mm_loadu_ps(row0 + x * 2), _mm_loadu_ps(row1 + x * 2));
+					const __m128 b = _mm_max_ps(_mm_loadu_ps(row0 + x * 2 + 4), _mm_loadu_ps(row1 + x * 2 + 4));
+					const __m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+					const __m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+					_mm_storeu_ps(out + x, _mm_max_ps(even, odd));
+				}
+			}
+#endif
+
+			for (; x < nextSize.x; x++)
+			{
+				const uint32_t x0 = x * 2, x1 = std::min(x * 2 + 1, size.x - 1);
+				out[x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+			}
+		}
+	}
+
+	_isHierarchyBuilt = true;
+}
+
+bool OcclusionCuller::IsVisible(const qt::AABB& worldBounds) const
+{
+	if (!_isHierarchyBuilt || worldBounds.IsEmpty())
+	{
+		return true;
+	}
+
+	glm::vec3 minNdc(FLT_MAX), maxNdc(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		const glm::vec3 corner(
+			(i & 1) ? worldBounds.max.x : worldBounds.min.x,
+			(i & 2) ? worldBounds.max.y : worldBounds.min.y,
+			(i & 4) ? worldBounds.max.z : worldBounds.min.z);
+		const glm::vec4 clip = _viewProjection * glm::vec4(corner, 1.0f);
+
+		// Reaches behind the near plane, so it can't be bounded on screen
+		if (clip.w <= 1e-5f || clip.z < -clip.w)
+		{
+			return true;
+		}
+
+		const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		minNdc = glm::min(minNdc, ndc);
+		maxNdc = glm::max(maxNdc, ndc);
+	}
+
+	// Entirely off screen or past the far plane
+	if (maxNdc.x < -1.0f || minNdc.x > 1.0f || maxNdc.y < -1.0f || minNdc.y > 1.0f || minNdc.z > 1.0f)
+	{
+		return false;
+	}
+
+	const float nearestDepth = minNdc.z * 0.5f + 0.5f;
+
+	const int x0 = std::max(0, static_cast<int>(floorf((minNdc.x * 0.5f + 0.5f) * _width)));
+	const int x1 = std::min(static_cast<int>(_width) - 1, static_cast<int>((maxNdc.x * 0.5f + 0.5f) * _width));
+	const int y0 = std::max(0, static_cast<int>(floorf((minNdc.y * 0.5f + 0.5f) * _height)));
+	const int y1 = std::min(static_cast<int>(_height) - 1, static_cast<int>((maxNdc.y * 0.5f + 0.5f) * _height));
+
+	// Coarsest level where the rectangle is still at most about two texels across
+	const int extent = std::max(x1 - x0, y1 - y0) + 1;
+	uint32_t level = 0;
+	while ((extent >> level) > 2 && level + 1 < _levelSizes.size())
+	{
+		level++;
+	}
+
+	const float* depth = _GetLevel(level);
+	const uint32_t levelWidth = _levelSizes[level].x;
+
+	for (int y = y0 >> level; y <= (y1 >> level); y++)
+	{
+		for (int x = x0 >> level; x <= (x1 >> level); x++)
+		{
+			if (depth[y * levelWidth + x] >= nearestDepth)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
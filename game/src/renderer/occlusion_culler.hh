@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include <glew.h>
+
+#include <glm.hpp>
+
+#include "common.hh"
+#include "math/math_simd.hh"
+#include "math/math_bounds.hh"
+#include "renderer/vertex.hh"
+
+/// CPU occlusion culling against a small software depth buffer.
+///
+/// Every frame, a few large occluders are rasterized (depth only, both windings) into a low resolution buffer,
+/// which is then reduced into a hierarchical Z pyramid where each texel holds the farthest depth below it.
+/// A bounding box is occluded if its nearest depth is behind every pyramid texel its screen rectangle covers,
+/// using the level where that rectangle is about two texels across.
+///
+/// Occluders are rasterized at pixel centers, so an object peeking out by less than a buffer pixel can be culled.
+/// Depths are window-space, 0 at the near plane and 1 at the far plane.
+class OcclusionCuller
+{
+private:
+	uint32_t _width, _height;
+	bool _useSimd;
+
+	glm::mat4 _viewProjection;
+	std::vector<float> _depth; // Nearest occluder depth per pixel, 1 if none. Level 0 of the pyramid
+	std::vector<std::vector<float>> _hierarchy; // Levels 1 and up, each half the size of the one before
+	std::vector<glm::uvec2> _levelSizes; // Including level 0
+	bool _isHierarchyBuilt;
+	uint32_t _numOccluderTriangles;
+
+	inline const float* _GetLevel(uint32_t level) const { return level == 0 ? _depth.data() : _hierarchy[level - 1].data(); }
+
+	/// Clips a clip-space triangle against the near plane, then rasterizes what is left.
+	void _AddTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	void _RasterizeTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+public:
+	/// width must be a multiple of 4 (one SSE register of pixels).
+	OcclusionCuller(uint32_t width = 256, uint32_t height = 128, bool useSimd = true);
+	~OcclusionCuller();
+
+	/// Clears the depth buffer for a new camera.
+	void BeginFrame(const glm::mat4& viewProjection);
+
+	/// Rasterizes a triangle list. If indices is NULL, numIndices vertices are used in order.
+	void AddOccluder(const PerVertexData* vertices, const GLuint* indices, uint32_t numIndices, const glm::mat4& worldMatrix);
+
+	/// Builds the depth pyramid. Call after the last AddOccluder() and before IsVisible().
+	void EndOccluders();
+
+	/// False if the box is certainly hidden behind occluders, or entirely outside the view.
+	bool IsVisible(const qt::AABB& worldBounds) const;
+
+	inline uint32_t GetWidth() const { return _width; }
+	inline uint32_t GetHeight() const { return _height; }
+	inline const std::vector<float>& GetDepth() const { return _depth; }
+	inline uint32_t GetNumOccluderTriangles() const { return _numOccluderTriangles; }
+};
@@ -0,0 +1,139 @@
+#include "ring_buffer.hh"
+
+RingBuffer::RingBuffer(GLsizeiptr regionSize, uint32_t numRegions)
+	: _buffer(0), _mapped(nullptr), _regionSize(regionSize), _numRegions(numRegions), _currentRegion(0), _head(0)
+{
+	if (_numRegions == 0 || _numRegions > RING_BUFFER_MAX_REGIONS)
+	{
+		DEBUG_LOG("RingBuffer", LOG_WARN, "%u regions requested, clamping to [1, %d]", _numRegions, RING_BUFFER_MAX_REGIONS);
+		_numRegions = (_numRegions == 0) ? 1 : RING_BUFFER_MAX_REGIONS;
+	}
+
+	for (uint32_t i = 0; i < RING_BUFFER_MAX_REGIONS; i++)
+	{
+		_fences[i] = 0;
+	}
+
+	// Keep every region start aligned for any kind of binding
+	const GLsizeiptr alignment = GetUniformAlignment();
+	_regionSize = (_regionSize + alignment - 1) & ~(alignment - 1);
+
+	const GLsizeiptr totalSize = _regionSize * _numRegions;
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+	glBufferStorage(GL_ARRAY_BUFFER, totalSize, NULL, flags);
+	_mapped = static_cast<uint8_t*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, totalSize, flags));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (_mapped == nullptr)
+	{
+		DEBUG_LOG("RingBuffer", LOG_ERROR, "Failed to persistently map a %lld byte buffer", static_cast<long long>(totalSize));
+	}
+}
+
+RingBuffer::~RingBuffer()
+{
+	for (uint32_t i = 0; i < _numRegions; i++)
+	{
+		if (_fences[i])
+		{
+			glDeleteSync(_fences[i]);
+		}
+	}
+
+	if (_mapped)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	glDeleteBuffers(1, &_buffer);
+}
+
+void RingBuffer::_WaitForRegion(uint32_t region)
+{
+	if (!_fences[region])
+	{
+		return;
+	}
+
+	// Flush on the first try so the fence is guaranteed to signal eventually, then keep waiting.
+	// Hitting the timeout means the CPU is more than _numRegions frames ahead of the GPU.
+	GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	GLuint64 timeout = 0;
+	
+	for (;;)
+	{
+		const GLenum result = glClientWaitSync(_fences[region], waitFlags, timeout);
+
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+		{
+			break;
+		}
+		if (result == GL_WAIT_FAILED)
+		{
+			DEBUG_LOG("RingBuffer", LOG_ERROR, "glClientWaitSync failed on region %u", region);
+			break;
+		}
+
+		waitFlags = 0;
+		timeout = 1000000; // 1 ms
+	}
+
+	glDeleteSync(_fences[region]);
+	_fences[region] = 0;
+}
+
+void RingBuffer::BeginFrame()
+{
+	_WaitForRegion(_currentRegion);
+	_head = 0;
+}
+
+void RingBuffer::EndFrame()
+{
+	_fences[_currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_currentRegion = (_currentRegion + 1) % _numRegions;
+}
+
+RingBufferAllocation RingBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+	RingBufferAllocation allocation;
+
+	const GLsizeiptr start = (_head + alignment - 1) & ~(alignment - 1);
+
+	if (_mapped == nullptr || start + size > _regionSize)
+	{
+		DEBUG_LOG("RingBuffer", LOG_ERROR, "Out of space: %lld bytes requested, %lld of %lld used this frame",
+			static_cast<long long>(size), static_cast<long long>(_head), static_cast<long long>(_regionSize));
+		return allocation;
+	}
+
+	_head = start + size;
+
+	allocation.buffer = _buffer;
+	allocation.offset = _currentRegion * _regionSize + start;
+	allocation.size = size;
+	allocation.data = _mapped + allocation.offset;
+
+	return allocation;
+}
+
+GLsizeiptr RingBuffer::GetUniformAlignment()
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	return static_cast<GLsizeiptr>(alignment);
+}
+
+GLsizeiptr RingBuffer::GetStorageAlignment()
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	return static_cast<GLsizeiptr>(alignment);
+}
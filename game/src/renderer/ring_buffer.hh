@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glew.h>
+
+#include "common.hh"
+
+#define RING_BUFFER_MAX_REGIONS 4
+
+/// A piece of the ring buffer handed out for the current frame.
+/// data points straight into mapped GPU memory and is only valid until EndFrame().
+struct RingBufferAllocation
+{
+	void* data = nullptr;
+	GLuint buffer = 0;
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;
+
+	inline bool IsValid() const { return data != nullptr; }
+};
+
+/// Persistently mapped buffer for data that is rewritten every frame (instance matrices, bone palettes, debug lines, particles...).
+/// The buffer is split into numRegions equal regions, one per frame in flight. Each frame allocates linearly from its region,
+/// and a fence placed at EndFrame() guards the region until the GPU is done reading it, so the CPU never overwrites data in use
+/// and never has to reallocate or orphan the buffer with glBufferData.
+class RingBuffer
+{
+private:
+	GLuint _buffer;
+	uint8_t* _mapped;
+
+	GLsizeiptr _regionSize;
+	uint32_t _numRegions;
+	uint32_t _currentRegion;
+	GLsizeiptr _head; // Next free byte in the current region
+
+	GLsync _fences[RING_BUFFER_MAX_REGIONS];
+
+	/// Blocks until the GPU has finished with every command that read from region.
+	void _WaitForRegion(uint32_t region);
+public:
+	RingBuffer(GLsizeiptr regionSize, uint32_t numRegions = 3);
+	~RingBuffer();
+
+	/// Waits for the region this frame will write to. Call once per frame before any Allocate().
+	void BeginFrame();
+
+	/// Fences the commands that use this frame's allocations and moves on to the next region.
+	/// Call once per frame after the last draw that reads from the buffer has been submitted.
+	void EndFrame();
+
+	/// Reserves size bytes in the current frame's region. alignment must be a power of two;
+	/// use GetUniformAlignment() or GetStorageAlignment() for ranges bound with glBindBufferRange().
+	/// Returns an invalid allocation if the region is full.
+	RingBufferAllocation Allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+
+	/// Binds an allocation to an indexed target, e.g. GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER.
+	inline void BindRange(GLenum target, GLuint index, const RingBufferAllocation& allocation) const
+	{
+		glBindBufferRange(target, index, _buffer, allocation.offset, allocation.size);
+	}
+
+	/// The minimum offset alignment the driver accepts for uniform buffer ranges.
+	static GLsizeiptr GetUniformAlignment();
+
+	/// The minimum offset alignment the driver accepts for shader storage buffer ranges.
+	static GLsizeiptr GetStorageAlignment();
+
+	inline GLuint GetBuffer() const { return _buffer; }
+	inline GLsizeiptr GetRegionSize() const { return _regionSize; }
+	inline GLsizeiptr GetBytesUsed() const { return _head; }
+};
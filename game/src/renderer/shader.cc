@@ -1,22 +1,46 @@
 #include "shader.hh"
 
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include "util/hash.hh"
+
 Shader::Shader(
 	const int glVersionMajor,
 	const int glVersionMinor,
 	const std::string& vertexFile,
 	const std::string& fragmentFile,
-	const std::string& geometryFile)
-	: _glVersionMajor(glVersionMajor), _glVersionMinor(glVersionMinor)
+	const std::string& geometryFile,
+	const std::vector<std::string>& defines)
+	: _id(0), _glVersionMajor(glVersionMajor), _glVersionMinor(glVersionMinor)
 {
+	const std::string vertexSource = _LoadShaderFile(vertexFile, defines);
+	const std::string geometrySource = (geometryFile != "") ? _LoadShaderFile(geometryFile, defines) : "";
+	const std::string fragmentSource = _LoadShaderFile(fragmentFile, defines);
+
+	uint64_t key = HashFNV1a64(_GetDriverString());
+	key = HashFNV1a64(vertexSource, key);
+	key = HashFNV1a64(geometrySource, key);
+	key = HashFNV1a64(fragmentSource, key);
+
+	if (_LoadProgramBinary(key))
+	{
+		return;
+	}
+
 	GLuint vertexShader = 0;
 	GLuint geometryShader = 0;
 	GLuint fragmentShader = 0;
 
-	vertexShader = _LoadShader(GL_VERTEX_SHADER, vertexFile);
-	if (geometryFile != "") geometryShader = _LoadShader(GL_GEOMETRY_SHADER, geometryFile);
-	fragmentShader = _LoadShader(GL_FRAGMENT_SHADER, fragmentFile);
+	vertexShader = _CompileShader(GL_VERTEX_SHADER, vertexSource, vertexFile);
+	if (geometryFile != "") geometryShader = _CompileShader(GL_GEOMETRY_SHADER, geometrySource, geometryFile);
+	fragmentShader = _CompileShader(GL_FRAGMENT_SHADER, fragmentSource, fragmentFile);
 
-	_LinkProgram(vertexShader, geometryShader, fragmentShader);
+	if (_LinkProgram(vertexShader, geometryShader, fragmentShader))
+	{
+		_SaveProgramBinary(key);
+	}
 
 	// End
 	glDeleteShader(vertexShader);
@@ -29,7 +53,7 @@ Shader::~Shader()
 	glDeleteProgram(_id);
 }
 
-std::string Shader::_LoadShaderFile(const std::string& filename)
+std::string Shader::_LoadShaderFile(const std::string& filename, const std::vector<std::string>& defines)
 {
 	std::string temp = "";
 	std::string src = "";
@@ -54,17 +78,32 @@ std::string Shader::_LoadShaderFile(const std::string& filename)
 	std::string version = std::to_string(_glVersionMajor) + std::to_string(_glVersionMinor) + "0";
 	src.replace(src.find("#version"), 12, ("#version " + version));
 
+	if (!defines.empty())
+	{
+		std::string header = "";
+		for (const auto& define : defines)
+		{
+			header += "#define " + define + "\n";
+		}
+
+		// Keep compiler error line numbers pointing into the file
+		const size_t versionEnd = src.find('\n', src.find("#version"));
+		const int nextLine = static_cast<int>(std::count(src.begin(), src.begin() + versionEnd, '\n')) + 2;
+		header += "#line " + std::to_string(nextLine) + "\n";
+
+		src.insert(versionEnd + 1, header);
+	}
+
 	return src;
 }
 
-GLuint Shader::_LoadShader(GLenum shaderType, const std::string& filename)
+GLuint Shader::_CompileShader(GLenum shaderType, const std::string& source, const std::string& filename)
 {
 	char infoLog[512];
 	GLint success;
 
 	GLuint shader = glCreateShader(shaderType);
-	std::string shaderCode = _LoadShaderFile(filename);
-	const GLchar* shaderSrc = shaderCode.c_str();
+	const GLchar* shaderSrc = source.c_str();
 	glShaderSource(shader, 1, &shaderSrc, NULL);
 	glCompileShader(shader);
 
@@ -79,12 +118,13 @@ GLuint Shader::_LoadShader(GLenum shaderType, const std::string& filename)
 	return shader;
 }
 
-void Shader::_LinkProgram(GLuint vertexShader, GLuint geometryShader, GLuint fragmentShader)
+bool Shader::_LinkProgram(GLuint vertexShader, GLuint geometryShader, GLuint fragmentShader)
 {
 	char infoLog[512];
 	GLint success;
 
 	_id = glCreateProgram();
+	glProgramParameteri(_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
 	glAttachShader(_id, vertexShader);
 	if (geometryShader)
@@ -101,6 +141,113 @@ void Shader::_LinkProgram(GLuint vertexShader, GLuint geometryShader, GLuint fra
 	}
 
 	glUseProgram(0);
+
+	return success == GL_TRUE;
+}
+
+std::string Shader::_GetDriverString()
+{
+	std::string driver;
+
+	const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+	for (GLenum name : names)
+	{
+		const GLubyte* value = glGetString(name);
+		driver += value ? reinterpret_cast<const char*>(value) : "";
+		driver += "\n";
+	}
+
+	return driver;
+}
+
+std::string Shader::_GetCachePath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+
+	return std::string(SHADER_CACHE_DIRECTORY) + name;
+}
+
+bool Shader::_LoadProgramBinary(uint64_t key)
+{
+	std::ifstream file(_GetCachePath(key), std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	ShaderCacheHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!file || header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION || header.key != key || header.binarySize == 0)
+	{
+		DEBUG_LOG("Shader", LOG_WARN, "Ignoring unrecognized program cache file %s", _GetCachePath(key).c_str());
+		return false;
+	}
+
+	std::vector<char> binary(header.binarySize);
+	file.read(binary.data(), binary.size());
+
+	if (!file)
+	{
+		DEBUG_LOG("Shader", LOG_WARN, "Program cache file %s is truncated", _GetCachePath(key).c_str());
+		return false;
+	}
+
+	_id = glCreateProgram();
+	glProgramBinary(_id, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+
+	// The driver is free to reject binaries, e.g. from an older version of itself, in which case the program just gets compiled
+	GLint success;
+	glGetProgramiv(_id, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		DEBUG_LOG("Shader", LOG_WARN, "Driver rejected cached program %s, recompiling", _GetCachePath(key).c_str());
+		glDeleteProgram(_id);
+		_id = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void Shader::_SaveProgramBinary(uint64_t key)
+{
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+
+	GLint length = 0;
+	glGetProgramiv(_id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+	if (numFormats == 0 || length <= 0)
+	{
+		return;
+	}
+
+	ShaderCacheHeader header;
+	header.magic = SHADER_CACHE_MAGIC;
+	header.version = SHADER_CACHE_VERSION;
+	header.key = key;
+
+	std::vector<char> binary(length);
+	GLenum binaryFormat = 0;
+	GLsizei binarySize = 0;
+	glGetProgramBinary(_id, length, &binarySize, &binaryFormat, binary.data());
+
+	header.binaryFormat = binaryFormat;
+	header.binarySize = static_cast<uint32_t>(binarySize);
+
+	std::error_code error;
+	std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+
+	std::ofstream file(_GetCachePath(key), std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(binary.data(), binarySize);
+
+	if (!file)
+	{
+		DEBUG_LOG("Shader", LOG_WARN, "Could not write program cache file %s", _GetCachePath(key).c_str());
+	}
 }
 
 void Shader::Use()
@@ -116,48 +263,48 @@ void Shader::UnUse()
 void Shader::Set1i(const int val, const std::string& name)
 {
 	GLint location = glGetUniformLocation(_id, name.c_str());
-	glUniform1i(location, val);
+	glProgramUniform1i(_id, location, val);
 }
 
 void Shader::Set1f(const float val, const std::string& name)
 {
 	GLint location = glGetUniformLocation(_id, name.c_str());
-	glUniform1f(location, val);
+	glProgramUniform1f(_id, location, val);
 }
 
 void Shader::SetVec2f(const glm::fvec2& val, const std::string& name)
 {
 	GLint location = glGetUniformLocation(_id, name.c_str());
-	glUniform2f(location, val.x, val.y);
+	glProgramUniform2f(_id, location, val.x, val.y);
 }
 
 void Shader::SetVec3f(const glm::fvec3& val, const std::string& name)
 {
 	GLint location = glGetUniformLocation(_id, name.c_str());
-	glUniform3f(location, val.x, val.y, val.z);
+	glProgramUniform3f(_id, location, val.x, val.y, val.z);
 }
 
 void Shader::SetVec4f(const glm::fvec4& val, const std::string& name)
 {
 	GLint location = glGetUniformLocation(_id, name.c_str());
-	glUniform4f(location, val.x, val.y, val.z, val.w);
+	glProgramUniform4f(_id, location, val.x, val.y, val.z, val.w);
 }
 
 void Shader::SetMat3fv(const glm::mat3& matrix, const std::string& name, GLboolean transpose)
 {
 	GLint location = glGetUniformLocation(_id, name.c_str());
-	glUniformMatrix3fv(location, 1, transpose, glm::value_ptr(matrix));
+	glProgramUniformMatrix3fv(_id, location, 1, transpose, glm::value_ptr(matrix));
 }
 
 void Shader::SetMat4fv(const glm::mat4& matrix, const std::string& name, GLboolean transpose)
 {
 	GLint location = glGetUniformLocation(_id, name.c_str());
-	glUniformMatrix4fv(location, 1, transpose, glm::value_ptr(matrix));
+	glProgramUniformMatrix4fv(_id, location, 1, transpose, glm::value_ptr(matrix));
 	
 }
 
 void Shader::SetArrMat4fv(const std::vector<glm::mat4>& matrices, const std::string& name, GLboolean transpose)
 {
 	GLint location = glGetUniformLocation(_id, name.c_str());
-	glUniformMatrix4fv(location, (GLsizei)(matrices.size()), transpose, glm::value_ptr(matrices[0]));
+	glProgramUniformMatrix4fv(_id, location, (GLsizei)(matrices.size()), transpose, glm::value_ptr(matrices[0]));
 }
@@ -17,6 +17,27 @@
 
 #include "common.hh"
 
+/// Linked program binaries are cached here, one file per program, named after the cache key.
+#define SHADER_CACHE_DIRECTORY "shadercache/"
+#define SHADER_CACHE_MAGIC 0x42535043 // "CPSB"
+#define SHADER_CACHE_VERSION 1
+
+/// Sits at the start of a cached program binary file, followed by binarySize bytes from glGetProgramBinary.
+struct ShaderCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t binaryFormat;
+	uint32_t binarySize;
+};
+
+/// Programs are compiled and linked from GLSL once, then stored with glGetProgramBinary and reloaded with glProgramBinary
+/// on later runs. The cache key hashes the GL vendor/renderer/version strings and the source of every stage, so editing
+/// a shader or updating the driver simply misses the cache. A binary the driver rejects falls back to a full compile.
+///
+/// Defines are inserted as "#define NAME" lines right after #version in every stage, and are part of the cache key.
+/// Uniforms are set with glProgramUniform*, so the program doesn't need to be in use to receive them.
 class Shader
 {
 private:
@@ -24,16 +45,22 @@ private:
 	const int _glVersionMajor; // OpenGL versions
 	const int _glVersionMinor;
 
-	std::string _LoadShaderFile(const std::string& filename);
-	GLuint _LoadShader(GLenum shaderType, const std::string& filename);
-	void _LinkProgram(GLuint vertexShader, GLuint geometryShader, GLuint fragmentShader);
+	std::string _LoadShaderFile(const std::string& filename, const std::vector<std::string>& defines);
+	GLuint _CompileShader(GLenum shaderType, const std::string& source, const std::string& filename);
+	bool _LinkProgram(GLuint vertexShader, GLuint geometryShader, GLuint fragmentShader);
+
+	static std::string _GetDriverString();
+	static std::string _GetCachePath(uint64_t key);
+	bool _LoadProgramBinary(uint64_t key);
+	void _SaveProgramBinary(uint64_t key);
 public:
 	Shader(
 		const int glVersionMajor,
 		const int glVersionMinor,
 		const std::string& vertexFile,
 		const std::string& fragmentFile,
-		const std::string& geometryFile = ""
+		const std::string& geometryFile = "",
+		const std::vector<std::string>& defines = {}
 	);
 	~Shader();
 	void Use();
@@ -0,0 +1,57 @@
+#include "shader_variants.hh"
+
+ShaderVariants::ShaderVariants(
+	const int glVersionMajor,
+	const int glVersionMinor,
+	const std::string& vertexFile,
+	const std::string& fragmentFile,
+	const std::string& geometryFile)
+	: _glVersionMajor(glVersionMajor), _glVersionMinor(glVersionMinor),
+	_vertexFile(vertexFile), _fragmentFile(fragmentFile), _geometryFile(geometryFile)
+{
+	for (auto*& i : _variants)
+	{
+		i = nullptr;
+	}
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	for (auto*& i : _variants)
+	{
+		delete i;
+	}
+}
+
+Shader* ShaderVariants::Get(uint32_t features)
+{
+	if (features >= (1u << SHADER_FEATURE_COUNT))
+	{
+		DEBUG_LOG("ShaderVariants", LOG_ERROR, "Unknown shader feature bits 0x%x in variant of %s", features, _vertexFile.c_str());
+		features &= (1u << SHADER_FEATURE_COUNT) - 1;
+	}
+
+	if (!_variants[features])
+	{
+		DEBUG_LOG("ShaderVariants", LOG_INFO, "Compiling variant 0x%x of %s", features, _vertexFile.c_str());
+		_variants[features] = new Shader(_glVersionMajor, _glVersionMinor, _vertexFile, _fragmentFile, _geometryFile, GetDefines(features));
+	}
+
+	return _variants[features];
+}
+
+std::vector<std::string> ShaderVariants::GetDefines(uint32_t features)
+{
+	static const char* names[SHADER_FEATURE_COUNT] = { "SKINNED", "SHADOWED", "INSTANCED", "DEPTH_ONLY", "DUAL_QUATERNION" };
+
+	std::vector<std::string> defines;
+	for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+	{
+		if (features & (1u << i))
+		{
+			defines.push_back(names[i]);
+		}
+	}
+
+	return defines;
+}
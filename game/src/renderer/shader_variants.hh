@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.hh"
+#include "renderer/shader.hh"
+
+/// Feature flags of a shader variant. Each one is compiled in as a #define of the same name (without the prefix).
+enum ShaderFeature : uint32_t
+{
+	SHADER_FEATURE_SKINNED = 1 << 0, // Blends the bone palette into the vertex position and normal
+	SHADER_FEATURE_SHADOWED = 1 << 1, // Samples the cascaded shadow map
+	SHADER_FEATURE_INSTANCED = 1 << 2, // Model matrix comes from the per-instance attribute instead of the modelMatrix uniform
+	SHADER_FEATURE_DEPTH_ONLY = 1 << 3, // Shadow map pass: transforms by lightProjection, no shading
+	SHADER_FEATURE_DUAL_QUATERNION = 1 << 4, // With SKINNED: the palette holds dual quaternions instead of matrices
+
+	SHADER_FEATURE_COUNT = 5
+};
+
+/// Every permutation of one set of shader files. A variant is compiled the first time it's asked for and kept,
+/// indexed by its feature bitmask, so each draw can use the cheapest program that has exactly the features it needs.
+///
+/// Variants are separate programs with their own uniforms: anything set per frame has to be sent to each variant a
+/// pass draws with.
+class ShaderVariants
+{
+private:
+	const int _glVersionMajor;
+	const int _glVersionMinor;
+	const std::string _vertexFile;
+	const std::string _fragmentFile;
+	const std::string _geometryFile;
+
+	Shader* _variants[1 << SHADER_FEATURE_COUNT];
+public:
+	ShaderVariants(
+		const int glVersionMajor,
+		const int glVersionMinor,
+		const std::string& vertexFile,
+		const std::string& fragmentFile,
+		const std::string& geometryFile = ""
+	);
+	~ShaderVariants();
+
+	/// Returns the variant with exactly these features, compiling it on first use.
+	Shader* Get(uint32_t features);
+
+	inline bool IsCompiled(uint32_t features) const { return _variants[features] != nullptr; }
+
+	static std::vector<std::string> GetDefines(uint32_t features);
+};
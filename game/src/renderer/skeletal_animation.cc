@@ -0,0 +1,554 @@
+#include "skeletal_animation.hh"
+#include "compressed_animation.hh"
+#include "blend_tree.hh"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+/// translate(position) * rotation, with the rotation laid out like qt::Quaternion::GetRotationTransformMat().
+static inline glm::mat4 _ComposeBoneMatrix(const glm::vec3& position, const qt::Quaternion& q)
+{
+	const float xy = q.x*q.y, xz = q.x*q.z, xw = q.x*q.w;
+	const float yz = q.y*q.z, yw = q.y*q.w, zw = q.z*q.w;
+	const float x2 = q.x*q.x, y2 = q.y*q.y, z2 = q.z*q.z;
+
+	return glm::mat4(
+		glm::vec4(1.0f - 2.0f*(y2 + z2), 2.0f*(xy - zw), 2.0f*(xz + yw), 0.0f),
+		glm::vec4(2.0f*(xy + zw), 1.0f - 2.0f*(x2 + z2), 2.0f*(yz - xw), 0.0f),
+		glm::vec4(2.0f*(xz - yw), 2.0f*(yz + xw), 1.0f - 2.0f*(x2 + y2), 0.0f),
+		glm::vec4(position, 1.0f));
+}
+
+Skeleton::Skeleton()
+{
+}
+
+Skeleton::~Skeleton()
+{
+}
+
+int32_t Skeleton::AddBone(const std::string& name, int32_t parent, const glm::mat4& inverseBindMatrix)
+{
+	if (parent >= static_cast<int32_t>(_parents.size()) || parent < -1)
+	{
+		DEBUG_LOG("Skeleton", LOG_ERROR, "Bone '%s' has parent %i, which isn't an earlier bone", name.c_str(), parent);
+		return -1;
+	}
+
+	_names.push_back(name);
+	_parents.push_back(parent);
+	_depths.push_back(parent < 0 ? 0 : _depths[parent] + 1);
+	_inverseBindMatrices.push_back(inverseBindMatrix);
+
+	return static_cast<int32_t>(_parents.size() - 1);
+}
+
+bool Skeleton::BuildFromTree(BoneTreeNode& root)
+{
+	struct FlatBone
+	{
+		BoneTreeNode* node;
+		int32_t parent;
+	};
+
+	// Collect every bone with its parent's ID, then put them in ID order
+	std::vector<FlatBone> bones;
+	std::vector<FlatBone> stack;
+	for (auto& child : root.GetChildren())
+	{
+		stack.push_back({ &child, -1 });
+	}
+
+	while (!stack.empty())
+	{
+		const FlatBone bone = stack.back();
+		stack.pop_back();
+		bones.push_back(bone);
+
+		for (auto& child : bone.node->GetChildren())
+		{
+			stack.push_back({ &child, static_cast<int32_t>(bone.node->GetID()) });
+		}
+	}
+
+	std::sort(bones.begin(), bones.end(), [](const FlatBone& a, const FlatBone& b) { return a.node->GetID() < b.node->GetID(); });
+
+	Clear();
+	for (uint32_t i = 0; i < bones.size(); i++)
+	{
+		if (bones[i].node->GetID() != i)
+		{
+			DEBUG_LOG("Skeleton", LOG_ERROR, "Bone IDs aren't contiguous: expected %u, found %u ('%s')",
+				i, bones[i].node->GetID(), bones[i].node->GetName().c_str());
+			Clear();
+			return false;
+		}
+
+		if (AddBone(bones[i].node->GetName(), bones[i].parent, bones[i].node->GetInvBindTransform()) < 0)
+		{
+			Clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Skeleton::Clear()
+{
+	_names.clear();
+	_parents.clear();
+	_depths.clear();
+	_inverseBindMatrices.clear();
+}
+
+int32_t Skeleton::FindBone(const std::string& name) const
+{
+	for (uint32_t i = 0; i < _names.size(); i++)
+	{
+		if (_names[i] == name)
+		{
+			return static_cast<int32_t>(i);
+		}
+	}
+
+	return -1;
+}
+
+static const uint32_t _MAX_CURSOR_STEPS = 4; // Keyframes to walk forward before binary searching instead
+
+/// The last keyframe at or before time (or the first, if there is none) and the one after it.
+static void _FindKeyframes(const std::vector<Keyframe>& keyframes, float time, uint32_t& cursor, uint32_t& previous, uint32_t& next)
+{
+	const uint32_t numKeyframes = static_cast<uint32_t>(keyframes.size());
+
+	uint32_t current = std::min(cursor, numKeyframes - 1);
+	bool found = false;
+
+	// Playing forward, the time is still in the same span or at most a few keyframes further
+	if (keyframes[current].timestamp <= time)
+	{
+		for (uint32_t step = 0; step < _MAX_CURSOR_STEPS; step++)
+		{
+			if (current + 1 >= numKeyframes || keyframes[current + 1].timestamp > time)
+			{
+				found = true;
+				break;
+			}
+			current++;
+		}
+	}
+
+	// Seeked backwards or far ahead
+	if (!found)
+	{
+		const auto after = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+			[](float t, const Keyframe& keyframe) { return t < keyframe.timestamp; });
+		current = after == keyframes.begin() ? 0 : static_cast<uint32_t>(after - keyframes.begin()) - 1;
+	}
+
+	cursor = current;
+	previous = current;
+	next = std::min(current + 1, numKeyframes - 1);
+}
+
+void SampleAnimation(const Animation& animation, float time, uint32_t& cursor, Pose& pose)
+{
+	uint32_t previousIndex, nextIndex;
+	_FindKeyframes(animation.keyframes, time, cursor, previousIndex, nextIndex);
+
+	const Keyframe& previousFrame = animation.keyframes[previousIndex];
+	const Keyframe& nextFrame = animation.keyframes[nextIndex];
+
+	const float span = nextFrame.timestamp - previousFrame.timestamp;
+	const float f = span > 0.0f ? glm::clamp((time - previousFrame.timestamp) / span, 0.0f, 1.0f) : 0.0f;
+	const float fInv = 1.0f - f;
+
+	const Pose& previous = previousFrame.pose;
+	const Pose& next = nextFrame.pose;
+	const uint32_t numBones = pose.GetNumBones();
+
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		pose.translations[i] = previous.translations[i] * fInv + next.translations[i] * f;
+	}
+
+	// qt::Quaternion::NLerp without the temporaries: flip to the shorter arc, blend and renormalize
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		const qt::Quaternion& a = previous.rotations[i];
+		const qt::Quaternion& b = next.rotations[i];
+
+		const float dot = a.w*b.w + a.x*b.x + a.y*b.y + a.z*b.z;
+		const float fb = dot < 0.0f ? -f : f;
+
+		qt::Quaternion& out = pose.rotations[i];
+		out.w = fInv*a.w + fb*b.w;
+		out.x = fInv*a.x + fb*b.x;
+		out.y = fInv*a.y + fb*b.y;
+		out.z = fInv*a.z + fb*b.z;
+
+		const float inverseLength = 1.0f / sqrtf(out.w*out.w + out.x*out.x + out.y*out.y + out.z*out.z);
+		out.w *= inverseLength;
+		out.x *= inverseLength;
+		out.y *= inverseLength;
+		out.z *= inverseLength;
+	}
+}
+
+void ConvertToAdditive(Animation& animation, const Pose& reference)
+{
+	for (auto& keyframe : animation.keyframes)
+	{
+		const uint32_t numBones = std::min(keyframe.pose.GetNumBones(), reference.GetNumBones());
+
+		for (uint32_t i = 0; i < numBones; i++)
+		{
+			// Played back as base * delta, so delta = inverse(reference) * pose
+			keyframe.pose.translations[i] -= reference.translations[i];
+			keyframe.pose.rotations[i] = qt::Quaternion::Multiply(qt::Quaternion::Conjugate(reference.rotations[i]), keyframe.pose.rotations[i]);
+		}
+	}
+}
+
+Animator::Animator()
+	: _skeleton(nullptr), _currentAnimation(nullptr), _currentClip(nullptr), _blendTree(nullptr), _animationTime(0.0f), _keyframeCursor(0),
+	_lastDeltaTime(0.0f), _maxBoneDepth(ANIMATOR_ALL_BONES), _extractRootMotion(false), _loopsSinceSample(0),
+	_rootStart(0.0f), _rootLoopOffset(0.0f), _sampledRoot(0.0f), _rootMotion(0.0f)
+{
+}
+
+Animator::Animator(const Skeleton* skeleton)
+	: Animator()
+{
+	SetSkeleton(skeleton);
+}
+
+Animator::~Animator()
+{
+}
+
+void Animator::SetSkeleton(const Skeleton* skeleton)
+{
+	_skeleton = skeleton;
+	_currentAnimation = nullptr;
+	_currentClip = nullptr;
+	_blendTree = nullptr;
+	_animationTime = 0.0f;
+	_keyframeCursor = 0;
+
+	const uint32_t numBones = skeleton ? skeleton->GetNumBones() : 0;
+
+	_localPose.Resize(numBones);
+	_modelMatrices.assign(numBones, glm::mat4(1.0f));
+	_skinningMatrices.assign(numBones, glm::mat4(1.0f));
+	_previousSkinningMatrices.assign(numBones, glm::mat4(1.0f));
+	_lastDeltaTime = 0.0f;
+	_PrepareRootMotion();
+}
+
+void Animator::SetAnimation(const Animation* animation)
+{
+	_animationTime = 0.0f;
+	_keyframeCursor = 0;
+	_currentAnimation = nullptr;
+	_currentClip = nullptr;
+	_blendTree = nullptr;
+
+	if (!animation || !_skeleton)
+	{
+		return;
+	}
+
+	for (uint32_t i = 1; i < animation->keyframes.size(); i++)
+	{
+		if (animation->keyframes[i].timestamp < animation->keyframes[i - 1].timestamp)
+		{
+			DEBUG_LOG("Animator", LOG_ERROR, "Keyframe %u at %.3fs comes before the keyframe ahead of it", i, animation->keyframes[i].timestamp);
+			return;
+		}
+	}
+
+	for (const auto& i : animation->keyframes)
+	{
+		if (i.pose.GetNumBones() != _skeleton->GetNumBones() || i.pose.rotations.size() != i.pose.translations.size())
+		{
+			DEBUG_LOG("Animator", LOG_ERROR, "Keyframe at %.3fs has %u bones, the skeleton has %u",
+				i.timestamp, i.pose.GetNumBones(), _skeleton->GetNumBones());
+			return;
+		}
+	}
+
+	_currentAnimation = animation;
+	_PrepareRootMotion();
+}
+
+void Animator::SetAnimation(const CompressedAnimation* clip)
+{
+	_animationTime = 0.0f;
+	_keyframeCursor = 0;
+	_currentAnimation = nullptr;
+	_currentClip = nullptr;
+	_blendTree = nullptr;
+
+	if (!clip || !_skeleton || !clip->IsValid())
+	{
+		return;
+	}
+
+	if (clip->GetNumBones() != _skeleton->GetNumBones())
+	{
+		DEBUG_LOG("Animator", LOG_ERROR, "Compressed clip has %u bones, the skeleton has %u", clip->GetNumBones(), _skeleton->GetNumBones());
+		return;
+	}
+
+	_currentClip = clip;
+	_trackCursors.assign(2 * clip->GetNumBones(), 0);
+	_PrepareRootMotion();
+}
+
+void Animator::SetBlendTree(BlendTree* tree)
+{
+	_animationTime = 0.0f;
+	_keyframeCursor = 0;
+	_currentAnimation = nullptr;
+	_currentClip = nullptr;
+	_blendTree = nullptr;
+
+	if (!tree || !_skeleton)
+	{
+		return;
+	}
+
+	if (tree->GetSkeleton() != _skeleton)
+	{
+		DEBUG_LOG("Animator", LOG_ERROR, "Blend tree was built for another skeleton");
+		return;
+	}
+
+	_blendTree = tree;
+	_PrepareRootMotion();
+}
+
+void Animator::_LocalToModel()
+{
+	const uint32_t numBones = _skeleton->GetNumBones();
+	const int32_t* parents = _skeleton->GetParents();
+	const glm::mat4* inverseBindMatrices = _skeleton->GetInverseBindMatrices();
+
+	// Parents come first, so their model matrix is always ready
+	for (uint32_t i = 0; i < numBones; i++)
+	{
+		// Past the LOD's depth a bone moves with its parent, which has been taken care of by now
+		if (_skeleton->GetDepth(i) > _maxBoneDepth)
+		{
+			_skinningMatrices[i] = _skinningMatrices[parents[i]];
+			continue;
+		}
+
+		const glm::mat4 local = _ComposeBoneMatrix(_localPose.translations[i], _localPose.rotations[i]);
+		_modelMatrices[i] = parents[i] < 0 ? local : _modelMatrices[parents[i]] * local;
+		_skinningMatrices[i] = _modelMatrices[i] * inverseBindMatrices[i];
+	}
+}
+
+void Animator::_Sample(float time, bool continuous)
+{
+	if (_currentClip)
+	{
+		_currentClip->Sample(time, _trackCursors, _localPose);
+	}
+	else
+	{
+		SampleAnimation(*_currentAnimation, time, _keyframeCursor, _localPose);
+	}
+
+	if (_localPose.GetNumBones() == 0)
+	{
+		return;
+	}
+
+	_ExtractRootMotion(_localPose.translations[0], continuous);
+	if (_extractRootMotion)
+	{
+		_localPose.translations[0].x = _rootStart.x;
+		_localPose.translations[0].z = _rootStart.z;
+	}
+
+	_LocalToModel();
+}
+
+void Animator::_PrepareRootMotion()
+{
+	_loopsSinceSample = 0;
+	_rootStart = glm::vec3(0.0f);
+	_rootLoopOffset = glm::vec3(0.0f);
+	_rootMotion = glm::vec3(0.0f);
+
+	if (!_extractRootMotion || _blendTree || !_IsPlaying() || _localPose.GetNumBones() == 0)
+	{
+		return;
+	}
+
+	// Only the clip's ends, so looping never has to sample it twice
+	glm::vec3 rootEnd;
+	if (_currentClip)
+	{
+		Pose ends;
+		ends.Resize(_localPose.GetNumBones());
+		std::vector<uint32_t> cursors;
+		_currentClip->Sample(0.0f, cursors, ends);
+		_rootStart = ends.translations[0];
+		_currentClip->Sample(_currentClip->GetDuration(), cursors, ends);
+		rootEnd = ends.translations[0];
+	}
+	else
+	{
+		_rootStart = _currentAnimation->keyframes.front().pose.translations[0];
+		rootEnd = _currentAnimation->keyframes.back().pose.translations[0];
+	}
+
+	_rootLoopOffset = rootEnd - _rootStart;
+	_sampledRoot = _rootStart; // Clips start at 0
+}
+
+void Animator::_ExtractRootMotion(const glm::vec3& sampledRoot, bool continuous)
+{
+	if (!_extractRootMotion || !continuous)
+	{
+		_rootMotion = glm::vec3(0.0f);
+	}
+	else
+	{
+		// Every loop the clock wrapped around picks up where the clip's end left the root
+		const glm::vec3 step = sampledRoot - _sampledRoot + _rootLoopOffset * static_cast<float>(_loopsSinceSample);
+		_rootMotion = glm::vec3(step.x, 0.0f, step.z);
+	}
+
+	_sampledRoot = sampledRoot;
+	_loopsSinceSample = 0;
+}
+
+float Animator::_GetDuration() const
+{
+	return _currentClip ? _currentClip->GetDuration() : _currentAnimation->duration;
+}
+
+bool Animator::_IsPlaying() const
+{
+	return _currentClip || (_currentAnimation && !_currentAnimation->keyframes.empty());
+}
+
+void Animator::Update(float deltaTime)
+{
+	if (_blendTree)
+	{
+		_blendTree->Update(deltaTime);
+		_blendTree->Evaluate(_localPose);
+		_skinningMatrices.swap(_previousSkinningMatrices);
+		_lastDeltaTime = deltaTime;
+		_LocalToModel();
+		return;
+	}
+
+	if (Advance(deltaTime))
+	{
+		_Sample(_animationTime, true);
+	}
+}
+
+bool Animator::Advance(float deltaTime)
+{
+	if (_blendTree || !_IsPlaying())
+	{
+		return false;
+	}
+
+	const float duration = _GetDuration();
+	_animationTime += deltaTime;
+	if (_animationTime > duration)
+	{
+		_loopsSinceSample += duration > 0.0f ? static_cast<uint32_t>(_animationTime / duration) : 0;
+		_animationTime = duration > 0.0f ? fmodf(_animationTime, duration) : 0.0f;
+		_keyframeCursor = 0; // Looped back to the start, so walking forward from the first keyframe is cheapest
+		std::fill(_trackCursors.begin(), _trackCursors.end(), 0);
+	}
+
+	_skinningMatrices.swap(_previousSkinningMatrices);
+	_lastDeltaTime = deltaTime;
+	return true;
+}
+
+void Animator::EvaluateAt(float time)
+{
+	_Sample(std::min(time, _GetDuration()), true);
+}
+
+void Animator::CopyPose(const Animator& source)
+{
+	// Same skeleton, so every copy fits in the memory already there
+	_localPose.translations = source._localPose.translations;
+	_localPose.rotations = source._localPose.rotations;
+	_modelMatrices = source._modelMatrices;
+	_skinningMatrices = source._skinningMatrices;
+
+	_ExtractRootMotion(source._sampledRoot, true);
+}
+
+void Animator::SetAnimationTime(float time)
+{
+	if (!_IsPlaying())
+	{
+		return;
+	}
+
+	const float duration = _GetDuration();
+	_animationTime = duration > 0.0f ? fmodf(time, duration) : 0.0f;
+	if (_animationTime < 0.0f)
+	{
+		_animationTime += duration;
+	}
+
+	_lastDeltaTime = 0.0f;
+	_loopsSinceSample = 0;
+	_Sample(_animationTime, false);
+}
+
+void Animator::SetRootMotion(bool extract)
+{
+	_extractRootMotion = extract;
+	_PrepareRootMotion();
+
+	// Pinned or released right away, without waiting for the next update
+	if (!_blendTree && _IsPlaying())
+	{
+		_Sample(_animationTime, false);
+	}
+}
+
+void Animator::Extrapolate(float time, glm::mat4* out) const
+{
+	const size_t numFloats = _skinningMatrices.size() * 16;
+	if (numFloats == 0)
+	{
+		return;
+	}
+
+	const float* current = &_skinningMatrices[0][0][0];
+	const float* previous = &_previousSkinningMatrices[0][0][0];
+	float* result = &out[0][0][0];
+
+	if (_lastDeltaTime <= 0.0f)
+	{
+		memcpy(result, current, numFloats * sizeof(float));
+		return;
+	}
+
+	// Element by element, which the compiler vectorizes. Not rigid, but close enough over the frame or three it covers
+	const float t = std::min(time / _lastDeltaTime, 1.0f);
+	for (size_t i = 0; i < numFloats; i++)
+	{
+		result[i] = current[i] + (current[i] - previous[i]) * t;
+	}
+}
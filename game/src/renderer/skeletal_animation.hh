@@ -3,7 +3,6 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
-#include <map>
 #include <string>
 
 #include <glm.hpp>
@@ -227,185 +226,186 @@ public:
 	}
 };
 
-// boneTransforms[MAX_BONES] -> loaded as gBones[NUM_BONES] into shader!
-struct BoneTransform
+/// Bones in contiguous arrays, ordered parent before child (parents[i] < i), so a single forward pass over the
+/// arrays visits every parent before its children. Bone indices are the indices into the shader's gBones array.
+/// Immutable once built and shared by every Animator playing on it.
+class Skeleton
 {
-	glm::vec3 position;
-	qt::Quaternion rotation;
-
-	BoneTransform(
-		const glm::vec3& position = glm::vec3(0.0f, 0.0f, 0.0f),
-		const qt::Quaternion& rotation = qt::Quaternion(0.0f, 0.0f, 0.0f, 0.0f, false)
-	)
-		: position(position), rotation(rotation)
-	{
-	}
+private:
+	std::vector<std::string> _names;
+	std::vector<int32_t> _parents; // -1 for roots
+	std::vector<uint32_t> _depths; // 0 for roots
+	std::vector<glm::mat4> _inverseBindMatrices; // Model space to bone space, in the bind pose
+public:
+	Skeleton();
+	~Skeleton();
 
-	~BoneTransform()
-	{
-	}
+	/// Appends a bone and returns its index. parent must be an earlier bone, or -1 for a root.
+	/// Returns -1 (and logs) if it isn't.
+	int32_t AddBone(const std::string& name, int32_t parent, const glm::mat4& inverseBindMatrix);
 
-	glm::mat4 GetLocalTransform()
-	{
-		glm::mat4 rotationMatrix = rotation.GetRotationTransformMat();
-		glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), position);
-		return (translationMatrix * rotationMatrix);
-	}
+	/// Flattens a bone tree whose inverse bind transforms have been calculated. The root node itself isn't a bone.
+	/// Bone IDs have to run from 0 with parents numbered before their children, which is how md5 numbers joints.
+	bool BuildFromTree(BoneTreeNode& root);
+
+	void Clear();
 
-	static BoneTransform Interpolate(BoneTransform& previousTransform, BoneTransform& nextTransform, float f)
+	/// -1 if there is no bone with that name.
+	int32_t FindBone(const std::string& name) const;
+
+	inline uint32_t GetNumBones() const { return static_cast<uint32_t>(_parents.size()); }
+	inline int32_t GetParent(uint32_t bone) const { return _parents[bone]; }
+	inline uint32_t GetDepth(uint32_t bone) const { return _depths[bone]; }
+	inline const std::string& GetName(uint32_t bone) const { return _names[bone]; }
+	inline const glm::mat4& GetInverseBindMatrix(uint32_t bone) const { return _inverseBindMatrices[bone]; }
+	inline const int32_t* GetParents() const { return _parents.data(); }
+	inline const glm::mat4* GetInverseBindMatrices() const { return _inverseBindMatrices.data(); }
+};
+
+/// Parent-relative bone transforms as structure of arrays, indexed by bone.
+struct Pose
+{
+	std::vector<glm::vec3> translations;
+	std::vector<qt::Quaternion> rotations;
+
+	/// New bones get the identity transform.
+	void Resize(uint32_t numBones)
 	{
-		glm::vec3 position = qt::Lerp(previousTransform.position, nextTransform.position, f);
-		qt::Quaternion rotation = qt::Quaternion::NLerp(previousTransform.rotation, nextTransform.rotation, f);
-		return BoneTransform(position, rotation);
+		translations.resize(numBones, glm::vec3(0.0f));
+		rotations.resize(numBones, qt::Quaternion(1.0f, 0.0f, 0.0f, 0.0f, false));
 	}
+
+	inline uint32_t GetNumBones() const { return static_cast<uint32_t>(translations.size()); }
 };
 
 struct Keyframe
 {
 	float timestamp; // Time, in seconds, from start of animation to where this keyframe occurs
-	std::map<std::string, BoneTransform> pose; // For this keyframe, a map of transformation matrices (value) to each bone name (key)
+	Pose pose; // One transform per bone of the skeleton the animation was made for
 };
 
 struct Animation
 {
-	std::vector<Keyframe> keyframes;
+	std::vector<Keyframe> keyframes; // Sorted by timestamp
 	float duration = 0.0f; // In seconds
 };
 
+/// Interpolates animation at time (clamped to its keyframes) into pose, which must have one transform per bone.
+/// cursor is the keyframe found by the previous call on the same clip: playing forward, the next pair is found in
+/// constant time however long the clip is; seeks binary search.
+void SampleAnimation(const Animation& animation, float time, uint32_t& cursor, Pose& pose);
+
+/// Turns a clip into one that plays on top of others (see BlendTree::AddAdditive): every keyframe becomes its
+/// difference from reference, usually the clip's first frame or the bind pose.
+void ConvertToAdditive(Animation& animation, const Pose& reference);
+
+class CompressedAnimation;
+class BlendTree;
+
+/// Animator::SetMaxBoneDepth() value that evaluates the whole skeleton.
+#define ANIMATOR_ALL_BONES 0xffffffff
+
+/// Plays an Animation on a Skeleton. Both are referenced, not copied, and must outlive the animator.
+///
+/// Every update interpolates the two surrounding keyframes bone by bone into a local pose, then takes it to model
+/// space in one linear pass over the bones. All buffers are sized when the skeleton is set, so updating never
+/// allocates. A CompressedAnimation can be played instead, and is sampled in place, or a BlendTree for cross-fades
+/// and layers.
+///
+/// With root motion on, the clip's horizontal root movement is taken out of the pose and handed over as a step per
+/// update, for whatever moves the character to apply.
 class Animator
 {
 private:
-	BoneTreeNode _entityRootBone; // Used to be lval reference
-	Animation _currentAnimation;
+	const Skeleton* _skeleton;
+	const Animation* _currentAnimation;
+	const CompressedAnimation* _currentClip; // Played instead of _currentAnimation when set
+	BlendTree* _blendTree; // Played instead of either when set
 	float _animationTime;
-
-
-	void _IncreaseAnimationTime()
-	{
-		_animationTime += (1.0f / 60.0f);
-		if (_animationTime > _currentAnimation.duration)
-		{
-			_animationTime = 0.0f;
-		}
-	}
-
-	/// NOTE: The transformations calculated are in bone space, not in model space.
-	/// To place these bone transforms into model space, they are recalculated in _ApplyPoseToBones
-	std::map<std::string, glm::mat4> _CalculateCurrentAnimationPose()
-	{
-		std::pair<Keyframe, Keyframe> frames = _GetPreviousAndNextFrames();
-		float f = _CalculateInterpolationFactor(frames.first, frames.second);
-		return _InterpolatePoses(frames.first, frames.second, f);
-	}
-
-	// TODO: OPTIMIZE
-	std::pair<Keyframe, Keyframe> _GetPreviousAndNextFrames()
-	{
-		std::vector<Keyframe> allFrames = _currentAnimation.keyframes;
-
-		Keyframe previousFrame = allFrames[0];
-		Keyframe nextFrame = allFrames[0];
-
-		// Iterate through all the frames of the current animation until it finds one where 
-		// the timestamp of the frame is greater than that of the current time in the animation
-		for (uint32_t i = 1; i < allFrames.size(); i++)
-		{
-			nextFrame = allFrames[i];
-			if (nextFrame.timestamp > _animationTime)
-			{
-				break;
-			}
-			previousFrame = allFrames[i];
-		}
-
-		return std::make_pair(previousFrame, nextFrame);
-	}
-
-	float _CalculateInterpolationFactor(const Keyframe& previousFrame, const Keyframe& nextFrame)
-	{
-		float totalTime = nextFrame.timestamp - previousFrame.timestamp;
-		float currentTime = _animationTime - previousFrame.timestamp;
-		return (currentTime / totalTime);
-	}
-
-	std::map<std::string, glm::mat4> _InterpolatePoses(Keyframe& previousFrame, Keyframe& nextFrame, float f)
-	{
-		// To interpolate between poses, the transforms of each bone has to be interpolated.
-		// Loop through all bones; for each bone, get the previous and next transform from
-		// the keyframes, and then use them to set a new, interpolated transform
-		std::map<std::string, glm::mat4> currentPose;
-		for (const auto& [name, matrix] : previousFrame.pose)
-		{
-			BoneTransform previousTransform = (previousFrame.pose)[name];
-			BoneTransform nextTransform = (nextFrame.pose)[name];
-
-			BoneTransform currentTransform = BoneTransform::Interpolate(previousTransform, nextTransform, f);
-			currentPose.insert(std::make_pair(name, currentTransform.GetLocalTransform()));
-		}
-		return currentPose;
-	}
-
-	/// This method is called recursively for every bone in the model, starting with the root bone.
-	/// Not only does it apply the pose, but it also moves each localized bone transform from
-	/// bone space (relative to parent bone) to model space.
-	void _ApplyPoseToBones(std::map<std::string, glm::mat4>& currentPose, BoneTreeNode& bone, const glm::mat4 parentTransform)
-	{
-		// Move localized "bone-space" transforms into "model-space" relative to origin
-		glm::mat4 currentLocTransform = currentPose[bone.GetName()];
-		glm::mat4 currentTransform = parentTransform * currentLocTransform; // Note how this is used recursively
-
-		for (BoneTreeNode childBone : bone.GetChildren())
-		{
-			_ApplyPoseToBones(currentPose, childBone, currentTransform);
-		}
-
-		//                y
-		//                ^  pose position
-		//                |     [BONE>
-		//   model-space  |     ^  ^\
-		//  pose transform T   /     \_<-- T*inverse(S)
-		//           -------> /        \_
-		//                |  /           [BONE> bind position
-		//                | /       ___->
-		//                |/   ____/
-		//       origin ->X___/--^--model-space-------------->x
-		//                       |_ bind transform S
-		//       
-		currentTransform = currentTransform * bone.GetInvBindTransform();
-		bone.SetAnimTransform(currentTransform);
-	}
-
+	uint32_t _keyframeCursor; // Last keyframe at or before _animationTime, as of the last sample
+	std::vector<uint32_t> _trackCursors; // The same for every track of _currentClip
+
+	Pose _localPose;
+	std::vector<glm::mat4> _modelMatrices; // Bone space to model space, in the current pose
+	std::vector<glm::mat4> _skinningMatrices; // _modelMatrices * inverse bind matrix, what the shader's gBones wants
+	std::vector<glm::mat4> _previousSkinningMatrices; // As of the update before last, for Extrapolate()
+	float _lastDeltaTime; // Time the last Update() covered; 0 after a seek, which has no motion to extrapolate
+	uint32_t _maxBoneDepth;
+
+	bool _extractRootMotion;
+	uint32_t _loopsSinceSample; // Times the clock wrapped since the last sample
+	glm::vec3 _rootStart; // Root translation at the start of the clip, which the pose's root is pinned to
+	glm::vec3 _rootLoopOffset; // Root translation at the end of the clip minus at the start
+	glm::vec3 _sampledRoot; // Root translation as last sampled, before pinning
+	glm::vec3 _rootMotion;
+
+	void _LocalToModel();
+	void _Sample(float time, bool continuous);
+	void _PrepareRootMotion();
+	void _ExtractRootMotion(const glm::vec3& sampledRoot, bool continuous);
+	float _GetDuration() const;
+	bool _IsPlaying() const;
 public:
-	Animator(BoneTreeNode& rootBone)
-		: _entityRootBone(rootBone), _animationTime(0.0f)
-	{
-
-	}
-
-	Animator()
-	{
-
-	}
-
-	~Animator()
-	{
-
-	}
-
-	void SetAnimation(const Animation& animation)
-	{
-		_animationTime = 0.0f;
-		_currentAnimation = animation;
-	}
-
-	void Update()
-	{
-		if (_currentAnimation.keyframes.empty())
-		{
-			return;
-		}
-		_IncreaseAnimationTime();
-		std::map<std::string, glm::mat4> currentPose = _CalculateCurrentAnimationPose();
-		_ApplyPoseToBones(currentPose, _entityRootBone, glm::mat4(1.0f));
-	}
-};
\ No newline at end of file
+	Animator();
+	Animator(const Skeleton* skeleton);
+	~Animator();
+
+	/// Resets the pose to the bind pose.
+	void SetSkeleton(const Skeleton* skeleton);
+
+	/// Restarts from the beginning. Rejected (and logged) if its poses don't have one transform per bone or its
+	/// keyframes are out of order.
+	void SetAnimation(const Animation* animation);
+
+	/// Same as above, for a compressed clip.
+	void SetAnimation(const CompressedAnimation* clip);
+
+	/// Plays the tree's root from now on; the tree keeps its own clip times. Rejected (and logged) if it was built
+	/// for another skeleton. The tree must outlive the animator, or be replaced first.
+	void SetBlendTree(BlendTree* tree);
+
+	/// Advances the animation (or every clip of the blend tree), looping at the end, and recomputes every matrix.
+	void Update(float deltaTime = 1.0f / 60.0f);
+
+	/// Update() in two halves, so animators playing the same clip at the same time can share one evaluation (see
+	/// AnimationSystem::SetPoseCacheRate()). Advance() moves the clock without sampling, and is false for blend trees
+	/// and animators with nothing to play, which have to Update() instead. Then either EvaluateAt() samples the clip at
+	/// a time near the clock and recomputes every matrix, or CopyPose() takes the pose of an animator on the same
+	/// skeleton that just evaluated the same clip, with the same root motion setting and bone depth.
+	bool Advance(float deltaTime);
+	void EvaluateAt(float time);
+	void CopyPose(const Animator& source);
+
+	/// Jumps to a time in the current animation (wrapped into its length) and recomputes every matrix.
+	/// Blend trees are seeked clip by clip, through BlendTree::SetClipTime().
+	void SetAnimationTime(float time);
+
+	/// Level of detail: from the next update on, bones deeper than maxDepth (roots are depth 0) aren't evaluated and
+	/// follow their deepest evaluated ancestor rigidly, as if still in their bind pose relative to it. Their model
+	/// matrices are left as they were. ANIMATOR_ALL_BONES evaluates every bone.
+	inline void SetMaxBoneDepth(uint32_t maxDepth) { _maxBoneDepth = maxDepth; }
+
+	/// Skinning matrices time seconds past the last Update(), continuing the motion between the last two updates
+	/// linearly, for the frames an animation LOD skips. Goes at most one update interval ahead. out receives one matrix
+	/// per bone.
+	void Extrapolate(float time, glm::mat4* out) const;
+
+	/// Root motion: the first bone's translation along x and z stays where the clip starts it, and the distance it
+	/// would have covered is GetRootMotion() instead. Height is left in the pose. Plain clips only; blend trees leave
+	/// the root alone.
+	void SetRootMotion(bool extract);
+
+	/// How far the root moved during the last update, in model space. Zero after a seek, or without root motion.
+	inline const glm::vec3& GetRootMotion() const { return _rootMotion; }
+	inline bool IsExtractingRootMotion() const { return _extractRootMotion; }
+
+	/// The Animation or CompressedAnimation playing, nullptr for blend trees.
+	inline const void* GetClip() const { return _currentClip ? static_cast<const void*>(_currentClip) : static_cast<const void*>(_currentAnimation); }
+	inline uint32_t GetMaxBoneDepth() const { return _maxBoneDepth; }
+
+	inline const Skeleton* GetSkeleton() const { return _skeleton; }
+	inline float GetAnimationTime() const { return _animationTime; }
+	inline const Pose& GetLocalPose() const { return _localPose; }
+	inline const std::vector<glm::mat4>& GetModelMatrices() const { return _modelMatrices; }
+	inline const std::vector<glm::mat4>& GetSkinningMatrices() const { return _skinningMatrices; }
+};
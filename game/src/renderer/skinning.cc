@@ -0,0 +1,180 @@
+#include "skinning.hh"
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+void SkinningSource::Build(const PerVertexData* vertices, uint32_t numVertices)
+{
+	positions.resize(numVertices);
+	normals.resize(numVertices);
+	boneIds.resize(static_cast<size_t>(numVertices) * 4);
+	boneWeights.resize(static_cast<size_t>(numVertices) * 4);
+
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		positions[i] = vertices[i].position;
+		normals[i] = vertices[i].normal;
+
+		const glm::vec4& weights = vertices[i].bone_weights;
+		const float total = weights.x + weights.y + weights.z + weights.w;
+
+		for (int j = 0; j < 4; j++)
+		{
+			const int id = vertices[i].bone_ids[j];
+			boneIds[i * 4 + j] = static_cast<uint8_t>((id < 0 || id > 255) ? 0 : id);
+			boneWeights[i * 4 + j] = total > 0.0f ? weights[j] / total : (j == 0 ? 1.0f : 0.0f);
+		}
+	}
+}
+
+void SkinVerticesScalar(const SkinningSource& source, const glm::mat4* palette, size_t begin, size_t end, SkinnedPositionNormal* out)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		const uint8_t* ids = &source.boneIds[i * 4];
+		const float* weights = &source.boneWeights[i * 4];
+
+		const glm::mat4 blended = palette[ids[0]] * weights[0] + palette[ids[1]] * weights[1]
+			+ palette[ids[2]] * weights[2] + palette[ids[3]] * weights[3];
+
+		const glm::vec3 position = glm::vec3(blended * glm::vec4(source.positions[i], 1.0f));
+		glm::vec3 normal = glm::vec3(blended * glm::vec4(source.normals[i], 0.0f));
+
+		const float length = sqrtf(glm::dot(normal, normal));
+		if (length > 0.0f)
+		{
+			normal /= length;
+		}
+
+		out[i].position = position;
+		out[i].normal = qt::PackSnorm1010102(normal.x, normal.y, normal.z);
+	}
+}
+
+#ifdef QT_SIMD_SSE
+void SkinVerticesSSE(const SkinningSource& source, const glm::mat4* palette, size_t begin, size_t end, SkinnedPositionNormal* out)
+{
+	static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "The kernel loads palette columns as four floats");
+
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 minusOne = _mm_set1_ps(-1.0f);
+	const __m128 snormScale = _mm_set1_ps(511.0f);
+	const __m128i tenBits = _mm_set1_epi32(0x3ff);
+	const __m128 tiny = _mm_set1_ps(FLT_MIN);
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const uint8_t* ids = &source.boneIds[i * 4];
+		const float* weights = &source.boneWeights[i * 4];
+
+		// Weighted sum of the four matrices, one column per register
+		const float* m = &palette[ids[0]][0][0];
+		__m128 w = _mm_set1_ps(weights[0]);
+		__m128 c0 = _mm_mul_ps(_mm_loadu_ps(m), w);
+		__m128 c1 = _mm_mul_ps(_mm_loadu_ps(m + 4), w);
+		__m128 c2 = _mm_mul_ps(_mm_loadu_ps(m + 8), w);
+		__m128 c3 = _mm_mul_ps(_mm_loadu_ps(m + 12), w);
+
+		for (int j = 1; j < 4; j++)
+		{
+			m = &palette[ids[j]][0][0];
+			w = _mm_set1_ps(weights[j]);
+			c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(m), w));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(m + 4), w));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(m + 8), w));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_loadu_ps(m + 12), w));
+		}
+
+		const glm::vec3& p = source.positions[i];
+		const glm::vec3& n = source.normals[i];
+
+		__m128 position = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y)));
+		position = _mm_add_ps(_mm_add_ps(position, _mm_mul_ps(c2, _mm_set1_ps(p.z))), c3);
+
+		__m128 normal = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n.x)), _mm_mul_ps(c1, _mm_set1_ps(n.y)));
+		normal = _mm_add_ps(normal, _mm_mul_ps(c2, _mm_set1_ps(n.z)));
+
+		// The fourth lane is 0 for affine matrices, so it doesn't disturb the length
+		const __m128 squared = _mm_mul_ps(normal, normal);
+		__m128 lengthSquared = _mm_add_ps(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 3, 0, 1)));
+		lengthSquared = _mm_add_ps(lengthSquared, _mm_shuffle_ps(lengthSquared, lengthSquared, _MM_SHUFFLE(1, 0, 3, 2)));
+
+		// A zero normal stays zero instead of turning into NaNs
+		normal = _mm_div_ps(normal, _mm_max_ps(_mm_sqrt_ps(lengthSquared), tiny));
+
+		// Pack to 10:10:10:2 and slip it into the position's unused fourth lane
+		const __m128 clamped = _mm_min_ps(_mm_max_ps(normal, minusOne), one);
+		const __m128i quantized = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(clamped, snormScale)), tenBits);
+
+		const uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(quantized))
+			| (static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_shuffle_epi32(quantized, _MM_SHUFFLE(1, 1, 1, 1)))) << 10)
+			| (static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_shuffle_epi32(quantized, _MM_SHUFFLE(2, 2, 2, 2)))) << 20);
+
+		const __m128 packedLane = _mm_castsi128_ps(_mm_cvtsi32_si128(static_cast<int>(packed)));
+		const __m128 zPacked = _mm_shuffle_ps(position, packedLane, _MM_SHUFFLE(0, 0, 2, 2)); // z, z, packed, packed
+		_mm_storeu_ps(reinterpret_cast<float*>(&out[i]), _mm_shuffle_ps(position, zPacked, _MM_SHUFFLE(2, 0, 1, 0)));
+	}
+}
+#endif
+
+CpuSkinner::CpuSkinner()
+	: _numVertices(0)
+{
+}
+
+CpuSkinner::~CpuSkinner()
+{
+}
+
+void CpuSkinner::Clear()
+{
+	_jobs.clear();
+	_batches.clear();
+	_numVertices = 0;
+}
+
+void CpuSkinner::Add(const SkinningSource& source, const glm::mat4* palette, SkinnedPositionNormal* out)
+{
+	const uint32_t job = static_cast<uint32_t>(_jobs.size());
+	const uint32_t numVertices = source.GetNumVertices();
+
+	_jobs.push_back({ &source, palette, out });
+
+	for (uint32_t begin = 0; begin < numVertices; begin += _BATCH_SIZE)
+	{
+		_batches.push_back({ job, begin, std::min(begin + _BATCH_SIZE, numVertices) });
+	}
+
+	_numVertices += numVertices;
+}
+
+void CpuSkinner::Run(ThreadPool* pool, bool useSimd)
+{
+	auto skinBatches = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const _Batch& batch = _batches[i];
+			const _Job& job = _jobs[batch.job];
+
+#ifdef QT_SIMD_SSE
+			if (useSimd)
+			{
+				SkinVerticesSSE(*job.source, job.palette, batch.begin, batch.end, job.out);
+				continue;
+			}
+#endif
+			SkinVerticesScalar(*job.source, job.palette, batch.begin, batch.end, job.out);
+		}
+	};
+
+	if (pool)
+	{
+		pool->ParallelFor(_batches.size(), 1, skinBatches);
+	}
+	else
+	{
+		skinBatches(0, _batches.size());
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+
+#include <glm.hpp>
+
+#include "common.hh"
+#include "math/math_simd.hh"
+#include "util/thread_pool.hh"
+#include "renderer/vertex.hh"
+
+/// Shader storage binding of the bone palette read by the SKINNED variant of core.vert.
+#define SKINNING_PALETTE_BINDING 5
+
+/// What the CPU skinning kernel writes for one vertex. Streamed into a vertex buffer and read as attributes 0 and 3,
+/// while the texcoords and colors still come from the mesh's own vertex buffer.
+struct SkinnedPositionNormal
+{
+	glm::vec3 position;
+	uint32_t normal; // snorm 10:10:10:2 (GL_INT_2_10_10_10_REV), like StaticVertex
+};
+
+static_assert(sizeof(SkinnedPositionNormal) == 16, "SkinnedPositionNormal must be one SSE store");
+
+/// A skinned mesh's bind pose as the CPU kernel reads it, one stream per attribute. Every vertex has four
+/// influences whose weights add up to 1; unused influences have weight 0.
+struct SkinningSource
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<uint8_t> boneIds; // Four per vertex
+	std::vector<float> boneWeights; // Four per vertex
+
+	/// Weights are renormalized the same way PackVertices() does, so both backends skin alike.
+	void Build(const PerVertexData* vertices, uint32_t numVertices);
+
+	inline uint32_t GetNumVertices() const { return static_cast<uint32_t>(positions.size()); }
+};
+
+/// out[i] = vertex i of source skinned by palette (one matrix per bone, as in Animator::GetSkinningMatrices()),
+/// for i in [begin, end). Normals are renormalized before packing.
+void SkinVerticesScalar(const SkinningSource& source, const glm::mat4* palette, size_t begin, size_t end, SkinnedPositionNormal* out);
+#ifdef QT_SIMD_SSE
+/// Blends the four matrices column by column in registers and writes every vertex with a single 16 byte store.
+void SkinVerticesSSE(const SkinningSource& source, const glm::mat4* palette, size_t begin, size_t end, SkinnedPositionNormal* out);
+#endif
+
+/// Skins many characters at once on the CPU, for when the vertex shader can't (or shouldn't) do it.
+///
+/// Characters are queued with Add(), then Run() splits all of their vertices into equal batches and hands them to the
+/// thread pool in one ParallelFor, so a crowd of small meshes spreads over the cores as well as one big mesh does.
+/// Output usually points into the frame's RingBuffer, so the GPU reads the results without another copy.
+class CpuSkinner
+{
+private:
+	static constexpr uint32_t _BATCH_SIZE = 1024; // Vertices per job, around 10us of work
+
+	struct _Job
+	{
+		const SkinningSource* source;
+		const glm::mat4* palette;
+		SkinnedPositionNormal* out;
+	};
+
+	struct _Batch
+	{
+		uint32_t job;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	std::vector<_Job> _jobs;
+	std::vector<_Batch> _batches;
+	uint32_t _numVertices;
+public:
+	CpuSkinner();
+	~CpuSkinner();
+
+	/// Forgets every queued character. Keeps the memory, so a steady crowd never reallocates.
+	void Clear();
+
+	/// Queues a character. out must have room for source.GetNumVertices() vertices; source, palette and out must stay
+	/// valid until Run() returns.
+	void Add(const SkinningSource& source, const glm::mat4* palette, SkinnedPositionNormal* out);
+
+	/// Skins everything queued since the last Clear(). pool = nullptr runs on the calling thread, useSimd = false
+	/// forces the scalar kernel.
+	void Run(ThreadPool* pool = nullptr, bool useSimd = true);
+
+	inline size_t GetNumCharacters() const { return _jobs.size(); }
+	inline uint32_t GetNumVertices() const { return _numVertices; }
+};
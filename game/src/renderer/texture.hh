@@ -8,6 +8,10 @@
 
 #include <SOIL2.h>
 
+#include "common.hh"
+#include "util/mapped_file.hh"
+#include "util/texture_bake.hh"
+
 class Texture
 {
 private:
@@ -15,24 +19,80 @@ private:
 	int _width;
 	int _height;
 	unsigned int _type;
-public:
+	bool _loaded; // False while _id is still the shared placeholder
 
+	void _SetParameters()
+	{
+		// Below: repeat texture in the ST-plane when surface is larger than texture
+		glTexParameteri(_type, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(_type, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		// Below: how to handle mipmaps (dynamic antialiasing depending on how close the camera is)
+		//		GL_NEAREST | GL_NEAREST_MIPMAP_LINEAR just takes the nearest texel, will look more pixel-y
+		//		GL_LINEAR | GL_LINEAR_MIPMAP_LINEAR takes an average of surrounding texels
+		//		GL_**_MIPMAP_** applies the effect to all mipmaps of the texture.
+		glTexParameteri(_type, GL_TEXTURE_MAG_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+		glTexParameteri(_type, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		// Below: make the texture N I C E and C R I S P Y
+		glTexParameteri(_type, GL_TEXTURE_MIN_LOD, static_cast<GLint>(1.0f));
+	}
+
+	/// 2x2 grey/magenta checker shown in place of textures that are still loading. Created once, never deleted.
+	static GLuint _GetPlaceholder()
+	{
+		static GLuint placeholder = 0;
+
+		if (placeholder == 0)
+		{
+			const uint8_t pixels[] = {
+				128, 128, 128, 255,		255, 0, 255, 255,
+				255, 0, 255, 255,		128, 128, 128, 255
+			};
+
+			glGenTextures(1, &placeholder);
+			glBindTexture(GL_TEXTURE_2D, placeholder);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		return placeholder;
+	}
+public:
+	/// Loads the image right away, on the calling thread.
 	Texture(const char* filename, GLenum type)
 	{
+		_id = 0;
+		_loaded = false;
 		_type = type;
 		SetTexture(filename);
 	}
 
+	/// Starts out as the placeholder texture. Hand it to a TextureLoader to fill in the real image later.
+	Texture(GLenum type)
+	{
+		_id = _GetPlaceholder();
+		_width = 2;
+		_height = 2;
+		_type = type;
+		_loaded = false;
+	}
+
 	~Texture()
 	{
-		glDeleteTextures(1, &_id);
+		if (_loaded)
+		{
+			glDeleteTextures(1, &_id);
+		}
 	}
 
 	/// Trivial -- set replace=true if dynamic texture replacement needed.
 	/// This does NOT replace individual textures associated with meshes, but the entire texture data in memory
 	void SetTexture(const char* filename, bool replace = false)
 	{ 
-		if (replace && _id)
+		if (replace && _loaded)
 		{
 			glDeleteTextures(1, &_id);
 		}
@@ -40,17 +100,7 @@ public:
 		glGenTextures(1, &_id);
 		glBindTexture(_type, _id);
 
-		// Below: repeat texture in the ST-plane when surface is larger than texture
-		glTexParameteri(_type, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(_type, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// Below: how to handle mipmaps (dynamic antialiasing depending on how close the camera is)
-		//		GL_NEAREST | GL_NEAREST_MIPMAP_LINEAR just takes the nearest texel, will look more pixel-y
-		//		GL_LINEAR | GL_LINEAR_MIPMAP_LINEAR takes an average of surrounding texels
-		//		GL_**_MIPMAP_** applies the effect to all mipmaps of the texture.
-		glTexParameteri(_type, GL_TEXTURE_MAG_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-		glTexParameteri(_type, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		// Below: make the texture N I C E and C R I S P Y
-		glTexParameteri(_type, GL_TEXTURE_MIN_LOD, static_cast<GLint>(1.0f));
+		_SetParameters();
 
 		// Load image
 		unsigned char* image = SOIL_load_image(filename, &_width, &_height, NULL, SOIL_LOAD_RGBA);
@@ -67,11 +117,83 @@ public:
 			DEBUG_LOG("Texture", LOG_ERROR, "SetTexture failed for [%s]", filename);
 		}
 
+		_loaded = true;
+
 		glActiveTexture(0);
 		glBindTexture(_type, 0);
 		SOIL_free_image_data(image);
 	}
 
+	/// Loads a file written by BakeTextureFile: one mapping, then one upload per stored mip level, no decoding.
+	/// Returns false, leaving the texture as it was, if the file is missing or invalid.
+	bool SetBakedTexture(const char* filename)
+	{
+		MappedFile file;
+		BakedTextureView view;
+
+		if (!file.Open(filename))
+		{
+			return false;
+		}
+		if (!ParseBakedTexture(file.GetData(), file.GetSize(), view))
+		{
+			DEBUG_LOG("Texture", LOG_ERROR, "[%s] is not a valid baked texture", filename);
+			return false;
+		}
+
+		static const GLenum internalFormats[NUM_BAKED_TEXTURE_FORMATS] = {
+			GL_RGBA8,
+			GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+			GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+			GL_COMPRESSED_RG_RGTC2
+		};
+		const BakedTextureHeader& header = *view.header;
+		const GLenum internalFormat = internalFormats[header.format];
+
+		GLuint id;
+		glCreateTextures(_type, 1, &id);
+		glTextureStorage2D(id, header.numLevels, internalFormat, header.width, header.height);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		for (uint32_t level = 0; level < header.numLevels; level++)
+		{
+			const GLsizei width = view.GetLevelWidth(level);
+			const GLsizei height = view.GetLevelHeight(level);
+
+			if (header.format == BAKED_TEXTURE_RGBA8)
+			{
+				glTextureSubImage2D(id, level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, view.GetLevelData(level));
+			}
+			else
+			{
+				glCompressedTextureSubImage2D(id, level, 0, 0, width, height, internalFormat, view.GetLevelSize(level), view.GetLevelData(level));
+			}
+		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		AdoptTexture(id, header.width, header.height);
+		return true;
+	}
+
+	/// Takes ownership of a fully uploaded GL texture (see TextureLoader), replacing the placeholder or the previous image.
+	void AdoptTexture(GLuint id, int width, int height)
+	{
+		if (_loaded)
+		{
+			glDeleteTextures(1, &_id);
+		}
+
+		_id = id;
+		_width = width;
+		_height = height;
+		_loaded = true;
+
+		glBindTexture(_type, _id);
+		_SetParameters();
+		glBindTexture(_type, 0);
+	}
+
 	/// Dynamically bind the texture to some spot(s) called the textureUnit.
 	void Bind(const GLint textureUnit)
 	{
@@ -87,5 +209,7 @@ public:
 	}
 
 	inline GLuint GetID() const { return _id; }
+	inline GLenum GetType() const { return _type; }
+	inline bool IsLoaded() const { return _loaded; }
 
 };
\ No newline at end of file
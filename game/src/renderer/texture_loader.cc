@@ -0,0 +1,164 @@
+#include "texture_loader.hh"
+
+#include <chrono>
+#include <thread>
+
+#include <SOIL2.h>
+
+TextureLoader::TextureLoader(ThreadPool& threadPool, double uploadBudgetMs)
+	: _threadPool(threadPool), _completed(256), _numInFlight(0),
+	_pixelUnpackBuffer(0), _pixelUnpackBufferSize(0), _uploadBudgetMs(uploadBudgetMs)
+{
+	glCreateBuffers(1, &_pixelUnpackBuffer);
+}
+
+TextureLoader::~TextureLoader()
+{
+	// Results still arriving would be pushed into _completed after it's gone, so drain everything first
+	while (_numInFlight.load() > 0)
+	{
+		DecodedImage* image;
+		if (_completed.TryPop(image))
+		{
+			delete image;
+			_numInFlight--;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	glDeleteBuffers(1, &_pixelUnpackBuffer);
+}
+
+void TextureLoader::Load(Texture* target, const std::string& path)
+{
+	// A baked version next to the image needs no decoding at all, so it's cheaper to load it right here
+	if (target->SetBakedTexture(GetBakedTexturePath(path).c_str()))
+	{
+		return;
+	}
+
+	DecodedImage* image = new DecodedImage();
+	image->target = target;
+	image->path = path;
+	image->width = 0;
+	image->height = 0;
+	image->failed = false;
+
+	_numInFlight++;
+
+	_threadPool.Submit([this, image]()
+	{
+		_Decode(image);
+
+		while (!_completed.TryPush(image))
+		{
+			std::this_thread::yield(); // The GL thread is behind, wait for room
+		}
+	});
+}
+
+void TextureLoader::_Decode(DecodedImage* image)
+{
+	int channels;
+	unsigned char* data = SOIL_load_image(image->path.c_str(), &image->width, &image->height, &channels, SOIL_LOAD_RGBA);
+
+	if (data == nullptr)
+	{
+		image->failed = true;
+		return;
+	}
+
+	BuildMipChainRGBA8(data, image->width, image->height, image->pixels, image->mipOffsets);
+	SOIL_free_image_data(data);
+}
+
+void TextureLoader::_Upload(DecodedImage* image)
+{
+	if (image->failed)
+	{
+		DEBUG_LOG("TextureLoader", LOG_ERROR, "Failed to load [%s], keeping the placeholder", image->path.c_str());
+		return;
+	}
+
+	const GLsizeiptr size = static_cast<GLsizeiptr>(image->pixels.size());
+
+	// Orphan the previous storage (the driver may still be reading it) and grow if needed
+	if (size > _pixelUnpackBufferSize)
+	{
+		_pixelUnpackBufferSize = size;
+	}
+	glNamedBufferData(_pixelUnpackBuffer, _pixelUnpackBufferSize, NULL, GL_STREAM_DRAW);
+
+	void* mapped = glMapNamedBufferRange(_pixelUnpackBuffer, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped == nullptr)
+	{
+		DEBUG_LOG("TextureLoader", LOG_ERROR, "Failed to map the pixel unpack buffer for [%s]", image->path.c_str());
+		return;
+	}
+	memcpy(mapped, image->pixels.data(), size);
+	glUnmapNamedBuffer(_pixelUnpackBuffer);
+
+	const GLsizei numLevels = static_cast<GLsizei>(image->mipOffsets.size());
+
+	GLuint id;
+	glCreateTextures(image->target->GetType(), 1, &id);
+	glTextureStorage2D(id, numLevels, GL_RGBA8, image->width, image->height);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pixelUnpackBuffer);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	int width = image->width;
+	int height = image->height;
+	for (GLsizei level = 0; level < numLevels; level++)
+	{
+		// With an unpack buffer bound, the pointer argument is an offset into it
+		glTextureSubImage2D(id, level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)image->mipOffsets[level]);
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	image->target->AdoptTexture(id, image->width, image->height);
+}
+
+void TextureLoader::Update()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	DecodedImage* image;
+	while (_completed.TryPop(image))
+	{
+		_Upload(image);
+		delete image;
+		_numInFlight--;
+
+		const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (elapsedMs >= _uploadBudgetMs)
+		{
+			break;
+		}
+	}
+}
+
+void TextureLoader::Flush()
+{
+	while (_numInFlight.load() > 0)
+	{
+		DecodedImage* image;
+		if (_completed.TryPop(image))
+		{
+			_Upload(image);
+			delete image;
+			_numInFlight--;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include <glew.h>
+
+#include "common.hh"
+#include "renderer/texture.hh"
+#include "util/thread_pool.hh"
+#include "util/mpmc_queue.hh"
+#include "util/texture_bake.hh"
+
+/// An image decoded on a worker thread, with its whole mip chain, waiting to be uploaded on the GL thread.
+struct DecodedImage
+{
+	Texture* target;
+	std::string path;
+	int width;
+	int height;
+	std::vector<uint8_t> pixels; // RGBA8, every mip level back to back
+	std::vector<size_t> mipOffsets; // Byte offset of each level in pixels
+	bool failed;
+};
+
+/// Loads textures without blocking the render thread.
+/// If a baked texture (see util/texture_bake.hh) sits next to the image, it is mapped and uploaded immediately instead.
+/// Otherwise Load() gives the image to the thread pool, which decodes it with SOIL and box-filters the mip chain on the CPU.
+/// Finished images come back through a lock-free queue, and Update() uploads as many as fit in its time budget
+/// through a pixel unpack buffer. Until then the Texture keeps showing its placeholder.
+class TextureLoader
+{
+private:
+	ThreadPool& _threadPool;
+	MPMCQueue<DecodedImage*> _completed;
+	std::atomic<uint32_t> _numInFlight; // Submitted and not yet uploaded
+
+	GLuint _pixelUnpackBuffer;
+	GLsizeiptr _pixelUnpackBufferSize;
+
+	double _uploadBudgetMs;
+
+	static void _Decode(DecodedImage* image);
+
+	void _Upload(DecodedImage* image);
+public:
+	TextureLoader(ThreadPool& threadPool, double uploadBudgetMs = 2.0);
+
+	/// Waits for in-flight decodes so no worker writes into a dead queue.
+	~TextureLoader();
+
+	/// Queues an image for loading into target. target must stay alive until it IsLoaded(), or until the loader is destroyed.
+	void Load(Texture* target, const std::string& path);
+
+	/// Uploads finished images until the frame's time budget is spent. Call once per frame on the GL thread.
+	/// At least one image is uploaded per call so a large texture can't starve forever.
+	void Update();
+
+	/// Uploads everything, blocking until every queued texture is in.
+	void Flush();
+
+	inline uint32_t GetNumPending() const { return _numInFlight.load(); }
+};
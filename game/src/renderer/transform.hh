@@ -9,6 +9,26 @@ private:
 	glm::vec3 _origin;
 	glm::vec3 _rotation;
 	glm::vec3 _scale;
+
+	// The model matrix is cached and only rebuilt after one of the values above has changed,
+	// so static transforms cost nothing per frame
+	mutable glm::mat4 _modelMatrix;
+	mutable bool _dirty;
+
+	/// When rotating any mesh in world space, it must be moved to the origin point, rotated, then MOVED BACK.
+	/// This is to assure the object rotates around its own relative origin, instead of always rotating around WORLD origin.
+	void _UpdateModelMatrix() const
+	{
+		_modelMatrix = glm::mat4(1.0f);
+		_modelMatrix = glm::translate(_modelMatrix, _origin);
+		_modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+		_modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+		_modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+		_modelMatrix = glm::translate(_modelMatrix, _position - _origin);
+		_modelMatrix = glm::scale(_modelMatrix, _scale);
+
+		_dirty = false;
+	}
 public:
 	Transform(
 		const glm::vec3& position = glm::vec3(), 
@@ -21,22 +41,25 @@ public:
 		_origin = origin;
 		_rotation = rotation;
 		_scale = scale;
+		_modelMatrix = glm::mat4(1.0f);
+		_dirty = true;
 	}
 
 	// my versions
-	inline glm::mat4 GetModelMatrix() const
+	/// Returns the cached model matrix, rebuilding it first only if the transform has been modified.
+	inline const glm::mat4& GetModelMatrix() const
 	{
-		glm::mat4 m = glm::mat4(1.0f);
-		m = glm::translate(m, _origin);
-		m = glm::rotate(m, glm::radians(_rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-		m = glm::rotate(m, glm::radians(_rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-		m = glm::rotate(m, glm::radians(_rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-		m = glm::translate(m, _position - _origin);
-		m = glm::scale(m, _scale);
+		if (_dirty)
+		{
+			_UpdateModelMatrix();
+		}
 		
-		return m;
+		return _modelMatrix;
 	}
 
+	/// True if the transform was modified since the model matrix was last rebuilt.
+	inline bool IsDirty() const { return _dirty; }
+
 	inline void GetViewMatrix(glm::mat4* memory, Camera* camera) const
 	{
 		std::cout << "Memory addr of mat4:viewMatrix inside func: " << &memory << "\n";
@@ -73,11 +96,17 @@ public:
 		return VP * M;
 	}
 
-	inline const glm::vec3 GetPosition() { return _position; }
-	inline const glm::vec3 GetRotation() { return _rotation; }
-	inline const glm::vec3 GetScale() { return _scale; }
+	inline const glm::vec3 GetPosition() const { return _position; }
+	inline const glm::vec3 GetOrigin() const { return _origin; }
+	inline const glm::vec3 GetRotation() const { return _rotation; }
+	inline const glm::vec3 GetScale() const { return _scale; }
+
+	inline void SetPosition(const glm::vec3& pos) { _position = pos; _dirty = true; }
+	inline void SetOrigin(const glm::vec3& origin) { _origin = origin; _dirty = true; }
+	inline void SetRotation(const glm::vec3& rot) { _rotation = rot; _dirty = true; }
+	inline void SetScale(const glm::vec3& scale) { _scale = scale; _dirty = true; }
 
-	inline void SetPosition(const glm::vec3& pos) { _position = pos; }
-	inline void SetRotation(const glm::vec3& rot) { _rotation = rot; }
-	inline void SetScale(const glm::vec3& scale) { _scale = scale; }
+	inline void Translate(const glm::vec3& val) { _position += val; _dirty = true; }
+	inline void Rotate(const glm::vec3& val) { _rotation += val; _dirty = true; }
+	inline void Scale(const glm::vec3& val) { _scale += val; _dirty = true; }
 };
\ No newline at end of file
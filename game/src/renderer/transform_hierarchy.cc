@@ -0,0 +1,79 @@
+#include "transform_hierarchy.hh"
+
+TransformHierarchy::TransformHierarchy()
+	: _numDirty(0), _firstDirty(NULL_TRANSFORM_HANDLE)
+{
+}
+
+TransformHierarchy::~TransformHierarchy()
+{
+}
+
+TransformHandle TransformHierarchy::Add(const Transform& local, TransformHandle parent)
+{
+	TransformHandle handle = static_cast<TransformHandle>(_locals.size());
+
+	if (parent != NULL_TRANSFORM_HANDLE && parent >= handle)
+	{
+		DEBUG_LOG("TransformHierarchy", LOG_ERROR, "Parent handle %u does not exist yet, adding node %u as a root", parent, handle);
+		parent = NULL_TRANSFORM_HANDLE;
+	}
+
+	_locals.push_back(local);
+	_parents.push_back(parent);
+	_worldMatrices.push_back(glm::mat4(1.0f));
+	_dirty.push_back(0);
+
+	_MarkDirty(handle);
+
+	return handle;
+}
+
+void TransformHierarchy::Clear()
+{
+	_locals.clear();
+	_parents.clear();
+	_worldMatrices.clear();
+	_dirty.clear();
+
+	_numDirty = 0;
+	_firstDirty = NULL_TRANSFORM_HANDLE;
+}
+
+void TransformHierarchy::Update()
+{
+	if (_numDirty == 0)
+	{
+		return;
+	}
+
+	const size_t count = _locals.size();
+
+	// Parents always come before their children, so by the time a node is visited its parent's world matrix
+	// is final for this pass, and _dirty[parent] tells whether it changed.
+	for (size_t i = _firstDirty; i < count; i++)
+	{
+		const TransformHandle parent = _parents[i];
+		const bool parentChanged = (parent != NULL_TRANSFORM_HANDLE) && _dirty[parent];
+
+		if (!_dirty[i] && !parentChanged)
+		{
+			continue;
+		}
+
+		if (parent == NULL_TRANSFORM_HANDLE)
+		{
+			_worldMatrices[i] = _locals[i].GetModelMatrix();
+		}
+		else
+		{
+			_worldMatrices[i] = _worldMatrices[parent] * _locals[i].GetModelMatrix();
+		}
+
+		_dirty[i] = 1;
+	}
+
+	std::fill(_dirty.begin() + _firstDirty, _dirty.end(), 0);
+	_numDirty = 0;
+	_firstDirty = NULL_TRANSFORM_HANDLE;
+}
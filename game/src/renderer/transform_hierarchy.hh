@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <glm.hpp>
+
+#include "common.hh"
+#include "renderer/transform.hh"
+
+typedef uint32_t TransformHandle;
+#define NULL_TRANSFORM_HANDLE 0xffffffff
+
+/// Flat parent/child hierarchy of transforms with cached world matrices.
+/// Nodes are stored in parent-before-child order (a parent must exist before a child can be added to it),
+/// so a single linear pass over the arrays is enough to bring every world matrix up to date.
+/// Only nodes that were edited, or whose parent was recomputed in the same pass, cost any matrix work.
+class TransformHierarchy
+{
+private:
+	std::vector<Transform> _locals;
+	std::vector<TransformHandle> _parents;
+	std::vector<glm::mat4> _worldMatrices;
+	std::vector<uint8_t> _dirty; // Local transform changed, or world matrix recomputed during the current Update()
+
+	uint32_t _numDirty;
+	TransformHandle _firstDirty; // Nothing before this index needs to be looked at during Update()
+
+	inline void _MarkDirty(TransformHandle handle)
+	{
+		if (!_dirty[handle])
+		{
+			_dirty[handle] = 1;
+			_numDirty++;
+		}
+
+		if (handle < _firstDirty)
+		{
+			_firstDirty = handle;
+		}
+	}
+public:
+	TransformHierarchy();
+	~TransformHierarchy();
+
+	/// Adds a node and returns its handle. The parent, if any, must already be part of the hierarchy.
+	TransformHandle Add(const Transform& local, TransformHandle parent = NULL_TRANSFORM_HANDLE);
+
+	/// Removes every node.
+	void Clear();
+
+	/// Recomputes world matrices for dirty nodes and their descendants. Does nothing if no node was edited.
+	void Update();
+
+	/// Returns the local transform for modification and flags it for recomputation on the next Update().
+	inline Transform& Edit(TransformHandle handle)
+	{
+		_MarkDirty(handle);
+		return _locals[handle];
+	}
+
+	inline const Transform& Get(TransformHandle handle) const { return _locals[handle]; }
+	inline TransformHandle GetParent(TransformHandle handle) const { return _parents[handle]; }
+
+	/// World matrix as of the last Update().
+	inline const glm::mat4& GetWorldMatrix(TransformHandle handle) const { return _worldMatrices[handle]; }
+
+	inline bool IsDirty() const { return _numDirty > 0; }
+	inline size_t size() const { return _locals.size(); }
+};
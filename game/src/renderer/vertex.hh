@@ -1,7 +1,14 @@
 #pragma once
 
+#include <vector>
+
+#include <glew.h>
+
 #include <glm.hpp>
 
+#include "common.hh"
+#include "math/math_pack.hh"
+
 struct Vertex
 {
 	glm::vec3 position;
@@ -10,6 +17,8 @@ struct Vertex
 	glm::vec3 normal;
 };
 
+/// Full precision vertex, as produced by the importers. Only lives on the CPU;
+/// what gets uploaded is one of the packed layouts below.
 struct PerVertexData
 {
 	glm::vec3 position;
@@ -18,4 +27,127 @@ struct PerVertexData
 	glm::vec3 normal;
 	glm::ivec4 bone_ids;
 	glm::vec4 bone_weights;
-};
\ No newline at end of file
+};
+
+enum VertexLayout { VERTEX_LAYOUT_STATIC = 0, VERTEX_LAYOUT_SKINNED };
+
+/// GPU vertex for meshes without bones.
+struct StaticVertex
+{
+	glm::vec3 position;
+	uint32_t normal;		// snorm 10:10:10:2 (GL_INT_2_10_10_10_REV)
+	uint16_t texcoord[2];	// half float
+	uint8_t color[4];		// unorm8
+};
+
+/// GPU vertex for skinned meshes. Same as StaticVertex up to the bone data.
+struct SkinnedVertex
+{
+	glm::vec3 position;
+	uint32_t normal;
+	uint16_t texcoord[2];
+	uint8_t color[4];
+	uint8_t boneIds[4];		// uint8, read with glVertexAttribIFormat
+	uint8_t boneWeights[4];	// unorm8, always sums to 255
+};
+
+static_assert(sizeof(StaticVertex) == 24, "StaticVertex must stay tightly packed");
+static_assert(sizeof(SkinnedVertex) == 32, "SkinnedVertex must stay tightly packed");
+
+static inline GLsizei GetVertexStride(VertexLayout layout)
+{
+	return (layout == VERTEX_LAYOUT_SKINNED) ? sizeof(SkinnedVertex) : sizeof(StaticVertex);
+}
+
+template <typename T>
+static inline void PackCommonVertexAttributes(const PerVertexData& in, T& out)
+{
+	out.position = in.position;
+	out.normal = qt::PackSnorm1010102(in.normal.x, in.normal.y, in.normal.z);
+	out.texcoord[0] = qt::FloatToHalf(in.texcoord.x);
+	out.texcoord[1] = qt::FloatToHalf(in.texcoord.y);
+	out.color[0] = qt::PackUnorm8(in.color.x);
+	out.color[1] = qt::PackUnorm8(in.color.y);
+	out.color[2] = qt::PackUnorm8(in.color.z);
+	out.color[3] = 255;
+}
+
+/// Weights are renormalized, and the rounding error is given to the largest weight so the four bytes always add up to 255.
+static inline void PackBoneWeights(const glm::vec4& weights, uint8_t out[4])
+{
+	float total = weights.x + weights.y + weights.z + weights.w;
+	if (total <= 0.0f)
+	{
+		out[0] = 255; out[1] = 0; out[2] = 0; out[3] = 0;
+		return;
+	}
+
+	int sum = 0;
+	int largest = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		out[i] = qt::PackUnorm8(weights[i] / total);
+		sum += out[i];
+		if (out[i] > out[largest])
+		{
+			largest = i;
+		}
+	}
+
+	out[largest] = static_cast<uint8_t>(out[largest] + (255 - sum));
+}
+
+/// Quantizes vertices into the given layout. out is resized to numVertices * GetVertexStride(layout) bytes.
+static inline void PackVertices(VertexLayout layout, const PerVertexData* vertices, uint32_t numVertices, std::vector<uint8_t>& out)
+{
+	out.resize(static_cast<size_t>(numVertices) * GetVertexStride(layout));
+
+	if (layout == VERTEX_LAYOUT_SKINNED)
+	{
+		SkinnedVertex* packed = reinterpret_cast<SkinnedVertex*>(out.data());
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			PackCommonVertexAttributes(vertices[i], packed[i]);
+			for (int j = 0; j < 4; j++)
+			{
+				const int id = vertices[i].bone_ids[j];
+				packed[i].boneIds[j] = static_cast<uint8_t>((id < 0 || id > 255) ? 0 : id);
+			}
+			PackBoneWeights(vertices[i].bone_weights, packed[i].boneWeights);
+		}
+	}
+	else
+	{
+		StaticVertex* packed = reinterpret_cast<StaticVertex*>(out.data());
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			PackCommonVertexAttributes(vertices[i], packed[i]);
+		}
+	}
+}
+
+/// Describes a packed layout to a vertex array object, reading from the given buffer binding index.
+/// Locations match core.vert: 0 position, 1 color, 2 texcoord, 3 normal, 4 bone IDs, 5 bone weights.
+static inline void SetVertexArrayFormat(GLuint vertexArrayObject, GLuint bindingIndex, VertexLayout layout)
+{
+	// StaticVertex and SkinnedVertex share offsets for everything but the bone data
+	glVertexArrayAttribFormat(vertexArrayObject, 0, 3, GL_FLOAT, GL_FALSE, offsetof(StaticVertex, position));
+	glVertexArrayAttribFormat(vertexArrayObject, 1, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(StaticVertex, color));
+	glVertexArrayAttribFormat(vertexArrayObject, 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(StaticVertex, texcoord));
+	glVertexArrayAttribFormat(vertexArrayObject, 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(StaticVertex, normal));
+
+	GLuint numAttributes = 4;
+
+	if (layout == VERTEX_LAYOUT_SKINNED)
+	{
+		glVertexArrayAttribIFormat(vertexArrayObject, 4, 4, GL_UNSIGNED_BYTE, offsetof(SkinnedVertex, boneIds));
+		glVertexArrayAttribFormat(vertexArrayObject, 5, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(SkinnedVertex, boneWeights));
+		numAttributes = 6;
+	}
+
+	for (GLuint i = 0; i < numAttributes; i++)
+	{
+		glVertexArrayAttribBinding(vertexArrayObject, i, bindingIndex);
+		glEnableVertexArrayAttrib(vertexArrayObject, i);
+	}
+}
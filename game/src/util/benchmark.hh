@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+
+#include "common.hh"
+
+/// Runs func `iterations` times and returns the average wall time of one call in microseconds.
+/// Callers should fold the results of func into something they print, so the work cannot be optimized away.
+template <typename Func>
+static double MeasureAverageMicroseconds(const size_t iterations, Func&& func)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	for (size_t i = 0; i < iterations; i++)
+	{
+		func();
+	}
+
+	const auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::micro>(end - start).count() / static_cast<double>(iterations);
+}
+
+/// Prints one benchmark result line, with the speedup relative to a baseline measurement.
+static void LogBenchmarkResult(const char* name, const size_t count, const double microseconds, const double baselineMicroseconds)
+{
+	DEBUG_LOG("Benchmark", LOG_INFO, "%-40s n=%-8zu %10.2f us  (%.2fx)",
+		name, count, microseconds, baselineMicroseconds / microseconds);
+}
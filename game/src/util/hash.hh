@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+#include "common.hh"
+
+#define HASH_FNV1A_64_OFFSET 0xcbf29ce484222325ull
+#define HASH_FNV1A_64_PRIME 0x100000001b3ull
+
+/// 64-bit FNV-1a. Fast and good enough to key caches on file contents; not meant to resist deliberate collisions.
+/// Pass the previous result as seed to hash several pieces as if they were one.
+static inline uint64_t HashFNV1a64(const void* data, size_t size, uint64_t seed = HASH_FNV1A_64_OFFSET)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= HASH_FNV1A_64_PRIME;
+	}
+
+	return hash;
+}
+
+/// Hashes the string and its length, so ("ab", "c") and ("a", "bc") hash differently when chained.
+static inline uint64_t HashFNV1a64(const std::string& string, uint64_t seed = HASH_FNV1A_64_OFFSET)
+{
+	const uint64_t length = string.size();
+	return HashFNV1a64(string.data(), string.size(), HashFNV1a64(&length, sizeof(length), seed));
+}
@@ -0,0 +1,134 @@
+#include "mapped_file.hh"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: _data(nullptr), _size(0)
+#ifdef _WIN32
+	, _fileHandle(INVALID_HANDLE_VALUE), _mappingHandle(NULL)
+#else
+	, _fileDescriptor(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	_fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (_fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_fileHandle, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	_size = static_cast<size_t>(size.QuadPart);
+
+	_mappingHandle = CreateFileMappingA(_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (_mappingHandle == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	_data = static_cast<const uint8_t*>(MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (_data == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (_data)
+	{
+		UnmapViewOfFile(_data);
+	}
+	if (_mappingHandle != NULL)
+	{
+		CloseHandle(_mappingHandle);
+	}
+	if (_fileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(_fileHandle);
+	}
+
+	_data = nullptr;
+	_size = 0;
+	_mappingHandle = NULL;
+	_fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	_fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (_fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(_fileDescriptor, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+	_size = static_cast<size_t>(info.st_size);
+
+	void* mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fileDescriptor, 0);
+	if (mapped == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	_data = static_cast<const uint8_t*>(mapped);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (_data)
+	{
+		munmap(const_cast<uint8_t*>(_data), _size);
+	}
+	if (_fileDescriptor >= 0)
+	{
+		close(_fileDescriptor);
+	}
+
+	_data = nullptr;
+	_size = 0;
+	_fileDescriptor = -1;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+#include "common.hh"
+
+/// Read-only memory mapping of a whole file. The OS pages data in on first touch, so opening is cheap
+/// regardless of file size, and nothing is copied until the caller reads it.
+class MappedFile
+{
+private:
+	const uint8_t* _data;
+	size_t _size;
+
+#ifdef _WIN32
+	void* _fileHandle;
+	void* _mappingHandle;
+#else
+	int _fileDescriptor;
+#endif
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// Maps path, closing whatever was mapped before. Returns false if the file can't be opened or is empty.
+	bool Open(const std::string& path);
+	void Close();
+
+	inline bool IsOpen() const { return _data != nullptr; }
+	inline const uint8_t* GetData() const { return _data; }
+	inline size_t GetSize() const { return _size; }
+};
@@ -0,0 +1,1096 @@
+#include "md5_importer.hh"
+
+#include <fstream>
+#include <filesystem>
+#include <string_view>
+#include <charconv>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+
+#include "util/mapped_file.hh"
+#include "util/hash.hh"
+
+/// Splits md5 text into tokens in one pass over memory: words and numbers, quoted strings (without their quotes),
+/// and the single characters { } ( ). "//" comments run to the end of the line. Tokens point into the text, nothing
+/// is copied. The first error is logged with its line and makes every later read fail.
+class _MD5Tokenizer
+{
+private:
+	const char* _cursor;
+	const char* _end;
+	uint32_t _line;
+	bool _failed;
+
+	void _SkipWhitespaceAndComments()
+	{
+		while (_cursor < _end)
+		{
+			if (*_cursor == '\n')
+			{
+				_line++;
+				_cursor++;
+			}
+			else if (*_cursor == ' ' || *_cursor == '\t' || *_cursor == '\r')
+			{
+				_cursor++;
+			}
+			else if (*_cursor == '/' && _cursor + 1 < _end && _cursor[1] == '/')
+			{
+				while (_cursor < _end && *_cursor != '\n')
+				{
+					_cursor++;
+				}
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	static inline bool _IsDelimiter(char c)
+	{
+		return c == '{' || c == '}' || c == '(' || c == ')' || c == '"'
+			|| c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+public:
+	_MD5Tokenizer(const char* text, size_t size)
+		: _cursor(text), _end(text + size), _line(1), _failed(false)
+	{
+	}
+
+	/// False at the end of the text, or after an error.
+	bool Next(std::string_view& token)
+	{
+		_SkipWhitespaceAndComments();
+		if (_failed || _cursor >= _end)
+		{
+			return false;
+		}
+
+		const char* start = _cursor;
+		if (*_cursor == '"')
+		{
+			start = ++_cursor;
+			while (_cursor < _end && *_cursor != '"' && *_cursor != '\n')
+			{
+				_cursor++;
+			}
+			token = std::string_view(start, _cursor - start);
+
+			if (_cursor >= _end || *_cursor != '"')
+			{
+				Fail("a closing quote");
+				return false;
+			}
+			_cursor++;
+			return true;
+		}
+
+		if (*_cursor == '{' || *_cursor == '}' || *_cursor == '(' || *_cursor == ')')
+		{
+			_cursor++;
+		}
+		else
+		{
+			while (_cursor < _end && !_IsDelimiter(*_cursor))
+			{
+				_cursor++;
+			}
+		}
+
+		token = std::string_view(start, _cursor - start);
+		return true;
+	}
+
+	void Fail(const char* expected)
+	{
+		if (!_failed)
+		{
+			DEBUG_LOG("MD5Importer", LOG_ERROR, "Line %u: expected %s", _line, expected);
+			_failed = true;
+		}
+	}
+
+	bool Expect(const char* expected)
+	{
+		std::string_view token;
+		if (!Next(token) || token != expected)
+		{
+			Fail(expected);
+			return false;
+		}
+		return true;
+	}
+
+	bool ReadString(std::string& value)
+	{
+		_SkipWhitespaceAndComments();
+		std::string_view token;
+		if (_cursor >= _end || *_cursor != '"' || !Next(token))
+		{
+			Fail("a quoted string");
+			return false;
+		}
+		value.assign(token.data(), token.size());
+		return true;
+	}
+
+	template <typename T>
+	bool ReadNumber(T& value)
+	{
+		std::string_view token;
+		if (!Next(token))
+		{
+			Fail("a number");
+			return false;
+		}
+
+		const auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+		if (result.ec != std::errc() || result.ptr != token.data() + token.size())
+		{
+			Fail("a number");
+			return false;
+		}
+		return true;
+	}
+
+	/// "( x y )" and "( x y z )"
+	bool ReadVec2(glm::vec2& value)
+	{
+		return Expect("(") && ReadNumber(value.x) && ReadNumber(value.y) && Expect(")");
+	}
+
+	bool ReadVec3(glm::vec3& value)
+	{
+		return Expect("(") && ReadNumber(value.x) && ReadNumber(value.y) && ReadNumber(value.z) && Expect(")");
+	}
+
+	/// Skips a whole { } block, nested blocks included.
+	bool SkipBlock()
+	{
+		if (!Expect("{"))
+		{
+			return false;
+		}
+
+		std::string_view token;
+		for (uint32_t depth = 1; depth > 0; )
+		{
+			if (!Next(token))
+			{
+				Fail("}");
+				return false;
+			}
+			if (token == "{")
+			{
+				depth++;
+			}
+			else if (token == "}")
+			{
+				depth--;
+			}
+		}
+		return true;
+	}
+
+	inline bool HasFailed() const { return _failed; }
+};
+
+struct _MD5Joint
+{
+	std::string name;
+	int32_t parent;
+	glm::vec3 position;
+	glm::vec3 orientation; // x, y, z of a unit quaternion with w <= 0
+
+	// Animation only
+	uint32_t flags; // Which of Tx Ty Tz Qx Qy Qz (bits 0 to 5) every frame replaces
+	uint32_t startIndex; // First of them in a frame's components
+};
+
+struct _MD5Vert
+{
+	glm::vec2 texcoord;
+	uint32_t firstWeight;
+	uint32_t numWeights;
+};
+
+struct _MD5Weight
+{
+	uint32_t joint;
+	float bias;
+	glm::vec3 position; // In the joint's space
+};
+
+/// md5 rotates points by q p q*, while the matrices a Pose turns into (and GetRotationTransformMat) rotate by the
+/// conjugate, so every orientation is stored conjugated to skin the way the file means.
+static inline qt::Quaternion _ToPoseRotation(const glm::vec3& orientation)
+{
+	return qt::Quaternion::Conjugate(qt::Quaternion(orientation.x, orientation.y, orientation.z));
+}
+
+static bool _ParseMD5MeshJoints(_MD5Tokenizer& tokens, std::vector<_MD5Joint>& joints)
+{
+	if (!tokens.Expect("{"))
+	{
+		return false;
+	}
+
+	std::string_view token;
+	while (tokens.Next(token) && token != "}")
+	{
+		_MD5Joint joint = {};
+		joint.name.assign(token.data(), token.size());
+
+		if (!tokens.ReadNumber(joint.parent) || !tokens.ReadVec3(joint.position) || !tokens.ReadVec3(joint.orientation))
+		{
+			return false;
+		}
+
+		joints.push_back(joint);
+	}
+
+	return !tokens.HasFailed();
+}
+
+static bool _ParseMD5MeshBlock(_MD5Tokenizer& tokens, std::vector<_MD5Vert>& verts, std::vector<uint32_t>& triIndices, std::vector<_MD5Weight>& weights)
+{
+	if (!tokens.Expect("{"))
+	{
+		return false;
+	}
+
+	std::string_view token;
+	while (tokens.Next(token) && token != "}")
+	{
+		uint32_t count, index;
+
+		if (token == "shader")
+		{
+			std::string shader;
+			tokens.ReadString(shader);
+		}
+		else if (token == "numverts")
+		{
+			if (tokens.ReadNumber(count))
+			{
+				verts.resize(count);
+			}
+		}
+		else if (token == "vert")
+		{
+			_MD5Vert vert;
+			if (tokens.ReadNumber(index) && tokens.ReadVec2(vert.texcoord) && tokens.ReadNumber(vert.firstWeight) && tokens.ReadNumber(vert.numWeights))
+			{
+				if (index >= verts.size())
+				{
+					tokens.Fail("a vert index below numverts");
+					return false;
+				}
+
+				vert.texcoord.y = 1.0f - vert.texcoord.y; // MD5 st(0,0) is in upper-left like DDS, OpenGL st(0,0) is lower-left!
+				verts[index] = vert;
+			}
+		}
+		else if (token == "numtris")
+		{
+			if (tokens.ReadNumber(count))
+			{
+				triIndices.resize(static_cast<size_t>(count) * 3);
+			}
+		}
+		else if (token == "tri")
+		{
+			uint32_t a, b, c;
+			if (tokens.ReadNumber(index) && tokens.ReadNumber(a) && tokens.ReadNumber(b) && tokens.ReadNumber(c))
+			{
+				if (static_cast<size_t>(index) * 3 >= triIndices.size())
+				{
+					tokens.Fail("a tri index below numtris");
+					return false;
+				}
+
+				triIndices[index * 3] = a;
+				triIndices[index * 3 + 1] = b;
+				triIndices[index * 3 + 2] = c;
+			}
+		}
+		else if (token == "numweights")
+		{
+			if (tokens.ReadNumber(count))
+			{
+				weights.resize(count);
+			}
+		}
+		else if (token == "weight")
+		{
+			_MD5Weight weight;
+			if (tokens.ReadNumber(index) && tokens.ReadNumber(weight.joint) && tokens.ReadNumber(weight.bias) && tokens.ReadVec3(weight.position))
+			{
+				if (index >= weights.size())
+				{
+					tokens.Fail("a weight index below numweights");
+					return false;
+				}
+
+				weights[index] = weight;
+			}
+		}
+		else
+		{
+			tokens.Fail("shader, numverts, vert, numtris, tri, numweights, weight or }");
+		}
+	}
+
+	return !tokens.HasFailed();
+}
+
+bool ParseMD5Mesh(const char* text, size_t size, std::vector<PerVertexData>& verticesOut, uint16_t flags, Skeleton* skeletonOut)
+{
+	if (!(flags & DUPLICATE_VERTICES_TO_MATCH_INDEX_BUFFER_SIZE))
+	{
+		// TODO
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Invalid flags parameter!");
+		return false;
+	}
+
+	std::vector<_MD5Joint> joints;
+	std::vector<_MD5Vert> verts;
+	std::vector<uint32_t> triIndices; // Three per triangle
+	std::vector<_MD5Weight> weights;
+	uint32_t numMeshes = 0;
+
+	_MD5Tokenizer tokens(text, size);
+	std::string_view token;
+	while (tokens.Next(token))
+	{
+		uint32_t count;
+
+		if (token == "MD5Version")
+		{
+			if (tokens.ReadNumber(count) && count != 10)
+			{
+				DEBUG_LOG("MD5Importer", LOG_WARN, "Expected MD5Version 10, got %u. There may be import errors!", count);
+			}
+		}
+		else if (token == "commandline")
+		{
+			std::string commandLine;
+			tokens.ReadString(commandLine);
+		}
+		else if (token == "numJoints")
+		{
+			if (tokens.ReadNumber(count))
+			{
+				joints.reserve(count);
+			}
+		}
+		else if (token == "numMeshes")
+		{
+			if (tokens.ReadNumber(count) && count > 1)
+			{
+				DEBUG_LOG("MD5Importer", LOG_WARN, "Expected numMeshes to be 1, got %u. Only the first is imported!", count);
+			}
+		}
+		else if (token == "joints")
+		{
+			_ParseMD5MeshJoints(tokens, joints);
+		}
+		else if (token == "mesh")
+		{
+			if (numMeshes++ == 0)
+			{
+				_ParseMD5MeshBlock(tokens, verts, triIndices, weights);
+			}
+			else
+			{
+				tokens.SkipBlock();
+			}
+		}
+		else
+		{
+			tokens.Fail("MD5Version, commandline, numJoints, numMeshes, joints or mesh");
+		}
+	}
+
+	if (tokens.HasFailed())
+	{
+		return false;
+	}
+
+	const uint32_t numVertices = static_cast<uint32_t>(verts.size());
+	const uint32_t numTris = static_cast<uint32_t>(triIndices.size() / 3);
+
+	if (numVertices == 0)
+	{
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Failed to find numverts...");
+		return false;
+	}
+
+	if (numTris == 0)
+	{
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Failed to find numtris...");
+		return false;
+	}
+
+	// Everything is indexed by now, so check the indices once instead of at every use
+	for (const auto& vert : verts)
+	{
+		if (static_cast<size_t>(vert.firstWeight) + vert.numWeights > weights.size())
+		{
+			DEBUG_LOG("MD5Importer", LOG_ERROR, "A vert uses weights past numweights");
+			return false;
+		}
+	}
+	for (const auto& weight : weights)
+	{
+		if (weight.joint >= joints.size())
+		{
+			DEBUG_LOG("MD5Importer", LOG_ERROR, "A weight uses joint %u of %zu", weight.joint, joints.size());
+			return false;
+		}
+	}
+	for (const uint32_t index : triIndices)
+	{
+		if (index >= numVertices)
+		{
+			DEBUG_LOG("MD5Importer", LOG_ERROR, "A tri uses vert %u of %u", index, numVertices);
+			return false;
+		}
+	}
+
+	std::vector<qt::Quaternion> jointOrientations(joints.size());
+	for (size_t i = 0; i < joints.size(); i++)
+	{
+		jointOrientations[i] = qt::Quaternion(joints[i].orientation.x, joints[i].orientation.y, joints[i].orientation.z);
+	}
+
+	// Calculate vertex positions
+	std::vector<glm::vec3> vertPositions(numVertices, glm::vec3(0.0f));
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		// position(X,Y,Z) = Sum k=[0, N) in (bone[k].pos * weight[k].bias)
+		// where N is the number of weights associated with this vertex in particular
+		// and all bias values add up to 1.0 per vertex
+		for (uint32_t j = 0; j < verts[i].numWeights; j++)
+		{
+			const _MD5Weight& weight = weights[verts[i].firstWeight + j];
+			const glm::vec3 tVert = qt::Quaternion::RotatePoint(weight.position, jointOrientations[weight.joint]);
+
+			vertPositions[i] += (joints[weight.joint].position + tVert) * weight.bias;
+		}
+	}
+
+	// Keep the four heaviest weights of every vertex, which is all a vertex can be skinned with
+	std::vector<glm::ivec4> vertBoneIDs(numVertices, glm::ivec4(0));
+	std::vector<glm::vec4> vertBoneWeights(numVertices, glm::vec4(0.0f));
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		for (uint32_t j = 0; j < verts[i].numWeights; j++)
+		{
+			const _MD5Weight& weight = weights[verts[i].firstWeight + j];
+
+			// Insertion into the sorted four, dropping the lightest
+			int slot = 4;
+			while (slot > 0 && vertBoneWeights[i][slot - 1] < weight.bias)
+			{
+				if (slot < 4)
+				{
+					vertBoneIDs[i][slot] = vertBoneIDs[i][slot - 1];
+					vertBoneWeights[i][slot] = vertBoneWeights[i][slot - 1];
+				}
+				slot--;
+			}
+
+			if (slot < 4)
+			{
+				vertBoneIDs[i][slot] = static_cast<int>(weight.joint);
+				vertBoneWeights[i][slot] = weight.bias;
+			}
+		}
+	}
+
+	if (skeletonOut)
+	{
+		// md5 joints are in model space and numbered parents first, as Skeleton wants them
+		skeletonOut->Clear();
+		for (size_t i = 0; i < joints.size(); i++)
+		{
+			// Bones rotate by the conjugate of the md5 orientation (see _ToPoseRotation), and the bind matrix is rigid,
+			// so its inverse rotates by the orientation itself after undoing the translation
+			glm::mat4 inverseBindMatrix = jointOrientations[i].GetRotationTransformMat();
+			inverseBindMatrix[3] = glm::vec4(-glm::vec3(inverseBindMatrix * glm::vec4(joints[i].position, 0.0f)), 1.0f);
+
+			if (skeletonOut->AddBone(joints[i].name, joints[i].parent, inverseBindMatrix) < 0)
+			{
+				skeletonOut->Clear();
+				break;
+			}
+		}
+	}
+
+	// Calculate vertex normals
+	// These must be recalculated during animation
+
+	// For every unique triangle, calculate the face normal for that specific triangle
+	// Add the face normal to the existing vertex normals for all three vertices, so that by the end,
+	// each vertex normal is the unnormalized arithmetic mean of the triangle normals
+	std::vector<glm::vec3> vertNormals(numVertices, glm::vec3(0.0f));
+	for (uint32_t t = 0; t < numTris; t++)
+	{
+		const uint32_t* tri = &triIndices[t * 3];
+		const glm::vec3 a = vertPositions[tri[0]];
+		const glm::vec3 b = vertPositions[tri[1]];
+		const glm::vec3 c = vertPositions[tri[2]];
+
+		const glm::vec3 normal = -glm::cross(b - a, c - a);
+
+		vertNormals[tri[0]] += normal;
+		vertNormals[tri[1]] += normal;
+		vertNormals[tri[2]] += normal;
+	}
+
+	// Finally, normalize all vertex normals
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		const float magnitude = sqrtf(glm::dot(vertNormals[i], vertNormals[i]));
+		if (magnitude > 0.0f)
+		{
+			vertNormals[i] /= magnitude;
+		}
+	}
+
+	// Duplicate vertices to match the number of indices, so models render with no indices
+	verticesOut.assign(triIndices.size(), PerVertexData());
+	for (size_t i = 0; i < triIndices.size(); i++)
+	{
+		const uint32_t v = triIndices[i];
+
+		verticesOut[i].position = vertPositions[v];
+		verticesOut[i].texcoord = verts[v].texcoord;
+		verticesOut[i].normal = vertNormals[v];
+		verticesOut[i].color = glm::vec3(1.0f, 1.0f, 1.0f);
+		verticesOut[i].bone_ids = vertBoneIDs[v];
+		verticesOut[i].bone_weights = vertBoneWeights[v];
+	}
+
+	return true;
+}
+
+static bool _ParseMD5AnimHierarchy(_MD5Tokenizer& tokens, std::vector<_MD5Joint>& joints, uint32_t numComponents)
+{
+	if (!tokens.Expect("{"))
+	{
+		return false;
+	}
+
+	std::string_view token;
+	while (tokens.Next(token) && token != "}")
+	{
+		_MD5Joint joint = {};
+		joint.name.assign(token.data(), token.size());
+
+		if (!tokens.ReadNumber(joint.parent) || !tokens.ReadNumber(joint.flags) || !tokens.ReadNumber(joint.startIndex))
+		{
+			return false;
+		}
+
+		uint32_t numAnimated = 0;
+		for (uint32_t bit = 0; bit < 6; bit++)
+		{
+			numAnimated += (joint.flags >> bit) & 1;
+		}
+
+		if (joint.startIndex + numAnimated > numComponents)
+		{
+			tokens.Fail("a startIndex that fits in numAnimatedComponents");
+			return false;
+		}
+
+		joints.push_back(joint);
+	}
+
+	return !tokens.HasFailed();
+}
+
+bool ParseMD5Anim(const char* text, size_t size, Animation& animationOut, const Skeleton* skeleton)
+{
+	std::vector<_MD5Joint> joints;
+	std::vector<float> components; // numComponents per frame
+	std::vector<bool> hasFrame;
+	uint32_t numFrames = 0;
+	uint32_t numJoints = 0;
+	uint32_t numComponents = 0;
+	uint32_t numBaseJoints = 0;
+	float frameRate = 0.0f;
+
+	_MD5Tokenizer tokens(text, size);
+	std::string_view token;
+	while (tokens.Next(token))
+	{
+		uint32_t count;
+
+		if (token == "MD5Version")
+		{
+			if (tokens.ReadNumber(count) && count != 10)
+			{
+				DEBUG_LOG("MD5Importer", LOG_WARN, "Expected MD5Version 10, got %u. There may be import errors!", count);
+			}
+		}
+		else if (token == "commandline")
+		{
+			std::string commandLine;
+			tokens.ReadString(commandLine);
+		}
+		else if (token == "numFrames")
+		{
+			if (tokens.ReadNumber(numFrames))
+			{
+				hasFrame.assign(numFrames, false);
+				components.resize(static_cast<size_t>(numFrames) * numComponents);
+			}
+		}
+		else if (token == "numJoints")
+		{
+			if (tokens.ReadNumber(numJoints))
+			{
+				joints.reserve(numJoints);
+			}
+		}
+		else if (token == "frameRate")
+		{
+			tokens.ReadNumber(frameRate);
+		}
+		else if (token == "numAnimatedComponents")
+		{
+			if (tokens.ReadNumber(numComponents))
+			{
+				components.resize(static_cast<size_t>(numFrames) * numComponents);
+			}
+		}
+		else if (token == "hierarchy")
+		{
+			_ParseMD5AnimHierarchy(tokens, joints, numComponents);
+		}
+		else if (token == "bounds")
+		{
+			tokens.SkipBlock();
+		}
+		else if (token == "baseframe")
+		{
+			if (tokens.Expect("{"))
+			{
+				while (tokens.Next(token) && token != "}")
+				{
+					if (numBaseJoints >= joints.size())
+					{
+						tokens.Fail("one baseframe entry per joint of the hierarchy");
+						break;
+					}
+
+					// The "(" of the position was just read
+					_MD5Joint& joint = joints[numBaseJoints++];
+					if (token != "(" || !tokens.ReadNumber(joint.position.x) || !tokens.ReadNumber(joint.position.y)
+						|| !tokens.ReadNumber(joint.position.z) || !tokens.Expect(")") || !tokens.ReadVec3(joint.orientation))
+					{
+						tokens.Fail("( position ) ( orientation )");
+						break;
+					}
+				}
+			}
+		}
+		else if (token == "frame")
+		{
+			if (tokens.ReadNumber(count))
+			{
+				if (count >= numFrames)
+				{
+					tokens.Fail("a frame index below numFrames");
+					break;
+				}
+
+				float* frame = components.data() + static_cast<size_t>(count) * numComponents;
+				tokens.Expect("{");
+				for (uint32_t i = 0; i < numComponents && tokens.ReadNumber(frame[i]); i++)
+				{
+				}
+				tokens.Expect("}");
+				hasFrame[count] = true;
+			}
+		}
+		else
+		{
+			tokens.Fail("MD5Version, commandline, numFrames, numJoints, frameRate, numAnimatedComponents, hierarchy, bounds, baseframe or frame");
+		}
+	}
+
+	if (tokens.HasFailed())
+	{
+		return false;
+	}
+
+	if (joints.empty() || joints.size() != numJoints || numBaseJoints != numJoints)
+	{
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Expected %u joints in both the hierarchy and the baseframe, got %zu and %u",
+			numJoints, joints.size(), numBaseJoints);
+		return false;
+	}
+
+	if (numFrames == 0 || frameRate <= 0.0f || std::find(hasFrame.begin(), hasFrame.end(), false) != hasFrame.end())
+	{
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Expected %u frames at a positive frameRate (%f)", numFrames, frameRate);
+		return false;
+	}
+
+	if (skeleton)
+	{
+		bool matches = skeleton->GetNumBones() == numJoints;
+		for (uint32_t i = 0; matches && i < numJoints; i++)
+		{
+			matches = skeleton->GetParent(i) == joints[i].parent;
+		}
+
+		if (!matches)
+		{
+			DEBUG_LOG("MD5Importer", LOG_ERROR, "The clip's %u joints don't match the skeleton's %u bones", numJoints, skeleton->GetNumBones());
+			return false;
+		}
+	}
+
+	// Every frame starts from the baseframe and replaces the components its joint's flags name, in order.
+	// md5anim joints are relative to their parents, like a Pose
+	animationOut.keyframes.resize(numFrames);
+	for (uint32_t f = 0; f < numFrames; f++)
+	{
+		Keyframe& keyframe = animationOut.keyframes[f];
+		keyframe.timestamp = static_cast<float>(f) / frameRate;
+		keyframe.pose.Resize(numJoints);
+
+		const float* frame = components.data() + static_cast<size_t>(f) * numComponents;
+		for (uint32_t j = 0; j < numJoints; j++)
+		{
+			const _MD5Joint& joint = joints[j];
+			glm::vec3 position = joint.position;
+			glm::vec3 orientation = joint.orientation;
+			uint32_t c = joint.startIndex;
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (joint.flags & (1 << axis))
+				{
+					position[axis] = frame[c++];
+				}
+			}
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (joint.flags & (8 << axis))
+				{
+					orientation[axis] = frame[c++];
+				}
+			}
+
+			keyframe.pose.translations[j] = position;
+			keyframe.pose.rotations[j] = _ToPoseRotation(orientation);
+		}
+	}
+	animationOut.duration = static_cast<float>(numFrames - 1) / frameRate;
+
+	return true;
+}
+
+bool ImportMD5Mesh(const std::string& path, std::vector<PerVertexData>& verticesOut, uint16_t flags, Skeleton* skeletonOut)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Could not open '%s'", path.c_str());
+		return false;
+	}
+
+	if (!ParseMD5Mesh(reinterpret_cast<const char*>(file.GetData()), file.GetSize(), verticesOut, flags, skeletonOut))
+	{
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Could not import '%s'", path.c_str());
+		return false;
+	}
+
+	DEBUG_LOG("MD5Importer", LOG_SUCCESS, "Imported data from '%s'", path.c_str());
+	return true;
+}
+
+bool ImportMD5Anim(const std::string& path, Animation& animationOut, const Skeleton* skeleton)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Could not open '%s'", path.c_str());
+		return false;
+	}
+
+	if (!ParseMD5Anim(reinterpret_cast<const char*>(file.GetData()), file.GetSize(), animationOut, skeleton))
+	{
+		DEBUG_LOG("MD5Importer", LOG_ERROR, "Could not import '%s'", path.c_str());
+		return false;
+	}
+
+	DEBUG_LOG("MD5Importer", LOG_SUCCESS, "Imported data from '%s'", path.c_str());
+	return true;
+}
+
+static MD5CacheHeader _MakeCacheHeader(uint64_t key, MD5CacheType type)
+{
+	MD5CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MD5_CACHE_MAGIC;
+	header.version = MD5_CACHE_VERSION;
+	header.type = type;
+	header.key = key;
+	return header;
+}
+
+static const MD5CacheHeader* _ParseCacheHeader(const uint8_t* data, size_t size, uint64_t key, MD5CacheType type)
+{
+	if (data == nullptr || size < sizeof(MD5CacheHeader))
+	{
+		return nullptr;
+	}
+
+	const MD5CacheHeader* header = reinterpret_cast<const MD5CacheHeader*>(data);
+	if (header->magic != MD5_CACHE_MAGIC || header->version != MD5_CACHE_VERSION || header->type != type || header->key != key)
+	{
+		return nullptr;
+	}
+
+	return header;
+}
+
+void WriteMD5MeshCache(uint64_t key, const std::vector<PerVertexData>& vertices, const Skeleton& skeleton, std::vector<uint8_t>& out)
+{
+	MD5CacheHeader header = _MakeCacheHeader(key, MD5_CACHE_MESH);
+	header.numBones = skeleton.GetNumBones();
+	header.numVertices = static_cast<uint32_t>(vertices.size());
+
+	out.resize(sizeof(header) + sizeof(MD5CacheBone) * header.numBones + sizeof(PerVertexData) * header.numVertices);
+	memcpy(out.data(), &header, sizeof(header));
+
+	uint8_t* cursor = out.data() + sizeof(header);
+	for (uint32_t i = 0; i < header.numBones; i++)
+	{
+		// Value-initialized, so the unused end of the name is written as zeros
+		MD5CacheBone bone{};
+		bone.inverseBindMatrix = skeleton.GetInverseBindMatrix(i);
+		bone.parent = skeleton.GetParent(i);
+
+		if (skeleton.GetName(i).size() >= MD5_CACHE_MAX_BONE_NAME)
+		{
+			DEBUG_LOG("MD5Importer", LOG_WARN, "Bone name '%s' is cached cut to %d characters", skeleton.GetName(i).c_str(), MD5_CACHE_MAX_BONE_NAME - 1);
+		}
+		strncpy(bone.name, skeleton.GetName(i).c_str(), MD5_CACHE_MAX_BONE_NAME - 1);
+
+		memcpy(cursor, &bone, sizeof(bone));
+		cursor += sizeof(bone);
+	}
+
+	memcpy(cursor, vertices.data(), sizeof(PerVertexData) * header.numVertices);
+}
+
+bool ReadMD5MeshCache(const uint8_t* data, size_t size, uint64_t key, std::vector<PerVertexData>& verticesOut, Skeleton* skeletonOut)
+{
+	const MD5CacheHeader* header = _ParseCacheHeader(data, size, key, MD5_CACHE_MESH);
+	if (!header || size != sizeof(MD5CacheHeader) + sizeof(MD5CacheBone) * header->numBones + sizeof(PerVertexData) * header->numVertices)
+	{
+		return false;
+	}
+
+	const MD5CacheBone* bones = reinterpret_cast<const MD5CacheBone*>(data + sizeof(MD5CacheHeader));
+	if (skeletonOut)
+	{
+		skeletonOut->Clear();
+		for (uint32_t i = 0; i < header->numBones; i++)
+		{
+			if (skeletonOut->AddBone(bones[i].name, bones[i].parent, bones[i].inverseBindMatrix) < 0)
+			{
+				skeletonOut->Clear();
+				return false;
+			}
+		}
+	}
+
+	const PerVertexData* vertices = reinterpret_cast<const PerVertexData*>(bones + header->numBones);
+	verticesOut.assign(vertices, vertices + header->numVertices);
+	return true;
+}
+
+void WriteMD5AnimCache(uint64_t key, const Animation& animation, std::vector<uint8_t>& out)
+{
+	MD5CacheHeader header = _MakeCacheHeader(key, MD5_CACHE_ANIM);
+	header.numBones = animation.keyframes.empty() ? 0 : animation.keyframes[0].pose.GetNumBones();
+	header.numKeyframes = static_cast<uint32_t>(animation.keyframes.size());
+	header.duration = animation.duration;
+
+	const size_t poseSize = (sizeof(glm::vec3) + sizeof(qt::Quaternion)) * header.numBones;
+	out.resize(sizeof(header) + sizeof(float) * header.numKeyframes + poseSize * header.numKeyframes);
+	memcpy(out.data(), &header, sizeof(header));
+
+	float* timestamps = reinterpret_cast<float*>(out.data() + sizeof(header));
+	uint8_t* poses = reinterpret_cast<uint8_t*>(timestamps + header.numKeyframes);
+	for (uint32_t i = 0; i < header.numKeyframes; i++)
+	{
+		const Pose& pose = animation.keyframes[i].pose;
+		timestamps[i] = animation.keyframes[i].timestamp;
+
+		memcpy(poses, pose.translations.data(), sizeof(glm::vec3) * header.numBones);
+		memcpy(poses + sizeof(glm::vec3) * header.numBones, pose.rotations.data(), sizeof(qt::Quaternion) * header.numBones);
+		poses += poseSize;
+	}
+}
+
+bool ReadMD5AnimCache(const uint8_t* data, size_t size, uint64_t key, Animation& animationOut)
+{
+	const MD5CacheHeader* header = _ParseCacheHeader(data, size, key, MD5_CACHE_ANIM);
+	const size_t poseSize = header ? (sizeof(glm::vec3) + sizeof(qt::Quaternion)) * header->numBones : 0;
+	if (!header || size != sizeof(MD5CacheHeader) + (sizeof(float) + poseSize) * header->numKeyframes)
+	{
+		return false;
+	}
+
+	const float* timestamps = reinterpret_cast<const float*>(data + sizeof(MD5CacheHeader));
+	const uint8_t* poses = reinterpret_cast<const uint8_t*>(timestamps + header->numKeyframes);
+
+	animationOut.keyframes.resize(header->numKeyframes);
+	animationOut.duration = header->duration;
+	for (uint32_t i = 0; i < header->numKeyframes; i++)
+	{
+		Keyframe& keyframe = animationOut.keyframes[i];
+		const glm::vec3* translations = reinterpret_cast<const glm::vec3*>(poses);
+		const qt::Quaternion* rotations = reinterpret_cast<const qt::Quaternion*>(poses + sizeof(glm::vec3) * header->numBones);
+
+		keyframe.timestamp = timestamps[i];
+		keyframe.pose.translations.assign(translations, translations + header->numBones);
+		keyframe.pose.rotations.assign(rotations, rotations + header->numBones);
+		poses += poseSize;
+	}
+
+	return true;
+}
+
+uint64_t GetMD5CacheKey(const std::string& path, MD5CacheType type, uint16_t flags)
+{
+	std::error_code error;
+	const uint64_t size = std::filesystem::file_size(path, error);
+	if (error)
+	{
+		return 0;
+	}
+
+	const int64_t time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+	if (error)
+	{
+		return 0;
+	}
+
+	uint64_t key = HashFNV1a64(path);
+	key = HashFNV1a64(&size, sizeof(size), key);
+	key = HashFNV1a64(&time, sizeof(time), key);
+	key = HashFNV1a64(&type, sizeof(type), key);
+	return HashFNV1a64(&flags, sizeof(flags), key);
+}
+
+std::string GetMD5CachePath(uint64_t key, MD5CacheType type)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+
+	return std::string(MD5_CACHE_DIRECTORY) + name + (type == MD5_CACHE_MESH ? MD5_MESH_CACHE_EXTENSION : MD5_ANIM_CACHE_EXTENSION);
+}
+
+static void _WriteCacheFile(const std::string& path, const std::vector<uint8_t>& data)
+{
+	std::error_code error;
+	std::filesystem::create_directories(MD5_CACHE_DIRECTORY, error);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+	if (!file)
+	{
+		DEBUG_LOG("MD5Importer", LOG_WARN, "Could not write cache file %s", path.c_str());
+	}
+}
+
+bool LoadMD5Mesh(const std::string& path, std::vector<PerVertexData>& verticesOut, uint16_t flags, Skeleton* skeletonOut)
+{
+	const uint64_t key = GetMD5CacheKey(path, MD5_CACHE_MESH, flags);
+	const std::string cachePath = GetMD5CachePath(key, MD5_CACHE_MESH);
+
+	MappedFile cache;
+	if (key != 0 && cache.Open(cachePath))
+	{
+		if (ReadMD5MeshCache(cache.GetData(), cache.GetSize(), key, verticesOut, skeletonOut))
+		{
+			DEBUG_LOG("MD5Importer", LOG_SUCCESS, "Loaded '%s' from %s", path.c_str(), cachePath.c_str());
+			return true;
+		}
+		DEBUG_LOG("MD5Importer", LOG_WARN, "Ignoring unrecognized cache file %s", cachePath.c_str());
+		cache.Close();
+	}
+
+	Skeleton skeleton;
+	if (!ImportMD5Mesh(path, verticesOut, flags, &skeleton))
+	{
+		return false;
+	}
+
+	if (key != 0)
+	{
+		std::vector<uint8_t> cacheData;
+		WriteMD5MeshCache(key, verticesOut, skeleton, cacheData);
+		_WriteCacheFile(cachePath, cacheData);
+	}
+
+	if (skeletonOut)
+	{
+		*skeletonOut = skeleton;
+	}
+	return true;
+}
+
+bool LoadMD5Anim(const std::string& path, Animation& animationOut, const Skeleton* skeleton)
+{
+	const uint64_t key = GetMD5CacheKey(path, MD5_CACHE_ANIM, 0);
+	const std::string cachePath = GetMD5CachePath(key, MD5_CACHE_ANIM);
+
+	MappedFile cache;
+	if (key != 0 && cache.Open(cachePath))
+	{
+		if (ReadMD5AnimCache(cache.GetData(), cache.GetSize(), key, animationOut) && !animationOut.keyframes.empty())
+		{
+			// The cache only knows the clip, so the skeleton check comes down to the bone count
+			if (skeleton && animationOut.keyframes[0].pose.GetNumBones() != skeleton->GetNumBones())
+			{
+				DEBUG_LOG("MD5Importer", LOG_ERROR, "'%s' has %u joints, the skeleton %u bones",
+					path.c_str(), animationOut.keyframes[0].pose.GetNumBones(), skeleton->GetNumBones());
+				return false;
+			}
+
+			DEBUG_LOG("MD5Importer", LOG_SUCCESS, "Loaded '%s' from %s", path.c_str(), cachePath.c_str());
+			return true;
+		}
+		DEBUG_LOG("MD5Importer", LOG_WARN, "Ignoring unrecognized cache file %s", cachePath.c_str());
+		cache.Close();
+	}
+
+	if (!ImportMD5Anim(path, animationOut, skeleton))
+	{
+		return false;
+	}
+
+	if (key != 0)
+	{
+		std::vector<uint8_t> cacheData;
+		WriteMD5AnimCache(key, animationOut, cacheData);
+		_WriteCacheFile(cachePath, cacheData);
+	}
+	return true;
+}
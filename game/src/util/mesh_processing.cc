@@ -0,0 +1,584 @@
+#include "mesh_processing.hh"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "util/hash.hh"
+
+/// Sum of squared distances to a set of planes, weighted by triangle area: p^T A p + 2 b^T p + c.
+struct SimplifyQuadric
+{
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+struct SimplifyCollapse
+{
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+static inline void _AddQuadric(SimplifyQuadric& q, const SimplifyQuadric& other)
+{
+	q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02;
+	q.a11 += other.a11; q.a12 += other.a12; q.a22 += other.a22;
+	q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+	q.c += other.c;
+	q.weight += other.weight;
+}
+
+/// Mean squared distance from p to the planes in q.
+static inline double _QuadricError(const SimplifyQuadric& q, const glm::vec3& p)
+{
+	const double x = p.x, y = p.y, z = p.z;
+
+	const double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+		+ 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+		+ 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z)
+		+ q.c;
+
+	return fabs(error) / std::max(q.weight, 1e-12);
+}
+
+static inline uint64_t _HalfEdgeKey(uint32_t a, uint32_t b)
+{
+	return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+/// Whether moving vertex from onto to turns any other triangle around from over (or nearly to an edge).
+static bool _CollapseFlipsTriangle(const PerVertexData* vertices, const GLuint* indices, const uint32_t* triangles, uint32_t numTriangles,
+	uint32_t from, uint32_t to)
+{
+	const glm::vec3 target = vertices[to].position;
+
+	for (uint32_t i = 0; i < numTriangles; i++)
+	{
+		const GLuint* triangle = &indices[triangles[i] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+		{
+			continue; // Removed by the collapse
+		}
+
+		glm::vec3 corners[3];
+		glm::vec3 moved[3];
+		for (int j = 0; j < 3; j++)
+		{
+			corners[j] = vertices[triangle[j]].position;
+			moved[j] = (triangle[j] == from) ? target : corners[j];
+		}
+
+		const glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+		const glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+
+		if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// Edge collapse link condition: the two ends may only share the neighbours opposite their edge, otherwise the
+/// collapse pinches the surface into a non-manifold edge.
+static bool _CollapseKeepsManifold(const GLuint* indices, const uint32_t* fromTriangles, uint32_t numFromTriangles,
+	const uint32_t* toTriangles, uint32_t numToTriangles, uint32_t from, uint32_t to, std::vector<uint32_t>& scratch)
+{
+	scratch.clear();
+	for (uint32_t i = 0; i < numFromTriangles; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			const GLuint vertex = indices[fromTriangles[i] * 3 + j];
+			if (vertex != from && vertex != to)
+			{
+				scratch.push_back(vertex);
+			}
+		}
+	}
+	std::sort(scratch.begin(), scratch.end());
+	scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+
+	const size_t numFromNeighbours = scratch.size();
+	for (uint32_t i = 0; i < numToTriangles; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			const GLuint vertex = indices[toTriangles[i] * 3 + j];
+			if (vertex != from && vertex != to && std::binary_search(scratch.begin(), scratch.begin() + numFromNeighbours, vertex))
+			{
+				scratch.push_back(vertex);
+			}
+		}
+	}
+	std::sort(scratch.begin() + numFromNeighbours, scratch.end());
+
+	return std::unique(scratch.begin() + numFromNeighbours, scratch.end()) - (scratch.begin() + numFromNeighbours) <= 2;
+}
+
+void WeldVertices(const PerVertexData* vertices, uint32_t numVertices, const GLuint* indices, uint32_t numIndices,
+	std::vector<PerVertexData>& outVertices, std::vector<GLuint>& outIndices)
+{
+	const uint32_t count = indices ? numIndices : numVertices;
+
+	outVertices.clear();
+	outIndices.resize(count);
+
+	// Open addressing over the unique vertices, at most half full
+	size_t tableSize = 1;
+	while (tableSize < static_cast<size_t>(numVertices) * 2)
+	{
+		tableSize <<= 1;
+	}
+
+	std::vector<uint32_t> table(tableSize, UINT32_MAX);
+	std::vector<uint32_t> remap(numVertices, UINT32_MAX); // So indexed input only hashes each source vertex once
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint32_t source = indices ? indices[i] : i;
+
+		if (remap[source] == UINT32_MAX)
+		{
+			const PerVertexData& vertex = vertices[source];
+
+			size_t slot = HashFNV1a64(&vertex, sizeof(vertex)) & (tableSize - 1);
+			while (table[slot] != UINT32_MAX && memcmp(&outVertices[table[slot]], &vertex, sizeof(vertex)) != 0)
+			{
+				slot = (slot + 1) & (tableSize - 1);
+			}
+
+			if (table[slot] == UINT32_MAX)
+			{
+				table[slot] = static_cast<uint32_t>(outVertices.size());
+				outVertices.push_back(vertex);
+			}
+
+			remap[source] = table[slot];
+		}
+
+		outIndices[i] = remap[source];
+	}
+}
+
+void OptimizeVertexCache(GLuint* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize)
+{
+	const uint32_t numTriangles = numIndices / 3;
+	if (numTriangles == 0)
+	{
+		return;
+	}
+
+	// Triangles around each vertex, and how many of them are still to be emitted
+	std::vector<uint32_t> liveTriangles(numVertices, 0);
+	for (uint32_t i = 0; i < numTriangles * 3; i++)
+	{
+		liveTriangles[indices[i]]++;
+	}
+
+	std::vector<uint32_t> offsets(numVertices + 1, 0);
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		offsets[i + 1] = offsets[i] + liveTriangles[i];
+	}
+
+	std::vector<uint32_t> adjacency(numTriangles * 3);
+	{
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < numTriangles * 3; i++)
+		{
+			adjacency[cursor[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<uint32_t> cacheTimes(numVertices, 0);
+	std::vector<uint8_t> emitted(numTriangles, 0);
+	std::vector<uint32_t> deadEnds; // Recently emitted vertices, to restart from when a fan runs out
+	std::vector<uint32_t> candidates;
+	std::vector<GLuint> output;
+	output.reserve(numTriangles * 3);
+
+	uint32_t time = cacheSize + 1; // Every vertex starts out of the cache
+	uint32_t scanCursor = 0;
+	int64_t fanning = 0;
+
+	while (fanning >= 0)
+	{
+		candidates.clear();
+
+		for (uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; i++)
+		{
+			const uint32_t triangle = adjacency[i];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+
+			for (int j = 0; j < 3; j++)
+			{
+				const GLuint vertex = indices[triangle * 3 + j];
+
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+
+				if (time - cacheTimes[vertex] > cacheSize)
+				{
+					cacheTimes[vertex] = time++;
+				}
+			}
+
+			emitted[triangle] = 1;
+		}
+
+		// Prefer the candidate that will still be in the cache after its remaining triangles are emitted, the oldest one first
+		fanning = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)
+			{
+				continue;
+			}
+
+			int64_t priority = 0;
+			if (time - cacheTimes[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+			{
+				priority = time - cacheTimes[vertex];
+			}
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = vertex;
+			}
+		}
+
+		while (fanning < 0 && !deadEnds.empty())
+		{
+			const uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+
+			if (liveTriangles[vertex] > 0)
+			{
+				fanning = vertex;
+			}
+		}
+
+		while (fanning < 0 && scanCursor < numVertices)
+		{
+			if (liveTriangles[scanCursor] > 0)
+			{
+				fanning = scanCursor;
+			}
+			scanCursor++;
+		}
+	}
+
+	memcpy(indices, output.data(), output.size() * sizeof(GLuint));
+}
+
+void OptimizeVertexFetch(std::vector<PerVertexData>& vertices, GLuint* indices, uint32_t numIndices)
+{
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<PerVertexData> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t i = 0; i < numIndices; i++)
+	{
+		if (remap[indices[i]] == UINT32_MAX)
+		{
+			remap[indices[i]] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[indices[i]]);
+		}
+
+		indices[i] = remap[indices[i]];
+	}
+
+	vertices.swap(reordered);
+}
+
+float ComputeACMR(const GLuint* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize)
+{
+	if (numIndices < 3)
+	{
+		return 0.0f;
+	}
+
+	// FIFO: a vertex is cached if it was transformed fewer than cacheSize misses ago
+	std::vector<uint32_t> missStamps(numVertices, 0);
+	uint32_t numMisses = 0;
+
+	for (uint32_t i = 0; i < numIndices; i++)
+	{
+		const GLuint vertex = indices[i];
+		if (missStamps[vertex] == 0 || numMisses - missStamps[vertex] >= cacheSize)
+		{
+			numMisses++;
+			missStamps[vertex] = numMisses;
+		}
+	}
+
+	return static_cast<float>(numMisses) / (numIndices / 3);
+}
+
+float SimplifyMesh(const PerVertexData* vertices, uint32_t numVertices, const GLuint* indices, uint32_t numIndices,
+	uint32_t targetNumIndices, float maxError, std::vector<GLuint>& outIndices)
+{
+	outIndices.assign(indices, indices + numIndices);
+
+	if (numIndices <= targetNumIndices || numVertices == 0)
+	{
+		return 0.0f;
+	}
+
+	// Vertices sharing a position (attribute seams) share one quadric, found through positionIds
+	std::vector<uint32_t> positionIds(numVertices);
+	std::vector<uint32_t> numWedges(numVertices, 0);
+	{
+		std::vector<PerVertexData> unique;
+		std::vector<GLuint> remap;
+		std::vector<PerVertexData> positions(numVertices);
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			// Every attribute but the position zeroed, so the bytewise hash only sees positions
+			positions[i].position = vertices[i].position;
+			positions[i].color = glm::vec3(0.0f);
+			positions[i].texcoord = glm::vec2(0.0f);
+			positions[i].normal = glm::vec3(0.0f);
+			positions[i].bone_ids = glm::ivec4(0);
+			positions[i].bone_weights = glm::vec4(0.0f);
+		}
+
+		WeldVertices(positions.data(), numVertices, NULL, 0, unique, remap);
+
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			positionIds[i] = remap[i];
+			numWedges[remap[i]]++;
+		}
+	}
+
+	std::vector<SimplifyQuadric> quadrics(numVertices, SimplifyQuadric{});
+
+	for (uint32_t i = 0; i + 2 < numIndices; i += 3)
+	{
+		const glm::vec3 p0 = vertices[indices[i]].position;
+		const glm::vec3 p1 = vertices[indices[i + 1]].position;
+		const glm::vec3 p2 = vertices[indices[i + 2]].position;
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		const float length = glm::length(normal);
+		if (length <= 0.0f)
+		{
+			continue;
+		}
+
+		normal /= length;
+		const double nx = normal.x, ny = normal.y, nz = normal.z;
+		const double d = -glm::dot(normal, p0);
+		const double w = length * 0.5; // Area
+
+		SimplifyQuadric plane;
+		plane.a00 = w * nx * nx; plane.a01 = w * nx * ny; plane.a02 = w * nx * nz;
+		plane.a11 = w * ny * ny; plane.a12 = w * ny * nz; plane.a22 = w * nz * nz;
+		plane.b0 = w * nx * d; plane.b1 = w * ny * d; plane.b2 = w * nz * d;
+		plane.c = w * d * d;
+		plane.weight = w;
+
+		for (int j = 0; j < 3; j++)
+		{
+			_AddQuadric(quadrics[positionIds[indices[i + j]]], plane);
+		}
+	}
+
+	// Only vertices without seams whose every edge is shared by exactly two triangles, one each way round, may move.
+	// Everything else (borders, seams, non-manifold spots) stays where it is and can only be collapsed onto
+	std::vector<uint8_t> collapsible(numVertices, 1);
+	for (uint32_t i = 0; i < numVertices; i++)
+	{
+		if (numWedges[positionIds[i]] > 1)
+		{
+			collapsible[i] = 0;
+		}
+	}
+
+	{
+		std::vector<uint64_t> halfEdges;
+		halfEdges.reserve(numIndices);
+		for (uint32_t i = 0; i + 2 < numIndices; i += 3)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				halfEdges.push_back(_HalfEdgeKey(indices[i + j], indices[i + (j + 1) % 3]));
+			}
+		}
+		std::sort(halfEdges.begin(), halfEdges.end());
+
+		for (size_t i = 0; i < halfEdges.size(); i++)
+		{
+			const uint32_t a = static_cast<uint32_t>(halfEdges[i] >> 32);
+			const uint32_t b = static_cast<uint32_t>(halfEdges[i]);
+
+			const bool duplicated = (i + 1 < halfEdges.size() && halfEdges[i + 1] == halfEdges[i]) || (i > 0 && halfEdges[i - 1] == halfEdges[i]);
+			const bool hasTwin = std::binary_search(halfEdges.begin(), halfEdges.end(), _HalfEdgeKey(b, a));
+
+			if (duplicated || !hasTwin)
+			{
+				collapsible[a] = 0;
+				collapsible[b] = 0;
+			}
+		}
+	}
+
+	std::vector<uint32_t> triangleOffsets(numVertices + 1);
+	std::vector<uint32_t> vertexTriangles;
+	std::vector<uint32_t> collapseTargets(numVertices);
+	std::vector<uint8_t> touched(numVertices);
+	std::vector<SimplifyCollapse> candidates;
+	std::vector<uint32_t> scratch;
+
+	const double maxErrorSquared = static_cast<double>(maxError) * maxError;
+	double resultErrorSquared = 0.0;
+
+	while (outIndices.size() > targetNumIndices)
+	{
+		// Triangles around each vertex
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (GLuint index : outIndices)
+		{
+			triangleOffsets[index + 1]++;
+		}
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			triangleOffsets[i + 1] += triangleOffsets[i];
+		}
+
+		vertexTriangles.resize(outIndices.size());
+		{
+			std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (uint32_t i = 0; i < outIndices.size(); i++)
+			{
+				vertexTriangles[cursor[outIndices[i]]++] = i / 3;
+			}
+		}
+
+		// Every edge that starts at a movable vertex, cheapest first
+		candidates.clear();
+		for (uint32_t i = 0; i < outIndices.size(); i += 3)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				const uint32_t a = outIndices[i + j];
+				const uint32_t b = outIndices[i + (j + 1) % 3];
+
+				for (int direction = 0; direction < 2; direction++)
+				{
+					const uint32_t from = direction ? b : a;
+					const uint32_t to = direction ? a : b;
+
+					if (!collapsible[from])
+					{
+						continue;
+					}
+
+					SimplifyQuadric merged = quadrics[positionIds[from]];
+					_AddQuadric(merged, quadrics[positionIds[to]]);
+
+					candidates.push_back({ from, to, _QuadricError(merged, vertices[to].position) });
+				}
+			}
+		}
+
+		if (candidates.empty())
+		{
+			break;
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const SimplifyCollapse& lhs, const SimplifyCollapse& rhs)
+		{
+			return lhs.cost < rhs.cost;
+		});
+
+		for (uint32_t i = 0; i < numVertices; i++)
+		{
+			collapseTargets[i] = i;
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+
+		// Collapses in one pass must not share triangles, so every vertex around a collapse is locked until the next pass
+		const uint32_t trianglesToRemove = (static_cast<uint32_t>(outIndices.size()) - targetNumIndices + 2) / 3;
+		uint32_t trianglesRemoved = 0;
+		uint32_t numCollapses = 0;
+
+		for (const auto& candidate : candidates)
+		{
+			if (trianglesRemoved >= trianglesToRemove || candidate.cost > maxErrorSquared)
+			{
+				break;
+			}
+
+			if (touched[candidate.from] || touched[candidate.to])
+			{
+				continue;
+			}
+
+			const uint32_t* triangles = &vertexTriangles[triangleOffsets[candidate.from]];
+			const uint32_t count = triangleOffsets[candidate.from + 1] - triangleOffsets[candidate.from];
+
+			const uint32_t* toTriangles = &vertexTriangles[triangleOffsets[candidate.to]];
+			const uint32_t toCount = triangleOffsets[candidate.to + 1] - triangleOffsets[candidate.to];
+
+			if (!_CollapseKeepsManifold(outIndices.data(), triangles, count, toTriangles, toCount, candidate.from, candidate.to, scratch)
+				|| _CollapseFlipsTriangle(vertices, outIndices.data(), triangles, count, candidate.from, candidate.to))
+			{
+				continue;
+			}
+
+			collapseTargets[candidate.from] = candidate.to;
+			_AddQuadric(quadrics[positionIds[candidate.to]], quadrics[positionIds[candidate.from]]);
+			resultErrorSquared = std::max(resultErrorSquared, candidate.cost);
+			numCollapses++;
+
+			for (uint32_t t = 0; t < count; t++)
+			{
+				const GLuint* triangle = &outIndices[triangles[t] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+
+				if (triangle[0] == candidate.to || triangle[1] == candidate.to || triangle[2] == candidate.to)
+				{
+					trianglesRemoved++;
+				}
+			}
+		}
+
+		if (numCollapses == 0)
+		{
+			break;
+		}
+
+		// Move collapsed corners and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t i = 0; i < outIndices.size(); i += 3)
+		{
+			const GLuint a = collapseTargets[outIndices[i]];
+			const GLuint b = collapseTargets[outIndices[i + 1]];
+			const GLuint c = collapseTargets[outIndices[i + 2]];
+
+			if (a != b && b != c && c != a)
+			{
+				outIndices[write++] = a;
+				outIndices[write++] = b;
+				outIndices[write++] = c;
+			}
+		}
+		outIndices.resize(write);
+	}
+
+	return static_cast<float>(sqrt(resultErrorSquared));
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include <glew.h>
+
+#include "common.hh"
+#include "renderer/vertex.hh"
+
+/// Merges bit-identical vertices of a flat (or indexed) triangle list. Unique vertices keep the order they first
+/// appear in; outIndices refers to outVertices. If indices is NULL, every vertex is used once, in order.
+void WeldVertices(const PerVertexData* vertices, uint32_t numVertices, const GLuint* indices, uint32_t numIndices,
+	std::vector<PerVertexData>& outVertices, std::vector<GLuint>& outIndices);
+
+/// Reorders triangles for the post-transform vertex cache with Tipsify (Sander, Nehab & Barczak 2007): triangles are
+/// emitted in fans around vertices that are likely still cached, jumping to recently used vertices at dead ends.
+/// Linear time. The triangles themselves and their winding are unchanged.
+void OptimizeVertexCache(GLuint* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize = 16);
+
+/// Renumbers vertices in the order the index buffer first uses them, so vertex fetches walk memory forwards.
+/// Vertices no index refers to are dropped.
+void OptimizeVertexFetch(std::vector<PerVertexData>& vertices, GLuint* indices, uint32_t numIndices);
+
+/// Average cache miss ratio: vertices transformed per triangle with a FIFO post-transform cache of cacheSize entries.
+/// 3 is no reuse at all (what glDrawArrays over a flat list gets), around 0.5-0.7 is typical for well ordered meshes.
+float ComputeACMR(const GLuint* indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize = 16);
+
+/// Reduces an indexed triangle list to at most targetNumIndices indices by quadric error metric edge collapse
+/// (Garland & Heckbert). Only the index buffer changes: vertices are collapsed onto neighbouring existing vertices,
+/// so every level of detail can share one vertex buffer.
+///
+/// Vertices on open borders and on attribute seams (several vertices at one position) never move, which keeps the
+/// silhouette and the UV layout intact but limits how far heavily seamed meshes go down.
+/// Collapses whose error would exceed maxError (a distance, in the mesh's units) are not made.
+///
+/// Returns the error of the result: the RMS distance between moved vertices and the planes of the triangles they merged.
+float SimplifyMesh(const PerVertexData* vertices, uint32_t numVertices, const GLuint* indices, uint32_t numIndices,
+	uint32_t targetNumIndices, float maxError, std::vector<GLuint>& outIndices);
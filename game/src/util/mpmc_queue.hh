@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "common.hh"
+
+/// Bounded lock-free multi-producer/multi-consumer queue (D. Vyukov's design).
+/// Each cell carries a sequence number that says whose turn it is, so producers and consumers
+/// only contend on one atomic each and never take a lock. Capacity must be a power of two.
+template <typename T>
+class MPMCQueue
+{
+private:
+	struct _Cell
+	{
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	std::unique_ptr<_Cell[]> _cells;
+	const size_t _mask;
+
+	alignas(64) std::atomic<size_t> _enqueuePosition;
+	alignas(64) std::atomic<size_t> _dequeuePosition;
+public:
+	MPMCQueue(size_t capacity)
+		: _cells(new _Cell[capacity]), _mask(capacity - 1), _enqueuePosition(0), _dequeuePosition(0)
+	{
+		if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+		{
+			DEBUG_LOG("MPMCQueue", LOG_FATAL, "Capacity %zu is not a power of two", capacity);
+		}
+
+		for (size_t i = 0; i < capacity; i++)
+		{
+			_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	MPMCQueue(const MPMCQueue&) = delete;
+	MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+	/// Returns false if the queue is full.
+	bool TryPush(const T& value)
+	{
+		size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+		_Cell* cell;
+
+		for (;;)
+		{
+			cell = &_cells[position & _mask];
+			const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+			if (difference == 0)
+			{
+				if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = _enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->data = value;
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Returns false if the queue is empty.
+	bool TryPop(T& value)
+	{
+		size_t position = _dequeuePosition.load(std::memory_order_relaxed);
+		_Cell* cell;
+
+		for (;;)
+		{
+			cell = &_cells[position & _mask];
+			const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+			if (difference == 0)
+			{
+				if (_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = _dequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = cell->data;
+		cell->sequence.store(position + _mask + 1, std::memory_order_release);
+		return true;
+	}
+};
@@ -0,0 +1,597 @@
+#include "texture_bake.hh"
+
+#include <fstream>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <SOIL2.h>
+
+void BuildMipChainRGBA8(const uint8_t* rgba, int width, int height, std::vector<uint8_t>& pixels, std::vector<size_t>& mipOffsets)
+{
+	// Reserve everything up front so the source level isn't moved while the next one is written
+	size_t totalSize = 0;
+	for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2))
+	{
+		totalSize += static_cast<size_t>(w) * h * 4;
+		if (w == 1 && h == 1)
+		{
+			break;
+		}
+	}
+
+	pixels.resize(totalSize);
+	memcpy(pixels.data(), rgba, static_cast<size_t>(width) * height * 4);
+
+	mipOffsets.clear();
+	mipOffsets.push_back(0);
+
+	// 2x2 box filter. Odd dimensions clamp the last row/column instead of reading past the edge
+	size_t sourceOffset = 0;
+	while (width > 1 || height > 1)
+	{
+		const int nextWidth = std::max(1, width / 2);
+		const int nextHeight = std::max(1, height / 2);
+		const size_t destinationOffset = sourceOffset + static_cast<size_t>(width) * height * 4;
+
+		const uint8_t* source = pixels.data() + sourceOffset;
+		uint8_t* destination = pixels.data() + destinationOffset;
+
+		for (int y = 0; y < nextHeight; y++)
+		{
+			const int y0 = std::min(y * 2, height - 1);
+			const int y1 = std::min(y * 2 + 1, height - 1);
+
+			for (int x = 0; x < nextWidth; x++)
+			{
+				const int x0 = std::min(x * 2, width - 1);
+				const int x1 = std::min(x * 2 + 1, width - 1);
+
+				for (int c = 0; c < 4; c++)
+				{
+					const int sum = source[(y0 * width + x0) * 4 + c] + source[(y0 * width + x1) * 4 + c]
+						+ source[(y1 * width + x0) * 4 + c] + source[(y1 * width + x1) * 4 + c];
+					destination[(y * nextWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+
+		mipOffsets.push_back(destinationOffset);
+		sourceOffset = destinationOffset;
+		width = nextWidth;
+		height = nextHeight;
+	}
+}
+
+// ---- Block compression -------------------------------------------------------------------------
+
+static inline uint16_t _PackRGB565(const float color[3])
+{
+	const int r = std::min(31, std::max(0, static_cast<int>(color[0] * (31.0f / 255.0f) + 0.5f)));
+	const int g = std::min(63, std::max(0, static_cast<int>(color[1] * (63.0f / 255.0f) + 0.5f)));
+	const int b = std::min(31, std::max(0, static_cast<int>(color[2] * (31.0f / 255.0f) + 0.5f)));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static inline void _UnpackRGB565(uint16_t packed, int color[3])
+{
+	const int r = (packed >> 11) & 31;
+	const int g = (packed >> 5) & 63;
+	const int b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+/// Copies a 4x4 block of texels out of the image, repeating the last row/column past the edges.
+static void _FetchBlock(const uint8_t* rgba, int width, int height, int blockX, int blockY, uint8_t block[16][4])
+{
+	for (int y = 0; y < 4; y++)
+	{
+		const int sourceY = std::min(blockY * 4 + y, height - 1);
+		for (int x = 0; x < 4; x++)
+		{
+			const int sourceX = std::min(blockX * 4 + x, width - 1);
+			memcpy(block[y * 4 + x], rgba + (static_cast<size_t>(sourceY) * width + sourceX) * 4, 4);
+		}
+	}
+}
+
+/// BC1 color block, always in 4-color mode. Endpoints are the extremes of the block along its principal axis.
+static void _EncodeBC1Block(const uint8_t block[16][4], uint8_t* out)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			mean[c] += block[i][c];
+		}
+	}
+	for (int c = 0; c < 3; c++)
+	{
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[6] = { 0.0f }; // rr, rg, rb, gg, gb, bb
+	for (int i = 0; i < 16; i++)
+	{
+		const float r = block[i][0] - mean[0];
+		const float g = block[i][1] - mean[1];
+		const float b = block[i][2] - mean[2];
+		covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+		covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+	}
+
+	// Power iteration for the principal axis
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 4; iteration++)
+	{
+		const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		const float length = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+		if (length < 1e-6f)
+		{
+			break;
+		}
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	float minProjection = 1e30f, maxProjection = -1e30f;
+	int minIndex = 0, maxIndex = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		const float projection = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+		if (projection < minProjection) { minProjection = projection; minIndex = i; }
+		if (projection > maxProjection) { maxProjection = projection; maxIndex = i; }
+	}
+
+	float maxColor[3], minColor[3];
+	for (int c = 0; c < 3; c++)
+	{
+		// Inset the endpoints slightly; the extremes are reached through the interpolated colors anyway
+		const float inset = (block[maxIndex][c] - block[minIndex][c]) / 16.0f;
+		maxColor[c] = block[maxIndex][c] - inset;
+		minColor[c] = block[minIndex][c] + inset;
+	}
+
+	uint16_t color0 = _PackRGB565(maxColor);
+	uint16_t color1 = _PackRGB565(minColor);
+	if (color0 < color1)
+	{
+		std::swap(color0, color1);
+	}
+
+	uint32_t indices = 0;
+	if (color0 != color1)
+	{
+		int palette[4][3];
+		_UnpackRGB565(color0, palette[0]);
+		_UnpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestError = 0x7fffffff;
+			for (int p = 0; p < 4; p++)
+			{
+				const int dr = block[i][0] - palette[p][0];
+				const int dg = block[i][1] - palette[p][1];
+				const int db = block[i][2] - palette[p][2];
+				const int error = dr * dr + dg * dg + db * db;
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = p;
+				}
+			}
+			indices |= static_cast<uint32_t>(bestIndex) << (i * 2);
+		}
+	}
+
+	out[0] = color0 & 0xff; out[1] = color0 >> 8;
+	out[2] = color1 & 0xff; out[3] = color1 >> 8;
+	out[4] = indices & 0xff; out[5] = (indices >> 8) & 0xff; out[6] = (indices >> 16) & 0xff; out[7] = indices >> 24;
+}
+
+/// BC4-style single channel block (BC3 alpha, BC5 red/green), always in 8-value mode.
+static void _EncodeBC4Block(const uint8_t block[16][4], int channel, uint8_t* out)
+{
+	int minValue = 255, maxValue = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		minValue = std::min(minValue, static_cast<int>(block[i][channel]));
+		maxValue = std::max(maxValue, static_cast<int>(block[i][channel]));
+	}
+
+	out[0] = static_cast<uint8_t>(maxValue);
+	out[1] = static_cast<uint8_t>(minValue);
+
+	uint64_t indices = 0;
+	if (maxValue != minValue)
+	{
+		int palette[8];
+		palette[0] = maxValue;
+		palette[1] = minValue;
+		for (int p = 1; p < 7; p++)
+		{
+			palette[p + 1] = ((7 - p) * maxValue + p * minValue) / 7;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestError = 0x7fffffff;
+			for (int p = 0; p < 8; p++)
+			{
+				const int error = abs(block[i][channel] - palette[p]);
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = p;
+				}
+			}
+			indices |= static_cast<uint64_t>(bestIndex) << (i * 3);
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		out[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+	}
+}
+
+static void _DecodeBC1Block(const uint8_t* in, uint8_t block[16][4])
+{
+	const uint16_t color0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+	const uint16_t color1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+	const uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<uint32_t>(in[7]) << 24);
+
+	int palette[4][4];
+	_UnpackRGB565(color0, palette[0]);
+	_UnpackRGB565(color1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+	for (int c = 0; c < 3; c++)
+	{
+		if (color0 > color1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	if (color0 <= color1)
+	{
+		palette[3][3] = 0;
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		const int index = (indices >> (i * 2)) & 3;
+		for (int c = 0; c < 4; c++)
+		{
+			block[i][c] = static_cast<uint8_t>(palette[index][c]);
+		}
+	}
+}
+
+static void _DecodeBC4Block(const uint8_t* in, int channel, uint8_t block[16][4])
+{
+	int palette[8];
+	palette[0] = in[0];
+	palette[1] = in[1];
+	if (palette[0] > palette[1])
+	{
+		for (int p = 1; p < 7; p++)
+		{
+			palette[p + 1] = ((7 - p) * palette[0] + p * palette[1]) / 7;
+		}
+	}
+	else
+	{
+		for (int p = 1; p < 5; p++)
+		{
+			palette[p + 1] = ((5 - p) * palette[0] + p * palette[1]) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		indices |= static_cast<uint64_t>(in[2 + i]) << (i * 8);
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		block[i][channel] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 7]);
+	}
+}
+
+static size_t _GetBlockSize(BakedTextureFormat format)
+{
+	return (format == BAKED_TEXTURE_BC1) ? 8 : 16;
+}
+
+size_t GetTextureLevelSize(BakedTextureFormat format, int width, int height)
+{
+	if (format == BAKED_TEXTURE_RGBA8)
+	{
+		return static_cast<size_t>(width) * height * 4;
+	}
+
+	return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * _GetBlockSize(format);
+}
+
+void EncodeTextureLevel(BakedTextureFormat format, const uint8_t* rgba, int width, int height, std::vector<uint8_t>& out)
+{
+	out.resize(GetTextureLevelSize(format, width, height));
+
+	if (format == BAKED_TEXTURE_RGBA8)
+	{
+		memcpy(out.data(), rgba, out.size());
+		return;
+	}
+
+	const int blocksX = (width + 3) / 4;
+	const int blocksY = (height + 3) / 4;
+	const size_t blockSize = _GetBlockSize(format);
+
+	uint8_t block[16][4];
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			_FetchBlock(rgba, width, height, bx, by, block);
+			uint8_t* destination = out.data() + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+
+			switch (format)
+			{
+				case BAKED_TEXTURE_BC1:
+					_EncodeBC1Block(block, destination);
+					break;
+				case BAKED_TEXTURE_BC3:
+					_EncodeBC4Block(block, 3, destination);
+					_EncodeBC1Block(block, destination + 8);
+					break;
+				case BAKED_TEXTURE_BC5:
+					_EncodeBC4Block(block, 0, destination);
+					_EncodeBC4Block(block, 1, destination + 8);
+					break;
+				default:
+					break;
+			}
+		}
+	}
+}
+
+void DecodeTextureLevel(BakedTextureFormat format, const uint8_t* data, int width, int height, std::vector<uint8_t>& rgba)
+{
+	rgba.resize(static_cast<size_t>(width) * height * 4);
+
+	if (format == BAKED_TEXTURE_RGBA8)
+	{
+		memcpy(rgba.data(), data, rgba.size());
+		return;
+	}
+
+	const int blocksX = (width + 3) / 4;
+	const int blocksY = (height + 3) / 4;
+	const size_t blockSize = _GetBlockSize(format);
+
+	uint8_t block[16][4];
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			const uint8_t* source = data + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+
+			switch (format)
+			{
+				case BAKED_TEXTURE_BC1:
+					_DecodeBC1Block(source, block);
+					break;
+				case BAKED_TEXTURE_BC3:
+					_DecodeBC1Block(source + 8, block);
+					_DecodeBC4Block(source, 3, block);
+					break;
+				case BAKED_TEXTURE_BC5:
+					_DecodeBC4Block(source, 0, block);
+					_DecodeBC4Block(source + 8, 1, block);
+					for (int i = 0; i < 16; i++)
+					{
+						block[i][2] = 0;
+						block[i][3] = 255;
+					}
+					break;
+				default:
+					break;
+			}
+
+			for (int y = 0; y < 4 && by * 4 + y < height; y++)
+			{
+				for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+				{
+					memcpy(rgba.data() + ((static_cast<size_t>(by) * 4 + y) * width + bx * 4 + x) * 4, block[y * 4 + x], 4);
+				}
+			}
+		}
+	}
+}
+
+// ---- File format -------------------------------------------------------------------------------
+
+static inline size_t _AlignTo16(size_t value)
+{
+	return (value + 15) & ~static_cast<size_t>(15);
+}
+
+bool BakeTexture(const uint8_t* rgba, int width, int height, BakedTextureFormat format, std::vector<uint8_t>& out)
+{
+	if (width <= 0 || height <= 0 || format >= NUM_BAKED_TEXTURE_FORMATS)
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> mipPixels;
+	std::vector<size_t> mipOffsets;
+	BuildMipChainRGBA8(rgba, width, height, mipPixels, mipOffsets);
+
+	if (mipOffsets.size() > BAKED_TEXTURE_MAX_LEVELS)
+	{
+		DEBUG_LOG("TextureBake", LOG_ERROR, "%dx%d needs %zu mip levels, the format stores at most %d",
+			width, height, mipOffsets.size(), BAKED_TEXTURE_MAX_LEVELS);
+		return false;
+	}
+
+	BakedTextureHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = BAKED_TEXTURE_MAGIC;
+	header.version = BAKED_TEXTURE_VERSION;
+	header.format = format;
+	header.width = static_cast<uint32_t>(width);
+	header.height = static_cast<uint32_t>(height);
+	header.numLevels = static_cast<uint32_t>(mipOffsets.size());
+
+	out.assign(_AlignTo16(sizeof(header)), 0);
+
+	std::vector<uint8_t> encoded;
+	int levelWidth = width;
+	int levelHeight = height;
+	for (uint32_t level = 0; level < header.numLevels; level++)
+	{
+		EncodeTextureLevel(format, mipPixels.data() + mipOffsets[level], levelWidth, levelHeight, encoded);
+
+		header.levels[level].offset = static_cast<uint32_t>(out.size());
+		header.levels[level].size = static_cast<uint32_t>(encoded.size());
+
+		out.insert(out.end(), encoded.begin(), encoded.end());
+		out.resize(_AlignTo16(out.size()), 0);
+
+		levelWidth = std::max(1, levelWidth / 2);
+		levelHeight = std::max(1, levelHeight / 2);
+	}
+
+	memcpy(out.data(), &header, sizeof(header));
+	return true;
+}
+
+bool ParseBakedTexture(const uint8_t* data, size_t size, BakedTextureView& view)
+{
+	if (data == nullptr || size < sizeof(BakedTextureHeader))
+	{
+		return false;
+	}
+
+	const BakedTextureHeader* header = reinterpret_cast<const BakedTextureHeader*>(data);
+
+	if (header->magic != BAKED_TEXTURE_MAGIC || header->version != BAKED_TEXTURE_VERSION
+		|| header->format >= NUM_BAKED_TEXTURE_FORMATS
+		|| header->width == 0 || header->height == 0
+		|| header->numLevels == 0 || header->numLevels > BAKED_TEXTURE_MAX_LEVELS)
+	{
+		return false;
+	}
+
+	// No more levels than halving the larger side takes to reach 1x1
+	uint32_t maxLevels = 1;
+	for (uint32_t side = std::max(header->width, header->height); side > 1; side >>= 1)
+	{
+		maxLevels++;
+	}
+
+	if (header->numLevels > maxLevels)
+	{
+		return false;
+	}
+
+	for (uint32_t level = 0; level < header->numLevels; level++)
+	{
+		const BakedTextureLevel& entry = header->levels[level];
+		const uint32_t levelWidth = std::max(1u, header->width >> level);
+		const uint32_t levelHeight = std::max(1u, header->height >> level);
+
+		if (static_cast<size_t>(entry.offset) + entry.size > size
+			|| entry.size != GetTextureLevelSize(static_cast<BakedTextureFormat>(header->format), levelWidth, levelHeight))
+		{
+			return false;
+		}
+	}
+
+	view.header = header;
+	view.base = data;
+	return true;
+}
+
+bool BakeTextureFile(const std::string& inputPath, const std::string& outputPath, BakedTextureFormat format)
+{
+	int width, height, channels;
+	unsigned char* image = SOIL_load_image(inputPath.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+
+	if (image == nullptr)
+	{
+		DEBUG_LOG("TextureBake", LOG_ERROR, "Failed to decode [%s]", inputPath.c_str());
+		return false;
+	}
+
+	std::vector<uint8_t> baked;
+	const bool success = BakeTexture(image, width, height, format, baked);
+	SOIL_free_image_data(image);
+
+	if (!success)
+	{
+		return false;
+	}
+
+	std::ofstream file(outputPath, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		DEBUG_LOG("TextureBake", LOG_ERROR, "Failed to open [%s] for writing", outputPath.c_str());
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(baked.data()), baked.size());
+
+	DEBUG_LOG("TextureBake", LOG_SUCCESS, "Baked [%s] -> [%s] (%dx%d, %zu bytes)", inputPath.c_str(), outputPath.c_str(), width, height, baked.size());
+	return true;
+}
+
+std::string GetBakedTexturePath(const std::string& imagePath)
+{
+	const size_t dot = imagePath.find_last_of('.');
+	const size_t slash = imagePath.find_last_of("/\\");
+
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+	{
+		return imagePath + BAKED_TEXTURE_EXTENSION;
+	}
+
+	return imagePath.substr(0, dot) + BAKED_TEXTURE_EXTENSION;
+}
+
+bool ParseBakedTextureFormat(const std::string& name, BakedTextureFormat& format)
+{
+	static const char* names[NUM_BAKED_TEXTURE_FORMATS] = { "rgba8", "bc1", "bc3", "bc5" };
+
+	for (uint32_t i = 0; i < NUM_BAKED_TEXTURE_FORMATS; i++)
+	{
+		if (name == names[i])
+		{
+			format = static_cast<BakedTextureFormat>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
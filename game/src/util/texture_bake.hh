@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "common.hh"
+
+#define BAKED_TEXTURE_MAGIC 0x58545043 // "CPTX"
+#define BAKED_TEXTURE_VERSION 1
+#define BAKED_TEXTURE_MAX_LEVELS 16
+#define BAKED_TEXTURE_EXTENSION ".cptex"
+
+enum BakedTextureFormat : uint32_t
+{
+	BAKED_TEXTURE_RGBA8 = 0,	// Uncompressed, 4 bytes per texel
+	BAKED_TEXTURE_BC1,			// RGB, 8 bytes per 4x4 block
+	BAKED_TEXTURE_BC3,			// RGBA, 16 bytes per 4x4 block
+	BAKED_TEXTURE_BC5,			// RG (e.g. tangent space normals), 16 bytes per 4x4 block
+	NUM_BAKED_TEXTURE_FORMATS
+};
+
+struct BakedTextureLevel
+{
+	uint32_t offset; // From the start of the file
+	uint32_t size;
+};
+
+/// Sits at the start of a baked texture file. Level data follows, each level 16-byte aligned,
+/// already in the layout glTextureSubImage2D / glCompressedTextureSubImage2D expect.
+struct BakedTextureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t numLevels;
+	BakedTextureLevel levels[BAKED_TEXTURE_MAX_LEVELS];
+};
+
+/// A parsed baked texture. Points into memory owned by someone else, usually a MappedFile.
+struct BakedTextureView
+{
+	const BakedTextureHeader* header = nullptr;
+	const uint8_t* base = nullptr;
+
+	inline const uint8_t* GetLevelData(uint32_t level) const { return base + header->levels[level].offset; }
+	inline uint32_t GetLevelSize(uint32_t level) const { return header->levels[level].size; }
+	inline uint32_t GetLevelWidth(uint32_t level) const { return std::max(1u, header->width >> level); }
+	inline uint32_t GetLevelHeight(uint32_t level) const { return std::max(1u, header->height >> level); }
+};
+
+/// Box-filters an RGBA8 image down to 1x1. pixels receives every level back to back, mipOffsets the start of each.
+void BuildMipChainRGBA8(const uint8_t* rgba, int width, int height, std::vector<uint8_t>& pixels, std::vector<size_t>& mipOffsets);
+
+/// Block compression of one RGBA8 level. Edge blocks of images that aren't a multiple of 4 repeat the last row/column.
+void EncodeTextureLevel(BakedTextureFormat format, const uint8_t* rgba, int width, int height, std::vector<uint8_t>& out);
+
+/// Inverse of EncodeTextureLevel, back to RGBA8. BC1 decodes with alpha 255, BC5 with blue 0 and alpha 255.
+void DecodeTextureLevel(BakedTextureFormat format, const uint8_t* data, int width, int height, std::vector<uint8_t>& rgba);
+
+size_t GetTextureLevelSize(BakedTextureFormat format, int width, int height);
+
+/// Builds the mip chain, encodes every level and writes the whole file image into out.
+bool BakeTexture(const uint8_t* rgba, int width, int height, BakedTextureFormat format, std::vector<uint8_t>& out);
+
+/// Validates a file image and fills view. Returns false on a bad magic, version, format or truncated data.
+bool ParseBakedTexture(const uint8_t* data, size_t size, BakedTextureView& view);
+
+/// Decodes an image file with SOIL and writes the baked version to outputPath.
+bool BakeTextureFile(const std::string& inputPath, const std::string& outputPath, BakedTextureFormat format);
+
+/// "res/textures/a.png" -> "res/textures/a.cptex"
+std::string GetBakedTexturePath(const std::string& imagePath);
+
+/// Parses "rgba8", "bc1", "bc3" or "bc5". Returns false for anything else.
+bool ParseBakedTextureFormat(const std::string& name, BakedTextureFormat& format);
@@ -0,0 +1,65 @@
+#include "thread_pool.hh"
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+	: _stopping(false)
+{
+	if (numThreads == 0)
+	{
+		const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		numThreads = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+	}
+
+	for (uint32_t i = 0; i < numThreads; i++)
+	{
+		_workers.emplace_back(&ThreadPool::_WorkerLoop, this);
+	}
+
+	DEBUG_LOG("ThreadPool", LOG_INFO, "Started %u worker threads", numThreads);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+		_jobs.clear();
+	}
+	_condition.notify_all();
+
+	for (auto& worker : _workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(std::move(job));
+	}
+	_condition.notify_one();
+}
+
+void ThreadPool::_WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+
+			if (_stopping)
+			{
+				return;
+			}
+
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+
+		job();
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#include "common.hh"
+
+/// Fixed set of worker threads pulling jobs from a shared queue.
+/// Jobs must not touch GL; hand results back to the main thread instead (see TextureLoader).
+class ThreadPool
+{
+private:
+	std::vector<std::thread> _workers;
+	std::deque<std::function<void()>> _jobs;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _stopping;
+
+	void _WorkerLoop();
+
+	/// Shared between the caller of ParallelFor() and its helper jobs, so a helper that starts late never touches a dead stack frame.
+	struct _ParallelForState
+	{
+		std::atomic<size_t> nextBatch{ 0 };
+		std::atomic<size_t> finishedBatches{ 0 };
+	};
+public:
+	/// numThreads = 0 picks one less than the number of hardware threads, leaving a core for the main thread.
+	ThreadPool(uint32_t numThreads = 0);
+
+	/// Finishes the jobs already running, drops the ones still queued, and joins every worker.
+	~ThreadPool();
+
+	void Submit(std::function<void()> job);
+
+	/// Calls func(begin, end) over [0, count) split into batches of at least minBatchSize, and returns when all of them are done.
+	/// The calling thread works on batches too, so this never deadlocks even if every worker is busy.
+	template <typename Func>
+	void ParallelFor(size_t count, size_t minBatchSize, Func&& func)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		const size_t numThreads = _workers.size() + 1;
+		const size_t batchSize = std::max(minBatchSize, (count + numThreads - 1) / numThreads);
+		const size_t numBatches = (count + batchSize - 1) / batchSize;
+
+		std::shared_ptr<_ParallelForState> state = std::make_shared<_ParallelForState>();
+
+		// Only ever called with batches < numBatches, and the caller waits for all of those, so func outlives every use
+		auto work = [state, &func, count, batchSize, numBatches]()
+		{
+			for (;;)
+			{
+				const size_t batch = state->nextBatch.fetch_add(1);
+				if (batch >= numBatches)
+				{
+					return;
+				}
+
+				const size_t begin = batch * batchSize;
+				func(begin, std::min(begin + batchSize, count));
+				state->finishedBatches.fetch_add(1);
+			}
+		};
+
+		const size_t numHelpers = std::min(_workers.size(), numBatches - 1);
+		for (size_t i = 0; i < numHelpers; i++)
+		{
+			Submit(work);
+		}
+
+		work();
+
+		while (state->finishedBatches.load() < numBatches)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	inline size_t GetNumThreads() const { return _workers.size(); }
+};